@@ -0,0 +1,373 @@
+/**
+	@file
+	@brief Implementation of CevaDebugPort
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a debug port on device 0 of an initialized chain
+
+	@param iface	The adapter. Must outlive the port.
+ */
+CevaDebugPort::CevaDebugPort(JtagInterface* iface)
+	: m_iface(iface)
+	, m_currentOpcode(-1)
+	, m_breakpointMask(0)
+{
+}
+
+CevaDebugPort::~CevaDebugPort()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Register access helpers
+
+/**
+	@brief Loads an opcode into the IR, unless it's already there
+
+	@throw JtagException if the scan fails
+ */
+void CevaDebugPort::SelectRegister(uint8_t opcode)
+{
+	if(m_currentOpcode == opcode)
+		return;
+
+	unsigned char ir[4] = {0, 0, 0, opcode};
+	m_iface->SetIRDeferred(0, ir, CEVA_IR_LENGTH);
+	m_currentOpcode = opcode;
+}
+
+/**
+	@brief Scans the selected data register and returns the captured value
+
+	@throw JtagException if the scan fails
+ */
+uint32_t CevaDebugPort::ReadDR()
+{
+	unsigned char zero[4] = {0};
+	unsigned char rx[4];
+	m_iface->ScanDR(0, zero, rx, 32);
+	return
+		(static_cast<uint32_t>(rx[3]) << 24) |
+		(static_cast<uint32_t>(rx[2]) << 16) |
+		(static_cast<uint32_t>(rx[1]) << 8) |
+		static_cast<uint32_t>(rx[0]);
+}
+
+/**
+	@brief Scans a value into the selected data register, without readback
+
+	@throw JtagException if the scan fails
+ */
+void CevaDebugPort::WriteDR(uint32_t value)
+{
+	unsigned char tx[4] =
+	{
+		static_cast<unsigned char>(value & 0xff),
+		static_cast<unsigned char>((value >> 8) & 0xff),
+		static_cast<unsigned char>((value >> 16) & 0xff),
+		static_cast<unsigned char>(value >> 24)
+	};
+	m_iface->ScanDRDeferred(0, tx, 32);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Identification
+
+/**
+	@brief Reads the core version register
+
+	@throw JtagException if the scan fails
+ */
+uint32_t CevaDebugPort::GetCoreVersion()
+{
+	SelectRegister(CEVA_OP_CORE_VERSION);
+	return ReadDR();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Run control
+
+/**
+	@brief Reads the core status register (CEVA_STATUS_* bits)
+
+	@throw JtagException if the scan fails
+ */
+uint32_t CevaDebugPort::GetStatus()
+{
+	SelectRegister(CEVA_OP_STATUS);
+	return ReadDR();
+}
+
+/**
+	@brief Checks if the core is halted in debug mode
+
+	@throw JtagException if the scan fails
+ */
+bool CevaDebugPort::IsHalted()
+{
+	return (GetStatus() & CEVA_STATUS_HALTED) ? true : false;
+}
+
+/**
+	@brief Requests the core to halt. Use IsHalted() to find out when it has.
+
+	@throw JtagException if the scan fails
+ */
+void CevaDebugPort::Halt()
+{
+	JtagTimelineSpan span("Halt");
+	SelectRegister(CEVA_OP_CTRL);
+	WriteDR(CEVA_CTRL_HALT);
+	m_iface->Commit();
+}
+
+/**
+	@brief Resumes execution
+
+	@throw JtagException if the scan fails
+ */
+void CevaDebugPort::Resume()
+{
+	JtagTimelineSpan span("Resume");
+	SelectRegister(CEVA_OP_CTRL);
+	WriteDR(CEVA_CTRL_RESUME);
+	m_iface->Commit();
+}
+
+/**
+	@brief Executes a single instruction and halts again
+
+	@throw JtagException if the scan fails
+ */
+void CevaDebugPort::Step()
+{
+	JtagTimelineSpan span("Step");
+	SelectRegister(CEVA_OP_CTRL);
+	WriteDR(CEVA_CTRL_STEP);
+	m_iface->Commit();
+}
+
+/**
+	@brief Reads the current PC. Works while the core is running, too.
+
+	@throw JtagException if the scan fails
+ */
+uint32_t CevaDebugPort::GetPC()
+{
+	SelectRegister(CEVA_OP_PC);
+	return ReadDR();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Registers
+
+/**
+	@brief Reads a block of consecutive core registers. The core must be halted.
+
+	@param first	Index of the first register
+	@param values	Output buffer
+	@param count	Number of registers to read
+
+	@throw JtagException if a scan fails
+ */
+void CevaDebugPort::ReadRegisters(unsigned int first, uint32_t* values, size_t count)
+{
+	JtagTimelineSpan span("ReadRegisters", "registers", count);
+	for(JtagTransaction transaction(m_iface, "ReadRegisters"); ; ForgetIR())
+	{
+		SelectRegister(CEVA_OP_REG_INDEX);
+		WriteDR(first);
+		SelectRegister(CEVA_OP_REG_READ);
+		for(size_t i=0; i<count; i++)
+			values[i] = ReadDR();
+		if(transaction.Done())
+			break;
+	}
+}
+
+/**
+	@brief Writes a block of consecutive core registers. The core must be halted.
+
+	@param first	Index of the first register
+	@param values	Values to write
+	@param count	Number of registers to write
+
+	@throw JtagException if a scan fails
+ */
+void CevaDebugPort::WriteRegisters(unsigned int first, const uint32_t* values, size_t count)
+{
+	JtagTimelineSpan span("WriteRegisters", "registers", count);
+	for(JtagTransaction transaction(m_iface, "WriteRegisters"); ; ForgetIR())
+	{
+		SelectRegister(CEVA_OP_REG_INDEX);
+		WriteDR(first);
+		SelectRegister(CEVA_OP_REG_WRITE);
+		for(size_t i=0; i<count; i++)
+			WriteDR(values[i]);
+		m_iface->Commit();
+		if(transaction.Done())
+			break;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory
+
+/**
+	@brief Reads a block of memory words. The core must be halted.
+
+	@param addr		Byte address of the first word (must be 4-byte aligned)
+	@param words	Output buffer
+	@param count	Number of words to read
+
+	@throw JtagException if a scan fails
+ */
+void CevaDebugPort::ReadMemory(uint32_t addr, uint32_t* words, size_t count)
+{
+	JtagTimelineSpan span("ReadMemory", "words", count);
+
+	//Only split the transfer up when a failure would mean doing it again
+	size_t chunk = m_iface->IsScanIntegrityEnabled() ? CEVA_TRANSACTION_WORDS : count;
+	for(size_t base=0; base<count; base += chunk)
+	{
+		size_t n = min(chunk, count - base);
+		for(JtagTransaction transaction(m_iface, "ReadMemory"); ; ForgetIR())
+		{
+			SelectRegister(CEVA_OP_MEM_ADDR);
+			WriteDR(addr + base*4);
+			SelectRegister(CEVA_OP_MEM_READ);
+			for(size_t i=0; i<n; i++)
+				words[base + i] = ReadDR();
+			if(transaction.Done())
+				break;
+		}
+	}
+}
+
+/**
+	@brief Writes a block of memory words. The core must be halted.
+
+	@param addr		Byte address of the first word (must be 4-byte aligned)
+	@param words	Data to write
+	@param count	Number of words to write
+
+	@throw JtagException if a scan fails
+ */
+void CevaDebugPort::WriteMemory(uint32_t addr, const uint32_t* words, size_t count)
+{
+	JtagTimelineSpan span("WriteMemory", "words", count);
+
+	size_t chunk = m_iface->IsScanIntegrityEnabled() ? CEVA_TRANSACTION_WORDS : count;
+	for(size_t base=0; base<count; base += chunk)
+	{
+		size_t n = min(chunk, count - base);
+		for(JtagTransaction transaction(m_iface, "WriteMemory"); ; ForgetIR())
+		{
+			SelectRegister(CEVA_OP_MEM_ADDR);
+			WriteDR(addr + base*4);
+			SelectRegister(CEVA_OP_MEM_WRITE);
+			for(size_t i=0; i<n; i++)
+				WriteDR(words[base + i]);
+			m_iface->Commit();
+			if(transaction.Done())
+				break;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Non-throwing variants
+
+/**
+	@brief ReadRegisters(), reporting errors as a status rather than throwing
+
+	@param first	Index of the first register
+	@param values	Output buffer (undefined if the read fails)
+	@param count	Number of registers to read
+
+	@return What went wrong, if anything
+ */
+JtagStatus CevaDebugPort::TryReadRegisters(unsigned int first, uint32_t* values, size_t count) noexcept
+{
+	JtagStatus status = m_iface->RunNoThrow([&]() { ReadRegisters(first, values, count); });
+
+	//The IR may not hold what we think it does
+	if(!status.IsOk())
+		ForgetIR();
+	return status;
+}
+
+/**
+	@brief ReadMemory(), reporting errors as a status rather than throwing
+
+	@param addr		Byte address of the first word (must be 4-byte aligned)
+	@param words	Output buffer (undefined if the read fails)
+	@param count	Number of words to read
+
+	@return What went wrong, if anything
+ */
+JtagStatus CevaDebugPort::TryReadMemory(uint32_t addr, uint32_t* words, size_t count) noexcept
+{
+	JtagStatus status = m_iface->RunNoThrow([&]() { ReadMemory(addr, words, count); });
+	if(!status.IsOk())
+		ForgetIR();
+	return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Breakpoints
+
+/**
+	@brief Arms a hardware breakpoint comparator
+
+	@param slot		Comparator index, less than CEVA_BREAKPOINT_COUNT
+	@param addr		Address to break at
+
+	@throw JtagException if the slot is out of range or a scan fails
+ */
+void CevaDebugPort::SetBreakpoint(unsigned int slot, uint32_t addr)
+{
+	if(slot >= CEVA_BREAKPOINT_COUNT)
+	{
+		throw JtagExceptionWrapper(
+			"Breakpoint slot out of range",
+			"");
+	}
+
+	SelectRegister(CEVA_OP_BP_ADDR + slot);
+	WriteDR(addr);
+	m_breakpointMask |= (1 << slot);
+	SelectRegister(CEVA_OP_BP_ENABLE);
+	WriteDR(m_breakpointMask);
+	m_iface->Commit();
+}
+
+/**
+	@brief Disarms a hardware breakpoint comparator
+
+	@param slot		Comparator index, less than CEVA_BREAKPOINT_COUNT
+
+	@throw JtagException if the slot is out of range or a scan fails
+ */
+void CevaDebugPort::ClearBreakpoint(unsigned int slot)
+{
+	if(slot >= CEVA_BREAKPOINT_COUNT)
+	{
+		throw JtagExceptionWrapper(
+			"Breakpoint slot out of range",
+			"");
+	}
+
+	m_breakpointMask &= ~(1 << slot);
+	SelectRegister(CEVA_OP_BP_ENABLE);
+	WriteDR(m_breakpointMask);
+	m_iface->Commit();
+}
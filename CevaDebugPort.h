@@ -0,0 +1,138 @@
+/**
+	@file
+	@brief Declaration of CevaDebugPort
+ */
+
+#ifndef CevaDebugPort_h
+#define CevaDebugPort_h
+
+/**
+	@brief Debug instructions of the CEVA DSP TAP
+
+	The IR is 32 bits wide and the opcode lives in the top byte (bits 31:24) of the IR word. All debug data registers
+	are 32 bits wide.
+
+	Only CORE_VERSION and PC have been confirmed on silicon so far. The remaining opcodes are provisional: they are
+	what CevaTapModel implements and what the debug stack is written against, and must be checked (and corrected here,
+	in one place) once the real run-control registers are mapped out.
+ */
+enum CevaDebugOpcode
+{
+	CEVA_OP_CTRL			= 0x10,		///< Run control, write-only (CEVA_CTRL_*)
+	CEVA_OP_STATUS			= 0x11,		///< Core status, read-only (CEVA_STATUS_*)
+	CEVA_OP_PC				= 0x34,		///< Current PC, read-only (confirmed)
+	CEVA_OP_MEM_ADDR		= 0x40,		///< Memory address pointer
+	CEVA_OP_MEM_READ		= 0x42,		///< Capture loads the word at the pointer, Update advances it by 4
+	CEVA_OP_MEM_WRITE		= 0x43,		///< Update stores the word at the pointer and advances it by 4
+	CEVA_OP_REG_INDEX		= 0x50,		///< Register index pointer
+	CEVA_OP_REG_READ		= 0x52,		///< Capture loads the register at the index, Update advances it by 1
+	CEVA_OP_REG_WRITE		= 0x53,		///< Update stores the register at the index and advances it by 1
+	CEVA_OP_BP_ADDR			= 0x60,		///< Breakpoint N address is at CEVA_OP_BP_ADDR + N
+	CEVA_OP_BP_ENABLE		= 0x68,		///< Bitmask of enabled breakpoints
+	CEVA_OP_CORE_VERSION	= 0x72,		///< Core version, read-only (confirmed)
+	CEVA_OP_IDCODE			= 0xfe,		///< 1149.1 IDCODE, selected by Test-Logic-Reset
+	CEVA_OP_BYPASS			= 0xff		///< 1149.1 BYPASS
+};
+
+///@brief CEVA_OP_CTRL commands
+enum CevaControlCommand
+{
+	CEVA_CTRL_HALT			= 0x01,
+	CEVA_CTRL_RESUME		= 0x02,
+	CEVA_CTRL_STEP			= 0x04
+};
+
+///@brief CEVA_OP_STATUS bits
+enum CevaStatusBits
+{
+	CEVA_STATUS_HALTED		= 0x01,
+	CEVA_STATUS_BP_HIT		= 0x02
+};
+
+///@brief Width of the IR, in bits
+#define CEVA_IR_LENGTH			32
+
+///@brief Number of registers visible through CEVA_OP_REG_READ / CEVA_OP_REG_WRITE, including the PC
+#define CEVA_REG_COUNT			33
+
+///@brief Register index of the PC
+#define CEVA_REG_PC				32
+
+///@brief Number of hardware breakpoint comparators
+#define CEVA_BREAKPOINT_COUNT	4
+
+///@brief Words per transaction when memory transfers are integrity checked (a failure retries the whole transaction)
+#define CEVA_TRANSACTION_WORDS	256
+
+/**
+	@brief Run control, register and memory access for the CEVA DSP, layered on top of a JtagInterface
+
+	Block transfers take a single IR load and then one DR scan per word, using the auto-incrementing address and index
+	pointers, so fetching all registers or a run of memory words costs a fraction of issuing one access per word.
+	Everything which doesn't need readback goes out through the deferred scan functions.
+
+	The DSP is assumed to be device 0 on the chain, and InitializeChain() must have been called already. The port
+	remembers which opcode is in the IR; anything else that scans the IR or resets the TAP behind its back must call
+	ForgetIR() afterwards.
+
+	The pointers advance on every Update-DR, so block transfers are JtagTransaction objects: when the interface is
+	integrity checking scans, one that fails restarts the block (or, for memory, its current CEVA_TRANSACTION_WORDS
+	chunk) from its first word, rather than repeating a single scan at the wrong address.
+ */
+class CevaDebugPort
+{
+public:
+	CevaDebugPort(JtagInterface* iface);
+	virtual ~CevaDebugPort();
+
+	///@brief Returns the interface this port sits on
+	JtagInterface* GetInterface()
+	{ return m_iface; }
+
+	///@brief Forces the next access to reload the IR
+	void ForgetIR()
+	{ m_currentOpcode = -1; }
+
+	//Identification
+	uint32_t GetCoreVersion();
+
+	//Run control
+	uint32_t GetStatus();
+	bool IsHalted();
+	void Halt();
+	void Resume();
+	void Step();
+	uint32_t GetPC();
+
+	//Registers
+	void ReadRegisters(unsigned int first, uint32_t* values, size_t count);
+	void WriteRegisters(unsigned int first, const uint32_t* values, size_t count);
+
+	//Memory
+	void ReadMemory(uint32_t addr, uint32_t* words, size_t count);
+	void WriteMemory(uint32_t addr, const uint32_t* words, size_t count);
+
+	//Non-throwing variants of the reads
+	JtagStatus TryReadRegisters(unsigned int first, uint32_t* values, size_t count) noexcept;
+	JtagStatus TryReadMemory(uint32_t addr, uint32_t* words, size_t count) noexcept;
+
+	//Breakpoints
+	void SetBreakpoint(unsigned int slot, uint32_t addr);
+	void ClearBreakpoint(unsigned int slot);
+
+protected:
+	void SelectRegister(uint8_t opcode);
+	uint32_t ReadDR();
+	void WriteDR(uint32_t value);
+
+	///@brief The adapter
+	JtagInterface* m_iface;
+
+	///@brief Opcode currently in the IR, so back-to-back accesses to the same register skip the IR scan
+	int m_currentOpcode;
+
+	///@brief Bitmask of enabled breakpoints
+	uint32_t m_breakpointMask;
+};
+
+#endif
@@ -0,0 +1,340 @@
+/**
+	@file
+	@brief Implementation of CevaTapModel
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+///@brief IDCODE reported by the model
+#define CEVA_MODEL_IDCODE		0x0cea0001
+
+///@brief Value of the core version register reported by the model
+#define CEVA_MODEL_VERSION		0x00020100
+
+/**
+	@brief Next-state table for the TAP controller, indexed by [state][tms]
+ */
+const JtagTapState g_tapNextState[16][2] =
+{
+	{ TAP_RUN_TEST_IDLE,	TAP_TEST_LOGIC_RESET },		//TEST_LOGIC_RESET
+	{ TAP_RUN_TEST_IDLE,	TAP_SELECT_DR_SCAN },		//RUN_TEST_IDLE
+	{ TAP_CAPTURE_DR,		TAP_SELECT_IR_SCAN },		//SELECT_DR_SCAN
+	{ TAP_SHIFT_DR,			TAP_EXIT1_DR },				//CAPTURE_DR
+	{ TAP_SHIFT_DR,			TAP_EXIT1_DR },				//SHIFT_DR
+	{ TAP_PAUSE_DR,			TAP_UPDATE_DR },			//EXIT1_DR
+	{ TAP_PAUSE_DR,			TAP_EXIT2_DR },				//PAUSE_DR
+	{ TAP_SHIFT_DR,			TAP_UPDATE_DR },			//EXIT2_DR
+	{ TAP_RUN_TEST_IDLE,	TAP_SELECT_DR_SCAN },		//UPDATE_DR
+	{ TAP_CAPTURE_IR,		TAP_TEST_LOGIC_RESET },		//SELECT_IR_SCAN
+	{ TAP_SHIFT_IR,			TAP_EXIT1_IR },				//CAPTURE_IR
+	{ TAP_SHIFT_IR,			TAP_EXIT1_IR },				//SHIFT_IR
+	{ TAP_PAUSE_IR,			TAP_UPDATE_IR },			//EXIT1_IR
+	{ TAP_PAUSE_IR,			TAP_EXIT2_IR },				//PAUSE_IR
+	{ TAP_SHIFT_IR,			TAP_UPDATE_IR },			//EXIT2_IR
+	{ TAP_RUN_TEST_IDLE,	TAP_SELECT_DR_SCAN }		//UPDATE_IR
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+CevaTapModel::CevaTapModel()
+	: m_cycles(0)
+{
+	Reset();
+}
+
+CevaTapModel::~CevaTapModel()
+{
+}
+
+/**
+	@brief Power-on reset: clears the TAP, the core and the debug logic. Memory contents are kept.
+ */
+void CevaTapModel::Reset()
+{
+	m_state = TAP_TEST_LOGIC_RESET;
+	m_tdo = false;
+	m_irShift = 0;
+	m_ir = static_cast<uint32_t>(CEVA_OP_IDCODE) << 24;
+	m_drShift = 0;
+	m_drLength = 32;
+
+	for(int i=0; i<CEVA_REG_COUNT; i++)
+		m_regs[i] = 0;
+	m_memAddr = 0;
+	m_regIndex = 0;
+	for(int i=0; i<CEVA_BREAKPOINT_COUNT; i++)
+		m_breakpoints[i] = 0;
+	m_breakpointMask = 0;
+
+	m_halted = false;
+	m_bpHit = false;
+	m_codeBase = 0x00000000;
+	m_codeSize = 0x10000;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Clocking
+
+/**
+	@brief Clocks one full TCK cycle
+
+	@param tms	TMS value sampled on the rising edge
+	@param tdi	TDI value sampled on the rising edge
+ */
+void CevaTapModel::Clock(bool tms, bool tdi)
+{
+	m_cycles ++;
+	if(!m_halted)
+		Execute();
+
+	//Rising edge: capture or shift in the current state, then move
+	switch(m_state)
+	{
+		case TAP_CAPTURE_DR:
+			CaptureDR();
+			break;
+
+		case TAP_SHIFT_DR:
+			m_drShift >>= 1;
+			if(tdi)
+				m_drShift |= (1u << (m_drLength - 1));
+			break;
+
+		case TAP_CAPTURE_IR:
+			//1149.1 requires the two LSBs to capture as 01
+			m_irShift = 0x00000001;
+			break;
+
+		case TAP_SHIFT_IR:
+			m_irShift >>= 1;
+			if(tdi)
+				m_irShift |= 0x80000000;
+			break;
+
+		default:
+			break;
+	}
+
+	m_state = g_tapNextState[m_state][tms ? 1 : 0];
+
+	//Falling edge: updates take effect, and TDO is driven from the end of whichever register is being shifted
+	switch(m_state)
+	{
+		case TAP_TEST_LOGIC_RESET:
+			m_ir = static_cast<uint32_t>(CEVA_OP_IDCODE) << 24;
+			m_drLength = 32;
+			break;
+
+		case TAP_UPDATE_DR:
+			UpdateDR();
+			break;
+
+		case TAP_UPDATE_IR:
+			UpdateIR();
+			break;
+
+		case TAP_SHIFT_DR:
+			m_tdo = m_drShift & 1;
+			break;
+
+		case TAP_SHIFT_IR:
+			m_tdo = m_irShift & 1;
+			break;
+
+		default:
+			break;
+	}
+}
+
+/**
+	@brief Executes one instruction of the (fictional) core program
+ */
+void CevaTapModel::Execute()
+{
+	uint32_t& pc = m_regs[CEVA_REG_PC];
+	pc += 2;
+	if( (pc < m_codeBase) || (pc >= m_codeBase + m_codeSize) )
+		pc = m_codeBase;
+
+	for(int i=0; i<CEVA_BREAKPOINT_COUNT; i++)
+	{
+		if( (m_breakpointMask & (1 << i)) && (m_breakpoints[i] == pc) )
+		{
+			m_halted = true;
+			m_bpHit = true;
+		}
+	}
+}
+
+/**
+	@brief Loads the DR shift register from the register selected by the IR
+ */
+void CevaTapModel::CaptureDR()
+{
+	switch(GetOpcode())
+	{
+		case CEVA_OP_IDCODE:
+			m_drShift = CEVA_MODEL_IDCODE;
+			break;
+
+		case CEVA_OP_CORE_VERSION:
+			m_drShift = CEVA_MODEL_VERSION;
+			break;
+
+		case CEVA_OP_PC:
+			m_drShift = m_regs[CEVA_REG_PC];
+			break;
+
+		case CEVA_OP_STATUS:
+			m_drShift = (m_halted ? CEVA_STATUS_HALTED : 0) | (m_bpHit ? CEVA_STATUS_BP_HIT : 0);
+			break;
+
+		case CEVA_OP_MEM_ADDR:
+			m_drShift = m_memAddr;
+			break;
+
+		case CEVA_OP_MEM_READ:
+			m_drShift = PeekMemory(m_memAddr);
+			break;
+
+		case CEVA_OP_REG_INDEX:
+			m_drShift = m_regIndex;
+			break;
+
+		case CEVA_OP_REG_READ:
+			m_drShift = m_regs[m_regIndex % CEVA_REG_COUNT];
+			break;
+
+		case CEVA_OP_BP_ENABLE:
+			m_drShift = m_breakpointMask;
+			break;
+
+		default:
+			m_drShift = 0;
+			break;
+	}
+}
+
+/**
+	@brief Acts on the value shifted into the DR
+ */
+void CevaTapModel::UpdateDR()
+{
+	uint8_t op = GetOpcode();
+	switch(op)
+	{
+		case CEVA_OP_CTRL:
+			if(m_drShift & CEVA_CTRL_HALT)
+				m_halted = true;
+			if(m_drShift & CEVA_CTRL_RESUME)
+			{
+				m_halted = false;
+				m_bpHit = false;
+			}
+			if( (m_drShift & CEVA_CTRL_STEP) && m_halted )
+			{
+				Execute();
+				m_halted = true;
+				m_bpHit = false;
+			}
+			break;
+
+		case CEVA_OP_MEM_ADDR:
+			m_memAddr = m_drShift;
+			break;
+
+		case CEVA_OP_MEM_READ:
+			m_memAddr += 4;
+			break;
+
+		case CEVA_OP_MEM_WRITE:
+			PokeMemory(m_memAddr, m_drShift);
+			m_memAddr += 4;
+			break;
+
+		case CEVA_OP_REG_INDEX:
+			m_regIndex = m_drShift;
+			break;
+
+		case CEVA_OP_REG_READ:
+			m_regIndex ++;
+			break;
+
+		case CEVA_OP_REG_WRITE:
+			m_regs[m_regIndex % CEVA_REG_COUNT] = m_drShift;
+			m_regIndex ++;
+			break;
+
+		case CEVA_OP_BP_ENABLE:
+			m_breakpointMask = m_drShift & ((1 << CEVA_BREAKPOINT_COUNT) - 1);
+			break;
+
+		default:
+			if( (op >= CEVA_OP_BP_ADDR) && (op < CEVA_OP_BP_ADDR + CEVA_BREAKPOINT_COUNT) )
+				m_breakpoints[op - CEVA_OP_BP_ADDR] = m_drShift;
+			break;
+	}
+}
+
+/**
+	@brief Latches the new instruction and sizes the DR accordingly
+ */
+void CevaTapModel::UpdateIR()
+{
+	m_ir = m_irShift;
+
+	switch(GetOpcode())
+	{
+		case CEVA_OP_CTRL:
+		case CEVA_OP_STATUS:
+		case CEVA_OP_PC:
+		case CEVA_OP_MEM_ADDR:
+		case CEVA_OP_MEM_READ:
+		case CEVA_OP_MEM_WRITE:
+		case CEVA_OP_REG_INDEX:
+		case CEVA_OP_REG_READ:
+		case CEVA_OP_REG_WRITE:
+		case CEVA_OP_BP_ENABLE:
+		case CEVA_OP_CORE_VERSION:
+		case CEVA_OP_IDCODE:
+			m_drLength = 32;
+			break;
+
+		default:
+			if( (GetOpcode() >= CEVA_OP_BP_ADDR) && (GetOpcode() < CEVA_OP_BP_ADDR + CEVA_BREAKPOINT_COUNT) )
+				m_drLength = 32;
+			else
+				m_drLength = 1;
+			break;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Backdoor access
+
+/**
+	@brief Reads a memory word. Unwritten memory reads as zero.
+
+	@param addr		Byte address, rounded down to a word boundary
+ */
+uint32_t CevaTapModel::PeekMemory(uint32_t addr) const
+{
+	map<uint32_t, uint32_t>::const_iterator it = m_memory.find(addr >> 2);
+	if(it == m_memory.end())
+		return 0;
+	return it->second;
+}
+
+/**
+	@brief Writes a memory word
+
+	@param addr		Byte address, rounded down to a word boundary
+	@param value	Value to write
+ */
+void CevaTapModel::PokeMemory(uint32_t addr, uint32_t value)
+{
+	m_memory[addr >> 2] = value;
+}
@@ -0,0 +1,143 @@
+/**
+	@file
+	@brief Declaration of CevaTapModel
+ */
+
+#ifndef CevaTapModel_h
+#define CevaTapModel_h
+
+/**
+	@brief TAP controller states, numbered as in IEEE 1149.1
+ */
+enum JtagTapState
+{
+	TAP_TEST_LOGIC_RESET,
+	TAP_RUN_TEST_IDLE,
+	TAP_SELECT_DR_SCAN,
+	TAP_CAPTURE_DR,
+	TAP_SHIFT_DR,
+	TAP_EXIT1_DR,
+	TAP_PAUSE_DR,
+	TAP_EXIT2_DR,
+	TAP_UPDATE_DR,
+	TAP_SELECT_IR_SCAN,
+	TAP_CAPTURE_IR,
+	TAP_SHIFT_IR,
+	TAP_EXIT1_IR,
+	TAP_PAUSE_IR,
+	TAP_EXIT2_IR,
+	TAP_UPDATE_IR
+};
+
+///@brief Next-state table of the TAP controller, indexed by [state][tms]
+extern const JtagTapState g_tapNextState[16][2];
+
+/**
+	@brief Cycle-level software model of the CEVA DSP's TAP and debug logic
+
+	Implements the 1149.1 state machine plus the debug registers described by CevaDebugOpcode, backed by a sparse
+	memory and a trivial core that executes one 2-byte instruction per TCK while running (wrapping around inside a
+	code window), so run control and breakpoints behave like the real thing.
+
+	The model is clocked one TCK cycle at a time exactly like the pins: GetTDO() is the value driven since the last
+	falling edge, and Clock() performs a full rising + falling edge with the given TMS and TDI.
+ */
+class CevaTapModel
+{
+public:
+	CevaTapModel();
+	virtual ~CevaTapModel();
+
+	void Reset();
+
+	///@brief Returns the current value of TDO
+	bool GetTDO() const
+	{ return m_tdo; }
+
+	void Clock(bool tms, bool tdi);
+
+	///@brief Returns the current TAP state
+	JtagTapState GetState() const
+	{ return m_state; }
+
+	//Backdoor access to target state, for setting up scenarios and checking results
+	uint32_t PeekMemory(uint32_t addr) const;
+	void PokeMemory(uint32_t addr, uint32_t value);
+
+	///@brief Returns a core register (CEVA_REG_PC is the PC)
+	uint32_t PeekRegister(unsigned int n) const
+	{ return m_regs[n % CEVA_REG_COUNT]; }
+
+	///@brief Sets a core register (CEVA_REG_PC is the PC)
+	void PokeRegister(unsigned int n, uint32_t value)
+	{ m_regs[n % CEVA_REG_COUNT] = value; }
+
+	///@brief Checks if the core is halted
+	bool IsHalted() const
+	{ return m_halted; }
+
+	///@brief Returns the number of TCK cycles clocked since construction
+	uint64_t GetCycleCount() const
+	{ return m_cycles; }
+
+protected:
+	void CaptureDR();
+	void UpdateDR();
+	void UpdateIR();
+	void Execute();
+	uint8_t GetOpcode() const
+	{ return m_ir >> 24; }
+
+	///@brief Current TAP state
+	JtagTapState m_state;
+
+	///@brief Current TDO value
+	bool m_tdo;
+
+	///@brief IR shift register
+	uint32_t m_irShift;
+
+	///@brief Active instruction
+	uint32_t m_ir;
+
+	///@brief DR shift register
+	uint32_t m_drShift;
+
+	///@brief Length of the selected DR (1 for BYPASS, 32 otherwise)
+	unsigned int m_drLength;
+
+	///@brief Core registers
+	uint32_t m_regs[CEVA_REG_COUNT];
+
+	///@brief Sparse target memory, indexed by word address
+	std::map<uint32_t, uint32_t> m_memory;
+
+	///@brief Memory address pointer
+	uint32_t m_memAddr;
+
+	///@brief Register index pointer
+	uint32_t m_regIndex;
+
+	///@brief Breakpoint comparators
+	uint32_t m_breakpoints[CEVA_BREAKPOINT_COUNT];
+
+	///@brief Bitmask of enabled breakpoints
+	uint32_t m_breakpointMask;
+
+	///@brief True if the core is halted
+	bool m_halted;
+
+	///@brief True if the core halted on a breakpoint
+	bool m_bpHit;
+
+	///@brief Start of the window the core executes in
+	uint32_t m_codeBase;
+
+	///@brief Size of the window the core executes in
+	uint32_t m_codeSize;
+
+	///@brief TCK cycles since construction
+	uint64_t m_cycles;
+};
+
+#endif
@@ -0,0 +1,581 @@
+/**
+	@file
+	@brief Implementation of ElfSymbolIndex
+ */
+
+#include "jtaghal.h"
+#include <algorithm>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+	@brief Header of an index image. The arrays described in ElfSymbolIndex follow immediately after it.
+ */
+struct SymbolIndexHeader
+{
+	///@brief Must be SYMBOL_INDEX_MAGIC
+	uint32_t	magic;
+
+	///@brief Must be SYMBOL_INDEX_VERSION
+	uint32_t	version;
+
+	///@brief Number of ranges
+	uint32_t	count;
+
+	///@brief Size of the name table, in bytes
+	uint32_t	strtab_size;
+
+	///@brief Size of the ELF the index was built from, used to detect stale sidecars
+	uint64_t	elf_size;
+
+	///@brief Modification time of the ELF the index was built from, used to detect stale sidecars
+	int64_t		elf_mtime;
+};
+
+//Stored in host byte order, so a sidecar copied to a host of the other endianness is rejected rather than misread
+#define SYMBOL_INDEX_MAGIC		0x4d59534a
+#define SYMBOL_INDEX_VERSION	1
+
+/**
+	@brief A function symbol pulled out of the ELF symbol table, before indexing
+ */
+struct ElfFunctionSymbol
+{
+	uint32_t	start;
+	uint32_t	size;
+	uint32_t	limit;		//end of the containing section, bounds zero-size symbols
+	bool		global;
+	const char*	name;
+
+	bool operator<(const ElfFunctionSymbol& rhs) const
+	{
+		//At equal addresses put the preferred alias first: global before local, then the larger one
+		if(start != rhs.start)
+			return start < rhs.start;
+		if(global != rhs.global)
+			return global;
+		return size > rhs.size;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ELF parsing
+
+/**
+	@brief Extracts all function symbols from one ELF class (32 or 64 bit)
+
+	Falls back to the dynamic symbol table if the image is stripped.
+ */
+template<class Ehdr, class Shdr, class Sym, int (*SymType)(int), int (*SymBind)(int)>
+static void ReadFunctionSymbols(const uint8_t* base, size_t len, vector<ElfFunctionSymbol>& syms)
+{
+	const Ehdr* ehdr = reinterpret_cast<const Ehdr*>(base);
+	if( (ehdr->e_shoff == 0) || (ehdr->e_shentsize != sizeof(Shdr)) ||
+		(ehdr->e_shoff + ehdr->e_shnum * sizeof(Shdr) > len) )
+	{
+		throw JtagExceptionWrapper(
+			"ELF section header table is missing or truncated",
+			"");
+	}
+	const Shdr* shdrs = reinterpret_cast<const Shdr*>(base + ehdr->e_shoff);
+
+	const Shdr* symtab = NULL;
+	for(size_t i=0; i<ehdr->e_shnum; i++)
+	{
+		if(shdrs[i].sh_type == SHT_SYMTAB)
+			symtab = &shdrs[i];
+		else if( (shdrs[i].sh_type == SHT_DYNSYM) && (symtab == NULL) )
+			symtab = &shdrs[i];
+	}
+	if(symtab == NULL)
+		return;
+
+	if( (symtab->sh_link >= ehdr->e_shnum) || (symtab->sh_offset + symtab->sh_size > len) )
+	{
+		throw JtagExceptionWrapper(
+			"ELF symbol table is truncated",
+			"");
+	}
+	const Shdr* strtab = &shdrs[symtab->sh_link];
+	if(strtab->sh_offset + strtab->sh_size > len)
+	{
+		throw JtagExceptionWrapper(
+			"ELF string table is truncated",
+			"");
+	}
+	const char* names = reinterpret_cast<const char*>(base + strtab->sh_offset);
+
+	const Sym* table = reinterpret_cast<const Sym*>(base + symtab->sh_offset);
+	size_t nsyms = symtab->sh_size / sizeof(Sym);
+	for(size_t i=0; i<nsyms; i++)
+	{
+		const Sym& s = table[i];
+		if( (s.st_shndx == SHN_UNDEF) || (s.st_shndx >= ehdr->e_shnum) )
+			continue;
+		if( (s.st_name == 0) || (s.st_name >= strtab->sh_size) )
+			continue;
+
+		//Functions, plus untyped labels in code sections (common in hand-written DSP assembly)
+		const Shdr& section = shdrs[s.st_shndx];
+		int type = SymType(s.st_info);
+		if( (type != STT_FUNC) && !( (type == STT_NOTYPE) && (section.sh_flags & SHF_EXECINSTR) ) )
+			continue;
+
+		//Skip mapping symbols ($a, $d etc) and anything the DSP can't address
+		const char* name = names + s.st_name;
+		if(name[0] == '$')
+			continue;
+		uint64_t end = static_cast<uint64_t>(section.sh_addr) + section.sh_size;
+		if( (s.st_value > 0xffffffff) || (end > 0x100000000ULL) )
+			continue;
+
+		ElfFunctionSymbol f;
+		f.start = s.st_value;
+		f.size = s.st_size;
+		f.limit = (end > s.st_value) ? end : (s.st_value + 1);
+		f.global = (SymBind(s.st_info) != STB_LOCAL);
+		f.name = name;
+		syms.push_back(f);
+	}
+}
+
+static int Elf32SymType(int info)
+{ return ELF32_ST_TYPE(info); }
+
+static int Elf32SymBind(int info)
+{ return ELF32_ST_BIND(info); }
+
+static int Elf64SymType(int info)
+{ return ELF64_ST_TYPE(info); }
+
+static int Elf64SymBind(int info)
+{ return ELF64_ST_BIND(info); }
+
+/**
+	@brief Recursively fills an Eytzinger-ordered key array from a sorted list
+
+	@param keys		Output keys (1-based)
+	@param ranks	Output sorted rank of each key
+	@param sorted	Sorted input keys
+	@param i		Next sorted element to place
+	@param k		Current tree node
+
+	@return Next sorted element to place after this subtree
+ */
+static size_t FillEytzinger(uint32_t* keys, uint32_t* ranks, const vector<uint32_t>& sorted, size_t i, size_t k)
+{
+	if(k <= sorted.size())
+	{
+		i = FillEytzinger(keys, ranks, sorted, i, 2*k);
+		keys[k] = sorted[i];
+		ranks[k] = i;
+		i ++;
+		i = FillEytzinger(keys, ranks, sorted, i, 2*k + 1);
+	}
+	return i;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+ElfSymbolIndex::ElfSymbolIndex()
+	: m_map(NULL)
+	, m_maplen(0)
+	, m_count(0)
+	, m_keys(NULL)
+	, m_ranks(NULL)
+	, m_ranges(NULL)
+	, m_strtab(NULL)
+{
+}
+
+ElfSymbolIndex::~ElfSymbolIndex()
+{
+	Clear();
+}
+
+/**
+	@brief Drops the current index, if any
+ */
+void ElfSymbolIndex::Clear()
+{
+	if(m_map)
+		munmap(m_map, m_maplen);
+	m_map = NULL;
+	m_maplen = 0;
+	m_image.clear();
+
+	m_count = 0;
+	m_keys = NULL;
+	m_ranks = NULL;
+	m_ranges = NULL;
+	m_strtab = NULL;
+}
+
+/**
+	@brief Points the lookup arrays at an index image (either m_image or a mapped sidecar)
+
+	The ranks and name offsets are checked against the image, so a corrupt sidecar is rejected (and LoadIndex() falls
+	back to rebuilding from the ELF) rather than sending Lookup() out of bounds.
+
+	@throw JtagException if the image is malformed
+ */
+void ElfSymbolIndex::AttachImage(const uint8_t* image, size_t len)
+{
+	const SymbolIndexHeader* hdr = reinterpret_cast<const SymbolIndexHeader*>(image);
+	if( (len < sizeof(SymbolIndexHeader)) || (hdr->magic != SYMBOL_INDEX_MAGIC) ||
+		(hdr->version != SYMBOL_INDEX_VERSION) )
+	{
+		throw JtagExceptionWrapper(
+			"Not a symbol index, or built by an incompatible version",
+			"");
+	}
+
+	size_t count = hdr->count;
+	size_t arrays = sizeof(uint32_t) * 2*(count+1) + sizeof(SymbolRange) * count;
+	if(sizeof(SymbolIndexHeader) + arrays + hdr->strtab_size != len)
+	{
+		throw JtagExceptionWrapper(
+			"Symbol index is truncated",
+			"");
+	}
+
+	const uint32_t* p = reinterpret_cast<const uint32_t*>(image + sizeof(SymbolIndexHeader));
+	const uint32_t* ranks = p + (count+1);
+	const SymbolRange* ranges = reinterpret_cast<const SymbolRange*>(p + 2*(count+1));
+	const char* strtab = reinterpret_cast<const char*>(ranges + count);
+
+	//A sidecar is just a file, so check everything Lookup() indexes with before trusting it
+	size_t strtab_size = hdr->strtab_size;
+	if( (strtab_size != 0) && (strtab[strtab_size - 1] != '\0') )
+	{
+		throw JtagExceptionWrapper(
+			"Symbol index name table is not terminated",
+			"");
+	}
+	for(size_t i=0; i<=count; i++)
+	{
+		if(ranks[i] > count)
+		{
+			throw JtagExceptionWrapper(
+				"Symbol index rank out of range",
+				"");
+		}
+	}
+	for(size_t i=0; i<count; i++)
+	{
+		if(ranges[i].name >= strtab_size)
+		{
+			throw JtagExceptionWrapper(
+				"Symbol index name offset out of range",
+				"");
+		}
+	}
+
+	m_count = count;
+	m_keys = p;
+	m_ranks = ranks;
+	m_ranges = ranges;
+	m_strtab = strtab;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Loading and saving
+
+/**
+	@brief Loads the symbols for an ELF, reusing its sidecar index if it is up to date
+
+	If the sidecar is missing or stale, the index is rebuilt from the ELF and the sidecar rewritten. Failure to write
+	the sidecar (read-only firmware directory etc) is not fatal.
+
+	@param elf_path		Path to the firmware image
+	@param index_path	Path to the sidecar, defaults to elf_path + ".symidx"
+
+	@throw JtagException if the ELF cannot be read
+ */
+void ElfSymbolIndex::Load(const string& elf_path, const string& index_path)
+{
+	string sidecar = index_path.empty() ? (elf_path + ".symidx") : index_path;
+	if(LoadIndex(sidecar, elf_path))
+		return;
+
+	LoadElf(elf_path);
+	try
+	{
+		SaveIndex(sidecar);
+	}
+	catch(const JtagException&)
+	{
+		LogWarning("Could not write symbol index %s, it will be rebuilt next time\n", sidecar.c_str());
+	}
+}
+
+/**
+	@brief Builds the index from the symbol table of an ELF image
+
+	Both ELF32 and ELF64 images are accepted, but only in host byte order.
+
+	@throw JtagException if the file can't be read or isn't a valid ELF
+ */
+void ElfSymbolIndex::LoadElf(const string& path)
+{
+	Clear();
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to open ELF image",
+			"");
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		close(fd);
+		throw JtagExceptionWrapper(
+			"Failed to stat ELF image",
+			"");
+	}
+	size_t len = st.st_size;
+	void* map = (len >= EI_NIDENT) ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if(map == MAP_FAILED)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to map ELF image",
+			"");
+	}
+	const uint8_t* base = static_cast<const uint8_t*>(map);
+
+	//Pull out every function symbol
+	vector<ElfFunctionSymbol> syms;
+	try
+	{
+		uint16_t one = 1;
+		int host_data = (*reinterpret_cast<uint8_t*>(&one) == 1) ? ELFDATA2LSB : ELFDATA2MSB;
+		if(memcmp(base, ELFMAG, SELFMAG) != 0)
+		{
+			throw JtagExceptionWrapper(
+				"Not an ELF image",
+				"");
+		}
+		if(base[EI_DATA] != host_data)
+		{
+			throw JtagExceptionWrapper(
+				"ELF byte order does not match the host",
+				"");
+		}
+
+		if( (base[EI_CLASS] == ELFCLASS32) && (len >= sizeof(Elf32_Ehdr)) )
+		{
+			ReadFunctionSymbols<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym, Elf32SymType, Elf32SymBind>(
+				base, len, syms);
+		}
+		else if( (base[EI_CLASS] == ELFCLASS64) && (len >= sizeof(Elf64_Ehdr)) )
+		{
+			ReadFunctionSymbols<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym, Elf64SymType, Elf64SymBind>(
+				base, len, syms);
+		}
+		else
+		{
+			throw JtagExceptionWrapper(
+				"Unsupported ELF class",
+				"");
+		}
+	}
+	catch(...)
+	{
+		munmap(map, len);
+		throw;
+	}
+
+	//Sort and drop aliases, keeping the preferred name at each address
+	sort(syms.begin(), syms.end());
+	size_t nout = 0;
+	for(size_t i=0; i<syms.size(); i++)
+	{
+		if( (nout == 0) || (syms[nout-1].start != syms[i].start) )
+			syms[nout++] = syms[i];
+	}
+	syms.resize(nout);
+
+	//Compute the image layout
+	size_t count = syms.size();
+	size_t strtab_size = 0;
+	for(size_t i=0; i<count; i++)
+		strtab_size += strlen(syms[i].name) + 1;
+	size_t arrays = sizeof(uint32_t) * 2*(count+1) + sizeof(SymbolRange) * count;
+	m_image.resize(sizeof(SymbolIndexHeader) + arrays + strtab_size);
+
+	SymbolIndexHeader* hdr = reinterpret_cast<SymbolIndexHeader*>(&m_image[0]);
+	hdr->magic = SYMBOL_INDEX_MAGIC;
+	hdr->version = SYMBOL_INDEX_VERSION;
+	hdr->count = count;
+	hdr->strtab_size = strtab_size;
+	hdr->elf_size = st.st_size;
+	hdr->elf_mtime = st.st_mtime;
+
+	uint32_t* keys = reinterpret_cast<uint32_t*>(&m_image[sizeof(SymbolIndexHeader)]);
+	uint32_t* ranks = keys + (count+1);
+	SymbolRange* ranges = reinterpret_cast<SymbolRange*>(ranks + (count+1));
+	char* strtab = reinterpret_cast<char*>(ranges + count);
+
+	//Ranges end at the symbol size, clipped to the next symbol. Zero-size labels extend up to the next symbol.
+	vector<uint32_t> starts(count);
+	size_t stroff = 0;
+	for(size_t i=0; i<count; i++)
+	{
+		const ElfFunctionSymbol& s = syms[i];
+		uint64_t end = s.size ? (static_cast<uint64_t>(s.start) + s.size) : s.limit;
+		if( (i+1 < count) && (end > syms[i+1].start) )
+			end = syms[i+1].start;
+		if(end > 0xffffffff)
+			end = 0xffffffff;
+
+		starts[i] = s.start;
+		ranges[i].start = s.start;
+		ranges[i].end = end;
+		ranges[i].name = stroff;
+		size_t namelen = strlen(s.name) + 1;
+		memcpy(strtab + stroff, s.name, namelen);
+		stroff += namelen;
+	}
+	munmap(map, len);
+
+	keys[0] = 0;
+	ranks[0] = 0;
+	FillEytzinger(keys, ranks, starts, 0, 1);
+
+	AttachImage(&m_image[0], m_image.size());
+}
+
+/**
+	@brief Maps a sidecar index written by SaveIndex()
+
+	@param path		Path to the sidecar
+	@param elf_path	If not empty, the sidecar is only accepted if it was built from this file in its current state
+
+	@return True if the sidecar was loaded, false if it is missing, stale or corrupted
+ */
+bool ElfSymbolIndex::LoadIndex(const string& path, const string& elf_path)
+{
+	Clear();
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if( (fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(SymbolIndexHeader)) )
+	{
+		close(fd);
+		return false;
+	}
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return false;
+
+	m_map = map;
+	m_maplen = st.st_size;
+	try
+	{
+		AttachImage(static_cast<const uint8_t*>(map), st.st_size);
+	}
+	catch(const JtagException&)
+	{
+		Clear();
+		return false;
+	}
+
+	if(!elf_path.empty())
+	{
+		const SymbolIndexHeader* hdr = static_cast<const SymbolIndexHeader*>(map);
+		struct stat elf_st;
+		if( (stat(elf_path.c_str(), &elf_st) != 0) ||
+			(hdr->elf_size != (uint64_t)elf_st.st_size) || (hdr->elf_mtime != elf_st.st_mtime) )
+		{
+			Clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+	@brief Writes the current index to a sidecar file
+
+	The file is written under a temporary name and renamed into place so a concurrent reader never maps a partial file.
+
+	@throw JtagException if the file could not be written
+ */
+void ElfSymbolIndex::SaveIndex(const string& path)
+{
+	if(m_image.empty())
+	{
+		throw JtagExceptionWrapper(
+			"No index built, nothing to save",
+			"");
+	}
+
+	string temp = path + ".tmp";
+	FILE* fp = fopen(temp.c_str(), "wb");
+	if(fp == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to create symbol index",
+			"");
+	}
+	bool ok = (fwrite(&m_image[0], 1, m_image.size(), fp) == m_image.size());
+	ok = (fclose(fp) == 0) && ok;
+	if(!ok || (rename(temp.c_str(), path.c_str()) != 0))
+	{
+		unlink(temp.c_str());
+		throw JtagExceptionWrapper(
+			"Failed to write symbol index",
+			"");
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Lookup
+
+/**
+	@brief Finds the function containing an address
+
+	@param addr		Address to look up
+	@param offset	If not NULL, set to the offset of addr from the start of the function
+
+	@return Name of the function, or NULL if the address is not inside any function
+ */
+const char* ElfSymbolIndex::Lookup(uint32_t addr, uint32_t* offset) const
+{
+	//Descend the tree. Four levels down the keys are 16 entries (one cache line) per node further along,
+	//so prefetching there hides most of the miss latency on large tables.
+	size_t n = m_count;
+	size_t k = 1;
+	while(k <= n)
+	{
+		__builtin_prefetch(m_keys + 16*k);
+		k = 2*k + (m_keys[k] <= addr);
+	}
+
+	//Undo the trailing right turns (and the last left turn) to find the first key > addr.
+	//The range we want is the one right before it in sorted order.
+	k >>= __builtin_ffsll(~static_cast<unsigned long long>(k));
+	size_t rank = k ? m_ranks[k] : n;
+	if(rank == 0)
+		return NULL;
+	rank --;
+
+	const SymbolRange& r = m_ranges[rank];
+	if(addr >= r.end)
+		return NULL;
+	if(offset)
+		*offset = addr - r.start;
+	return m_strtab + r.name;
+}
@@ -0,0 +1,83 @@
+/**
+	@file
+	@brief Declaration of ElfSymbolIndex
+ */
+
+#ifndef ElfSymbolIndex_h
+#define ElfSymbolIndex_h
+
+/**
+	@brief One function's address range within an ElfSymbolIndex
+ */
+struct SymbolRange
+{
+	///@brief First address of the function
+	uint32_t	start;
+
+	///@brief Address just past the end of the function
+	uint32_t	end;
+
+	///@brief Offset of the function name within the name table
+	uint32_t	name;
+};
+
+/**
+	@brief Address to function-symbol lookup table for DSP firmware ELF images
+
+	Function symbols are collapsed into a sorted list of non-overlapping address ranges. The range start addresses are
+	stored in Eytzinger (BFS) order, so a lookup walks the key array from the front: the first few levels of the tree
+	stay hot in L1, the remaining levels can be prefetched ahead of time, and the descent is branch-free.
+
+	The index image has the same layout in memory and on disk. SaveIndex() writes it out as a sidecar file, and
+	LoadIndex() simply mmaps the sidecar back in, so reloading the symbols of a large image costs no parsing, just one
+	pass over the ranges to check the offsets in them.
+
+	Only 32-bit addresses are indexed, since that's all the DSP can generate.
+ */
+class ElfSymbolIndex
+{
+public:
+	ElfSymbolIndex();
+	~ElfSymbolIndex();
+
+	void Load(const std::string& elf_path, const std::string& index_path = "");
+	void LoadElf(const std::string& path);
+	bool LoadIndex(const std::string& path, const std::string& elf_path = "");
+	void SaveIndex(const std::string& path);
+
+	const char* Lookup(uint32_t addr, uint32_t* offset = NULL) const;
+
+	///@brief Returns the number of indexed function ranges
+	size_t GetSymbolCount() const
+	{ return m_count; }
+
+protected:
+	void Clear();
+	void AttachImage(const uint8_t* image, size_t len);
+
+	///@brief Index image built in memory by LoadElf()
+	std::vector<uint8_t> m_image;
+
+	///@brief Mapping of a sidecar loaded by LoadIndex(), or NULL
+	void* m_map;
+
+	///@brief Size of m_map
+	size_t m_maplen;
+
+	///@brief Number of ranges in the index
+	size_t m_count;
+
+	///@brief Range start addresses in Eytzinger order (1-based, m_count+1 entries)
+	const uint32_t* m_keys;
+
+	///@brief Sorted rank of each entry in m_keys
+	const uint32_t* m_ranks;
+
+	///@brief The ranges themselves, in sorted order
+	const SymbolRange* m_ranges;
+
+	///@brief Symbol names
+	const char* m_strtab;
+};
+
+#endif
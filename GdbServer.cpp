@@ -0,0 +1,798 @@
+/**
+	@file
+	@brief Implementation of GdbServer
+ */
+
+#include "jtaghal.h"
+#include <poll.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+///@brief How long to wait between status polls while the target is running, in ms
+#define GDB_RUN_POLL_INTERVAL	1
+
+///@brief How many status polls to wait for the target to halt after a halt request
+#define GDB_HALT_TIMEOUT_POLLS	1000
+
+static const char g_hexDigits[] = "0123456789abcdef";
+
+/**
+	@brief Converts one hex digit, returning -1 if it isn't one
+ */
+static int HexValue(char c)
+{
+	if( (c >= '0') && (c <= '9') )
+		return c - '0';
+	if( (c >= 'a') && (c <= 'f') )
+		return c - 'a' + 10;
+	if( (c >= 'A') && (c <= 'F') )
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+	@brief Appends a 32-bit value as 8 hex digits in target (little endian) byte order
+ */
+static void AppendHexWord(string& out, uint32_t value)
+{
+	for(int i=0; i<4; i++)
+	{
+		uint8_t b = value >> (8*i);
+		out += g_hexDigits[b >> 4];
+		out += g_hexDigits[b & 0xf];
+	}
+}
+
+/**
+	@brief Parses 8 hex digits in target (little endian) byte order
+
+	@return False if there aren't 8 valid digits at pos
+ */
+static bool ParseHexWord(const string& in, size_t pos, uint32_t& value)
+{
+	if(pos + 8 > in.length())
+		return false;
+	value = 0;
+	for(int i=0; i<4; i++)
+	{
+		int hi = HexValue(in[pos + 2*i]);
+		int lo = HexValue(in[pos + 2*i + 1]);
+		if( (hi < 0) || (lo < 0) )
+			return false;
+		value |= static_cast<uint32_t>((hi << 4) | lo) << (8*i);
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+GdbServer::GdbServer(CevaDebugPort* port)
+	: m_port(port)
+	, m_fd(-1)
+	, m_noAck(false)
+	, m_rxpos(0)
+	, m_rxlen(0)
+	, m_disconnected(false)
+	, m_stopSignal(5)
+	, m_regsValid(false)
+{
+	for(int i=0; i<CEVA_BREAKPOINT_COUNT; i++)
+	{
+		m_bpUsed[i] = false;
+		m_bpAddr[i] = 0;
+	}
+}
+
+GdbServer::~GdbServer()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Connection handling
+
+/**
+	@brief Accepts and serves gdb connections, one at a time, forever
+
+	@throw JtagException if accepting fails or the adapter fails
+ */
+void GdbServer::Serve(ServerSocket& sock)
+{
+	while(true)
+	{
+		int fd = sock.Accept();
+		LogNotice("gdb connected\n");
+		ServeClient(fd);
+		close(fd);
+		LogNotice("gdb disconnected\n");
+	}
+}
+
+/**
+	@brief Serves one gdb session until the client detaches or disconnects
+
+	The target is halted on attach, as gdb expects. However the session ends (detach, kill, or the client just going
+	away), our breakpoints are removed and the target is left running.
+
+	@throw JtagException if the adapter fails
+ */
+void GdbServer::ServeClient(int fd)
+{
+	m_fd = fd;
+	m_noAck = false;
+	m_rxpos = 0;
+	m_rxlen = 0;
+	m_lastPacket = "";
+	m_stopSignal = 5;
+	m_disconnected = false;
+
+	m_port->Halt();
+	WaitForHalt();
+	InvalidateCaches();
+
+	string packet;
+	while(ReadPacket(packet))
+	{
+		if(!HandlePacket(packet))
+			break;
+	}
+
+	ClearBreakpoints();
+	m_port->Resume();
+	m_fd = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Packet layer
+
+/**
+	@brief Reads one byte from the client
+
+	@param timeout_ms	How long to wait, or -1 to block
+
+	@return The byte, -1 on timeout, -2 if the client went away
+ */
+int GdbServer::ReadByte(int timeout_ms)
+{
+	if(m_rxpos == m_rxlen)
+	{
+		struct pollfd pfd;
+		pfd.fd = m_fd;
+		pfd.events = POLLIN;
+		int ret = poll(&pfd, 1, timeout_ms);
+		if(ret == 0)
+			return -1;
+		if( (ret < 0) && (errno == EINTR) )
+			return -1;
+
+		ssize_t n = recv(m_fd, m_rxbuf, sizeof(m_rxbuf), 0);
+		if(n <= 0)
+			return -2;
+		m_rxpos = 0;
+		m_rxlen = n;
+	}
+	return m_rxbuf[m_rxpos++];
+}
+
+/**
+	@brief Reads the next packet, handling acks, retransmission and checksums
+
+	@param packet	Payload of the packet (without framing). A lone interrupt byte is returned as "\x03".
+
+	@return False if the client went away
+ */
+bool GdbServer::ReadPacket(string& packet)
+{
+	while(true)
+	{
+		int c = ReadByte(-1);
+		if(c == -2)
+			return false;
+
+		//Acks for our last packet. Only a NAK needs any action.
+		if(c == '+')
+			continue;
+		if(c == '-')
+		{
+			if(!m_lastPacket.empty())
+				ServerSocket::SendAll(m_fd, m_lastPacket.c_str(), m_lastPacket.length());
+			continue;
+		}
+		if(c == 0x03)
+		{
+			packet = "\x03";
+			return true;
+		}
+		if(c != '$')
+			continue;
+
+		//Payload up to the '#', then two checksum digits
+		packet = "";
+		uint8_t sum = 0;
+		while(true)
+		{
+			c = ReadByte(-1);
+			if(c < 0)
+				return false;
+			if(c == '#')
+				break;
+			packet += static_cast<char>(c);
+			sum += c;
+		}
+		int hi = ReadByte(-1);
+		int lo = ReadByte(-1);
+		if( (hi < 0) || (lo < 0) )
+			return false;
+
+		if(m_noAck)
+			return true;
+		if( (HexValue(hi) < 0) || (HexValue(lo) < 0) || ( ((HexValue(hi) << 4) | HexValue(lo)) != sum) )
+		{
+			if(!ServerSocket::SendAll(m_fd, "-", 1))
+				return false;
+			continue;
+		}
+		if(!ServerSocket::SendAll(m_fd, "+", 1))
+			return false;
+		return true;
+	}
+}
+
+/**
+	@brief Frames and sends a packet
+
+	@return False if the client went away
+ */
+bool GdbServer::SendPacket(const string& payload)
+{
+	uint8_t sum = 0;
+	for(size_t i=0; i<payload.length(); i++)
+		sum += payload[i];
+
+	m_lastPacket = "$";
+	m_lastPacket += payload;
+	m_lastPacket += '#';
+	m_lastPacket += g_hexDigits[sum >> 4];
+	m_lastPacket += g_hexDigits[sum & 0xf];
+	return ServerSocket::SendAll(m_fd, m_lastPacket.c_str(), m_lastPacket.length());
+}
+
+/**
+	@brief Checks, without blocking, whether the client has sent an interrupt
+
+	Any other bytes received are left in the buffer for ReadPacket(). If the client has gone away, m_disconnected is
+	set instead.
+ */
+bool GdbServer::PollInterrupt()
+{
+	//Look through what we already have first
+	for(size_t i=m_rxpos; i<m_rxlen; i++)
+	{
+		if(m_rxbuf[i] == 0x03)
+		{
+			memmove(m_rxbuf + i, m_rxbuf + i + 1, m_rxlen - i - 1);
+			m_rxlen --;
+			return true;
+		}
+	}
+
+	//Then top up the buffer if there's anything new
+	if(m_rxpos == m_rxlen)
+	{
+		m_rxpos = 0;
+		m_rxlen = 0;
+	}
+	if(m_rxlen == sizeof(m_rxbuf))
+		return false;
+	ssize_t n = recv(m_fd, m_rxbuf + m_rxlen, sizeof(m_rxbuf) - m_rxlen, MSG_DONTWAIT);
+	if( (n == 0) || ( (n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR) ) )
+	{
+		m_disconnected = true;
+		return false;
+	}
+	if(n < 0)
+		return false;
+	m_rxlen += n;
+	return PollInterrupt();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Command dispatch
+
+/**
+	@brief Executes one packet and sends the reply
+
+	@return False if the session is over
+ */
+bool GdbServer::HandlePacket(const string& packet)
+{
+	string reply;
+
+	try
+	{
+		switch(packet[0])
+		{
+			//Interrupt while already halted: nothing to do
+			case 0x03:
+				return true;
+
+			case '?':
+				reply = GetStopReply();
+				break;
+
+			case 'g':
+				reply = HandleReadRegisters();
+				break;
+
+			case 'G':
+				reply = HandleWriteRegisters(packet);
+				break;
+
+			case 'p':
+				reply = HandleReadRegister(packet);
+				break;
+
+			case 'P':
+				reply = HandleWriteRegister(packet);
+				break;
+
+			case 'm':
+				reply = HandleReadMemory(packet);
+				break;
+
+			case 'M':
+				reply = HandleWriteMemory(packet, false);
+				break;
+
+			case 'X':
+				reply = HandleWriteMemory(packet, true);
+				break;
+
+			case 'Z':
+				reply = HandleBreakpoint(packet, true);
+				break;
+
+			case 'z':
+				reply = HandleBreakpoint(packet, false);
+				break;
+
+			//The client may go away while the target runs, which ends the session
+			case 'c':
+				reply = HandleResume(false);
+				if(m_disconnected)
+					return false;
+				break;
+
+			case 's':
+				reply = HandleResume(true);
+				break;
+
+			//Single thread, so thread selection always succeeds
+			case 'H':
+			case 'T':
+				reply = "OK";
+				break;
+
+			//Detach: ServeClient() leaves the target running without our breakpoints
+			case 'D':
+				SendPacket("OK");
+				return false;
+
+			//Kill: nothing to kill, just end the session (the same way as a detach)
+			case 'k':
+				return false;
+
+			case 'q':
+				if(packet.compare(0, 10, "qSupported") == 0)
+					reply = "PacketSize=4000;QStartNoAckMode+;hwbreak+";
+				else if(packet == "qAttached")
+					reply = "1";
+				else if(packet == "qC")
+					reply = "QC1";
+				else if(packet == "qfThreadInfo")
+					reply = "m1";
+				else if(packet == "qsThreadInfo")
+					reply = "l";
+				break;
+
+			case 'Q':
+				if(packet == "QStartNoAckMode")
+				{
+					SendPacket("OK");
+					m_noAck = true;
+					return true;
+				}
+				break;
+
+			//Anything else is unsupported, which is signalled by an empty reply
+			default:
+				break;
+		}
+	}
+	catch(const JtagException& ex)
+	{
+		LogWarning("%s", ex.GetDescription().c_str());
+		reply = "E01";
+	}
+
+	return SendPacket(reply);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Registers
+
+/**
+	@brief g: all registers, in index order
+ */
+string GdbServer::HandleReadRegisters()
+{
+	FetchRegisters();
+
+	string reply;
+	for(int i=0; i<CEVA_REG_COUNT; i++)
+		AppendHexWord(reply, m_regs[i]);
+	return reply;
+}
+
+/**
+	@brief G: write all registers, in index order
+ */
+string GdbServer::HandleWriteRegisters(const string& packet)
+{
+	uint32_t regs[CEVA_REG_COUNT];
+	for(int i=0; i<CEVA_REG_COUNT; i++)
+	{
+		if(!ParseHexWord(packet, 1 + 8*i, regs[i]))
+			return "E01";
+	}
+
+	m_port->WriteRegisters(0, regs, CEVA_REG_COUNT);
+	memcpy(m_regs, regs, sizeof(regs));
+	m_regsValid = true;
+	return "OK";
+}
+
+/**
+	@brief p n: read one register
+ */
+string GdbServer::HandleReadRegister(const string& packet)
+{
+	unsigned long n = strtoul(packet.c_str() + 1, NULL, 16);
+	if(n >= CEVA_REG_COUNT)
+		return "E01";
+
+	FetchRegisters();
+
+	string reply;
+	AppendHexWord(reply, m_regs[n]);
+	return reply;
+}
+
+/**
+	@brief P n=v: write one register
+ */
+string GdbServer::HandleWriteRegister(const string& packet)
+{
+	size_t eq = packet.find('=');
+	unsigned long n = strtoul(packet.c_str() + 1, NULL, 16);
+	uint32_t value;
+	if( (eq == string::npos) || (n >= CEVA_REG_COUNT) || !ParseHexWord(packet, eq+1, value) )
+		return "E01";
+
+	m_port->WriteRegisters(n, &value, 1);
+	m_regs[n] = value;
+	return "OK";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory
+
+/**
+	@brief m addr,len: read memory
+ */
+string GdbServer::HandleReadMemory(const string& packet)
+{
+	char* end;
+	uint32_t addr = strtoul(packet.c_str() + 1, &end, 16);
+	if(*end != ',')
+		return "E01";
+	size_t len = strtoul(end + 1, NULL, 16);
+
+	//Reply is two hex digits per byte and must fit in PacketSize
+	if(len > 0x2000)
+		len = 0x2000;
+
+	//The line cache works on 32-bit addresses, so a read can't wrap past the top of memory
+	if(static_cast<uint64_t>(addr) + len > 0x100000000ULL)
+		return "E01";
+
+	vector<uint8_t> data(len);
+	if(len)
+		ReadMemoryCached(addr, &data[0], len);
+
+	string reply;
+	reply.reserve(2*len);
+	for(size_t i=0; i<len; i++)
+	{
+		reply += g_hexDigits[data[i] >> 4];
+		reply += g_hexDigits[data[i] & 0xf];
+	}
+	return reply;
+}
+
+/**
+	@brief M addr,len:hex or X addr,len:binary: write memory
+ */
+string GdbServer::HandleWriteMemory(const string& packet, bool binary)
+{
+	char* end;
+	uint32_t addr = strtoul(packet.c_str() + 1, &end, 16);
+	if(*end != ',')
+		return "E01";
+	size_t len = strtoul(end + 1, &end, 16);
+	if(*end != ':')
+		return "E01";
+	size_t pos = end + 1 - packet.c_str();
+
+	vector<uint8_t> data;
+	data.reserve(len);
+	if(binary)
+	{
+		//'}' escapes the next byte, XORed with 0x20
+		for(size_t i=pos; (i < packet.length()) && (data.size() < len); i++)
+		{
+			uint8_t c = packet[i];
+			if( (c == '}') && (i+1 < packet.length()) )
+				c = packet[++i] ^ 0x20;
+			data.push_back(c);
+		}
+	}
+	else
+	{
+		for(size_t i=pos; (i+1 < packet.length()) && (data.size() < len); i += 2)
+		{
+			int hi = HexValue(packet[i]);
+			int lo = HexValue(packet[i+1]);
+			if( (hi < 0) || (lo < 0) )
+				return "E01";
+			data.push_back( (hi << 4) | lo);
+		}
+	}
+	if(data.size() != len)
+		return "E01";
+	if(static_cast<uint64_t>(addr) + len > 0x100000000ULL)
+		return "E01";
+
+	if(len)
+		WriteMemory(addr, &data[0], len);
+	return "OK";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Breakpoints
+
+/**
+	@brief Z/z type,addr,kind: insert or remove a breakpoint
+
+	Software (type 0) and hardware (type 1) breakpoints both use the comparators. Watchpoints are unsupported.
+ */
+string GdbServer::HandleBreakpoint(const string& packet, bool insert)
+{
+	if( (packet.length() < 4) || ( (packet[1] != '0') && (packet[1] != '1') ) || (packet[2] != ',') )
+		return "";
+	uint32_t addr = strtoul(packet.c_str() + 3, NULL, 16);
+
+	//Look for an existing comparator on this address, and a free one while we're at it
+	int match = -1;
+	int free_slot = -1;
+	for(int i=0; i<CEVA_BREAKPOINT_COUNT; i++)
+	{
+		if(m_bpUsed[i] && (m_bpAddr[i] == addr))
+			match = i;
+		else if(!m_bpUsed[i] && (free_slot < 0))
+			free_slot = i;
+	}
+
+	if(insert)
+	{
+		if(match >= 0)
+			return "OK";
+		if(free_slot < 0)
+			return "E0c";
+		m_port->SetBreakpoint(free_slot, addr);
+		m_bpUsed[free_slot] = true;
+		m_bpAddr[free_slot] = addr;
+	}
+	else if(match >= 0)
+	{
+		m_port->ClearBreakpoint(match);
+		m_bpUsed[match] = false;
+	}
+	return "OK";
+}
+
+/**
+	@brief Removes all of our breakpoints from the target
+ */
+void GdbServer::ClearBreakpoints()
+{
+	for(int i=0; i<CEVA_BREAKPOINT_COUNT; i++)
+	{
+		if(m_bpUsed[i])
+			m_port->ClearBreakpoint(i);
+		m_bpUsed[i] = false;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Run control
+
+/**
+	@brief c / s: resume or step, and wait for the target to stop again
+
+	Resuming at a different address isn't supported; gdb writes the PC with P first instead.
+ */
+string GdbServer::HandleResume(bool step)
+{
+	InvalidateCaches();
+
+	if(step)
+	{
+		m_port->Step();
+		WaitForHalt();
+		m_stopSignal = 5;
+		return GetStopReply();
+	}
+
+	m_port->Resume();
+	m_stopSignal = 5;
+	while(!m_port->IsHalted())
+	{
+		//Nobody left to report the stop to: detach, leaving the target running
+		if(m_disconnected)
+		{
+			LogNotice("gdb went away while the target was running, detaching\n");
+			return "";
+		}
+
+		if(PollInterrupt())
+		{
+			m_port->Halt();
+			m_stopSignal = 2;
+		}
+		else
+			usleep(GDB_RUN_POLL_INTERVAL * 1000);
+	}
+	return GetStopReply();
+}
+
+/**
+	@brief Waits (within reason) for the target to halt after a halt request or a step
+ */
+void GdbServer::WaitForHalt()
+{
+	for(int i=0; (i < GDB_HALT_TIMEOUT_POLLS) && !m_port->IsHalted(); i++)
+		usleep(1000);
+}
+
+/**
+	@brief Builds the stop reply for the current halt
+ */
+string GdbServer::GetStopReply()
+{
+	char reply[32];
+	if( (m_stopSignal == 5) && (m_port->GetStatus() & CEVA_STATUS_BP_HIT) )
+		snprintf(reply, sizeof(reply), "T%02xhwbreak:;", m_stopSignal);
+	else
+		snprintf(reply, sizeof(reply), "S%02x", m_stopSignal);
+	return reply;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Target state caching
+
+/**
+	@brief Forgets everything cached about the target. Called whenever it may have run.
+ */
+void GdbServer::InvalidateCaches()
+{
+	m_regsValid = false;
+	m_memCache.clear();
+}
+
+/**
+	@brief Makes sure m_regs is up to date, fetching the whole register file in one block if not
+ */
+void GdbServer::FetchRegisters()
+{
+	if(m_regsValid)
+		return;
+	m_port->ReadRegisters(0, m_regs, CEVA_REG_COUNT);
+	m_regsValid = true;
+}
+
+/**
+	@brief Reads target memory through the line cache
+
+	Runs of consecutive missing lines are fetched with a single block read.
+ */
+void GdbServer::ReadMemoryCached(uint32_t addr, uint8_t* data, size_t len)
+{
+	const uint32_t line_bytes = GDB_CACHE_LINE_WORDS * 4;
+	uint32_t first = addr / line_bytes;
+	uint32_t last = (addr + len - 1) / line_bytes;
+
+	if(m_memCache.size() + (last - first + 1) > GDB_CACHE_MAX_LINES)
+		m_memCache.clear();
+
+	//Fill in the holes
+	for(uint32_t line = first; line <= last; )
+	{
+		if(m_memCache.find(line) != m_memCache.end())
+		{
+			line ++;
+			continue;
+		}
+
+		uint32_t run_end = line + 1;
+		while( (run_end <= last) && (m_memCache.find(run_end) == m_memCache.end()) )
+			run_end ++;
+
+		size_t nlines = run_end - line;
+		vector<uint32_t> words(nlines * GDB_CACHE_LINE_WORDS);
+		m_port->ReadMemory(line * line_bytes, &words[0], words.size());
+		for(size_t i=0; i<nlines; i++)
+			memcpy(m_memCache[line + i].words, &words[i * GDB_CACHE_LINE_WORDS], line_bytes);
+
+		line = run_end;
+	}
+
+	//Then copy out
+	for(size_t i=0; i<len; i++)
+	{
+		uint32_t a = addr + i;
+		const GdbCacheLine& l = m_memCache[a / line_bytes];
+		data[i] = l.words[(a / 4) % GDB_CACHE_LINE_WORDS] >> (8 * (a & 3));
+	}
+}
+
+/**
+	@brief Writes target memory and updates the cache
+
+	The port only does word accesses, so partial words at either end are merged with the current contents first.
+ */
+void GdbServer::WriteMemory(uint32_t addr, const uint8_t* data, size_t len)
+{
+	uint32_t start = addr & ~3;
+	uint32_t end = (addr + len + 3) & ~3;
+	vector<uint32_t> words( (end - start) / 4);
+
+	//Existing contents, for the partial words (cheap if gdb just read this area, which it usually has)
+	if( (start != addr) || (end != addr + len) )
+	{
+		vector<uint8_t> current(end - start);
+		ReadMemoryCached(start, &current[0], current.size());
+		for(size_t i=0; i<current.size(); i++)
+			words[i/4] |= static_cast<uint32_t>(current[i]) << (8 * (i & 3));
+	}
+
+	for(size_t i=0; i<len; i++)
+	{
+		uint32_t off = addr + i - start;
+		words[off/4] &= ~(0xffu << (8 * (off & 3)));
+		words[off/4] |= static_cast<uint32_t>(data[i]) << (8 * (off & 3));
+	}
+
+	m_port->WriteMemory(start, &words[0], words.size());
+
+	//Keep any cached copy coherent
+	const uint32_t line_bytes = GDB_CACHE_LINE_WORDS * 4;
+	for(size_t i=0; i<words.size(); i++)
+	{
+		uint32_t a = start + 4*i;
+		map<uint32_t, GdbCacheLine>::iterator it = m_memCache.find(a / line_bytes);
+		if(it != m_memCache.end())
+			it->second.words[(a / 4) % GDB_CACHE_LINE_WORDS] = words[i];
+	}
+}
@@ -0,0 +1,118 @@
+/**
+	@file
+	@brief Declaration of GdbServer
+ */
+
+#ifndef GdbServer_h
+#define GdbServer_h
+
+///@brief Size of a GdbServer memory cache line, in 32-bit words
+#define GDB_CACHE_LINE_WORDS	16
+
+///@brief Maximum number of cached lines before the cache is flushed
+#define GDB_CACHE_MAX_LINES		16384
+
+/**
+	@brief One line of target memory cached by GdbServer
+ */
+struct GdbCacheLine
+{
+	uint32_t words[GDB_CACHE_LINE_WORDS];
+};
+
+/**
+	@brief GDB remote serial protocol server for the CEVA DSP
+
+	Serves one gdb connection at a time. Supports register read/write (g/G/p/P), memory read/write (m/M/X), hardware
+	breakpoints (Z0/Z1, both backed by the comparators since we don't know a software breakpoint opcode), continue,
+	single step, interrupt (^C) and no-ack mode.
+
+	Every scan costs tens of microseconds over the bit-banged link, so the server avoids them where it can:
+
+	\li Registers are fetched all at once in a single block transfer the first time any of them is needed after a halt,
+		and served from that copy until the target runs again.
+	\li Memory is cached in lines of GDB_CACHE_LINE_WORDS words between halts. Consecutive missing lines are
+		fetched as a single block, so gdb's habit of issuing many small reads around the stack and PC costs one
+		transfer instead of dozens. Writes go straight through to the target and update the cache.
+ */
+class GdbServer
+{
+public:
+	GdbServer(CevaDebugPort* port);
+	virtual ~GdbServer();
+
+	void Serve(ServerSocket& sock);
+	void ServeClient(int fd);
+
+protected:
+
+	//Packet layer
+	int ReadByte(int timeout_ms);
+	bool ReadPacket(std::string& packet);
+	bool SendPacket(const std::string& payload);
+	bool PollInterrupt();
+
+	//Command handlers
+	bool HandlePacket(const std::string& packet);
+	std::string HandleReadRegisters();
+	std::string HandleWriteRegisters(const std::string& packet);
+	std::string HandleReadRegister(const std::string& packet);
+	std::string HandleWriteRegister(const std::string& packet);
+	std::string HandleReadMemory(const std::string& packet);
+	std::string HandleWriteMemory(const std::string& packet, bool binary);
+	std::string HandleBreakpoint(const std::string& packet, bool insert);
+	void ClearBreakpoints();
+	std::string HandleResume(bool step);
+	void WaitForHalt();
+	std::string GetStopReply();
+
+	//Target state caching
+	void InvalidateCaches();
+	void FetchRegisters();
+	void ReadMemoryCached(uint32_t addr, uint8_t* data, size_t len);
+	void WriteMemory(uint32_t addr, const uint8_t* data, size_t len);
+
+	///@brief The target
+	CevaDebugPort* m_port;
+
+	///@brief Socket of the current client
+	int m_fd;
+
+	///@brief True once the client has switched off acknowledgements
+	bool m_noAck;
+
+	///@brief Last packet sent, for retransmission on NAK
+	std::string m_lastPacket;
+
+	///@brief Receive buffer
+	uint8_t m_rxbuf[4096];
+
+	///@brief Read position within m_rxbuf
+	size_t m_rxpos;
+
+	///@brief Number of valid bytes in m_rxbuf
+	size_t m_rxlen;
+
+	///@brief Set by PollInterrupt() when the client goes away while the target is running
+	bool m_disconnected;
+
+	///@brief Signal to report in the next stop reply
+	int m_stopSignal;
+
+	///@brief True if m_regs is up to date
+	bool m_regsValid;
+
+	///@brief Cached register file
+	uint32_t m_regs[CEVA_REG_COUNT];
+
+	///@brief Cached memory, indexed by line number
+	std::map<uint32_t, GdbCacheLine> m_memCache;
+
+	///@brief True if the breakpoint slot is in use
+	bool m_bpUsed[CEVA_BREAKPOINT_COUNT];
+
+	///@brief Address of each breakpoint slot
+	uint32_t m_bpAddr[CEVA_BREAKPOINT_COUNT];
+};
+
+#endif
@@ -0,0 +1,239 @@
+/**
+	@file
+	@brief Implementation of JtagAsyncEngine and JtagFuture
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// JtagFuture
+
+/**
+	@brief Creates a future that refers to nothing
+ */
+JtagFuture::JtagFuture()
+{
+}
+
+JtagFuture::JtagFuture(const shared_ptr<JtagAsyncState>& state)
+	: m_state(state)
+{
+}
+
+/**
+	@brief Checks if the operation has run, without blocking
+ */
+bool JtagFuture::IsReady() const
+{
+	if(!m_state)
+		return false;
+	lock_guard<mutex> lock(m_state->mutex);
+	return m_state->done;
+}
+
+/**
+	@brief Waits for the operation to run
+
+	@throw JtagException if the operation failed, or if the future refers to nothing
+ */
+void JtagFuture::Wait() const
+{
+	if(!m_state)
+	{
+		throw JtagExceptionWrapper(
+			"Waiting on an empty future",
+			"");
+	}
+
+	exception_ptr error;
+	{
+		unique_lock<mutex> lock(m_state->mutex);
+		while(!m_state->done)
+			m_state->completed.wait(lock);
+		error = m_state->error;
+	}
+	if(error)
+		rethrow_exception(error);
+}
+
+/**
+	@brief Calls a function once the operation has run
+
+	The callback runs on the worker thread, or immediately on this one if the operation has already run.
+ */
+void JtagFuture::Then(const function<void()>& callback) const
+{
+	if(!Subscribe(callback))
+		callback();
+}
+
+/**
+	@brief Registers a function to be called on the worker thread once the operation has run
+
+	@return False (and the callback is not registered) if the operation has already run
+ */
+bool JtagFuture::Subscribe(const function<void()>& callback) const
+{
+	if(!m_state)
+	{
+		throw JtagExceptionWrapper(
+			"Subscribing to an empty future",
+			"");
+	}
+
+	lock_guard<mutex> lock(m_state->mutex);
+	if(m_state->done)
+		return false;
+	m_state->callbacks.push_back(callback);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+JtagAsyncEngine::JtagAsyncEngine()
+	: m_busy(false)
+	, m_stop(false)
+{
+}
+
+/**
+	@brief Stops the worker. Operations that haven't started yet fail.
+
+	The adapter must still be alive, since the worker may be in the middle of an operation.
+ */
+JtagAsyncEngine::~JtagAsyncEngine()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	if(m_worker.joinable())
+		m_worker.join();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Queueing
+
+/**
+	@brief Queues an operation behind everything submitted before it
+
+	@param operation	Runs on the worker thread. An exception thrown from it fails the future.
+
+	@return The operation's completion token
+ */
+JtagFuture JtagAsyncEngine::Submit(const function<void()>& operation)
+{
+	Operation op;
+	op.run = operation;
+	op.state = make_shared<JtagAsyncState>();
+	JtagFuture future(op.state);
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if(!m_worker.joinable())
+			m_worker = thread(&JtagAsyncEngine::WorkerThread, this);
+		m_queue.push_back(op);
+	}
+	m_wake.notify_one();
+	return future;
+}
+
+/**
+	@brief Waits until every queued operation has run
+
+	Does nothing when called from the worker itself (from an operation or a completion callback), which is already
+	past everything queued before it.
+ */
+void JtagAsyncEngine::Flush()
+{
+	if(IsWorkerThread())
+		return;
+
+	unique_lock<mutex> lock(m_mutex);
+	while(m_busy || !m_queue.empty())
+		m_idle.wait(lock);
+}
+
+/**
+	@brief Checks if the caller is the worker thread
+ */
+bool JtagAsyncEngine::IsWorkerThread() const
+{
+	return this_thread::get_id() == m_worker.get_id();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Execution
+
+/**
+	@brief Runs operations until the engine shuts down
+ */
+void JtagAsyncEngine::WorkerThread()
+{
+	unique_lock<mutex> lock(m_mutex);
+	while(true)
+	{
+		while(!m_stop && m_queue.empty())
+			m_wake.wait(lock);
+
+		//Whatever is left when we're told to stop never gets to the adapter
+		if(m_stop)
+		{
+			while(!m_queue.empty())
+			{
+				Operation op = m_queue.front();
+				m_queue.pop_front();
+				lock.unlock();
+				Complete(*op.state, make_exception_ptr(JtagExceptionWrapper(
+					"Adapter closed before the operation ran",
+					"")));
+				lock.lock();
+			}
+			m_idle.notify_all();
+			return;
+		}
+
+		Operation op = m_queue.front();
+		m_queue.pop_front();
+		m_busy = true;
+		lock.unlock();
+
+		exception_ptr error;
+		try
+		{
+			op.run();
+		}
+		catch(...)
+		{
+			error = current_exception();
+		}
+		Complete(*op.state, error);
+
+		lock.lock();
+		m_busy = false;
+		if(m_queue.empty())
+			m_idle.notify_all();
+	}
+}
+
+/**
+	@brief Marks an operation done, wakes anyone waiting for it and runs its callbacks
+ */
+void JtagAsyncEngine::Complete(JtagAsyncState& state, exception_ptr error)
+{
+	vector< function<void()> > callbacks;
+	{
+		lock_guard<mutex> lock(state.mutex);
+		state.done = true;
+		state.error = error;
+		callbacks.swap(state.callbacks);
+	}
+	state.completed.notify_all();
+
+	for(size_t i=0; i<callbacks.size(); i++)
+		callbacks[i]();
+}
@@ -0,0 +1,150 @@
+/**
+	@file
+	@brief Declaration of JtagAsyncEngine and JtagFuture
+ */
+
+#ifndef JtagAsyncEngine_h
+#define JtagAsyncEngine_h
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+/**
+	@brief Shared state of one operation queued on a JtagAsyncEngine
+ */
+struct JtagAsyncState
+{
+	JtagAsyncState()
+		: done(false)
+	{}
+
+	///@brief Protects everything below
+	std::mutex mutex;
+
+	///@brief Signalled when the operation completes
+	std::condition_variable completed;
+
+	///@brief True once the operation has run (successfully or not)
+	bool done;
+
+	///@brief What the operation threw, if anything
+	std::exception_ptr error;
+
+	///@brief Called on the worker thread when the operation completes. They must not throw.
+	std::vector< std::function<void()> > callbacks;
+};
+
+/**
+	@brief Completion token for an asynchronous JtagInterface operation
+
+	Three ways to consume it:
+
+	\li Blocking: Wait() returns once the operation has run, and rethrows the JtagException if it failed.
+	\li Callbacks: Then() registers a function called on the worker thread as soon as the operation completes (or
+		right away, on the calling thread, if it already has). Call Wait() from the callback to collect the outcome;
+		it won't block.
+	\li C++20 coroutines: co_await the future. The coroutine resumes on the worker thread once the operation has run,
+		and the co_await expression rethrows if it failed.
+
+	Futures are cheap to copy; all copies refer to the same operation.
+ */
+class JtagFuture
+{
+public:
+	JtagFuture();
+	explicit JtagFuture(const std::shared_ptr<JtagAsyncState>& state);
+
+	///@brief Returns true if the future refers to an operation
+	bool IsValid() const
+	{ return m_state ? true : false; }
+
+	bool IsReady() const;
+	void Wait() const;
+	void Then(const std::function<void()>& callback) const;
+	bool Subscribe(const std::function<void()>& callback) const;
+
+#if defined(__cpp_impl_coroutine)
+	bool await_ready() const
+	{ return IsReady(); }
+
+	bool await_suspend(std::coroutine_handle<> handle) const
+	{ return Subscribe([handle]() { handle.resume(); }); }
+
+	void await_resume() const
+	{ Wait(); }
+#endif
+
+protected:
+	///@brief The operation
+	std::shared_ptr<JtagAsyncState> m_state;
+};
+
+/**
+	@brief Runs queued operations on an adapter from a worker thread, in submission order
+
+	This is the execution engine behind JtagInterface::ScanDRAsync() and friends. Operations are closures calling the
+	ordinary synchronous register-level functions, so they behave exactly as if the caller had made the calls itself,
+	just later and on another thread. The worker is started on the first Submit().
+
+	The adapter is not thread safe, so while anything is queued the submitting thread must leave it alone; the
+	synchronous register-level calls take care of that by calling Flush() first.
+ */
+class JtagAsyncEngine
+{
+public:
+	JtagAsyncEngine();
+	virtual ~JtagAsyncEngine();
+
+	JtagFuture Submit(const std::function<void()>& operation);
+	void Flush();
+
+	bool IsWorkerThread() const;
+
+protected:
+	void WorkerThread();
+
+	/**
+		@brief One queued operation
+	 */
+	struct Operation
+	{
+		///@brief What to run
+		std::function<void()> run;
+
+		///@brief Where to report completion
+		std::shared_ptr<JtagAsyncState> state;
+	};
+
+	static void Complete(JtagAsyncState& state, std::exception_ptr error);
+
+	///@brief The worker
+	std::thread m_worker;
+
+	///@brief Protects m_queue, m_busy and m_stop
+	std::mutex m_mutex;
+
+	///@brief Signalled when work arrives or the engine shuts down
+	std::condition_variable m_wake;
+
+	///@brief Signalled when the queue drains
+	std::condition_variable m_idle;
+
+	///@brief Operations not started yet, oldest first
+	std::deque<Operation> m_queue;
+
+	///@brief True while the worker is running an operation
+	bool m_busy;
+
+	///@brief Set to make the worker exit
+	bool m_stop;
+};
+
+#endif
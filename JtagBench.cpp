@@ -0,0 +1,1160 @@
+/**
+	@file
+	@brief jtag-bench: benchmarks every layer of the stack, from register access up to chain initialization
+ */
+
+#include "jtaghal.h"
+#include "devmem.h"
+#include <elf.h>
+
+using namespace std;
+
+/*
+ * One benchmark result: mean and 95% confidence interval half-width over a number of samples
+ */
+struct BenchResult
+{
+    string name;
+    string unit;
+    double mean;
+    double ci;
+    size_t samples;
+};
+
+/*
+ * Settings shared by all benchmarks
+ */
+struct BenchConfig
+{
+    //Samples per benchmark
+    size_t samples;
+
+    //Minimum duration of one sample, in seconds
+    double min_sample;
+
+    //Only run benchmarks whose name contains this
+    string filter;
+};
+
+static BenchConfig g_config;
+static vector<BenchResult> g_results;
+
+/*
+ * Two-sided 95% Student t quantiles, by degrees of freedom
+ */
+static double TQuantile95(size_t df)
+{
+    static const double t[] =
+    {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if(df < sizeof(t) / sizeof(t[0]))
+        return t[df];
+    return 1.960;
+}
+
+/*
+ * Rates are better when higher, everything else (times) when lower
+ */
+static bool HigherIsBetter(const string& unit)
+{
+    return (unit.size() > 2) && (unit.compare(unit.size() - 2, 2, "/s") == 0);
+}
+
+/*
+ * Runs a benchmark and records its result.
+ *
+ * batch() performs ops_per_batch operations. Batches are repeated until a sample lasts at least min_sample, and
+ * each sample is reported either as ns per operation, or (if unit is a rate) as operations per second.
+ */
+static void Bench(const string& name, const string& unit, double ops_per_batch, const function<void()>& batch)
+{
+    if(!g_config.filter.empty() && (name.find(g_config.filter) == string::npos))
+        return;
+
+    //Warm up, and find out how many batches make up a sample
+    uint64_t start = GetTimeNs();
+    batch();
+    double once = (GetTimeNs() - start) * 1e-9;
+    size_t batches = 1;
+    if(once < g_config.min_sample)
+        batches = static_cast<size_t>(g_config.min_sample / max(once, 1e-9)) + 1;
+
+    vector<double> values;
+    for(size_t s = 0; s < g_config.samples; s++)
+    {
+        start = GetTimeNs();
+        for(size_t b = 0; b < batches; b++)
+            batch();
+        double per_op = (GetTimeNs() - start) * 1e-9 / (batches * ops_per_batch);
+        values.push_back(HigherIsBetter(unit) ? (1 / per_op) : (per_op * 1e9));
+    }
+
+    double sum = 0;
+    for(size_t i = 0; i < values.size(); i++)
+        sum += values[i];
+    double mean = sum / values.size();
+    double var = 0;
+    for(size_t i = 0; i < values.size(); i++)
+        var += (values[i] - mean) * (values[i] - mean);
+    double sd = (values.size() > 1) ? sqrt(var / (values.size() - 1)) : 0;
+
+    BenchResult r;
+    r.name = name;
+    r.unit = unit;
+    r.mean = mean;
+    r.ci = TQuantile95(values.size() - 1) * sd / sqrt(values.size());
+    r.samples = values.size();
+    g_results.push_back(r);
+
+    printf("%-28s %14.4g %-7s +/- %.2g (%.1f%%)\n", name.c_str(), r.mean, unit.c_str(), r.ci,
+        (mean != 0) ? (100 * r.ci / mean) : 0.0);
+    fflush(stdout);
+}
+
+/*
+ * Register access: the cost of one read or write of the control register, and of devmem's map / access / unmap
+ */
+static void BenchRegister(SprdJtagRegisterModel* model, SprdMmioDJtagInterface* iface)
+{
+    volatile uint32_t sink = 0;
+    if(model)
+    {
+        Bench("reg_read", "ns", 1000, [&]()
+        {
+            for(int i = 0; i < 1000; i++)
+                sink = model->Read();
+        });
+        uint32_t value = model->Read() & ~(SprdJtagProfileSc8810::tdo | SprdJtagProfileSc8810::rtck);
+        Bench("reg_write", "ns", 1000, [&]()
+        {
+            for(int i = 0; i < 1000; i++)
+                model->Write(value);
+        });
+        return;
+    }
+
+    volatile uint32_t* reg = iface->GetRegister();
+    Bench("reg_read", "ns", 1000, [&]()
+    {
+        for(int i = 0; i < 1000; i++)
+            sink = *reg;
+    });
+    uint32_t value = *reg;
+    Bench("reg_write", "ns", 1000, [&]()
+    {
+        for(int i = 0; i < 1000; i++)
+            *reg = value;
+    });
+    Bench("devmem_readl", "ns", 10, [&]()
+    {
+        for(int i = 0; i < 10; i++)
+            sink = devmem_readl(iface->GetLayout().address);
+    });
+}
+
+/*
+ * Wire level: raw TCK edges, ShiftData() throughput at a range of widths, and TMS transitions
+ */
+static void BenchWire(JtagInterface* iface)
+{
+    iface->ResetToIdle();
+    Bench("edge_rate", "edge/s", 2 * 4096, [&]()
+    {
+        iface->SendDummyClocks(4096);
+    });
+
+    //Stay in Shift-DR the whole time; the bits just go round the DR
+    static const size_t widths[] = {1, 8, 32, 256, 4096, 65536, 1024 * 1024};
+    vector<unsigned char> tdi(1024 * 1024 / 8, 0x5a);
+    vector<unsigned char> tdo(tdi.size());
+    iface->EnterShiftDR();
+    for(size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++)
+    {
+        size_t width = widths[i];
+        char name[32];
+        snprintf(name, sizeof(name), "shift_data_%zu", width);
+        Bench(name, "bit/s", width, [&]()
+        {
+            iface->ShiftData(false, &tdi[0], &tdo[0], width);
+        });
+    }
+    iface->ShiftData(true, &tdi[0], NULL, 1);
+    iface->LeaveExit1DR();
+
+    Bench("tms_dr_roundtrip", "ns", 1, [&]()
+    {
+        iface->EnterShiftDR();
+        iface->ShiftData(true, &tdi[0], NULL, 1);
+        iface->LeaveExit1DR();
+    });
+    Bench("reset_to_idle", "ns", 1, [&]()
+    {
+        iface->ResetToIdle();
+    });
+}
+
+/*
+ * Register level: SetIR() / ScanDR() latency, and chain initialization
+ */
+static void BenchRegisterLevel(JtagInterface* iface)
+{
+    Bench("initialize_chain", "ns", 1, [&]()
+    {
+        iface->InitializeChain(true);
+    });
+
+    unsigned char ir[4] = {0, 0, 0, 0xfe};     //IDCODE
+    unsigned char dr[4] = {0};
+    unsigned char out[4];
+    Bench("set_ir", "ns", 1, [&]()
+    {
+        iface->SetIR(0, ir, 32);
+    });
+    Bench("scan_dr_32", "ns", 1, [&]()
+    {
+        iface->ScanDR(0, dr, out, 32);
+    });
+}
+
+/*
+ * Several control blocks at once (register model only): DR scans queued on each interface's asynchronous worker,
+ * for one block and then for two side by side
+ */
+static void BenchInstances()
+{
+    const size_t scans = 256;
+    SprdJtagRegisterModel models[2];
+    SprdMmioDJtagInterface* ifaces[2];
+    vector<unsigned char> out[2];
+    unsigned char ir[4] = {0, 0, 0, 0xfe};     //IDCODE
+    unsigned char dr[4] = {0};
+    for(int i = 0; i < 2; i++)
+    {
+        ifaces[i] = new SprdMmioDJtagInterface(&models[i]);
+        ifaces[i]->InitializeChain(true);
+        ifaces[i]->SetIR(0, ir, 32);
+        out[i].resize(4 * scans);
+    }
+
+    for(int n = 1; n <= 2; n++)
+    {
+        Bench((n == 1) ? "scan_dr_async_1x" : "scan_dr_async_2x", "scan/s", n * scans, [&]()
+        {
+            for(int i = 0; i < n; i++)
+            {
+                for(size_t j = 0; j < scans; j++)
+                    ifaces[i]->ScanDRAsync(0, dr, &out[i][4*j], 32);
+            }
+            for(int i = 0; i < n; i++)
+                ifaces[i]->FlushAsync();
+        });
+    }
+
+    for(int i = 0; i < 2; i++)
+        delete ifaces[i];
+}
+
+/*
+ * SoC profiles (register model only): the same block driven through kernels instantiated without RTCK, to show what
+ * pacing TCK on the returned clock costs per edge
+ */
+static void BenchProfiles()
+{
+    typedef SprdJtagProfile<SprdJtagProfileSc8810::address, 8, 4, 3, 2, 1, -1> NoRtck;
+    static const SprdJtagProfileEntry profile = SprdJtagProfileEntry::Make<NoRtck>("no_rtck", "SC8810 without RTCK");
+
+    SprdJtagRegisterModel model;
+    SprdMmioDJtagInterface iface(&model, profile);
+    iface.ResetToIdle();
+    Bench("edge_rate_no_rtck", "edge/s", 2 * 4096, [&]()
+    {
+        iface.SendDummyClocks(4096);
+    });
+
+    vector<unsigned char> tdi(4096 / 8, 0x5a);
+    vector<unsigned char> tdo(tdi.size());
+    iface.EnterShiftDR();
+    Bench("shift_data_4096_no_rtck", "bit/s", 4096, [&]()
+    {
+        iface.ShiftData(false, &tdi[0], &tdo[0], 4096);
+    });
+    iface.ShiftData(true, &tdi[0], NULL, 1);
+    iface.LeaveExit1DR();
+}
+
+/*
+ * Runs one detection benchmark: how long the driver takes to notice a fault that should make op() throw
+ */
+static void BenchDetection(const string& name, SprdJtagRegisterModel* model, JtagInterface* iface,
+    const SprdJtagFaults& faults, const function<void()>& op)
+{
+    Bench(name, "ns", 1, [&]()
+    {
+        model->SetFaults(faults);
+        bool detected = false;
+        try
+        {
+            op();
+        }
+        catch(const JtagException&)
+        {
+            detected = true;
+        }
+        model->ClearFaults();
+        iface->ResetToIdle();
+        if(!detected)
+        {
+            throw JtagExceptionWrapper(
+                name + ": fault not detected",
+                "");
+        }
+    });
+}
+
+/*
+ * Fault injection (register model only): what integrity checking costs with nothing going wrong, how long each
+ * fault takes to detect, and block read goodput while retrying through random faults, with any corruption that
+ * still got through (a lost TCK edge that skips Update-DR leaves the shift path intact, so the pattern can't see it)
+ */
+static void BenchFaults(SprdJtagRegisterModel* model, JtagInterface* iface)
+{
+    //Known memory to read back
+    const size_t words = CEVA_TRANSACTION_WORDS;
+    for(size_t i = 0; i < words; i++)
+        model->GetModel().PokeMemory(0x1000 + 4*i, i * 0x9e3779b9);
+    vector<uint32_t> buf(words);
+
+    iface->InitializeChain(true);
+    CevaDebugPort port(iface);
+    port.Halt();
+    Bench("read_memory", "word/s", words, [&]()
+    {
+        port.ReadMemory(0x1000, &buf[0], words);
+    });
+    iface->EnableScanIntegrity();
+    Bench("read_memory_checked", "word/s", words, [&]()
+    {
+        port.ReadMemory(0x1000, &buf[0], words);
+    });
+
+    //The chain fault messages are expected here
+    int level = g_jtagLogLevel;
+    JtagLogger::SetLevel(JTAG_LOG_WARNING);
+
+    SprdJtagFaults faults;
+    faults.tdo_stuck = 1;
+    BenchDetection("detect_tdo_stuck_1", model, iface, faults, [&]() { iface->InitializeChain(true); });
+    faults.tdo_stuck = 0;
+    BenchDetection("detect_tdo_stuck_0", model, iface, faults, [&]() { iface->InitializeChain(true); });
+    faults.tdo_stuck = 1;
+    faults.tdo_stuck_states = 1 << TAP_SHIFT_DR;
+    BenchDetection("detect_tdo_stuck_1_dr", model, iface, faults, [&]() { iface->InitializeChain(true); });
+    faults = SprdJtagFaults();
+    faults.rtck_dropped = true;
+    BenchDetection("detect_rtck_dropped", model, iface, faults, [&]() { iface->SendDummyClocks(1); });
+
+    JtagLogger::SetLevel(level);
+    iface->InitializeChain(true);
+    port.ForgetIR();
+
+    //Random faults, retried by integrity checking
+    static const struct
+    {
+        const char* name;
+        double tdo_ber;
+        double tdi_ber;
+        double desync_rate;
+        unsigned int rtck_jitter;
+    } cases[] =
+    {
+        { "recover_tdo_ber",    1e-4,   0,      0,      0 },
+        { "recover_tdi_ber",    0,      1e-4,   0,      0 },
+        { "recover_desync",     0,      0,      1e-4,   0 },
+        { "recover_rtck_jitter", 0,     0,      0,      8 },
+    };
+    for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        if(!g_config.filter.empty() && (string(cases[c].name).find(g_config.filter) == string::npos))
+            continue;
+
+        faults = SprdJtagFaults();
+        faults.tdo_ber = cases[c].tdo_ber;
+        faults.tdi_ber = cases[c].tdi_ber;
+        faults.desync_rate = cases[c].desync_rate;
+        faults.rtck_jitter = cases[c].rtck_jitter;
+        model->SetFaults(faults);
+
+        JtagPerfSnapshot before;
+        iface->GetPerfSnapshot(before);
+        uint64_t injected = model->GetInjectedCount();
+        size_t wrong = 0;
+        size_t failed = 0;
+        Bench(cases[c].name, "word/s", words, [&]()
+        {
+            //Running out of retries counts against goodput, but isn't the end of the benchmark
+            try
+            {
+                port.ReadMemory(0x1000, &buf[0], words);
+            }
+            catch(const JtagException&)
+            {
+                failed ++;
+                iface->ResetToIdle();
+                port.ForgetIR();
+                return;
+            }
+            for(size_t i = 0; i < words; i++)
+            {
+                if(buf[i] != static_cast<uint32_t>(i * 0x9e3779b9))
+                    wrong ++;
+            }
+        });
+        model->ClearFaults();
+
+        JtagPerfSnapshot after;
+        iface->GetPerfSnapshot(after);
+        printf("    %" PRIu64 " faults injected, %zu retries, %zu reads failed, %zu words wrong\n",
+            model->GetInjectedCount() - injected, after.recoverable_errors - before.recoverable_errors, failed,
+            wrong);
+    }
+
+    //What failing costs the caller: 1% of scans fail their check outright (no retries), and are caught as exceptions
+    //or returned as a status
+    iface->EnableScanIntegrity(JTAG_INTEGRITY_PATTERN_BITS, 0);
+    faults = SprdJtagFaults();
+    faults.tdo_ber = 0.01 / JTAG_INTEGRITY_PATTERN_BITS;
+    port.GetPC();
+    unsigned char zero[4] = {0};
+    unsigned char rx[4];
+    const size_t scans = 256;
+    size_t total = 0;
+    size_t failed = 0;
+    model->SetFaults(faults);
+    Bench("scan_errors_exception", "scan/s", scans, [&]()
+    {
+        for(size_t i = 0; i < scans; i++)
+        {
+            try
+            {
+                iface->ScanDR(0, zero, rx, 32);
+            }
+            catch(const JtagException&)
+            {
+                failed ++;
+            }
+        }
+        total += scans;
+    });
+    if(total)
+        printf("    %zu of %zu scans failed (%.2f%%)\n", failed, total, 100.0 * failed / total);
+    total = 0;
+    failed = 0;
+    Bench("scan_errors_status", "scan/s", scans, [&]()
+    {
+        for(size_t i = 0; i < scans; i++)
+        {
+            if(!iface->TryScanDR(0, zero, rx, 32).IsOk())
+                failed ++;
+        }
+        total += scans;
+    });
+    if(total)
+        printf("    %zu of %zu scans failed (%.2f%%)\n", failed, total, 100.0 * failed / total);
+    model->ClearFaults();
+
+    //...and the error alone, without the scan
+    Bench("error_exception", "ns", 1, [&]()
+    {
+        try
+        {
+            JtagStatusWrapper(JTAG_STATUS_INTEGRITY, "%s failed its integrity check %u times", "ScanDR", 1).Throw();
+        }
+        catch(const JtagException&)
+        {
+            failed ++;
+        }
+    });
+    volatile int sink = 0;
+    Bench("error_status", "ns", 1000, [&]()
+    {
+        for(unsigned int i = 0; i < 1000; i++)
+        {
+            JtagStatus status = JtagStatusWrapper(JTAG_STATUS_INTEGRITY, "%s failed its integrity check %u times",
+                "ScanDR", i);
+            sink = status.GetCode();
+        }
+    });
+
+    iface->DisableScanIntegrity();
+    iface->ResetToIdle();
+}
+
+/*
+ * The clocks every wire-level operation is timed with
+ */
+static void BenchTiming()
+{
+    volatile uint64_t sink = 0;
+    Bench("clock_ns", "ns", 1000, [&]()
+    {
+        for(int i = 0; i < 1000; i++)
+            sink = GetTimeNs();
+    });
+    Bench("cycle_counter", "ns", 1000, [&]()
+    {
+        for(int i = 0; i < 1000; i++)
+            sink = JtagCycleClock::Now();
+    });
+}
+
+/*
+ * jtaghal bit utilities, which every scan goes through
+ */
+static void BenchBitUtilities()
+{
+    vector<unsigned char> a(512, 0xa5);
+    vector<unsigned char> b(520, 0);
+    volatile bool sink = false;
+
+    Bench("peek_bit", "ns", 4096, [&]()
+    {
+        bool x = false;
+        for(int i = 0; i < 4096; i++)
+            x ^= PeekBit(&a[0], i);
+        sink = x;
+    });
+    Bench("poke_bit", "ns", 4096, [&]()
+    {
+        for(int i = 0; i < 4096; i++)
+            PokeBit(&b[0], i, i & 1);
+    });
+    Bench("copy_bit_array_aligned", "bit/s", 4096, [&]()
+    {
+        CopyBitArray(&b[0], 0, &a[0], 0, 4096);
+    });
+    Bench("copy_bit_array_unaligned", "bit/s", 4093, [&]()
+    {
+        CopyBitArray(&b[0], 3, &a[0], 5, 4093);
+    });
+    Bench("flip_bit_array", "ns", 1, [&]()
+    {
+        FlipBitArray(&a[0], a.size());
+    });
+}
+
+/*
+ * Writes an ELF32 image with count function symbols of 16 to 64 bytes each, laid out back to back in .text from
+ * 0x10000, as a stand-in for a large DSP firmware image
+ */
+static bool WriteSymbolElf(const string& path, size_t count)
+{
+    vector<Elf32_Sym> syms(count + 1);
+    string names(1, '\0');
+    memset(&syms[0], 0, sizeof(Elf32_Sym) * syms.size());
+    uint32_t addr = 0x10000;
+    for(size_t i = 0; i < count; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "func_%zu", i);
+        Elf32_Sym& s = syms[i + 1];
+        s.st_name = names.size();
+        s.st_value = addr;
+        s.st_size = 16 + 4 * (i % 13);
+        s.st_info = ELF32_ST_INFO(STB_GLOBAL, STT_FUNC);
+        s.st_shndx = 1;
+        names.append(name, strlen(name) + 1);
+        addr += s.st_size;
+    }
+
+    //Header, symbols, names, then the section headers: null, .text (no file data), .symtab and .strtab
+    Elf32_Ehdr ehdr;
+    memset(&ehdr, 0, sizeof(ehdr));
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS32;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_EXEC;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_ehsize = sizeof(ehdr);
+    ehdr.e_shentsize = sizeof(Elf32_Shdr);
+    ehdr.e_shnum = 4;
+    size_t symoff = sizeof(ehdr);
+    size_t stroff = symoff + sizeof(Elf32_Sym) * syms.size();
+    ehdr.e_shoff = (stroff + names.size() + 3) & ~3;
+
+    Elf32_Shdr shdrs[4];
+    memset(shdrs, 0, sizeof(shdrs));
+    shdrs[1].sh_type = SHT_NOBITS;
+    shdrs[1].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    shdrs[1].sh_addr = 0x10000;
+    shdrs[1].sh_size = addr - 0x10000;
+    shdrs[2].sh_type = SHT_SYMTAB;
+    shdrs[2].sh_offset = symoff;
+    shdrs[2].sh_size = sizeof(Elf32_Sym) * syms.size();
+    shdrs[2].sh_link = 3;
+    shdrs[2].sh_info = 1;
+    shdrs[2].sh_entsize = sizeof(Elf32_Sym);
+    shdrs[3].sh_type = SHT_STRTAB;
+    shdrs[3].sh_offset = stroff;
+    shdrs[3].sh_size = names.size();
+
+    FILE* fp = fopen(path.c_str(), "wb");
+    if(!fp)
+        return false;
+    static const char pad[4] = {0};
+    bool ok = (fwrite(&ehdr, sizeof(ehdr), 1, fp) == 1);
+    ok = ok && (fwrite(&syms[0], sizeof(Elf32_Sym), syms.size(), fp) == syms.size());
+    ok = ok && (fwrite(names.c_str(), 1, names.size(), fp) == names.size());
+    ok = ok && (fwrite(pad, 1, ehdr.e_shoff - stroff - names.size(), fp) == ehdr.e_shoff - stroff - names.size());
+    ok = ok && (fwrite(shdrs, sizeof(shdrs), 1, fp) == 1);
+    return (fclose(fp) == 0) && ok;
+}
+
+/*
+ * Symbolization: ElfSymbolIndex::Lookup() at random addresses across a 100k-function image (about 4 MB of code,
+ * so the key array is well out of L1), and reloading the index from its sidecar
+ */
+static void BenchSymbols()
+{
+    const size_t count = 100000;
+    char path[] = "/tmp/jtag-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0)
+        return;
+    close(fd);
+    string sidecar = string(path) + ".symidx";
+    if(!WriteSymbolElf(path, count))
+    {
+        unlink(path);
+        return;
+    }
+
+    ElfSymbolIndex index;
+    index.Load(path, sidecar);
+
+    //Addresses from just below the first function to just past the last, so a few miss
+    vector<uint32_t> addrs(4096);
+    uint32_t seed = 1;
+    for(size_t i = 0; i < addrs.size(); i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        addrs[i] = 0xff00 + (seed >> 8) % (count * 40);
+    }
+
+    volatile uintptr_t sink = 0;
+    Bench("symbol_lookup", "lookup/s", addrs.size(), [&]()
+    {
+        uintptr_t x = 0;
+        for(size_t i = 0; i < addrs.size(); i++)
+            x += reinterpret_cast<uintptr_t>(index.Lookup(addrs[i]));
+        sink = x;
+    });
+    Bench("symbol_index_load", "ns", 1, [&]()
+    {
+        ElfSymbolIndex reload;
+        reload.LoadIndex(sidecar, path);
+    });
+
+    unlink(sidecar.c_str());
+    unlink(path);
+}
+
+/*
+ * Serves protocol sessions on a local Unix socket from a thread, for the scripted clients of the protocol servers
+ */
+class BenchServerThread
+{
+public:
+    BenchServerThread(const string& name, const function<void(int)>& serve)
+    {
+        char endpoint[128];
+        snprintf(endpoint, sizeof(endpoint), "unix:/tmp/jtag-bench-%s-%d.sock", name.c_str(), (int)getpid());
+        m_endpoint = endpoint;
+        m_sock.Listen(m_endpoint);
+        m_thread = thread([this, serve]()
+        {
+            try
+            {
+                while(true)
+                {
+                    int fd = m_sock.Accept();
+                    serve(fd);
+                    close(fd);
+                }
+            }
+            catch(const JtagException&)
+            {
+                //Accept() fails once the destructor shuts the socket down
+            }
+        });
+    }
+
+    ~BenchServerThread()
+    {
+        shutdown(m_sock.GetFD(), SHUT_RDWR);
+        m_thread.join();
+    }
+
+    int Connect()
+    { return ServerSocket::Connect(m_endpoint); }
+
+protected:
+    string m_endpoint;
+    ServerSocket m_sock;
+    thread m_thread;
+};
+
+/*
+ * Just enough of a GDB remote protocol client to script a debug session. Acks are skipped rather than checked, and
+ * none are sent (the server doesn't wait for them).
+ */
+class BenchGdbClient
+{
+public:
+    BenchGdbClient(int fd)
+        : m_fd(fd)
+        , m_rxpos(0)
+        , m_rxlen(0)
+    {}
+
+    ~BenchGdbClient()
+    { close(m_fd); }
+
+    /*
+     * Sends a packet and returns the payload of the reply
+     */
+    string Transact(const string& payload)
+    {
+        uint8_t sum = 0;
+        for(size_t i = 0; i < payload.size(); i++)
+            sum += payload[i];
+        char tail[4];
+        snprintf(tail, sizeof(tail), "#%02x", sum);
+        string packet = "$" + payload + tail;
+        if(!ServerSocket::SendAll(m_fd, packet.data(), packet.size()))
+            throw JtagExceptionWrapper("gdb server went away", "");
+
+        string reply;
+        while(ReadByte() != '$')
+        {}
+        for(char c; (c = ReadByte()) != '#'; )
+            reply += c;
+        ReadByte();
+        ReadByte();
+        return reply;
+    }
+
+protected:
+    char ReadByte()
+    {
+        if(m_rxpos == m_rxlen)
+        {
+            ssize_t len = recv(m_fd, m_rxbuf, sizeof(m_rxbuf), 0);
+            if(len <= 0)
+                throw JtagExceptionWrapper("gdb server went away", "");
+            m_rxpos = 0;
+            m_rxlen = len;
+        }
+        return m_rxbuf[m_rxpos++];
+    }
+
+    int m_fd;
+    char m_rxbuf[4096];
+    size_t m_rxpos;
+    size_t m_rxlen;
+};
+
+/*
+ * Parses a 32-bit register value as GDB sends it (8 hex digits, target byte order)
+ */
+static uint32_t ParseGdbWord(const string& hex)
+{
+    uint32_t value = 0;
+    for(size_t i = 0; (i < 4) && (2*i + 2 <= hex.size()); i++)
+        value |= strtoul(hex.substr(2*i, 2).c_str(), NULL, 16) << (8*i);
+    return value;
+}
+
+/*
+ * GdbServer end to end, against the simulated DSP over a local socket: a whole scripted session (attach, read the
+ * registers and some memory, set a breakpoint a little way ahead, continue to it, clear it and detach), and a step
+ * as gdb does one (step, then re-read the registers and the memory around the PC)
+ */
+static void BenchGdb()
+{
+    SimJtagInterface iface;
+    iface.InitializeChain();
+    CevaDebugPort port(&iface);
+    GdbServer server(&port);
+    BenchServerThread serving("gdb", [&](int fd) { server.ServeClient(fd); });
+
+    Bench("gdb_session", "ns", 1, [&]()
+    {
+        BenchGdbClient gdb(serving.Connect());
+        gdb.Transact("qSupported:hwbreak+");
+        gdb.Transact("QStartNoAckMode");
+        gdb.Transact("?");
+        gdb.Transact("g");
+        gdb.Transact("m1000,100");
+        uint32_t pc = ParseGdbWord(gdb.Transact("p20"));
+
+        char cmd[32];
+        snprintf(cmd, sizeof(cmd), "%x,2", (pc + 0x100) & 0xfffe);
+        if(gdb.Transact(string("Z1,") + cmd) != "OK")
+            throw JtagExceptionWrapper("gdb server refused the breakpoint", "");
+        string stop = gdb.Transact("c");
+        if(stop.compare(0, 3, "T05") != 0)
+            throw JtagExceptionWrapper("gdb session didn't stop at the breakpoint", stop);
+        gdb.Transact(string("z1,") + cmd);
+        gdb.Transact("D");
+    });
+
+    BenchGdbClient gdb(serving.Connect());
+    gdb.Transact("QStartNoAckMode");
+    Bench("gdb_step", "ns", 1, [&]()
+    {
+        gdb.Transact("s");
+        gdb.Transact("g");
+        char cmd[32];
+        snprintf(cmd, sizeof(cmd), "m%x,40", ParseGdbWord(gdb.Transact("p20")));
+        gdb.Transact(cmd);
+    });
+    gdb.Transact("D");
+}
+
+/*
+ * Appends one remote_bitbang TCK cycle (falling edge, optionally a TDO read, then the rising edge)
+ */
+static void AppendBitbangCycle(string& script, bool tms, bool tdi, bool read)
+{
+    char pins = (tms << 1) | tdi;
+    script += '0' + pins;
+    if(read)
+        script += 'R';
+    script += '0' + (4 | pins);
+}
+
+/*
+ * RemoteBitbangServer end to end, against the simulated DSP over a local socket, as OpenOCD drives it: reading the
+ * IDCODE (reset, into Shift-DR, then a TDO read per bit), and a long shift with a single read at the end to sync
+ */
+static void BenchRemoteBitbang()
+{
+    SimJtagInterface iface;
+    RemoteBitbangServer server(&iface);
+    BenchServerThread serving("bitbang", [&](int fd) { server.ServeClient(fd); });
+    int fd = serving.Connect();
+
+    //Test-Logic-Reset, Run-Test/Idle, Select-DR-Scan, Capture-DR, Shift-DR
+    string idcode;
+    static const bool entry[] = {1, 1, 1, 1, 1, 0, 1, 0, 0};
+    const size_t entry_cycles = sizeof(entry) / sizeof(entry[0]);
+    for(size_t i = 0; i < entry_cycles; i++)
+        AppendBitbangCycle(idcode, entry[i], 0, false);
+    for(int i = 0; i < 32; i++)
+        AppendBitbangCycle(idcode, i == 31, 0, true);
+    AppendBitbangCycle(idcode, 1, 0, false);
+    AppendBitbangCycle(idcode, 0, 0, false);
+    size_t idcode_cycles = entry_cycles + 34;
+
+    //The server thread can't be stopped while a client is connected, so hang up whatever happens
+    try
+    {
+        char bits[32];
+        auto transact = [&](const string& script, size_t reads)
+        {
+            if(!ServerSocket::SendAll(fd, script.data(), script.size()) || !ServerSocket::RecvAll(fd, bits, reads))
+                throw JtagExceptionWrapper("remote_bitbang server went away", "");
+        };
+
+        transact(idcode, 32);
+        uint32_t value = 0;
+        for(int i = 0; i < 32; i++)
+            value |= static_cast<uint32_t>(bits[i] == '1') << i;
+        if(value != 0x0cea0001)
+        {
+            char msg[32];
+            snprintf(msg, sizeof(msg), "%08x", value);
+            throw JtagExceptionWrapper("remote_bitbang read back the wrong IDCODE", msg);
+        }
+
+        Bench("bitbang_idcode", "cycle/s", idcode_cycles, [&]()
+        {
+            transact(idcode, 32);
+        });
+
+        //Stay in Shift-DR; the bits just go round the DR
+        const size_t shift_cycles = 4096;
+        string shift;
+        for(size_t i = 0; i < entry_cycles; i++)
+            AppendBitbangCycle(shift, entry[i], 0, false);
+        for(size_t i = 0; i < shift_cycles; i++)
+            AppendBitbangCycle(shift, 0, i & 1, i == shift_cycles - 1);
+        Bench("bitbang_shift", "cycle/s", entry_cycles + shift_cycles, [&]()
+        {
+            transact(shift, 1);
+        });
+    }
+    catch(const JtagException&)
+    {
+        close(fd);
+        throw;
+    }
+
+    ServerSocket::SendAll(fd, "Q", 1);
+    close(fd);
+}
+
+/*
+ * XvcServer end to end, against the simulated DSP over a local socket: shift: vectors of a range of lengths, up to
+ * the largest the server advertises, all within Shift-DR
+ */
+static void BenchXvc()
+{
+    SimJtagInterface iface;
+    XvcServer server(&iface);
+    BenchServerThread serving("xvc", [&](int fd) { server.ServeClient(fd); });
+    int fd = serving.Connect();
+
+    //The server thread can't be stopped while a client is connected, so hang up whatever happens
+    try
+    {
+        const size_t max_bits = XVC_MAX_VECTOR_BYTES * 8;
+        vector<uint8_t> tms(XVC_MAX_VECTOR_BYTES, 0);
+        vector<uint8_t> tdi(XVC_MAX_VECTOR_BYTES);
+        vector<uint8_t> tdo(XVC_MAX_VECTOR_BYTES);
+        for(size_t i = 0; i < tdi.size(); i++)
+            tdi[i] = i * 0x9d + 0x5a;
+
+        //One shift: command, in a single send as XVC clients do
+        vector<uint8_t> command;
+        auto shift = [&](size_t nbits)
+        {
+            size_t nbytes = (nbits + 7) / 8;
+            command.assign((const uint8_t*)"shift:", (const uint8_t*)"shift:" + 6);
+            for(int i = 0; i < 4; i++)
+                command.push_back(nbits >> (8*i));
+            command.insert(command.end(), tms.begin(), tms.begin() + nbytes);
+            command.insert(command.end(), tdi.begin(), tdi.begin() + nbytes);
+            if(!ServerSocket::SendAll(fd, &command[0], command.size()) || !ServerSocket::RecvAll(fd, &tdo[0], nbytes))
+                throw JtagExceptionWrapper("XVC server went away", "");
+        };
+
+        char info[64] = {0};
+        const char getinfo[] = "getinfo:";
+        if(!ServerSocket::SendAll(fd, getinfo, strlen(getinfo)) || (recv(fd, info, sizeof(info) - 1, 0) <= 0))
+            throw JtagExceptionWrapper("XVC server went away", "");
+        if(strncmp(info, "xvcServer_v1.0:", 15))
+            throw JtagExceptionWrapper("Unexpected XVC getinfo: reply", info);
+
+        //Test-Logic-Reset, Run-Test/Idle, Select-DR-Scan, Capture-DR, Shift-DR
+        tms[0] = 0x5f;
+        tms[1] = 0;
+        shift(9);
+        tms[0] = 0;
+
+        //The first 32 bits out are the IDCODE, then the DR echoes TDI 32 bits late
+        shift(max_bits);
+        uint32_t idcode = tdo[0] | (tdo[1] << 8) | (tdo[2] << 16) | (static_cast<uint32_t>(tdo[3]) << 24);
+        if( (idcode != 0x0cea0001) || memcmp(&tdo[4], &tdi[0], tdo.size() - 4) )
+        {
+            char msg[32];
+            snprintf(msg, sizeof(msg), "IDCODE %08x", idcode);
+            throw JtagExceptionWrapper("XVC shift read back the wrong bits", msg);
+        }
+
+        static const size_t lengths[] = {32, 1024, 32768, max_bits};
+        for(size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+        {
+            size_t nbits = lengths[i];
+            char name[32];
+            snprintf(name, sizeof(name), "xvc_shift_%zu", nbits);
+            Bench(name, "bit/s", nbits, [&]()
+            {
+                shift(nbits);
+            });
+        }
+    }
+    catch(const JtagException&)
+    {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+}
+
+/*
+ * Writes results in the machine-readable format: a comment line naming the target, then one tab-separated line per
+ * benchmark with name, unit, mean, 95% confidence interval half-width and sample count.
+ */
+static bool WriteResults(const string& path, const string& target)
+{
+    FILE* fp = fopen(path.c_str(), "w");
+    if(!fp)
+        return false;
+    fprintf(fp, "# jtag-bench 1 target=%s\n", target.c_str());
+    for(size_t i = 0; i < g_results.size(); i++)
+    {
+        const BenchResult& r = g_results[i];
+        fprintf(fp, "%s\t%s\t%.6g\t%.6g\t%zu\n", r.name.c_str(), r.unit.c_str(), r.mean, r.ci, r.samples);
+    }
+    return fclose(fp) == 0;
+}
+
+/*
+ * Reads results written by WriteResults()
+ */
+static bool ReadResults(const string& path, map<string, BenchResult>& results)
+{
+    FILE* fp = fopen(path.c_str(), "r");
+    if(!fp)
+        return false;
+    char line[256];
+    while(fgets(line, sizeof(line), fp))
+    {
+        if(line[0] == '#')
+            continue;
+        char name[128];
+        char unit[32];
+        BenchResult r;
+        if(sscanf(line, "%127s\t%31s\t%lf\t%lf\t%zu", name, unit, &r.mean, &r.ci, &r.samples) != 5)
+            continue;
+        r.name = name;
+        r.unit = unit;
+        results[r.name] = r;
+    }
+    fclose(fp);
+    return true;
+}
+
+/*
+ * Compares results against a baseline. A benchmark regressed if it got worse by more than threshold percent and its
+ * confidence interval no longer overlaps the baseline's.
+ *
+ * Returns the number of regressions.
+ */
+static int CompareResults(const map<string, BenchResult>& baseline, double threshold)
+{
+    int regressions = 0;
+    printf("\n%-28s %14s %14s %8s\n", "vs baseline", "baseline", "now", "change");
+    for(size_t i = 0; i < g_results.size(); i++)
+    {
+        const BenchResult& now = g_results[i];
+        map<string, BenchResult>::const_iterator it = baseline.find(now.name);
+        if( (it == baseline.end()) || (it->second.unit != now.unit) || (it->second.mean == 0) )
+            continue;
+        const BenchResult& base = it->second;
+
+        //Positive change is always an improvement
+        bool higher = HigherIsBetter(now.unit);
+        double change = 100 * (now.mean - base.mean) / base.mean;
+        if(!higher)
+            change = -change;
+        bool separated = higher ?
+            (now.mean + now.ci < base.mean - base.ci) || (now.mean - now.ci > base.mean + base.ci) :
+            (now.mean - now.ci > base.mean + base.ci) || (now.mean + now.ci < base.mean - base.ci);
+
+        const char* verdict = "";
+        if(separated && (change < -threshold))
+        {
+            verdict = "REGRESSION";
+            regressions++;
+        }
+        else if(separated && (change > threshold))
+            verdict = "improved";
+        printf("%-28s %14.4g %14.4g %+7.1f%% %s\n", now.name.c_str(), base.mean, now.mean, change, verdict);
+    }
+    return regressions;
+}
+
+/*
+ * jtag-bench [--model] [--quick] [--out file] [--baseline file] [--threshold percent] [--filter name]
+ *
+ * Runs against the SW-JTAG hardware, or with --model against SprdJtagRegisterModel (the same driver code, with a
+ * software control register). Results go to bench_output.txt unless --out says otherwise. Exits with 3 if any
+ * benchmark regressed against the baseline.
+ */
+int main(int argc, char* argv[])
+{
+    bool model = false;
+    string out = "bench_output.txt";
+    string baseline_path;
+    double threshold = 5;
+    g_config.samples = 10;
+    g_config.min_sample = 0.02;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--model"))
+            model = true;
+        else if(!strcmp(argv[i], "--quick"))
+        {
+            g_config.samples = 5;
+            g_config.min_sample = 0.002;
+        }
+        else if(!strcmp(argv[i], "--out") && (i + 1 < argc))
+            out = argv[++i];
+        else if(!strcmp(argv[i], "--baseline") && (i + 1 < argc))
+            baseline_path = argv[++i];
+        else if(!strcmp(argv[i], "--threshold") && (i + 1 < argc))
+            threshold = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--filter") && (i + 1 < argc))
+            g_config.filter = argv[++i];
+        else
+        {
+            fprintf(stderr,
+                "Usage: jtag-bench [--model] [--quick] [--out file] [--baseline file] [--threshold percent] "
+                "[--filter name]\n");
+            return 1;
+        }
+    }
+
+    map<string, BenchResult> baseline;
+    if(!baseline_path.empty() && !ReadResults(baseline_path, baseline))
+    {
+        fprintf(stderr, "Failed to read baseline %s\n", baseline_path.c_str());
+        return 1;
+    }
+
+    SprdJtagRegisterModel* regs = model ? new SprdJtagRegisterModel : NULL;
+    SprdMmioDJtagInterface* iface = model ? new SprdMmioDJtagInterface(regs) : new SprdMmioDJtagInterface;
+    int ret = 0;
+    try
+    {
+        printf("%-28s %14s %-7s %s\n", "benchmark", "mean", "unit", "95% CI");
+        BenchRegister(regs, iface);
+        BenchWire(iface);
+        BenchRegisterLevel(iface);
+        if(model)
+        {
+            BenchFaults(regs, iface);
+            BenchInstances();
+            BenchProfiles();
+        }
+        BenchTiming();
+        BenchBitUtilities();
+        BenchSymbols();
+        BenchGdb();
+        BenchRemoteBitbang();
+        BenchXvc();
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    delete iface;
+    delete regs;
+
+    if(!WriteResults(out, model ? "model" : "hardware"))
+    {
+        fprintf(stderr, "Failed to write %s\n", out.c_str());
+        return 1;
+    }
+    if(!baseline.empty() && CompareResults(baseline, threshold))
+        ret = 3;
+    return ret;
+}
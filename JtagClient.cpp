@@ -0,0 +1,428 @@
+/**
+	@file
+	@brief Implementation of JtagClient
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+JtagClient::JtagClient()
+	: m_fd(-1)
+	, m_inTransaction(false)
+{
+}
+
+JtagClient::~JtagClient()
+{
+	Close();
+}
+
+/**
+	@brief Connects to a daemon
+
+	@param endpoint		Endpoint the daemon listens on (see ServerSocket)
+
+	@throw JtagException if the daemon isn't there
+ */
+void JtagClient::Connect(const string& endpoint)
+{
+	Close();
+	m_fd = ServerSocket::Connect(endpoint);
+}
+
+/**
+	@brief Disconnects from the daemon
+ */
+void JtagClient::Close()
+{
+	if(m_fd >= 0)
+		close(m_fd);
+	m_fd = -1;
+	m_inTransaction = false;
+}
+
+/**
+	@brief Returns $JTAGD_SOCKET if set, otherwise JTAGD_DEFAULT_ENDPOINT
+ */
+string JtagClient::GetDefaultEndpoint()
+{
+	const char* env = getenv("JTAGD_SOCKET");
+	if(env && *env)
+		return env;
+	return JTAGD_DEFAULT_ENDPOINT;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Transport
+
+/**
+	@brief Sends a request and waits for its reply
+
+	Header and payload go out in a single write, so each request costs one round trip.
+
+	@param opcode	A JtagdOpcode
+	@param device	Chain position, for register-level scans
+	@param bits		Bit or word count (see JtagdOpcode)
+	@param arg		Opcode-specific argument
+	@param payload	Request payload
+	@param length	Size of the request payload, in bytes
+	@param reply	Reply payload
+	@param fds		File descriptors to pass along (Unix sockets only)
+	@param nfds		Number of file descriptors
+
+	@throw JtagException if the connection fails or the daemon reports an error
+ */
+void JtagClient::Transact(
+	uint16_t opcode,
+	uint16_t device,
+	uint32_t bits,
+	uint32_t arg,
+	const void* payload,
+	size_t length,
+	vector<uint8_t>& reply,
+	const int* fds,
+	size_t nfds)
+{
+	if(m_fd < 0)
+	{
+		throw JtagExceptionWrapper(
+			"Not connected to the daemon",
+			"");
+	}
+	if(length > JTAGD_MAX_PAYLOAD)
+	{
+		throw JtagExceptionWrapper(
+			"Request payload too large",
+			"");
+	}
+
+	JtagdRequestHeader req;
+	req.opcode = m_inTransaction ? (opcode | JTAGD_FLAG_TRANSACTION) : opcode;
+	req.device = device;
+	req.bits = bits;
+	req.arg = arg;
+	req.length = length;
+
+	string msg(reinterpret_cast<const char*>(&req), sizeof(req));
+	if(length)
+		msg.append(static_cast<const char*>(payload), length);
+
+	JtagdReplyHeader hdr;
+	bool sent;
+	if(nfds)
+		sent = ServerSocket::SendWithFds(m_fd, msg.c_str(), msg.length(), fds, nfds);
+	else
+		sent = ServerSocket::SendAll(m_fd, msg.c_str(), msg.length());
+	if(!sent || !ServerSocket::RecvAll(m_fd, &hdr, sizeof(hdr)))
+	{
+		Close();
+		throw JtagExceptionWrapper(
+			"Lost connection to the daemon",
+			"");
+	}
+
+	reply.resize(hdr.length);
+	if(hdr.length && !ServerSocket::RecvAll(m_fd, &reply[0], hdr.length))
+	{
+		Close();
+		throw JtagExceptionWrapper(
+			"Lost connection to the daemon",
+			"");
+	}
+
+	if(hdr.status != JTAGD_STATUS_OK)
+	{
+		throw JtagExceptionWrapper(
+			string("Daemon: ") + string(reply.begin(), reply.end()),
+			"");
+	}
+}
+
+/**
+	@brief Sends a request with no arguments which returns one word
+
+	@throw JtagException if the request fails
+ */
+uint32_t JtagClient::TransactWord(uint16_t opcode)
+{
+	uint32_t value;
+	TransactCopy(opcode, 0, 0, &value, sizeof(value));
+	return value;
+}
+
+/**
+	@brief Sends a request with no payload and copies the reply out, checking its size
+
+	@throw JtagException if the request fails or the reply has the wrong size
+ */
+void JtagClient::TransactCopy(uint16_t opcode, uint32_t bits, uint32_t arg, void* out, size_t outlen)
+{
+	Transact(opcode, 0, bits, arg, NULL, 0, m_reply);
+	if(m_reply.size() != outlen)
+	{
+		throw JtagExceptionWrapper(
+			"Daemon reply has the wrong size",
+			"");
+	}
+	if(outlen)
+		memcpy(out, &m_reply[0], outlen);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scheduling
+
+/**
+	@brief Sets how the daemon schedules this connection, and the name it shows up under in statistics
+
+	@param priority	Scheduling class
+	@param name		Client name, truncated to JTAGD_CLIENT_NAME_LENGTH - 1 characters
+
+	@throw JtagException if the request fails
+ */
+void JtagClient::SetClient(JtagdPriority priority, const string& name)
+{
+	Transact(JTAGD_OP_SET_CLIENT, 0, 0, priority, name.c_str(), name.length(), m_reply);
+}
+
+/**
+	@brief Gets the latency and throughput statistics of every client connected to the daemon
+
+	@throw JtagException if the request fails
+ */
+void JtagClient::GetClientStats(vector<JtagdClientStats>& stats)
+{
+	Transact(JTAGD_OP_GET_CLIENT_STATS, 0, 0, 0, NULL, 0, m_reply);
+	if(m_reply.size() % sizeof(JtagdClientStats))
+	{
+		throw JtagExceptionWrapper(
+			"Daemon reply has the wrong size",
+			"");
+	}
+	stats.resize(m_reply.size() / sizeof(JtagdClientStats));
+	if(!stats.empty())
+		memcpy(&stats[0], &m_reply[0], m_reply.size());
+}
+
+/**
+	@brief Starts a transaction: the daemon runs nothing but this connection's requests until EndTransaction()
+
+	If the client goes quiet for JTAGD_TRANSACTION_TIMEOUT in the middle of a transaction, the daemon ends it.
+ */
+void JtagClient::BeginTransaction()
+{
+	m_inTransaction = true;
+}
+
+/**
+	@brief Ends a transaction, letting other clients at the adapter again
+
+	@throw JtagException if the request fails
+ */
+void JtagClient::EndTransaction()
+{
+	m_inTransaction = false;
+	Ping();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Daemon / chain
+
+/**
+	@brief Does a round trip without touching the adapter
+
+	@throw JtagException if the daemon doesn't answer
+ */
+void JtagClient::Ping()
+{
+	Transact(JTAGD_OP_PING, 0, 0, 0, NULL, 0, m_reply);
+}
+
+/**
+	@brief Gets the daemon and chain description
+
+	@param info		Daemon and chain information
+	@param idcodes	IDCODE of each device on the chain
+
+	@throw JtagException if the request fails
+ */
+void JtagClient::GetInfo(JtagdInfo& info, vector<uint32_t>& idcodes)
+{
+	Transact(JTAGD_OP_GET_INFO, 0, 0, 0, NULL, 0, m_reply);
+	if(m_reply.size() < sizeof(info))
+	{
+		throw JtagExceptionWrapper(
+			"Daemon reply has the wrong size",
+			"");
+	}
+	memcpy(&info, &m_reply[0], sizeof(info));
+	if(m_reply.size() != sizeof(info) + info.chain_length * sizeof(uint32_t))
+	{
+		throw JtagExceptionWrapper(
+			"Daemon reply has the wrong size",
+			"");
+	}
+	idcodes.resize(info.chain_length);
+	if(info.chain_length)
+		memcpy(&idcodes[0], &m_reply[sizeof(info)], info.chain_length * sizeof(uint32_t));
+}
+
+/**
+	@brief Gets the adapter's performance counters
+
+	@throw JtagException if the request fails
+ */
+void JtagClient::GetStats(JtagdStats& stats)
+{
+	TransactCopy(JTAGD_OP_GET_STATS, 0, 0, &stats, sizeof(stats));
+}
+
+/**
+	@brief Makes the daemon rescan the chain
+
+	@throw JtagException if the request fails
+ */
+void JtagClient::Reinitialize()
+{
+	Transact(JTAGD_OP_REINIT, 0, 0, 0, NULL, 0, m_reply);
+}
+
+/**
+	@brief Resets the TAPs and leaves them in Run-Test-Idle
+
+	@throw JtagException if the request fails
+ */
+void JtagClient::ResetToIdle()
+{
+	Transact(JTAGD_OP_RESET_TO_IDLE, 0, 0, 0, NULL, 0, m_reply);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Register level
+
+/**
+	@brief Sets the IR of one device, see JtagInterface::SetIR()
+
+	@param device	Zero-based index of the target device
+	@param data		IR value to load
+	@param data_out	Captured IR value (may be NULL)
+	@param count	IR length, in bits
+
+	@throw JtagException if the request fails
+ */
+void JtagClient::SetIR(unsigned int device, const unsigned char* data, unsigned char* data_out, size_t count)
+{
+	size_t nbytes = (count + 7) / 8;
+	Transact(JTAGD_OP_SET_IR, device, count, 0, data, nbytes, m_reply);
+	if(data_out && (m_reply.size() == nbytes))
+		memcpy(data_out, &m_reply[0], nbytes);
+}
+
+/**
+	@brief Scans the DR of one device, see JtagInterface::ScanDR()
+
+	@param device		Zero-based index of the target device
+	@param send_data	Data to scan in
+	@param rcv_data		Data scanned out, or NULL if not needed (saves sending it back)
+	@param count		Number of bits to scan
+
+	@throw JtagException if the request fails
+ */
+void JtagClient::ScanDR(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+{
+	size_t nbytes = (count + 7) / 8;
+	Transact(JTAGD_OP_SCAN_DR, device, count, rcv_data ? 1 : 0, send_data, nbytes, m_reply);
+	if(rcv_data && (m_reply.size() == nbytes))
+		memcpy(rcv_data, &m_reply[0], nbytes);
+}
+
+/**
+	@brief Raw shift from whatever state the TAP is in, see JtagInterface::ShiftData()
+
+	@throw JtagException if the request fails
+ */
+void JtagClient::ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+{
+	size_t nbytes = (count + 7) / 8;
+	Transact(JTAGD_OP_SHIFT_DATA, 0, count, last_tms ? 1 : 0, send_data, nbytes, m_reply);
+	if(rcv_data && (m_reply.size() == nbytes))
+		memcpy(rcv_data, &m_reply[0], nbytes);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CEVA DSP
+
+/**
+	@brief See CevaDebugPort::GetCoreVersion()
+ */
+uint32_t JtagClient::GetCoreVersion()
+{
+	return TransactWord(JTAGD_OP_CEVA_VERSION);
+}
+
+/**
+	@brief See CevaDebugPort::GetStatus()
+ */
+uint32_t JtagClient::GetStatus()
+{
+	return TransactWord(JTAGD_OP_CEVA_STATUS);
+}
+
+/**
+	@brief See CevaDebugPort::GetPC()
+ */
+uint32_t JtagClient::GetPC()
+{
+	return TransactWord(JTAGD_OP_CEVA_PC);
+}
+
+/**
+	@brief See CevaDebugPort::Halt()
+ */
+void JtagClient::Halt()
+{
+	Transact(JTAGD_OP_CEVA_HALT, 0, 0, 0, NULL, 0, m_reply);
+}
+
+/**
+	@brief See CevaDebugPort::Resume()
+ */
+void JtagClient::Resume()
+{
+	Transact(JTAGD_OP_CEVA_RESUME, 0, 0, 0, NULL, 0, m_reply);
+}
+
+/**
+	@brief See CevaDebugPort::Step()
+ */
+void JtagClient::Step()
+{
+	Transact(JTAGD_OP_CEVA_STEP, 0, 0, 0, NULL, 0, m_reply);
+}
+
+/**
+	@brief See CevaDebugPort::ReadRegisters()
+ */
+void JtagClient::ReadRegisters(unsigned int first, uint32_t* values, size_t count)
+{
+	TransactCopy(JTAGD_OP_CEVA_READ_REGS, count, first, values, count * sizeof(uint32_t));
+}
+
+/**
+	@brief See CevaDebugPort::ReadMemory()
+ */
+void JtagClient::ReadMemory(uint32_t addr, uint32_t* words, size_t count)
+{
+	TransactCopy(JTAGD_OP_CEVA_READ_MEM, count, addr, words, count * sizeof(uint32_t));
+}
+
+/**
+	@brief See CevaDebugPort::WriteMemory()
+ */
+void JtagClient::WriteMemory(uint32_t addr, const uint32_t* words, size_t count)
+{
+	Transact(JTAGD_OP_CEVA_WRITE_MEM, 0, 0, addr, words, count * sizeof(uint32_t), m_reply);
+}
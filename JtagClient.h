@@ -0,0 +1,90 @@
+/**
+	@file
+	@brief Declaration of JtagClient
+ */
+
+#ifndef JtagClient_h
+#define JtagClient_h
+
+/**
+	@brief Connection to a JtagDaemon
+
+	Each call is one request/reply round trip over the daemon socket. Errors reported by the daemon are rethrown
+	locally as JtagException, with the daemon's description.
+
+	Bit order and byte layout of scan data are the same as for the corresponding JtagInterface calls.
+
+	Requests made between BeginTransaction() and EndTransaction() run back to back, with no other client's scans in
+	between, so an IR/DR sequence can't be disturbed by someone else changing the IR.
+ */
+class JtagClient
+{
+public:
+	JtagClient();
+	virtual ~JtagClient();
+
+	void Connect(const std::string& endpoint);
+	void Close();
+
+	static std::string GetDefaultEndpoint();
+
+	///@brief Returns the socket, or -1 if not connected
+	int GetFD()
+	{ return m_fd; }
+
+	//Generic request
+	void Transact(
+		uint16_t opcode,
+		uint16_t device,
+		uint32_t bits,
+		uint32_t arg,
+		const void* payload,
+		size_t length,
+		std::vector<uint8_t>& reply,
+		const int* fds = NULL,
+		size_t nfds = 0);
+
+	//Scheduling
+	void SetClient(JtagdPriority priority, const std::string& name);
+	void GetClientStats(std::vector<JtagdClientStats>& stats);
+	void BeginTransaction();
+	void EndTransaction();
+
+	//Daemon / chain
+	void Ping();
+	void GetInfo(JtagdInfo& info, std::vector<uint32_t>& idcodes);
+	void GetStats(JtagdStats& stats);
+	void Reinitialize();
+	void ResetToIdle();
+
+	//Register level
+	void SetIR(unsigned int device, const unsigned char* data, unsigned char* data_out, size_t count);
+	void ScanDR(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
+	void ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
+
+	//CEVA DSP
+	uint32_t GetCoreVersion();
+	uint32_t GetStatus();
+	uint32_t GetPC();
+	void Halt();
+	void Resume();
+	void Step();
+	void ReadRegisters(unsigned int first, uint32_t* values, size_t count);
+	void ReadMemory(uint32_t addr, uint32_t* words, size_t count);
+	void WriteMemory(uint32_t addr, const uint32_t* words, size_t count);
+
+protected:
+	uint32_t TransactWord(uint16_t opcode);
+	void TransactCopy(uint16_t opcode, uint32_t bits, uint32_t arg, void* out, size_t outlen);
+
+	///@brief Socket, or -1 if not connected
+	int m_fd;
+
+	///@brief True between BeginTransaction() and EndTransaction()
+	bool m_inTransaction;
+
+	///@brief Reply scratch buffer
+	std::vector<uint8_t> m_reply;
+};
+
+#endif
@@ -0,0 +1,125 @@
+/**
+	@file
+	@brief Implementation of JtagCycleClock
+ */
+
+#include "jtaghal.h"
+#include <setjmp.h>
+
+using namespace std;
+
+///@brief How long JtagCycleClock::Calibrate() measures the counter for, in ns
+#define JTAG_CLOCK_CALIBRATION_NS	2000000
+
+double JtagCycleClock::m_nsPerCycle = 0;
+
+#if defined(__i386__) || defined(__x86_64__) || defined(__aarch64__)
+
+bool JtagCycleClock::m_hardware = true;
+
+#elif defined(__arm__) && defined(__ARM_ARCH) && (__ARM_ARCH >= 7)
+
+static sigjmp_buf g_probeJump;
+
+static void ProbeHandler(int /*sig*/)
+{
+	siglongjmp(g_probeJump, 1);
+}
+
+/**
+	@brief Checks that CNTVCT can be read from user space, and is counting
+
+	Without a generic timer, or if the kernel hasn't enabled user access, the read is an undefined instruction.
+ */
+static bool ProbeCounter()
+{
+	struct sigaction sa;
+	struct sigaction old;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = ProbeHandler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGILL, &sa, &old);
+
+	volatile bool ok = false;
+	if(sigsetjmp(g_probeJump, 1) == 0)
+	{
+		uint32_t lo;
+		uint32_t hi;
+		asm volatile("mrrc p15, 1, %0, %1, c14" : "=r"(lo), "=r"(hi));
+		uint64_t first = (static_cast<uint64_t>(hi) << 32) | lo;
+
+		uint64_t start = GetTimeNs();
+		while(GetTimeNs() - start < 10000)
+		{}
+		asm volatile("mrrc p15, 1, %0, %1, c14" : "=r"(lo), "=r"(hi));
+		ok = ( ( (static_cast<uint64_t>(hi) << 32) | lo) != first);
+	}
+
+	sigaction(SIGILL, &old, NULL);
+	return ok;
+}
+
+//Probed before main(), so Now() never changes units under a running timer
+bool JtagCycleClock::m_hardware = ProbeCounter();
+
+#else
+
+bool JtagCycleClock::m_hardware = false;
+
+#endif
+
+/**
+	@brief Returns true if Now() reads a hardware counter, false if it falls back to GetTimeNs()
+ */
+bool JtagCycleClock::IsHardware()
+{
+	return m_hardware;
+}
+
+/**
+	@brief Returns the counter's rate, in Hz
+ */
+double JtagCycleClock::GetFrequency()
+{
+	Calibrate();
+	return 1e9 / m_nsPerCycle;
+}
+
+/**
+	@brief Measures the counter's rate against the monotonic clock, if that hasn't been done yet
+
+	Called automatically by ToNs(). Thread safe.
+ */
+void JtagCycleClock::Calibrate()
+{
+	static bool calibrated = (DoCalibrate(), true);
+	(void)calibrated;
+}
+
+void JtagCycleClock::DoCalibrate()
+{
+	if(!m_hardware)
+	{
+		m_nsPerCycle = 1;
+		return;
+	}
+
+	uint64_t t0 = GetTimeNs();
+	uint64_t c0 = Now();
+	uint64_t t1;
+	uint64_t c1;
+	do
+	{
+		t1 = GetTimeNs();
+		c1 = Now();
+	} while(t1 - t0 < JTAG_CLOCK_CALIBRATION_NS);
+	m_nsPerCycle = static_cast<double>(t1 - t0) / (c1 - c0);
+}
+
+/**
+	@brief Now() for targets without a usable cycle counter
+ */
+uint64_t JtagCycleClock::Fallback()
+{
+	return GetTimeNs();
+}
@@ -0,0 +1,123 @@
+/**
+	@file
+	@brief Declaration of JtagCycleClock and JtagScopedTimer
+ */
+
+#ifndef JtagClock_h
+#define JtagClock_h
+
+/**
+	@brief Calibrated CPU cycle counter, for timing individual wire-level operations
+
+	Reading the counter is a single instruction: rdtsc on x86, CNTVCT_EL0 on AArch64, and CNTVCT (the generic timer's
+	virtual count) on ARMv7. That is a fraction of the cost of GetTimeNs(), which matters when every TCK edge is
+	timed. ARMv7 parts without a generic timer, or kernels that don't open it to user space, are detected at startup,
+	and like every other architecture fall back to GetTimeNs(); Now() then simply counts nanoseconds.
+
+	Counts are only meaningful as differences. ToNs() converts them using a rate measured against the monotonic clock
+	the first time it is needed (about 2 ms). x86 hosts are assumed to have an invariant TSC, as anything from the last
+	decade does.
+ */
+class JtagCycleClock
+{
+public:
+
+	///@brief Returns the current cycle count
+	static uint64_t Now()
+	{
+#if defined(__i386__) || defined(__x86_64__)
+		uint32_t lo;
+		uint32_t hi;
+		asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+		return (static_cast<uint64_t>(hi) << 32) | lo;
+#elif defined(__aarch64__)
+		uint64_t count;
+		asm volatile("mrs %0, cntvct_el0" : "=r"(count));
+		return count;
+#elif defined(__arm__) && defined(__ARM_ARCH) && (__ARM_ARCH >= 7)
+		if(__builtin_expect(!m_hardware, 0))
+			return Fallback();
+		uint32_t lo;
+		uint32_t hi;
+		asm volatile("mrrc p15, 1, %0, %1, c14" : "=r"(lo), "=r"(hi));
+		return (static_cast<uint64_t>(hi) << 32) | lo;
+#else
+		return Fallback();
+#endif
+	}
+
+	///@brief Converts a difference of two Now() values to nanoseconds
+	static uint64_t ToNs(uint64_t cycles)
+	{
+		if(__builtin_expect(m_nsPerCycle == 0, 0))
+			Calibrate();
+		return static_cast<uint64_t>(cycles * m_nsPerCycle);
+	}
+
+	static bool IsHardware();
+	static double GetFrequency();
+	static void Calibrate();
+
+protected:
+	static uint64_t Fallback();
+	static void DoCalibrate();
+
+	///@brief Nanoseconds per count, or 0 before calibration
+	static double m_nsPerCycle;
+
+	///@brief True if the cycle counter can be read from user space
+	static bool m_hardware;
+};
+
+/**
+	@brief Times its own lifetime with the cycle counter
+
+	On destruction the elapsed time is added to a running total, and recorded in a latency histogram if one was given.
+	Adapters put one at the top of each wire-level function to maintain the shift time and latency histograms, and
+	because it is a destructor, operations that throw are still accounted for. Stop() does the same early, and returns
+	the time, for passing on to a probe.
+ */
+class JtagScopedTimer
+{
+public:
+	///@brief Starts timing
+	JtagScopedTimer(uint64_t& total_ns, JtagLatencyHistogram* hist = NULL)
+		: m_total(total_ns)
+		, m_hist(hist)
+		, m_start(JtagCycleClock::Now())
+		, m_running(true)
+	{}
+
+	///@brief Accounts for the elapsed time, unless Stop() already did
+	~JtagScopedTimer()
+	{
+		if(m_running)
+			Stop();
+	}
+
+	///@brief Stops timing, accounts for the elapsed time and returns it, in ns
+	uint64_t Stop()
+	{
+		uint64_t ns = JtagCycleClock::ToNs(JtagCycleClock::Now() - m_start);
+		m_total += ns;
+		if(m_hist)
+			m_hist->Record(ns);
+		m_running = false;
+		return ns;
+	}
+
+protected:
+	///@brief Running total to add to, in ns
+	uint64_t& m_total;
+
+	///@brief Histogram to record in, if any
+	JtagLatencyHistogram* m_hist;
+
+	///@brief Cycle count at construction
+	uint64_t m_start;
+
+	///@brief False once Stop() has been called
+	bool m_running;
+};
+
+#endif
@@ -0,0 +1,454 @@
+/**
+	@file
+	@brief Implementation of JtagCostModel, JtagCostEstimate and JtagCostEstimator
+ */
+
+#include "jtaghal.h"
+#include <algorithm>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// JtagCostModel
+
+/**
+	@brief Creates an uncalibrated model, in which everything is free
+ */
+JtagCostModel::JtagCostModel()
+	: data_call_ns(0)
+	, data_bit_ns(0)
+	, tms_call_ns(0)
+	, tms_bit_ns(0)
+	, dummy_call_ns(0)
+	, dummy_clock_ns(0)
+	, rtck_ns(0)
+{
+}
+
+/**
+	@brief Times one calibration run JTAG_COST_REPEATS times
+
+	@return The median time, in ns
+ */
+template<typename Op>
+static double MedianRunTime(Op op)
+{
+	op();
+
+	vector<double> times;
+	for(int i=0; i<JTAG_COST_REPEATS; i++)
+	{
+		uint64_t start = GetTimeNs();
+		op();
+		times.push_back(GetTimeNs() - start);
+	}
+	nth_element(times.begin(), times.begin() + times.size()/2, times.end());
+	return times[times.size()/2];
+}
+
+/**
+	@brief Splits the times of a short and a long run into a fixed cost and a cost per clock
+ */
+static void FitCost(double short_ns, double long_ns, double& call_ns, double& clock_ns)
+{
+	clock_ns = max(0.0, (long_ns - short_ns) / (JTAG_COST_LONG_RUN - JTAG_COST_SHORT_RUN));
+	call_ns = max(0.0, short_ns - clock_ns * JTAG_COST_SHORT_RUN);
+}
+
+/**
+	@brief Measures the costs on an adapter
+
+	Each wire-level operation is timed with a short and a long run of clocks. TMS is held low throughout and the
+	chain is expected to be in Run-Test/Idle, where every operation in the library leaves it, so the TAP stays put.
+	Even from another state, a TAP clocked with TMS low never reaches Update-DR or Update-IR, so calibrating writes
+	nothing to the target. RTCK waits are taken from the adapter's own counters.
+
+	@param iface	The adapter
+
+	@throw JtagException if a shift fails
+ */
+void JtagCostModel::Calibrate(JtagInterface* iface)
+{
+	iface->Commit();
+
+	JtagPerfSnapshot before;
+	iface->GetPerfSnapshot(before);
+
+	unsigned char zeros[JTAG_COST_LONG_RUN / 8] = {0};
+	unsigned char rx[JTAG_COST_LONG_RUN / 8];
+
+	//Reading the clock isn't part of any operation
+	double empty = MedianRunTime([]{});
+
+	double data_short = MedianRunTime([&]{ iface->ShiftData(false, zeros, rx, JTAG_COST_SHORT_RUN); });
+	double data_long = MedianRunTime([&]{ iface->ShiftData(false, zeros, rx, JTAG_COST_LONG_RUN); });
+	double tms_short = MedianRunTime([&]{ iface->ShiftTMS(false, zeros, JTAG_COST_SHORT_RUN); });
+	double tms_long = MedianRunTime([&]{ iface->ShiftTMS(false, zeros, JTAG_COST_LONG_RUN); });
+	double dummy_short = MedianRunTime([&]{ iface->SendDummyClocks(JTAG_COST_SHORT_RUN); });
+	double dummy_long = MedianRunTime([&]{ iface->SendDummyClocks(JTAG_COST_LONG_RUN); });
+
+	FitCost(data_short - empty, data_long - empty, data_call_ns, data_bit_ns);
+	FitCost(tms_short - empty, tms_long - empty, tms_call_ns, tms_bit_ns);
+	FitCost(dummy_short - empty, dummy_long - empty, dummy_call_ns, dummy_clock_ns);
+
+	//Take the RTCK share out of the per-clock costs
+	JtagPerfSnapshot after;
+	iface->GetPerfSnapshot(after);
+	uint64_t clocks =
+		(after.data_bits - before.data_bits) +
+		(after.mode_bits - before.mode_bits) +
+		(after.dummy_clocks - before.dummy_clocks);
+	uint64_t waited = after.rtck_wait.GetSum() - before.rtck_wait.GetSum();
+	rtck_ns = clocks ? (static_cast<double>(waited) / clocks) : 0;
+	data_bit_ns = max(0.0, data_bit_ns - rtck_ns);
+	tms_bit_ns = max(0.0, tms_bit_ns - rtck_ns);
+	dummy_clock_ns = max(0.0, dummy_clock_ns - rtck_ns);
+}
+
+/**
+	@brief Prints the costs
+ */
+void JtagCostModel::Print(FILE* fp) const
+{
+	fprintf(fp, "ShiftData:       %10.0f ns/call + %8.1f ns/bit\n", data_call_ns, data_bit_ns);
+	fprintf(fp, "ShiftTMS:        %10.0f ns/call + %8.1f ns/bit\n", tms_call_ns, tms_bit_ns);
+	fprintf(fp, "SendDummyClocks: %10.0f ns/call + %8.1f ns/clock\n", dummy_call_ns, dummy_clock_ns);
+	fprintf(fp, "RTCK wait:       %26.1f ns/clock\n", rtck_ns);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// JtagCostEstimate
+
+/**
+	@brief Creates an empty estimate
+ */
+JtagCostEstimate::JtagCostEstimate()
+	: data_calls(0)
+	, data_bits(0)
+	, tms_calls(0)
+	, tms_bits(0)
+	, run_clocks(0)
+	, dummy_calls(0)
+	, dummy_clocks(0)
+	, total(0)
+{
+	for(int i=0; i<LAYER_COUNT; i++)
+		time[i] = 0;
+}
+
+/**
+	@brief Returns the layer taking the most time
+ */
+JtagCostEstimate::Layer JtagCostEstimate::GetDominantLayer() const
+{
+	Layer best = LAYER_CALLS;
+	for(int i=1; i<LAYER_COUNT; i++)
+	{
+		if(time[i] > time[best])
+			best = static_cast<Layer>(i);
+	}
+	return best;
+}
+
+/**
+	@brief Returns a description of a layer
+ */
+const char* JtagCostEstimate::GetLayerName(Layer layer)
+{
+	switch(layer)
+	{
+		case LAYER_CALLS:
+			return "adapter calls";
+		case LAYER_DATA:
+			return "data shifting";
+		case LAYER_TMS:
+			return "TAP state changes";
+		case LAYER_IDLE:
+			return "idle clocks";
+		case LAYER_RTCK:
+			return "RTCK waits";
+		case LAYER_WAIT:
+			return "RUNTEST waits";
+		default:
+			return "unknown";
+	}
+}
+
+/**
+	@brief Prints the counts, the time taken by each layer and the total
+ */
+void JtagCostEstimate::Print(FILE* fp) const
+{
+	fprintf(fp, "ShiftData:       %12" PRIu64 " calls, %14" PRIu64 " bits\n", data_calls, data_bits);
+	fprintf(fp, "ShiftTMS:        %12" PRIu64 " calls, %14" PRIu64 " bits (%" PRIu64 " RUNTEST)\n",
+		tms_calls, tms_bits, run_clocks);
+	fprintf(fp, "SendDummyClocks: %12" PRIu64 " calls, %14" PRIu64 " clocks\n", dummy_calls, dummy_clocks);
+	for(int i=0; i<LAYER_COUNT; i++)
+	{
+		fprintf(fp, "%-18s %12.6f s %6.1f%%\n",
+			GetLayerName(static_cast<Layer>(i)), time[i], (total > 0) ? (100 * time[i] / total) : 0.0);
+	}
+	fprintf(fp, "%-18s %12.6f s\n", "estimated total", total);
+	fprintf(fp, "dominated by %s\n", GetLayerName(GetDominantLayer()));
+}
+
+///@brief The operation counts of a JtagCostEstimate
+static uint64_t JtagCostEstimate::* const g_costCounts[] =
+{
+	&JtagCostEstimate::data_calls,
+	&JtagCostEstimate::data_bits,
+	&JtagCostEstimate::tms_calls,
+	&JtagCostEstimate::tms_bits,
+	&JtagCostEstimate::run_clocks,
+	&JtagCostEstimate::dummy_calls,
+	&JtagCostEstimate::dummy_clocks
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SVF counting
+
+/**
+	@brief Plays an SVF file into a JtagCostEstimator, skipping TDO checks and RUNTEST waits
+ */
+class SvfCostCounter : public SvfPlayer
+{
+public:
+	SvfCostCounter(JtagCostEstimator* estimator)
+		: SvfPlayer(estimator)
+		, m_estimator(estimator)
+	{}
+
+protected:
+	virtual size_t EmitScan(bool last, size_t count, bool /*compare*/, bool /*has_mask*/)
+	{
+		m_estimator->ShiftData(last, m_tdiChunk, NULL, count);
+		return SVF_NO_MISMATCH;
+	}
+
+	virtual void EmitRun(bool tms, uint64_t clocks, double min_time)
+	{ m_estimator->AddRun(tms, clocks, min_time); }
+
+	///@brief The estimator
+	JtagCostEstimator* m_estimator;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// JtagCostEstimator construction / destruction
+
+/**
+	@brief Creates an estimator
+
+	@param model			Costs of the adapter the workload is meant for
+	@param chain_length		Number of TAPs in the chain, for padding SetIR() and ScanDR()
+	@param ir_length		Total IR length of the chain (only used with more than one TAP)
+ */
+JtagCostEstimator::JtagCostEstimator(const JtagCostModel& model, size_t chain_length, size_t ir_length)
+	: m_model(model)
+	, m_waitTime(0)
+{
+	m_idcodes.resize(max<size_t>(chain_length, 1), 0);
+	m_irtotal = ir_length;
+}
+
+JtagCostEstimator::~JtagCostEstimator()
+{
+	ShutdownAsync();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Workloads
+
+/**
+	@brief Counts the operations of an SVF file
+
+	@throw JtagException if the file can't be read or doesn't parse
+ */
+void JtagCostEstimator::AddSvf(const string& path)
+{
+	SvfCostCounter counter(this);
+	counter.Play(path);
+}
+
+/**
+	@brief Counts the operations of a CevaDebugPort memory read or write
+
+	@param bytes	Transfer size, rounded up to whole words
+	@param write	True for WriteMemory(), false for ReadMemory()
+ */
+void JtagCostEstimator::AddMemoryTransfer(size_t bytes, bool write)
+{
+	size_t words = (bytes + 3) / 4;
+	if(words == 0)
+		return;
+
+	//Every word after the first in a transaction costs the same, so count a one and a two word transfer and
+	//extrapolate, per transaction: with integrity checking on, the transfer is split into CEVA_TRANSACTION_WORDS chunks
+	//that each set the address up again
+	JtagCostEstimate start = m_counts;
+	uint32_t buf[2] = {0, 0};
+	JtagCostEstimate one;
+	for(size_t n=1; n<=2; n++)
+	{
+		CevaDebugPort port(this);
+		if(write)
+			port.WriteMemory(0, buf, n);
+		else
+			port.ReadMemory(0, buf, n);
+		if(n == 1)
+			one = m_counts;
+	}
+
+	size_t chunk = IsScanIntegrityEnabled() ? CEVA_TRANSACTION_WORDS : words;
+	size_t full = words / chunk;
+	size_t rest = words % chunk;
+	for(size_t i=0; i<sizeof(g_costCounts)/sizeof(g_costCounts[0]); i++)
+	{
+		uint64_t JtagCostEstimate::* field = g_costCounts[i];
+		uint64_t first = one.*field - start.*field;
+		uint64_t each = (m_counts.*field - one.*field) - first;
+		uint64_t total = full * (first + (chunk - 1) * each);
+		if(rest)
+			total += first + (rest - 1) * each;
+		m_counts.*field = start.*field + total;
+	}
+}
+
+/**
+	@brief Counts RUNTEST clocks the way SvfPlayer::RunClocks() sends them, and the minimum time beyond them
+
+	@param tms		TMS level to hold
+	@param clocks	Number of TCK cycles
+	@param min_time	Minimum time from the first clock, in seconds
+ */
+void JtagCostEstimator::AddRun(bool tms, uint64_t clocks, double min_time)
+{
+	unsigned char level[SVF_CHUNK_BITS / 8];
+	memset(level, tms ? 0xff : 0x00, sizeof(level));
+
+	uint64_t calls = 0;
+	for(uint64_t left = clocks; left; )
+	{
+		size_t count = min(left, static_cast<uint64_t>(SVF_CHUNK_BITS));
+		ShiftTMS(false, level, count);
+		left -= count;
+		calls ++;
+	}
+	m_counts.run_clocks += clocks;
+
+	double clock_time = (calls * m_model.tms_call_ns + clocks * (m_model.tms_bit_ns + m_model.rtck_ns)) * 1e-9;
+	if(min_time > clock_time)
+		m_waitTime += min_time - clock_time;
+}
+
+/**
+	@brief Applies the cost model to everything counted so far
+ */
+void JtagCostEstimator::GetEstimate(JtagCostEstimate& estimate)
+{
+	estimate = m_counts;
+
+	uint64_t state_bits = m_counts.tms_bits - m_counts.run_clocks;
+	uint64_t clocks = m_counts.data_bits + m_counts.tms_bits + m_counts.dummy_clocks;
+
+	estimate.time[JtagCostEstimate::LAYER_CALLS] = 1e-9 * (
+		m_counts.data_calls * m_model.data_call_ns +
+		m_counts.tms_calls * m_model.tms_call_ns +
+		m_counts.dummy_calls * m_model.dummy_call_ns);
+	estimate.time[JtagCostEstimate::LAYER_DATA] = 1e-9 * m_counts.data_bits * m_model.data_bit_ns;
+	estimate.time[JtagCostEstimate::LAYER_TMS] = 1e-9 * state_bits * m_model.tms_bit_ns;
+	estimate.time[JtagCostEstimate::LAYER_IDLE] = 1e-9 * (
+		m_counts.dummy_clocks * m_model.dummy_clock_ns +
+		m_counts.run_clocks * m_model.tms_bit_ns);
+	estimate.time[JtagCostEstimate::LAYER_RTCK] = 1e-9 * clocks * m_model.rtck_ns;
+	estimate.time[JtagCostEstimate::LAYER_WAIT] = m_waitTime;
+
+	estimate.total = 0;
+	for(int i=0; i<JtagCostEstimate::LAYER_COUNT; i++)
+		estimate.total += estimate.time[i];
+}
+
+/**
+	@brief Forgets everything counted so far
+ */
+void JtagCostEstimator::Clear()
+{
+	m_counts = JtagCostEstimate();
+	m_waitTime = 0;
+	ResetPerfCounters();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Adapter information
+
+string JtagCostEstimator::GetName()
+{
+	return "cost estimator";
+}
+
+string JtagCostEstimator::GetSerial()
+{
+	return "";
+}
+
+string JtagCostEstimator::GetUserID()
+{
+	return "";
+}
+
+int JtagCostEstimator::GetFrequency()
+{
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Low-level JTAG interface
+
+/**
+	@brief Counts a data shift. Nothing is read back, so rcv_data is zeroed.
+
+	With integrity checking on, the last pattern length of bits echo the first ones instead, the way an error-free
+	link returns the pattern, so checked scans pass and are counted once rather than retried.
+ */
+void JtagCostEstimator::ShiftData(bool /*last_tms*/, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+{
+	CountShiftData(count);
+	m_counts.data_calls ++;
+	m_counts.data_bits += count;
+	if(!rcv_data)
+		return;
+
+	memset(rcv_data, 0, (count + 7) / 8);
+	if( (m_integrityBits == 0) || (count < m_integrityBits) )
+		return;
+	size_t delay = count - m_integrityBits;
+	for(size_t i=0; i<m_integrityBits; i++)
+		PokeBit(rcv_data, delay + i, PeekBit(send_data, i));
+}
+
+/**
+	@brief Counts a TMS shift
+ */
+void JtagCostEstimator::ShiftTMS(bool /*tdi*/, const unsigned char* /*send_data*/, size_t count)
+{
+	CountShiftTMS(count);
+	m_counts.tms_calls ++;
+	m_counts.tms_bits += count;
+}
+
+/**
+	@brief Counts dummy clocks
+ */
+void JtagCostEstimator::SendDummyClocks(size_t n)
+{
+	CountDummyClocks(n);
+	m_counts.dummy_calls ++;
+	m_counts.dummy_clocks += n;
+}
+
+/**
+	@brief Returns zero, as every read does
+ */
+bool JtagCostEstimator::ReadTDO()
+{
+	return false;
+}
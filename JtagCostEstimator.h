@@ -0,0 +1,158 @@
+/**
+	@file
+	@brief Declaration of JtagCostModel, JtagCostEstimate and JtagCostEstimator
+ */
+
+#ifndef JtagCostEstimator_h
+#define JtagCostEstimator_h
+
+///@brief Clocks per call of the short calibration runs
+#define JTAG_COST_SHORT_RUN		16
+
+///@brief Clocks per call of the long calibration runs
+#define JTAG_COST_LONG_RUN		1024
+
+///@brief Times each calibration run is repeated (the median is used)
+#define JTAG_COST_REPEATS		15
+
+/**
+	@brief Cost of each kind of wire-level operation on one adapter, measured by Calibrate()
+
+	Every operation is modelled as a fixed cost per adapter call plus a cost per TCK cycle. The per-cycle costs
+	exclude RTCK waits, which are accounted separately since they depend on the target rather than on the host.
+ */
+struct JtagCostModel
+{
+	JtagCostModel();
+
+	///@brief Fixed cost of one ShiftData() call, in ns
+	double data_call_ns;
+
+	///@brief Cost of each ShiftData() bit, in ns
+	double data_bit_ns;
+
+	///@brief Fixed cost of one ShiftTMS() call, in ns
+	double tms_call_ns;
+
+	///@brief Cost of each ShiftTMS() bit, in ns
+	double tms_bit_ns;
+
+	///@brief Fixed cost of one SendDummyClocks() call, in ns
+	double dummy_call_ns;
+
+	///@brief Cost of each dummy clock, in ns
+	double dummy_clock_ns;
+
+	///@brief Mean time spent waiting for RTCK per TCK cycle, in ns
+	double rtck_ns;
+
+	void Calibrate(JtagInterface* iface);
+	void Print(FILE* fp) const;
+};
+
+/**
+	@brief Predicted wall time of a workload, broken down by layer
+ */
+struct JtagCostEstimate
+{
+	JtagCostEstimate();
+
+	/**
+		@brief Where the time goes
+	 */
+	enum Layer
+	{
+		LAYER_CALLS,			///< Fixed cost of each adapter call
+		LAYER_DATA,				///< Shifting scan data
+		LAYER_TMS,				///< Moving the TAP between states
+		LAYER_IDLE,				///< Dummy and RUNTEST clocks
+		LAYER_RTCK,				///< Waiting for the target to return TCK
+		LAYER_WAIT,				///< RUNTEST minimum times beyond the clocks themselves
+		LAYER_COUNT
+	};
+
+	///@brief Number of ShiftData() calls
+	uint64_t data_calls;
+
+	///@brief Number of data bits shifted
+	uint64_t data_bits;
+
+	///@brief Number of ShiftTMS() calls
+	uint64_t tms_calls;
+
+	///@brief Number of TMS bits shifted
+	uint64_t tms_bits;
+
+	///@brief Number of those TMS bits that were RUNTEST clocks rather than state changes
+	uint64_t run_clocks;
+
+	///@brief Number of SendDummyClocks() calls
+	uint64_t dummy_calls;
+
+	///@brief Number of dummy clocks
+	uint64_t dummy_clocks;
+
+	///@brief Time spent in each layer, in seconds
+	double time[LAYER_COUNT];
+
+	///@brief Total predicted time, in seconds
+	double total;
+
+	Layer GetDominantLayer() const;
+	static const char* GetLayerName(Layer layer);
+	void Print(FILE* fp) const;
+};
+
+/**
+	@brief Predicts how long a workload will take on an adapter, without running it
+
+	The estimator is itself a JtagInterface, which counts the wire-level operations it is asked for and does nothing
+	else. A workload run against it - a JtagScanPlan or SetIR() / ScanDR() calls made on the estimator, an SVF file
+	(AddSvf()) or a debug port memory transfer (AddMemoryTransfer()) - goes through exactly the code it would on the
+	real adapter, so the counts are exact. GetEstimate() multiplies them by the costs in a JtagCostModel calibrated on
+	the real adapter. CopyScanIntegrity() from the real adapter counts its integrity patterns and transaction chunking
+	too.
+
+	Everything the estimator "reads" from TDO is zero, so workloads must not depend on what they read back; SVF TDO
+	checks are skipped. Time spent above the wire level (building scans, parsing SVF) isn't modelled, and is normally
+	small next to the shifting itself.
+ */
+class JtagCostEstimator : public JtagInterface
+{
+public:
+	JtagCostEstimator(const JtagCostModel& model, size_t chain_length = 1, size_t ir_length = 0);
+	virtual ~JtagCostEstimator();
+
+	//Workloads
+	void AddSvf(const std::string& path);
+	void AddMemoryTransfer(size_t bytes, bool write);
+	void AddRun(bool tms, uint64_t clocks, double min_time);
+
+	void GetEstimate(JtagCostEstimate& estimate);
+	void Clear();
+
+	//Adapter information
+	virtual std::string GetName();
+	virtual std::string GetSerial();
+	virtual std::string GetUserID();
+	virtual int GetFrequency();
+
+	//Low-level JTAG interface, which only counts
+	virtual void ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
+	virtual void SendDummyClocks(size_t n);
+	virtual bool ReadTDO();
+
+protected:
+	virtual void ShiftTMS(bool tdi, const unsigned char* send_data, size_t count);
+
+	///@brief Costs to apply
+	JtagCostModel m_model;
+
+	///@brief What has been counted so far (time is only filled in by GetEstimate())
+	JtagCostEstimate m_counts;
+
+	///@brief RUNTEST waiting beyond the clocks themselves, in seconds
+	double m_waitTime;
+};
+
+#endif
@@ -0,0 +1,1022 @@
+/**
+	@file
+	@brief Implementation of JtagDaemon
+ */
+
+#include "jtaghal.h"
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+using namespace std;
+
+//File sealing, spelled out since older libcs don't define it
+#ifndef F_GET_SEALS
+#define F_GET_SEALS			1034
+#define F_SEAL_SHRINK		0x0002
+#endif
+
+///@brief Size of one recv() from a client
+#define JTAGD_RECV_SIZE		65536
+
+volatile sig_atomic_t JtagDaemon::m_stopRequested = 0;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a daemon serving an adapter
+
+	@param iface	The adapter. InitializeChain() must have been called already, and it must outlive the daemon.
+ */
+JtagDaemon::JtagDaemon(JtagInterface* iface)
+	: m_iface(iface)
+	, m_port(iface)
+	, m_startTime(GetTime())
+	, m_requestCount(0)
+{
+}
+
+JtagDaemon::~JtagDaemon()
+{
+	for(list<JtagdConnection>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+		CloseClient(*it);
+}
+
+/**
+	@brief Makes Serve() return at the next opportunity. Safe to call from a signal handler.
+ */
+void JtagDaemon::RequestStop()
+{
+	m_stopRequested = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Connection handling
+
+/**
+	@brief Accepts and serves clients until RequestStop() is called
+
+	@throw JtagException if accepting fails
+ */
+void JtagDaemon::Serve(ServerSocket& sock)
+{
+	vector<struct pollfd> fds;
+	while(!m_stopRequested)
+	{
+		//Listening socket, then each client's socket followed by its doorbell if it has a ring
+		fds.clear();
+		struct pollfd pfd;
+		pfd.fd = sock.GetFD();
+		pfd.events = (m_clients.size() < JTAGD_MAX_CLIENTS) ? POLLIN : 0;
+		pfd.revents = 0;
+		fds.push_back(pfd);
+		for(list<JtagdConnection>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+		{
+			pfd.fd = it->fd;
+			pfd.events = IsBacklogged(*it) ? 0 : POLLIN;
+			if(!it->txbuf.empty())
+				pfd.events |= POLLOUT;
+			fds.push_back(pfd);
+			if(it->ring.base)
+			{
+				pfd.fd = it->ring.doorbell;
+				pfd.events = POLLIN;
+				fds.push_back(pfd);
+			}
+		}
+
+		//Only look if there's work left over from the last round, sleep until a stalled transaction times out, or
+		//sleep until something happens
+		double now = GetTime();
+		int timeout = -1;
+		if(HasRunnableWork(now))
+			timeout = 0;
+		else if(m_scheduler.IsBlocked(now))
+			timeout = static_cast<int>(ceil( (m_scheduler.GetWakeupTime() - now) * 1000));
+
+		//Signals interrupt the wait, which is how RequestStop() gets noticed
+		if(poll(&fds[0], fds.size(), timeout) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			throw JtagExceptionWrapper(
+				"poll() failed",
+				"");
+		}
+
+		//Queue whatever arrived
+		now = GetTime();
+		size_t i = 1;
+		for(list<JtagdConnection>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+		{
+			//Writability is dealt with by SendReplies() below
+			bool sock_ready = ( (fds[i++].revents & ~POLLOUT) != 0);
+			bool ring_ready = false;
+			if(it->ring.base)
+				ring_ready = (fds[i++].revents != 0);
+
+			if(ring_ready)
+				ReadRing(*it, now);
+			if(sock_ready && !ReadRequests(*it, now))
+			{
+				it->dead = true;
+				it->queue.m_items.clear();
+			}
+		}
+
+		if(fds[0].revents & POLLIN)
+		{
+			JtagdConnection conn;
+			conn.fd = sock.Accept();
+			conn.dead = false;
+			conn.reserved = 0;
+			fcntl(conn.fd, F_SETFL, fcntl(conn.fd, F_GETFL) | O_NONBLOCK);
+			memset(&conn.ring, 0, sizeof(conn.ring));
+			m_clients.push_back(conn);
+
+			JtagdConnection& added = m_clients.back();
+			struct ucred cred;
+			socklen_t len = sizeof(cred);
+			if(getsockopt(added.fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+				added.queue.m_pid = cred.pid;
+			m_scheduler.AddClient(&added.queue);
+		}
+
+		RunSlices();
+
+		//Answer everything that completed in one go per client, then drop whoever went away. Requests held back while
+		//a client was backlogged are picked up again once it has read enough.
+		for(list<JtagdConnection>::iterator it = m_clients.begin(); it != m_clients.end(); )
+		{
+			SendReplies(*it);
+			if(!it->dead && !it->rxbuf.empty() && !IsBacklogged(*it) && !ParseRequests(*it, now))
+			{
+				it->dead = true;
+				it->queue.m_items.clear();
+			}
+			if(it->dead)
+			{
+				m_scheduler.RemoveClient(&it->queue);
+				CloseClient(*it);
+				it = m_clients.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+}
+
+/**
+	@brief Closes a client connection and releases everything it holds
+ */
+void JtagDaemon::CloseClient(JtagdConnection& conn)
+{
+	DetachRing(conn.ring);
+	for(size_t i=0; i<conn.fds.size(); i++)
+		close(conn.fds[i]);
+	conn.fds.clear();
+	close(conn.fd);
+}
+
+/**
+	@brief Reads whatever a client has sent, and queues the complete requests in it
+
+	@param conn		The client
+	@param now		Current time
+
+	@return False if the client disconnected or broke the protocol, and should be dropped
+ */
+bool JtagDaemon::ReadRequests(JtagdConnection& conn, double now)
+{
+	size_t oldlen = conn.rxbuf.size();
+	conn.rxbuf.resize(oldlen + JTAGD_RECV_SIZE);
+	ssize_t n = ServerSocket::RecvWithFds(conn.fd, &conn.rxbuf[oldlen], JTAGD_RECV_SIZE, conn.fds);
+	if( (n < 0) && ( (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) ) )
+	{
+		conn.rxbuf.resize(oldlen);
+		return true;
+	}
+	if(n <= 0)
+		return false;
+	conn.rxbuf.resize(oldlen + n);
+
+	return ParseRequests(conn, now);
+}
+
+/**
+	@brief Queues complete requests from a client's receive buffer, until it runs out or the client is backlogged
+
+	Whatever is left stays in the buffer for the next call.
+
+	@param conn		The client
+	@param now		Current time
+
+	@return False if the client broke the protocol, and should be dropped
+ */
+bool JtagDaemon::ParseRequests(JtagdConnection& conn, double now)
+{
+	size_t pos = 0;
+	while( (conn.rxbuf.size() - pos >= sizeof(JtagdRequestHeader)) && !IsBacklogged(conn) )
+	{
+		JtagdRequestHeader req;
+		memcpy(&req, &conn.rxbuf[pos], sizeof(req));
+
+		//There's no way to resynchronize after an oversized request, so give up on the client
+		if(req.length > JTAGD_MAX_PAYLOAD)
+		{
+			const char* message = "Request payload too large";
+			AppendReply(conn.txbuf, JTAGD_STATUS_BAD_REQUEST, message, strlen(message));
+			return false;
+		}
+		if(conn.rxbuf.size() - pos - sizeof(req) < req.length)
+			break;
+
+		//The item is copied into the queue, so point it at its own buffers only once it's there
+		conn.queue.m_items.push_back(JtagdWorkItem());
+		JtagdWorkItem& item = conn.queue.m_items.back();
+		item.req = req;
+		item.ring = false;
+		item.tag = 0;
+		item.payload.assign(conn.rxbuf.begin() + pos + sizeof(req), conn.rxbuf.begin() + pos + sizeof(req) + req.length);
+		item.status = CheckRequest(req, item.message);
+
+		//Only size the reply for requests that passed, the bit count is the client's to choose
+		item.reply.resize( (item.status == JTAGD_STATUS_OK) ? (GetReplySize(req) + 1) : 1 );
+		item.tx = item.payload.empty() ? NULL : &item.payload[0];
+		item.txlen = req.length;
+		item.rx = &item.reply[0];
+		item.rxcap = item.reply.size() - 1;
+		item.done = 0;
+		item.queued = now;
+		item.waiting = now;
+		conn.reserved += item.reply.size();
+
+		pos += sizeof(req) + req.length;
+	}
+	conn.rxbuf.erase(conn.rxbuf.begin(), conn.rxbuf.begin() + pos);
+	return true;
+}
+
+/**
+	@brief Checks whether a client has so many replies unread, or coming, that no more of its requests should be read
+ */
+bool JtagDaemon::IsBacklogged(const JtagdConnection& conn)
+{
+	return (conn.txbuf.length() + conn.reserved) >= JTAGD_MAX_BACKLOG;
+}
+
+/**
+	@brief Sends a client as much of its pending replies as its socket will take
+
+	The rest waits for the next round, when poll() says the socket is writable again.
+ */
+void JtagDaemon::SendReplies(JtagdConnection& conn)
+{
+	size_t sent = 0;
+	while(sent < conn.txbuf.length())
+	{
+		ssize_t n = send(conn.fd, conn.txbuf.c_str() + sent, conn.txbuf.length() - sent, 0);
+		if(n > 0)
+		{
+			sent += n;
+			continue;
+		}
+		if( (n < 0) && (errno == EINTR) )
+			continue;
+		if( (n < 0) && ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) )
+			break;
+
+		conn.dead = true;
+		conn.queue.m_items.clear();
+		conn.txbuf.clear();
+		return;
+	}
+	conn.txbuf.erase(0, sent);
+}
+
+/**
+	@brief Rejects requests whose bit count doesn't fit the protocol, before anything is sized from it
+
+	@param req		The request, with length the size of the payload that came with it
+	@param message	Reason for rejecting it
+
+	@return JTAGD_STATUS_OK, or JTAGD_STATUS_BAD_REQUEST
+ */
+uint32_t JtagDaemon::CheckRequest(const JtagdRequestHeader& req, string& message)
+{
+	switch(req.opcode & ~JTAGD_FLAG_TRANSACTION)
+	{
+		case JTAGD_OP_SET_IR:
+		case JTAGD_OP_SCAN_DR:
+		case JTAGD_OP_SHIFT_DATA:
+			if(static_cast<uint64_t>(req.bits) > static_cast<uint64_t>(JTAGD_MAX_PAYLOAD) * 8)
+			{
+				message = "Bit count too large";
+				return JTAGD_STATUS_BAD_REQUEST;
+			}
+			if(req.length < (static_cast<size_t>(req.bits) + 7) / 8)
+			{
+				message = "Payload shorter than the bit count";
+				return JTAGD_STATUS_BAD_REQUEST;
+			}
+			break;
+
+		default:
+			break;
+	}
+	return JTAGD_STATUS_OK;
+}
+
+/**
+	@brief Returns how big a socket reply to a request can get, so Dispatch() has somewhere to put it
+ */
+size_t JtagDaemon::GetReplySize(const JtagdRequestHeader& req)
+{
+	size_t nbytes = (static_cast<size_t>(req.bits) + 7) / 8;
+	switch(req.opcode & ~JTAGD_FLAG_TRANSACTION)
+	{
+		case JTAGD_OP_GET_INFO:
+			return sizeof(JtagdInfo) + m_iface->GetChainLength() * sizeof(uint32_t);
+
+		case JTAGD_OP_GET_CLIENT_STATS:
+			return JTAGD_MAX_CLIENTS * sizeof(JtagdClientStats);
+
+		case JTAGD_OP_GET_STATS:
+			return sizeof(JtagdStats);
+
+		case JTAGD_OP_SET_IR:
+		case JTAGD_OP_SHIFT_DATA:
+			return nbytes;
+
+		case JTAGD_OP_SCAN_DR:
+			return req.arg ? nbytes : 0;
+
+		case JTAGD_OP_CEVA_VERSION:
+		case JTAGD_OP_CEVA_STATUS:
+		case JTAGD_OP_CEVA_PC:
+			return sizeof(uint32_t);
+
+		case JTAGD_OP_CEVA_READ_REGS:
+		case JTAGD_OP_CEVA_READ_MEM:
+			if(static_cast<uint64_t>(req.bits) * 4 > JTAGD_MAX_PAYLOAD)
+				return 0;
+			return req.bits * sizeof(uint32_t);
+
+		default:
+			return 0;
+	}
+}
+
+/**
+	@brief Appends a reply header and payload
+ */
+void JtagDaemon::AppendReply(string& reply, uint32_t status, const void* data, size_t len)
+{
+	JtagdReplyHeader hdr;
+	hdr.status = status;
+	hdr.length = len;
+	reply.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+	if(len)
+		reply.append(static_cast<const char*>(data), len);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Shared memory transport
+
+/**
+	@brief Maps a client's ring, using the descriptors that came with the request
+
+	@return A JtagdStatus, with the reason in message on failure
+ */
+uint32_t JtagDaemon::AttachRing(JtagdConnection& conn, const JtagdRequestHeader& req, string& message)
+{
+	//Whatever came with the request is used up here, one way or another, so a later attach never sees it
+	if(conn.fds.size() < 3)
+	{
+		for(size_t i=0; i<conn.fds.size(); i++)
+			close(conn.fds[i]);
+		conn.fds.clear();
+		message = "Shared memory attach needs a memfd and two eventfds";
+		return JTAGD_STATUS_BAD_REQUEST;
+	}
+
+	int memfd = conn.fds[0];
+	int doorbell = conn.fds[1];
+	int completion = conn.fds[2];
+	for(size_t i=3; i<conn.fds.size(); i++)
+		close(conn.fds[i]);
+	conn.fds.clear();
+
+	//Queued ring requests point into the old mapping
+	if(conn.ring.queued)
+	{
+		close(memfd);
+		close(doorbell);
+		close(completion);
+		message = "Shared memory requests still in flight";
+		return JTAGD_STATUS_BAD_REQUEST;
+	}
+
+	DetachRing(conn.ring);
+
+	//A client shrinking the region under us would turn our accesses into SIGBUS and take the daemon down with them.
+	//Only a memfd sealed against shrinking is safe to map: anything else (a plain file, say) can be truncated.
+	int seals = fcntl(memfd, F_GET_SEALS);
+	if( (seals < 0) || !(seals & F_SEAL_SHRINK) )
+	{
+		close(memfd);
+		close(doorbell);
+		close(completion);
+		message = "Shared memory must be a memfd sealed against shrinking";
+		return JTAGD_STATUS_BAD_REQUEST;
+	}
+
+	struct stat st;
+	void* base = MAP_FAILED;
+	if( (fstat(memfd, &st) == 0) && (static_cast<uint64_t>(st.st_size) >= sizeof(JtagdShmHeader)) )
+		base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	close(memfd);
+	if(base == MAP_FAILED)
+	{
+		close(doorbell);
+		close(completion);
+		message = "Failed to map shared memory";
+		return JTAGD_STATUS_ERROR;
+	}
+
+	//Check the geometry once, and never look at it again: the client can scribble on it at any time
+	JtagdShmHeader* header = static_cast<JtagdShmHeader*>(base);
+	uint32_t entries = header->ring_entries;
+	uint32_t data_offset = header->data_offset;
+	uint32_t data_size = header->data_size;
+	uint64_t rings_end =
+		sizeof(JtagdShmHeader) + static_cast<uint64_t>(entries) * (sizeof(JtagdShmRequest) + sizeof(JtagdShmCompletion));
+	if( (header->magic != JTAGD_SHM_MAGIC) ||
+		(header->version != JTAGD_PROTOCOL_VERSION) ||
+		(entries == 0) || (entries > JTAGD_SHM_MAX_ENTRIES) || (entries & (entries - 1)) || (entries != req.bits) ||
+		(data_offset < rings_end) || (data_offset & 7) ||
+		(static_cast<uint64_t>(data_offset) + data_size > static_cast<uint64_t>(st.st_size)) )
+	{
+		munmap(base, st.st_size);
+		close(doorbell);
+		close(completion);
+		message = "Bad shared memory header";
+		return JTAGD_STATUS_BAD_REQUEST;
+	}
+
+	JtagdSharedRing& ring = conn.ring;
+	ring.base = static_cast<uint8_t*>(base);
+	ring.size = st.st_size;
+	ring.doorbell = doorbell;
+	ring.completion = completion;
+	ring.entries = entries;
+	ring.dataSize = data_size;
+	ring.header = header;
+	ring.sq = reinterpret_cast<JtagdShmRequest*>(ring.base + sizeof(JtagdShmHeader));
+	ring.cq = reinterpret_cast<JtagdShmCompletion*>(ring.base + sizeof(JtagdShmHeader) + entries * sizeof(JtagdShmRequest));
+	ring.data = ring.base + data_offset;
+	ring.sqHead = __atomic_load_n(&header->sq_head, __ATOMIC_ACQUIRE);
+	ring.cqTail = __atomic_load_n(&header->cq_tail, __ATOMIC_ACQUIRE);
+	return JTAGD_STATUS_OK;
+}
+
+/**
+	@brief Unmaps a ring and closes its eventfds, if one is attached
+ */
+void JtagDaemon::DetachRing(JtagdSharedRing& ring)
+{
+	if(!ring.base)
+		return;
+	munmap(ring.base, ring.size);
+	close(ring.doorbell);
+	close(ring.completion);
+	memset(&ring, 0, sizeof(ring));
+}
+
+/**
+	@brief Queues everything submitted on a client's ring
+
+	@param conn		The client
+	@param now		Current time
+ */
+void JtagDaemon::ReadRing(JtagdConnection& conn, double now)
+{
+	JtagdSharedRing& ring = conn.ring;
+	uint64_t count;
+	if(read(ring.doorbell, &count, sizeof(count)) < 0)
+	{
+		//Nothing to clear, but check the queue anyway
+	}
+
+	JtagdShmHeader* header = ring.header;
+	uint32_t mask = ring.entries - 1;
+	uint32_t tail = __atomic_load_n(&header->sq_tail, __ATOMIC_ACQUIRE);
+	while(ring.sqHead != tail)
+	{
+		//A well-behaved client never has more requests outstanding than the completion queue holds. If this one
+		//does, leave the rest queued until it rings the doorbell again.
+		uint32_t cq_head = __atomic_load_n(&header->cq_head, __ATOMIC_ACQUIRE);
+		if(ring.cqTail - cq_head + ring.queued >= ring.entries)
+			break;
+
+		//Work on a private copy, the client can change the slot under our feet
+		JtagdShmRequest sreq = ring.sq[ring.sqHead & mask];
+		ring.sqHead ++;
+
+		conn.queue.m_items.push_back(JtagdWorkItem());
+		JtagdWorkItem& item = conn.queue.m_items.back();
+		item.req.opcode = sreq.opcode;
+		item.req.device = sreq.device;
+		item.req.bits = sreq.bits;
+		item.req.arg = sreq.arg;
+		item.req.length = sreq.tx_length;
+		item.ring = true;
+		item.tag = sreq.tag;
+		item.tx = ring.data + sreq.tx_offset;
+		item.txlen = sreq.tx_length;
+		item.rx = ring.data + sreq.rx_offset;
+		item.rxcap = sreq.rx_length;
+		item.done = 0;
+		item.status = JTAGD_STATUS_OK;
+		item.queued = now;
+		item.waiting = now;
+
+		//Bad ranges get an empty error completion, since there's nowhere safe to put a message
+		uint64_t tx_end = static_cast<uint64_t>(sreq.tx_offset) + sreq.tx_length;
+		uint64_t rx_end = static_cast<uint64_t>(sreq.rx_offset) + sreq.rx_length;
+		bool overlap = sreq.tx_length && sreq.rx_length && (sreq.tx_offset < rx_end) && (sreq.rx_offset < tx_end);
+		if( (tx_end > ring.dataSize) || (rx_end > ring.dataSize) || overlap ||
+			( (sreq.opcode & ~JTAGD_FLAG_TRANSACTION) == JTAGD_OP_ATTACH_SHM) )
+		{
+			item.status = JTAGD_STATUS_BAD_REQUEST;
+			item.tx = NULL;
+			item.txlen = 0;
+			item.rx = NULL;
+			item.rxcap = 0;
+		}
+		else
+			item.status = CheckRequest(item.req, item.message);
+		ring.queued ++;
+
+		if(ring.sqHead == tail)
+			tail = __atomic_load_n(&header->sq_tail, __ATOMIC_ACQUIRE);
+	}
+	__atomic_store_n(&header->sq_head, ring.sqHead, __ATOMIC_RELEASE);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scheduling
+
+/**
+	@brief Checks if any client has a request the scheduler would let run now
+ */
+bool JtagDaemon::HasRunnableWork(double now)
+{
+	if(m_scheduler.IsBlocked(now))
+		return false;
+	for(list<JtagdConnection>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+	{
+		if(!it->queue.m_items.empty())
+			return true;
+	}
+	return false;
+}
+
+/**
+	@brief Runs slices chosen by the scheduler until nothing is runnable or JTAGD_SCHEDULE_BUDGET is used up
+ */
+void JtagDaemon::RunSlices()
+{
+	double start = GetTime();
+	double now = start;
+	while(now - start < JTAGD_SCHEDULE_BUDGET)
+	{
+		JtagSchedulerQueue* queue = m_scheduler.PickNext(now);
+		if(!queue)
+			break;
+
+		list<JtagdConnection>::iterator it = m_clients.begin();
+		while(&it->queue != queue)
+			++it;
+		JtagdConnection& conn = *it;
+
+		JtagdWorkItem& item = queue->m_items.front();
+		m_scheduler.OnSliceStart(queue, item);
+		size_t rxlen = 0;
+		double slice_start = now;
+		bool finished = ExecuteSlice(conn, item, rxlen);
+		now = GetTime();
+		m_scheduler.OnSliceEnd(queue, item, slice_start, now);
+		if(!finished)
+			continue;
+
+		Complete(conn, item, rxlen);
+		m_scheduler.OnComplete(queue, item, rxlen, now);
+		queue->m_items.pop_front();
+		m_requestCount ++;
+		if(conn.dead)
+			queue->m_items.clear();
+	}
+}
+
+/**
+	@brief Executes the next slice of a request
+
+	Memory transfers longer than JTAGD_SLICE_WORDS go JTAGD_SLICE_WORDS at a time, everything else in one go.
+
+	@param conn		The client the request came from
+	@param item		The request
+	@param rxlen	Bytes of reply, once finished
+
+	@return True if the request is finished, with the outcome in item.status and item.message
+ */
+bool JtagDaemon::ExecuteSlice(JtagdConnection& conn, JtagdWorkItem& item, size_t& rxlen)
+{
+	//Failed validation already
+	if(item.status != JTAGD_STATUS_OK)
+		return true;
+
+	JtagdRequestHeader req = item.req;
+	req.opcode &= ~JTAGD_FLAG_TRANSACTION;
+	req.length = item.txlen;
+
+	switch(req.opcode)
+	{
+		case JTAGD_OP_ATTACH_SHM:
+			item.status = AttachRing(conn, req, item.message);
+			return true;
+
+		case JTAGD_OP_SET_CLIENT:
+			if(req.arg >= JTAGD_PRIORITY_COUNT)
+			{
+				item.status = JTAGD_STATUS_BAD_REQUEST;
+				item.message = "Unknown priority";
+				return true;
+			}
+			conn.queue.m_priority = req.arg;
+			conn.queue.m_name.clear();
+			if(item.txlen)
+			{
+				conn.queue.m_name.assign(
+					reinterpret_cast<const char*>(item.tx),
+					min(item.txlen, static_cast<size_t>(JTAGD_CLIENT_NAME_LENGTH - 1)));
+			}
+			return true;
+
+		case JTAGD_OP_GET_CLIENT_STATS:
+			{
+				vector<JtagdClientStats> stats;
+				m_scheduler.GetStats(stats, GetTime());
+				size_t len = stats.size() * sizeof(JtagdClientStats);
+				if(item.rxcap < len)
+				{
+					item.status = JTAGD_STATUS_BAD_REQUEST;
+					item.message = "Reply buffer too small";
+					return true;
+				}
+				if(len)
+					memcpy(item.rx, &stats[0], len);
+				rxlen = len;
+			}
+			return true;
+
+		case JTAGD_OP_CEVA_READ_MEM:
+		case JTAGD_OP_CEVA_WRITE_MEM:
+			{
+				//Anything malformed goes through Dispatch() whole, which knows how to complain about it
+				bool write = (req.opcode == JTAGD_OP_CEVA_WRITE_MEM);
+				uint32_t words = write ? (item.txlen / 4) : req.bits;
+				if(words <= JTAGD_SLICE_WORDS)
+					break;
+				if(write && ( (item.txlen & 3) || (reinterpret_cast<uintptr_t>(item.tx) & 3) ) )
+					break;
+				if(!write && ( (item.rxcap < words * sizeof(uint32_t)) || (reinterpret_cast<uintptr_t>(item.rx) & 3) ) )
+					break;
+
+				uint32_t n = min(words - item.done, static_cast<uint32_t>(JTAGD_SLICE_WORDS));
+				JtagdRequestHeader sub = req;
+				sub.bits = n;
+				sub.arg = req.arg + item.done * sizeof(uint32_t);
+				size_t sublen = n * sizeof(uint32_t);
+				if(write)
+				{
+					sub.length = sublen;
+					size_t unused = 0;
+					item.status = Dispatch(sub, item.tx + item.done * 4, sublen, NULL, unused, item.message);
+				}
+				else
+					item.status = Dispatch(sub, NULL, 0, item.rx + item.done * 4, sublen, item.message);
+				if(item.status != JTAGD_STATUS_OK)
+					return true;
+
+				item.done += n;
+				if(item.done < words)
+					return false;
+				rxlen = write ? 0 : (words * sizeof(uint32_t));
+			}
+			return true;
+
+		default:
+			break;
+	}
+
+	rxlen = item.rxcap;
+	item.status = Dispatch(req, item.tx, item.txlen, item.rx, rxlen, item.message);
+	return true;
+}
+
+/**
+	@brief Answers a finished request, on the transport it came in on
+
+	Socket replies are only queued here, SendReplies() sends them.
+ */
+void JtagDaemon::Complete(JtagdConnection& conn, JtagdWorkItem& item, size_t rxlen)
+{
+	if(!item.ring)
+	{
+		conn.reserved -= item.reply.size();
+		if(item.status == JTAGD_STATUS_OK)
+			AppendReply(conn.txbuf, item.status, item.rx, rxlen);
+		else
+			AppendReply(conn.txbuf, item.status, item.message.c_str(), item.message.length());
+		return;
+	}
+
+	JtagdSharedRing& ring = conn.ring;
+	JtagdShmCompletion cpl;
+	cpl.tag = item.tag;
+	cpl.status = item.status;
+	if(item.status == JTAGD_STATUS_OK)
+		cpl.length = rxlen;
+	else
+	{
+		cpl.length = min(item.message.length(), item.rxcap);
+		if(cpl.length)
+			memcpy(item.rx, item.message.c_str(), cpl.length);
+	}
+	ring.queued --;
+
+	//ReadRing() never takes more than fits, so the client must have moved its head backwards
+	uint32_t cq_head = __atomic_load_n(&ring.header->cq_head, __ATOMIC_ACQUIRE);
+	if(ring.cqTail - cq_head >= ring.entries)
+	{
+		conn.dead = true;
+		return;
+	}
+
+	ring.cq[ring.cqTail & (ring.entries - 1)] = cpl;
+	ring.cqTail ++;
+	__atomic_store_n(&ring.header->cq_tail, ring.cqTail, __ATOMIC_RELEASE);
+
+	//Wake the client per request, so it can refill its slot while we get on with the next one
+	uint64_t one = 1;
+	if(write(ring.completion, &one, sizeof(one)) < 0)
+	{
+		//Only fails if the counter saturates, and then the client is awake anyway
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Request execution
+
+/**
+	@brief Executes one request
+
+	The same code serves both transports: socket requests pass buffers owned by their JtagdWorkItem, ring requests
+	pass buffers in the client's shared memory.
+
+	@param req		The request. req.length is ignored in favor of txlen.
+	@param tx		Request payload
+	@param txlen	Size of the request payload
+	@param rx		Reply buffer
+	@param rxlen	Size of the reply buffer on entry, bytes of reply on return
+	@param message	Reason for failure, if not successful
+
+	@return A JtagdStatus
+ */
+uint32_t JtagDaemon::Dispatch(
+	const JtagdRequestHeader& req,
+	const uint8_t* tx,
+	size_t txlen,
+	uint8_t* rx,
+	size_t& rxlen,
+	string& message)
+{
+	size_t rxcap = rxlen;
+	size_t nbytes = (static_cast<size_t>(req.bits) + 7) / 8;
+	rxlen = 0;
+
+	try
+	{
+		switch(req.opcode)
+		{
+			case JTAGD_OP_PING:
+				return JTAGD_STATUS_OK;
+
+			case JTAGD_OP_GET_INFO:
+				{
+					JtagdInfo info;
+					info.version = JTAGD_PROTOCOL_VERSION;
+					info.chain_length = m_iface->GetChainLength();
+					info.ir_length = m_iface->GetIRLength();
+					info.frequency = m_iface->GetFrequency();
+					info.uptime = GetTime() - m_startTime;
+					info.requests = m_requestCount;
+
+					size_t len = sizeof(info) + info.chain_length * sizeof(uint32_t);
+					if(rxcap < len)
+						break;
+					memcpy(rx, &info, sizeof(info));
+					for(size_t i=0; i<info.chain_length; i++)
+					{
+						uint32_t idcode = m_iface->GetIDCode(i);
+						memcpy(rx + sizeof(info) + i*sizeof(uint32_t), &idcode, sizeof(idcode));
+					}
+					rxlen = len;
+				}
+				return JTAGD_STATUS_OK;
+
+			case JTAGD_OP_GET_STATS:
+				{
+					JtagdStats stats;
+					stats.shift_ops = m_iface->GetShiftOpCount();
+					stats.data_bits = m_iface->GetDataBitCount();
+					stats.mode_bits = m_iface->GetModeBitCount();
+					stats.dummy_clocks = m_iface->GetDummyClockCount();
+					stats.shift_time = m_iface->GetShiftTime();
+					if(rxcap < sizeof(stats))
+						break;
+					memcpy(rx, &stats, sizeof(stats));
+					rxlen = sizeof(stats);
+				}
+				return JTAGD_STATUS_OK;
+
+			case JTAGD_OP_REINIT:
+				m_port.ForgetIR();
+				m_iface->InitializeChain(true);
+				return JTAGD_STATUS_OK;
+
+			case JTAGD_OP_RESET_TO_IDLE:
+				m_port.ForgetIR();
+				m_iface->ResetToIdle();
+				return JTAGD_STATUS_OK;
+
+			case JTAGD_OP_SET_IR:
+			case JTAGD_OP_SCAN_DR:
+			case JTAGD_OP_SHIFT_DATA:
+				if( (req.bits == 0) || (txlen < nbytes) )
+				{
+					message = "Payload shorter than the bit count";
+					return JTAGD_STATUS_BAD_REQUEST;
+				}
+				if( (req.opcode != JTAGD_OP_SHIFT_DATA) && (req.device >= m_iface->GetChainLength()) )
+				{
+					message = "Device index out of range";
+					return JTAGD_STATUS_BAD_REQUEST;
+				}
+
+				//DR scans read back only if there's somewhere to put the data
+				if( (req.opcode == JTAGD_OP_SCAN_DR) && (rxcap == 0) )
+				{
+					m_port.ForgetIR();
+					m_iface->ScanDR(req.device, tx, NULL, req.bits);
+					return JTAGD_STATUS_OK;
+				}
+				if(rxcap < nbytes)
+					break;
+
+				m_port.ForgetIR();
+				if(req.opcode == JTAGD_OP_SET_IR)
+					m_iface->SetIR(req.device, tx, rx, req.bits);
+				else if(req.opcode == JTAGD_OP_SCAN_DR)
+					m_iface->ScanDR(req.device, tx, rx, req.bits);
+				else
+				{
+					//Raw bits could be going into an IR as easily as a DR
+					m_iface->ForgetIR();
+					m_iface->ShiftData(req.arg ? true : false, tx, rx, req.bits);
+				}
+				rxlen = nbytes;
+				return JTAGD_STATUS_OK;
+
+			default:
+				rxlen = rxcap;
+				return DispatchCeva(req, tx, txlen, rx, rxlen, message);
+		}
+	}
+	catch(const JtagException& ex)
+	{
+		//Whatever failed may have left the TAP anywhere
+		m_port.ForgetIR();
+		rxlen = 0;
+		message = ex.GetDescription();
+		return JTAGD_STATUS_ERROR;
+	}
+
+	message = "Reply buffer too small";
+	return JTAGD_STATUS_BAD_REQUEST;
+}
+
+/**
+	@brief Executes a JTAGD_OP_CEVA_* request, see Dispatch()
+
+	@throw JtagException if the scans fail
+ */
+uint32_t JtagDaemon::DispatchCeva(
+	const JtagdRequestHeader& req,
+	const uint8_t* tx,
+	size_t txlen,
+	uint8_t* rx,
+	size_t& rxlen,
+	string& message)
+{
+	size_t rxcap = rxlen;
+	rxlen = 0;
+
+	uint32_t value;
+	switch(req.opcode)
+	{
+		case JTAGD_OP_CEVA_VERSION:
+		case JTAGD_OP_CEVA_STATUS:
+		case JTAGD_OP_CEVA_PC:
+			if(rxcap < sizeof(value))
+				break;
+			if(req.opcode == JTAGD_OP_CEVA_VERSION)
+				value = m_port.GetCoreVersion();
+			else if(req.opcode == JTAGD_OP_CEVA_STATUS)
+				value = m_port.GetStatus();
+			else
+				value = m_port.GetPC();
+			memcpy(rx, &value, sizeof(value));
+			rxlen = sizeof(value);
+			return JTAGD_STATUS_OK;
+
+		case JTAGD_OP_CEVA_HALT:
+			m_port.Halt();
+			return JTAGD_STATUS_OK;
+
+		case JTAGD_OP_CEVA_RESUME:
+			m_port.Resume();
+			return JTAGD_STATUS_OK;
+
+		case JTAGD_OP_CEVA_STEP:
+			m_port.Step();
+			return JTAGD_STATUS_OK;
+
+		case JTAGD_OP_CEVA_READ_REGS:
+		case JTAGD_OP_CEVA_READ_MEM:
+			if( (req.opcode == JTAGD_OP_CEVA_READ_REGS) &&
+				( (req.arg >= CEVA_REG_COUNT) || (req.bits > CEVA_REG_COUNT - req.arg) ) )
+			{
+				message = "Register index out of range";
+				return JTAGD_STATUS_BAD_REQUEST;
+			}
+			if(req.bits == 0)
+				return JTAGD_STATUS_OK;
+			if(static_cast<uint64_t>(req.bits) * 4 > rxcap)
+				break;
+			if(reinterpret_cast<uintptr_t>(rx) & 3)
+			{
+				message = "Reply buffer is not word aligned";
+				return JTAGD_STATUS_BAD_REQUEST;
+			}
+
+			//Straight into the reply buffer, which for the ring is the client's memory
+			if(req.opcode == JTAGD_OP_CEVA_READ_REGS)
+				m_port.ReadRegisters(req.arg, reinterpret_cast<uint32_t*>(rx), req.bits);
+			else
+				m_port.ReadMemory(req.arg, reinterpret_cast<uint32_t*>(rx), req.bits);
+			rxlen = req.bits * sizeof(uint32_t);
+			return JTAGD_STATUS_OK;
+
+		case JTAGD_OP_CEVA_WRITE_MEM:
+			if(txlen & 3)
+			{
+				message = "Write payload is not a whole number of words";
+				return JTAGD_STATUS_BAD_REQUEST;
+			}
+			if(txlen == 0)
+				return JTAGD_STATUS_OK;
+
+			//Socket payloads follow a header and whatever came before them, so they may need realigning
+			if(reinterpret_cast<uintptr_t>(tx) & 3)
+			{
+				m_txWords.resize(txlen / 4);
+				memcpy(&m_txWords[0], tx, txlen);
+				m_port.WriteMemory(req.arg, &m_txWords[0], txlen / 4);
+			}
+			else
+				m_port.WriteMemory(req.arg, reinterpret_cast<const uint32_t*>(tx), txlen / 4);
+			return JTAGD_STATUS_OK;
+
+		default:
+			message = "Unknown opcode";
+			return JTAGD_STATUS_BAD_REQUEST;
+	}
+
+	message = "Reply buffer too small";
+	return JTAGD_STATUS_BAD_REQUEST;
+}
@@ -0,0 +1,187 @@
+/**
+	@file
+	@brief Declaration of JtagDaemon
+ */
+
+#ifndef JtagDaemon_h
+#define JtagDaemon_h
+
+///@brief Maximum number of clients connected to a JtagDaemon at once
+#define JTAGD_MAX_CLIENTS		16
+
+///@brief Reply bytes a client may have unsent or reserved before the daemon stops reading its requests
+#define JTAGD_MAX_BACKLOG		JTAGD_MAX_PAYLOAD
+
+/**
+	@brief Daemon side of a shared memory ring attached by a client (see JtagdShmHeader)
+ */
+struct JtagdSharedRing
+{
+	///@brief Start of the mapping, or NULL if no ring is attached
+	uint8_t* base;
+
+	///@brief Size of the mapping
+	size_t size;
+
+	///@brief eventfd the client writes after queueing requests
+	int doorbell;
+
+	///@brief eventfd the daemon writes after posting completions
+	int completion;
+
+	///@brief Queue depth, as read at attach time
+	uint32_t entries;
+
+	///@brief Size of the data area, as read at attach time
+	uint32_t dataSize;
+
+	///@brief Private copy of the submission queue head
+	uint32_t sqHead;
+
+	///@brief Private copy of the completion queue tail
+	uint32_t cqTail;
+
+	///@brief Requests taken off the submission queue but not completed yet
+	uint32_t queued;
+
+	///@brief The header
+	JtagdShmHeader* header;
+
+	///@brief Submission queue
+	JtagdShmRequest* sq;
+
+	///@brief Completion queue
+	JtagdShmCompletion* cq;
+
+	///@brief Data area
+	uint8_t* data;
+};
+
+/**
+	@brief State of one JtagDaemon client connection
+ */
+struct JtagdConnection
+{
+	///@brief Socket
+	int fd;
+
+	///@brief Set when the connection should be closed once the current round is over
+	bool dead;
+
+	///@brief Bytes received but not yet parsed
+	std::vector<uint8_t> rxbuf;
+
+	///@brief Socket replies not yet sent (the socket is non-blocking, so a client that doesn't read holds them here)
+	std::string txbuf;
+
+	///@brief Reply buffer bytes held by queued socket requests
+	size_t reserved;
+
+	///@brief File descriptors received but not yet claimed by a request
+	std::vector<int> fds;
+
+	///@brief Shared memory data plane, if attached
+	JtagdSharedRing ring;
+
+	///@brief Requests waiting to run, and statistics
+	JtagSchedulerQueue queue;
+};
+
+/**
+	@brief Long-lived server owning the adapter, so short-lived tools don't pay for setting it up
+
+	Opening the adapter maps the control register, enables the SW-JTAG block and walks the chain, which costs far
+	more than the handful of scans a typical scripted command actually needs. The daemon does all of that once and
+	then serves JtagdOpcode requests from any number of JtagClient connections over a Unix (or TCP) socket.
+
+	Connections are multiplexed with poll(). Requests from both transports are queued per client, and a
+	JtagScheduler decides whose request runs next; see there for the policy. Requests are atomic with respect to
+	other clients (long memory transfers are split into slices which are each atomic), and transactions marked with
+	JTAGD_FLAG_TRANSACTION are atomic as a whole. After at most JTAGD_SCHEDULE_BUDGET of scanning the daemon polls
+	again, so newly arrived interactive requests get a look in, and all replies produced in the meantime are sent
+	with one write per client. Client sockets are non-blocking: whatever a client doesn't read stays queued for it
+	(polling for POLLOUT), and once that plus the replies its queued requests may produce passes JTAGD_MAX_BACKLOG,
+	the daemon stops reading from it until it catches up. One client that never reads can't stall the others.
+
+	Clients on a Unix socket may also attach a shared memory ring (JTAGD_OP_ATTACH_SHM). Its requests execute with
+	the adapter reading TDI from, and writing TDO into, the client's memory, so bulk transfers cost no copies and no
+	socket traffic beyond the eventfd wakeups. The doorbell eventfd sits in the same poll() set as the sockets.
+
+	Exceptions thrown by the adapter are returned to the client that caused them and the daemon carries on. The
+	CevaDebugPort IR cache is dropped after every raw scan, since those may leave anything in the IR.
+ */
+class JtagDaemon
+{
+public:
+	JtagDaemon(JtagInterface* iface);
+	virtual ~JtagDaemon();
+
+	void Serve(ServerSocket& sock);
+
+	static void RequestStop();
+
+protected:
+	//Socket transport
+	bool ReadRequests(JtagdConnection& conn, double now);
+	bool ParseRequests(JtagdConnection& conn, double now);
+	static bool IsBacklogged(const JtagdConnection& conn);
+	void SendReplies(JtagdConnection& conn);
+	void CloseClient(JtagdConnection& conn);
+	size_t GetReplySize(const JtagdRequestHeader& req);
+	static uint32_t CheckRequest(const JtagdRequestHeader& req, std::string& message);
+
+	//Shared memory transport
+	uint32_t AttachRing(JtagdConnection& conn, const JtagdRequestHeader& req, std::string& message);
+	void DetachRing(JtagdSharedRing& ring);
+	void ReadRing(JtagdConnection& conn, double now);
+
+	//Scheduling
+	bool HasRunnableWork(double now);
+	void RunSlices();
+	bool ExecuteSlice(JtagdConnection& conn, JtagdWorkItem& item, size_t& rxlen);
+	void Complete(JtagdConnection& conn, JtagdWorkItem& item, size_t rxlen);
+
+	//Execution
+	uint32_t Dispatch(
+		const JtagdRequestHeader& req,
+		const uint8_t* tx,
+		size_t txlen,
+		uint8_t* rx,
+		size_t& rxlen,
+		std::string& message);
+	uint32_t DispatchCeva(
+		const JtagdRequestHeader& req,
+		const uint8_t* tx,
+		size_t txlen,
+		uint8_t* rx,
+		size_t& rxlen,
+		std::string& message);
+
+	static void AppendReply(std::string& reply, uint32_t status, const void* data, size_t len);
+
+	///@brief The adapter
+	JtagInterface* m_iface;
+
+	///@brief DSP debug access on top of the adapter
+	CevaDebugPort m_port;
+
+	///@brief Connected clients
+	std::list<JtagdConnection> m_clients;
+
+	///@brief Decides whose request runs next
+	JtagScheduler m_scheduler;
+
+	///@brief Scratch buffer for word-aligning socket payloads
+	std::vector<uint32_t> m_txWords;
+
+	///@brief When the daemon started
+	double m_startTime;
+
+	///@brief Requests served so far
+	uint32_t m_requestCount;
+
+	///@brief Set from signal handlers to make Serve() return
+	static volatile sig_atomic_t m_stopRequested;
+};
+
+#endif
@@ -0,0 +1,325 @@
+/**
+	@file
+	@brief Wire format spoken between JtagDaemon and JtagClient
+ */
+
+#ifndef JtagDaemonProtocol_h
+#define JtagDaemonProtocol_h
+
+/**
+	@brief Where the daemon listens, and the client connects, unless told otherwise
+
+	Can be overridden with the JTAGD_SOCKET environment variable.
+ */
+#define JTAGD_DEFAULT_ENDPOINT	"unix:/tmp/jtagd.sock"
+
+///@brief Largest request or reply payload, in bytes
+#define JTAGD_MAX_PAYLOAD		(16 * 1024 * 1024)
+
+///@brief Protocol version, reported by JTAGD_OP_GET_INFO
+#define JTAGD_PROTOCOL_VERSION	1
+
+/**
+	@brief Daemon requests
+
+	Each request is a JtagdRequestHeader followed by header.length bytes of payload, and gets exactly one
+	JtagdReplyHeader followed by reply.length bytes of payload back. Requests are executed in order, so clients may
+	pipeline as many of them as they like before reading the replies.
+
+	All fields are in host byte order: the daemon and its clients always run on the same machine.
+ */
+enum JtagdOpcode
+{
+	JTAGD_OP_PING			= 0x00,		///< Does nothing. Reply: empty
+	JTAGD_OP_GET_INFO		= 0x01,		///< Reply: JtagdInfo followed by chain_length IDCODEs
+	JTAGD_OP_GET_STATS		= 0x02,		///< Reply: JtagdStats
+	JTAGD_OP_REINIT			= 0x03,		///< Re-runs InitializeChain(). Reply: empty
+	JTAGD_OP_RESET_TO_IDLE	= 0x04,		///< Reply: empty
+	JTAGD_OP_ATTACH_SHM		= 0x05,		///< Attaches a shared memory ring (see JtagdShmHeader). Carries the memfd,
+										///< the doorbell eventfd and the completion eventfd, in that order, as
+										///< SCM_RIGHTS. bits = ring entries. Reply: empty. Socket only.
+	JTAGD_OP_SET_CLIENT		= 0x06,		///< Sets the scheduling class (arg, a JtagdPriority) and the name shown in
+										///< statistics (payload, up to JTAGD_CLIENT_NAME_LENGTH-1 characters). Reply: empty
+	JTAGD_OP_GET_CLIENT_STATS	= 0x07,	///< Reply: one JtagdClientStats per connected client
+
+	JTAGD_OP_SET_IR			= 0x10,		///< Loads bits of payload into the IR of device. Reply: the captured IR
+	JTAGD_OP_SCAN_DR		= 0x11,		///< Scans bits of payload through the DR of device. Reply: TDO if arg is
+										///< nonzero, otherwise empty
+	JTAGD_OP_SHIFT_DATA		= 0x12,		///< Raw ShiftData() of bits from the current state, last_tms = arg.
+										///< Reply: TDO
+
+	JTAGD_OP_CEVA_VERSION	= 0x20,		///< Reply: one uint32_t
+	JTAGD_OP_CEVA_STATUS	= 0x21,		///< Reply: one uint32_t (CEVA_STATUS_*)
+	JTAGD_OP_CEVA_PC		= 0x22,		///< Reply: one uint32_t
+	JTAGD_OP_CEVA_HALT		= 0x23,		///< Reply: empty
+	JTAGD_OP_CEVA_RESUME	= 0x24,		///< Reply: empty
+	JTAGD_OP_CEVA_STEP		= 0x25,		///< Reply: empty
+	JTAGD_OP_CEVA_READ_REGS	= 0x26,		///< Reads bits registers starting at arg. Reply: bits uint32_t's
+	JTAGD_OP_CEVA_READ_MEM	= 0x27,		///< Reads bits words starting at address arg. Reply: bits uint32_t's
+	JTAGD_OP_CEVA_WRITE_MEM	= 0x28		///< Writes payload (whole words) starting at address arg. Reply: empty
+};
+
+/**
+	@brief Opcode flag: more requests belonging to the same transaction follow
+
+	Requests are executed atomically with respect to other clients, but a sequence such as an IR scan followed by
+	the DR scan it sets up must not have anyone else's scans in between either. Setting this flag on every request of
+	the sequence but the last keeps the adapter reserved for the client until the last one completes, or until
+	JTAGD_TRANSACTION_TIMEOUT passes without the client sending the next request.
+ */
+#define JTAGD_FLAG_TRANSACTION	0x8000
+
+/**
+	@brief Scheduling classes
+
+	Higher classes are always served first, and requests waiting in a lower class are promoted one class every
+	JTAGD_AGING_TIME so they can't starve. Clients within a class take turns, one slice each.
+ */
+enum JtagdPriority
+{
+	JTAGD_PRIORITY_INTERACTIVE	= 0,	///< Single register reads, run control: latency matters
+	JTAGD_PRIORITY_NORMAL		= 1,	///< Default
+	JTAGD_PRIORITY_BULK			= 2,	///< Memory dumps and firmware loads: throughput matters
+
+	JTAGD_PRIORITY_COUNT
+};
+
+///@brief Size of JtagdClientStats::name, including the terminating null
+#define JTAGD_CLIENT_NAME_LENGTH	32
+
+///@brief Result of a daemon request
+enum JtagdStatus
+{
+	JTAGD_STATUS_OK			= 0,		///< Success, payload as described for the opcode
+	JTAGD_STATUS_ERROR		= 1,		///< The operation threw. Payload is the exception description.
+	JTAGD_STATUS_BAD_REQUEST	= 2		///< Unknown opcode or malformed request. Payload is a message.
+};
+
+///@brief Header of a request
+struct JtagdRequestHeader
+{
+	///@brief A JtagdOpcode
+	uint16_t opcode;
+
+	///@brief Chain position for register-level scans
+	uint16_t device;
+
+	///@brief Bit (or word) count, depending on the opcode
+	uint32_t bits;
+
+	///@brief Opcode-specific argument
+	uint32_t arg;
+
+	///@brief Number of payload bytes following the header
+	uint32_t length;
+};
+
+///@brief Header of a reply
+struct JtagdReplyHeader
+{
+	///@brief A JtagdStatus
+	uint32_t status;
+
+	///@brief Number of payload bytes following the header
+	uint32_t length;
+};
+
+///@brief Reply to JTAGD_OP_GET_INFO
+struct JtagdInfo
+{
+	///@brief JTAGD_PROTOCOL_VERSION
+	uint32_t version;
+
+	///@brief Number of TAPs on the chain. This many IDCODEs follow.
+	uint32_t chain_length;
+
+	///@brief Total IR length of the chain
+	uint32_t ir_length;
+
+	///@brief TCK frequency reported by the adapter, in Hz (0 if unknown)
+	uint32_t frequency;
+
+	///@brief Seconds since the daemon started
+	uint32_t uptime;
+
+	///@brief Number of requests served so far, this one excluded
+	uint32_t requests;
+};
+
+///@brief Reply to JTAGD_OP_GET_STATS
+struct JtagdStats
+{
+	uint64_t shift_ops;
+	uint64_t data_bits;
+	uint64_t mode_bits;
+	uint64_t dummy_clocks;
+	double shift_time;
+};
+
+/**
+	@brief One entry of the reply to JTAGD_OP_GET_CLIENT_STATS
+
+	Latency is measured from the moment the daemon has read a request to the moment its reply is queued, so it
+	includes waiting for other clients. Percentiles come from a log2 histogram and are upper bounds.
+ */
+struct JtagdClientStats
+{
+	///@brief Name set with JTAGD_OP_SET_CLIENT, empty if none
+	char name[JTAGD_CLIENT_NAME_LENGTH];
+
+	///@brief Process ID of the client, 0 if unknown (TCP)
+	uint32_t pid;
+
+	///@brief Scheduling class (JtagdPriority)
+	uint32_t priority;
+
+	///@brief Requests completed
+	uint64_t requests;
+
+	///@brief Slices executed (requests plus extra slices of long transfers)
+	uint64_t slices;
+
+	///@brief Request payload bytes consumed
+	uint64_t tx_bytes;
+
+	///@brief Reply payload bytes produced
+	uint64_t rx_bytes;
+
+	///@brief Requests currently queued
+	uint32_t queued;
+
+	uint32_t reserved;
+
+	///@brief Seconds since the client connected
+	double connected_time;
+
+	///@brief Seconds of adapter time spent on this client's requests
+	double busy_time;
+
+	///@brief Sum of request latencies, in seconds
+	double latency_sum;
+
+	///@brief Median request latency, in seconds
+	double latency_p50;
+
+	///@brief 99th percentile request latency, in seconds
+	double latency_p99;
+
+	///@brief Worst request latency, in seconds
+	double latency_max;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Shared memory data plane
+
+///@brief JtagdShmHeader::magic ("JSHM")
+#define JTAGD_SHM_MAGIC			0x4d48534a
+
+///@brief Largest ring accepted by the daemon, in entries
+#define JTAGD_SHM_MAX_ENTRIES	4096
+
+/**
+	@brief Head of a shared memory ring, at offset 0 of the memfd
+
+	The region holds the header, the submission queue (ring_entries JtagdShmRequest's) right after it, the completion
+	queue (ring_entries JtagdShmCompletion's) after that, and the data area at data_offset. Requests refer to their
+	scan data by offset into the data area, and the daemon passes those addresses straight to ShiftData() and
+	friends, so payloads are never copied on their way to or from the wire.
+
+	The client owns sq_tail and cq_head, the daemon owns sq_head and cq_tail; all four are free-running and only
+	reduced modulo ring_entries when indexing. Producers store their index with release semantics after filling the
+	entry, consumers load it with acquire semantics. The client writes the doorbell eventfd after queueing requests,
+	and the daemon writes the completion eventfd after posting completions.
+
+	A client must not have more than ring_entries requests outstanding, which guarantees the completion queue never
+	overflows. The geometry fields are read once at attach time and ignored afterwards.
+ */
+struct JtagdShmHeader
+{
+	///@brief JTAGD_SHM_MAGIC
+	uint32_t magic;
+
+	///@brief JTAGD_PROTOCOL_VERSION
+	uint32_t version;
+
+	///@brief Queue depth, a power of two no larger than JTAGD_SHM_MAX_ENTRIES
+	uint32_t ring_entries;
+
+	///@brief Offset of the data area from the start of the region
+	uint32_t data_offset;
+
+	///@brief Size of the data area
+	uint32_t data_size;
+
+	uint32_t reserved[11];
+
+	///@brief Next submission slot the client will fill (client writes)
+	uint32_t sq_tail;
+	uint32_t pad0[15];
+
+	///@brief Next submission slot the daemon will execute (daemon writes)
+	uint32_t sq_head;
+	uint32_t pad1[15];
+
+	///@brief Next completion slot the daemon will fill (daemon writes)
+	uint32_t cq_tail;
+	uint32_t pad2[15];
+
+	///@brief Next completion slot the client will consume (client writes)
+	uint32_t cq_head;
+	uint32_t pad3[15];
+};
+
+/**
+	@brief Submission queue entry
+
+	Takes the same opcodes (and JTAGD_FLAG_TRANSACTION) as the socket, except JTAGD_OP_ATTACH_SHM. What the socket
+	protocol sends as payload is read from tx_offset, and what it returns is written at rx_offset. Ranges must lie
+	within the data area and must not overlap, and word-sized CEVA transfers must be 4-byte aligned.
+ */
+struct JtagdShmRequest
+{
+	///@brief A JtagdOpcode
+	uint16_t opcode;
+
+	///@brief As for JtagdRequestHeader
+	uint16_t device;
+
+	///@brief As for JtagdRequestHeader
+	uint32_t bits;
+
+	///@brief As for JtagdRequestHeader
+	uint32_t arg;
+
+	///@brief Offset of the request payload within the data area
+	uint32_t tx_offset;
+
+	///@brief Size of the request payload
+	uint32_t tx_length;
+
+	///@brief Offset of the reply buffer within the data area
+	uint32_t rx_offset;
+
+	///@brief Size of the reply buffer. For JTAGD_OP_SCAN_DR, zero means no readback.
+	uint32_t rx_length;
+
+	uint32_t reserved;
+
+	///@brief Opaque to the daemon, returned in the completion
+	uint64_t tag;
+};
+
+///@brief Completion queue entry
+struct JtagdShmCompletion
+{
+	///@brief JtagdShmRequest::tag of the request
+	uint64_t tag;
+
+	///@brief A JtagdStatus. On failure the message is written to the reply buffer, truncated to fit.
+	uint32_t status;
+
+	///@brief Bytes written to the reply buffer
+	uint32_t length;
+};
+
+#endif
@@ -60,6 +60,7 @@ JtagException::JtagException(
 	, m_file(file)
 	, m_line(line)
 {
+	JTAG_PROBE3(exception, m_message.c_str(), m_file.c_str(), m_line);
 }
 
 /**
@@ -33,11 +33,8 @@
 	@brief Implementation of JtagInterface
  */
 
-#define LogTrace printf
-#define LogNotice printf
-#define LogWarning printf
-
 #include "jtaghal.h"
+#include <assert.h>
 
 using namespace std;
 
@@ -53,19 +50,56 @@ using namespace std;
  */
 JtagInterface::JtagInterface()
 {
+	m_async = NULL;
+	m_irtotal = 0;
 	m_perfShiftOps = 0;
 	m_perfDataBits = 0;
 	m_perfModeBits = 0;
 	m_perfDummyClocks = 0;
 	m_perfShiftTime = 0;
+	m_perfRecoverableErrors = 0;
+	m_perfIntegrityChecks = 0;
+	m_perfIntegrityFailures = 0;
+	m_integrityBits = 0;
+	m_integrityRetries = 0;
+	m_integrityMinBits = 0;
+	m_integritySeed = 0x9e3779b97f4a7c15ULL;
+	m_transactionDepth = 0;
+	m_transactionFailed = false;
+	m_lastIRDevice = 0;
+	m_lastIRBits = 0;
+	m_lastIRKnown = false;
+	m_noThrowDepth = 0;
+
+	//Calibrate the cycle counter now, rather than inside the first timed operation
+	JtagCycleClock::Calibrate();
 }
 
 /**
-	@brief Generic destructor, nothing special
+	@brief Generic destructor
+
+	Derived classes are already gone by the time this runs, so each must have called ShutdownAsync() in its own
+	destructor.
  */
 JtagInterface::~JtagInterface()
 {
+	assert(m_async == NULL);
+	delete m_async;
+}
 
+/**
+	@brief Runs everything queued for the asynchronous interface, then stops its worker
+
+	Every driver calls this first thing in its destructor, while it can still shift: otherwise the worker could be
+	calling into a half-destroyed adapter.
+ */
+void JtagInterface::ShutdownAsync()
+{
+	if(!m_async)
+		return;
+	m_async->Flush();
+	delete m_async;
+	m_async = NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -79,12 +113,17 @@ JtagInterface::~JtagInterface()
 /**
 	@brief Enters Test-Logic-Reset state by shifting six ones into TMS
 
+	This also resets every instruction register, so there is no IR for a retried scan to load again.
+
 	@throw JtagException if ShiftTMS() fails
  */
 void JtagInterface::TestLogicReset()
 {
 	unsigned char all_ones = 0xff;
 	ShiftTMS(false, &all_ones, 6);
+	JTAG_PROBE2(tap_state, TAP_TEST_LOGIC_RESET, 6);
+	m_lastIRBits = 0;
+	m_lastIRKnown = true;
 }
 
 /**
@@ -98,6 +137,7 @@ void JtagInterface::ResetToIdle()
 
 	unsigned char zero = 0x00;
 	ShiftTMS(false, &zero, 1);
+	JTAG_PROBE2(tap_state, TAP_RUN_TEST_IDLE, 1);
 }
 
 /**
@@ -115,6 +155,7 @@ void JtagInterface::EnterShiftIR()
 
 	unsigned char data = 0x03;
 	ShiftTMS(false, &data, 4);
+	JTAG_PROBE2(tap_state, TAP_SHIFT_IR, 4);
 }
 
 /**
@@ -130,6 +171,7 @@ void JtagInterface::LeaveExit1IR()
 
 	unsigned char data = 0x1;
 	ShiftTMS(false, &data, 2);
+	JTAG_PROBE2(tap_state, TAP_RUN_TEST_IDLE, 2);
 }
 
 /**
@@ -146,6 +188,7 @@ void JtagInterface::EnterShiftDR()
 
 	unsigned char data = 0x1;
 	ShiftTMS(false, &data, 3);
+	JTAG_PROBE2(tap_state, TAP_SHIFT_DR, 3);
 }
 
 /**
@@ -161,6 +204,7 @@ void JtagInterface::LeaveExit1DR()
 
 	unsigned char data = 0x1;
 	ShiftTMS(false, &data, 2);
+	JTAG_PROBE2(tap_state, TAP_RUN_TEST_IDLE, 2);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -190,6 +234,8 @@ void JtagInterface::PrintChainFaultMessage()
  */
 void JtagInterface::InitializeChain(bool quiet)
 {
+	JtagTimelineSpan span("InitializeChain");
+
 	//Clear out any junk already on the chain. This is necessary if chain state ever changes
 	m_idcodes.clear();
 //	for(auto d : m_devices)
@@ -204,10 +250,10 @@ void JtagInterface::InitializeChain(bool quiet)
 
 	//Reset the TAP to run-test-idle state
 	ResetToIdle();
-	printf("ResetToIdle done\n");
+	LogTrace("ResetToIdle done\n");
 	//Flush the instruction registers with zero bits
 	EnterShiftIR();
-	printf("EnterShiftIR done\n");
+	LogTrace("EnterShiftIR done\n");
 	ShiftData(false, lots_of_zeros, temp, 1024);
 	if(0 != (temp[127] & 0x80))
 	{
@@ -237,7 +283,7 @@ void JtagInterface::InitializeChain(bool quiet)
 		if(PeekBit(temp, m_irtotal))
 			break;
 	}
-	LogTrace("Found %zu total IR bits\n", m_irtotal);
+	LogDebug("Found %zu total IR bits\n", m_irtotal);
 
 	//Shift zeros into everyone's DR
 	EnterShiftDR();
@@ -266,7 +312,7 @@ void JtagInterface::InitializeChain(bool quiet)
 			break;
 		}
 	}
-	LogTrace("Found %d total devices\n", (int) devcount);
+	LogDebug("Found %d total devices\n", (int) devcount);
 
 	//Now we know how many devices we have! Reset the TAP
 	ResetToIdle();
@@ -294,7 +340,10 @@ void JtagInterface::InitializeChain(bool quiet)
 			m_idcodes.push_back(0);
 			continue;
 		}
-		LogWarning("IDCODE %08x\n", idcode);
+		if(quiet)
+			LogVerbose("IDCODE %08x\n", idcode);
+		else
+			LogNotice("IDCODE %08x\n", idcode);
 		idcode_bits += 32;
 		m_idcodes.push_back(idcode);
 	}
@@ -338,7 +387,7 @@ void JtagInterface::InitializeChain(bool quiet)
  */
 unsigned int JtagInterface::GetIDCode(unsigned int device)
 {
-	if(device >= m_devices.size())
+	if(device >= m_idcodes.size())
 	{
 		throw JtagExceptionWrapper(
 			"Device index out of range",
@@ -377,40 +426,16 @@ void JtagInterface::SetIR(unsigned int device, const unsigned char* data, size_t
  */
 void JtagInterface::SetIRDeferred(unsigned int device, const unsigned char* data, size_t count)
 {
-	EnterShiftIR();
-
-	//OPTIMIZATION: If we have a single device in the chain, don't bother with calculating padding bits
-	if(m_devices.size() == 1)
-		ShiftData(true, data, NULL, count);
+	WaitForAsync();
+	if(Failed())
+		return;
+	JtagTimelineSpan span("SetIR", "bits", count);
 
-	else
+	for(unsigned int attempt = 0; !ShiftIR(device, data, NULL, count); attempt ++)
 	{
-		//First, calculate the total number of bits to shift. Set everything to "bypass" to start
-		size_t shift_bytes = m_irtotal >> 3;
-		if(m_irtotal & 7)
-			shift_bytes ++;
-		vector<uint8_t> txd;
-		for(size_t i=0; i<shift_bytes; i++)
-			txd.push_back(0xff);
-
-		//Calculate how many bits to send BEFORE our IR.
-		//This is the sum of all IR widths of devices with LOWER indexes than us.
-		size_t leading_bits = 0;
-//		for(size_t i=0; i<device; i++)
-//			leading_bits += GetJtagDevice(i)->GetIRLength();
-
-		//Patch in the IR data we're sending
-		for(size_t i=0; i<count; i++)
-			PokeBit(&txd[0], i+leading_bits, PeekBit(data, i));
-
-		//Send the whole block
-		vector<uint8_t> rxd;
-		for(size_t i=0; i<shift_bytes; i++)
-			rxd.push_back(0x00);
-		ShiftData(true, &txd[0], NULL, m_irtotal);
+		if(!RecoverFromScanError(attempt, "SetIR", false))
+			return;
 	}
-
-	LeaveExit1IR();
 }
 
 /**
@@ -427,11 +452,43 @@ void JtagInterface::SetIRDeferred(unsigned int device, const unsigned char* data
  */
 void JtagInterface::SetIR(unsigned int device, const unsigned char* data, unsigned char* data_out, size_t count)
 {
+	WaitForAsync();
+	if(Failed())
+		return;
+	JtagTimelineSpan span("SetIR", "bits", count);
+
+	for(unsigned int attempt = 0; !ShiftIR(device, data, data_out, count); attempt ++)
+	{
+		if(!RecoverFromScanError(attempt, "SetIR", false))
+			return;
+	}
+
+	Commit();
+}
+
+/**
+	@brief Does the work of SetIR(), from Run-Test-Idle back to Run-Test-Idle
+
+	@throw JtagException if any shift operation fails.
+
+	@param device	Zero-based index of the target device. All other devices are set to BYPASS mode.
+	@param data		The IR value to scan (see ShiftData() for bit/byte ordering)
+	@param data_out	IR capture value, or NULL
+	@param count 	Instruction register length, in bits
+
+	@return False if the scan failed its integrity check
+ */
+bool JtagInterface::ShiftIR(unsigned int device, const unsigned char* data, unsigned char* data_out, size_t count)
+{
+	bool ok;
+
+	//Until it's known to have gone in, the IR could be anything
+	m_lastIRKnown = false;
 	EnterShiftIR();
 
 	//OPTIMIZATION: If we have a single device in the chain, don't bother with calculating padding bits
-	if(m_devices.size() == 1)
-		ShiftData(true, data, data_out, count);
+	if(m_idcodes.size() == 1)
+		ok = ShiftChecked(true, data, data_out, count);
 
 	//Nope, we need to do a bit more work since there's more than one device.
 	//TODO: this is a very quick and dirty implementation that's not even remotely efficient.
@@ -456,12 +513,11 @@ void JtagInterface::SetIR(unsigned int device, const unsigned char* data, unsign
 		for(size_t i=0; i<count; i++)
 			PokeBit(&txd[0], i+leading_bits, PeekBit(data, i));
 
-		//Send the whole block
-		//TODO: optimize, if data_out is null skip the readout
+		//Send the whole block, reading back only if the caller wants the capture value
 		vector<uint8_t> rxd;
 		for(size_t i=0; i<shift_bytes; i++)
 			rxd.push_back(0x00);
-		ShiftData(true, &txd[0], &rxd[0], m_irtotal);
+		ok = ShiftChecked(true, &txd[0], data_out ? &rxd[0] : NULL, m_irtotal);
 
 		//Pull reply data out
 		if(data_out != NULL)
@@ -472,7 +528,16 @@ void JtagInterface::SetIR(unsigned int device, const unsigned char* data, unsign
 	}
 	LeaveExit1IR();
 
-	Commit();
+	//Remember it, for retries to load again after resetting the chain
+	if(ok && !Failed())
+	{
+		m_lastIR.assign(data, data + (count + 7) / 8);
+		m_lastIRDevice = device;
+		m_lastIRBits = count;
+		m_lastIRKnown = true;
+	}
+
+	return ok;
 }
 
 /**
@@ -490,11 +555,42 @@ void JtagInterface::SetIR(unsigned int device, const unsigned char* data, unsign
  */
 void JtagInterface::ScanDR(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
 {
+	WaitForAsync();
+	if(Failed())
+		return;
+	JtagTimelineSpan span("ScanDR", "bits", count);
+
+	for(unsigned int attempt = 0; !ShiftDR(device, send_data, rcv_data, count); attempt ++)
+	{
+		if(!RecoverFromScanError(attempt, "ScanDR", true))
+			return;
+	}
+
+	Commit();
+}
+
+/**
+	@brief Does the work of ScanDR(), from Run-Test-Idle back to Run-Test-Idle
+
+	@throw JtagException if any shift operation fails.
+
+	@param device		Zero-based index of the target device. All other devices are assumed to be in BYPASS mode and
+						their DR is set to zero.
+	@param send_data	The data value to scan (see ShiftData() for bit/byte ordering)
+	@param rcv_data		Output data to scan, or NULL
+	@param count 		Number of bits to scan
+
+	@return False if the scan failed its integrity check
+ */
+bool JtagInterface::ShiftDR(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+{
+	bool ok;
+
 	EnterShiftDR();
 
 	//OPTIMIZATION: If we have a single device in the chain, don't bother with calculating padding bits
-	if(m_devices.size() == 1)
-		ShiftData(true, send_data, rcv_data, count);
+	if(m_idcodes.size() == 1)
+		ok = ShiftChecked(true, send_data, rcv_data, count);
 
 	//Calculate padding and do the scan
 	else
@@ -504,7 +600,7 @@ void JtagInterface::ScanDR(unsigned int device, const unsigned char* send_data,
 
 		//First, calculate the total number of bits to shift.
 		//All other devices should be in bypass mode so they count as 1 bit
-		size_t shift_bits = (m_devices.size() - 1) + count;
+		size_t shift_bits = (m_idcodes.size() - 1) + count;
 		size_t shift_bytes = shift_bits >> 3;
 		if(shift_bits & 7)
 			shift_bytes ++;
@@ -526,7 +622,7 @@ void JtagInterface::ScanDR(unsigned int device, const unsigned char* send_data,
 		vector<uint8_t> rxd;
 		for(size_t i=0; i<shift_bytes; i++)
 			rxd.push_back(0x00);
-		ShiftData(true, &txd[0], &rxd[0], shift_bits);
+		ok = ShiftChecked(true, &txd[0], &rxd[0], shift_bits);
 
 		//Pull reply data out
 		if(rcv_data != NULL)
@@ -538,7 +634,7 @@ void JtagInterface::ScanDR(unsigned int device, const unsigned char* send_data,
 
 	LeaveExit1DR();
 
-	Commit();
+	return ok;
 }
 
 /**
@@ -559,16 +655,28 @@ void JtagInterface::ScanDR(unsigned int device, const unsigned char* send_data,
  */
 void JtagInterface::ScanDRDeferred(unsigned int /*device*/, const unsigned char* send_data, size_t count)
 {
-	if(m_devices.size() != 1)
+	WaitForAsync();
+	if(Failed())
+		return;
+	JtagTimelineSpan span("ScanDR", "bits", count);
+
+	if(m_idcodes.size() != 1)
 	{
 		throw JtagExceptionWrapper(
 			"Bypassing extra devices not yet supported!",
 			"");
 	}
 
-	EnterShiftDR();
-	ShiftData(true, send_data, NULL, count);
-	LeaveExit1DR();
+	for(unsigned int attempt = 0; ; attempt ++)
+	{
+		EnterShiftDR();
+		bool ok = ShiftChecked(true, send_data, NULL, count);
+		LeaveExit1DR();
+		if(ok)
+			break;
+		if(!RecoverFromScanError(attempt, "ScanDR", true))
+			return;
+	}
 }
 
 void JtagInterface::SendDummyClocksDeferred(size_t n)
@@ -576,6 +684,13 @@ void JtagInterface::SendDummyClocksDeferred(size_t n)
 	SendDummyClocks(n);
 }
 
+bool JtagInterface::ReadTDO()
+{
+	throw JtagExceptionWrapper(
+		"This adapter cannot sample TDO outside of a scan",
+		"");
+}
+
 /**
 	@brief Indicates if split (pipelined) DR scanning is supported.
 
@@ -610,7 +725,9 @@ bool JtagInterface::IsSplitScanSupported()
  */
 void JtagInterface::ScanDRSplitWrite(unsigned int /*device*/, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
 {
-	if(m_devices.size() != 1)
+	WaitForAsync();
+
+	if(m_idcodes.size() != 1)
 	{
 		throw JtagExceptionWrapper(
 			"Bypassing extra devices not yet supported!",
@@ -638,7 +755,9 @@ void JtagInterface::ScanDRSplitWrite(unsigned int /*device*/, const unsigned cha
  */
 void JtagInterface::ScanDRSplitRead(unsigned int /*device*/, unsigned char* rcv_data, size_t count)
 {
-	if(m_devices.size() != 1)
+	WaitForAsync();
+
+	if(m_idcodes.size() != 1)
 	{
 		throw JtagExceptionWrapper(
 			"Bypassing extra devices not yet supported!",
@@ -648,6 +767,65 @@ void JtagInterface::ScanDRSplitRead(unsigned int /*device*/, unsigned char* rcv_
 	ShiftDataReadOnly(rcv_data, count);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Asynchronous register-level interface
+
+/**
+	@brief Queues SetIR() on the worker thread
+
+	@param device	Zero-based index of the target device. All other devices are set to BYPASS mode.
+	@param data		The IR value to scan, copied before returning
+	@param data_out	IR capture value, or NULL. Must stay valid until the future completes.
+	@param count 	Instruction register length, in bits
+
+	@return Completion token. Waiting on it throws if the scan failed.
+ */
+JtagFuture JtagInterface::SetIRAsync(unsigned int device, const unsigned char* data, unsigned char* data_out, size_t count)
+{
+	if(!m_async)
+		m_async = new JtagAsyncEngine;
+
+	vector<unsigned char> txd(data, data + (count + 7) / 8);
+	return m_async->Submit([this, device, txd, data_out, count]()
+	{
+		if(data_out)
+			SetIR(device, &txd[0], data_out, count);
+		else
+			SetIR(device, &txd[0], count);
+	});
+}
+
+/**
+	@brief Queues ScanDR() on the worker thread
+
+	@param device		Zero-based index of the target device. All other devices are assumed to be in BYPASS mode.
+	@param send_data	The data value to scan, copied before returning
+	@param rcv_data		Output data, or NULL. Must stay valid until the future completes.
+	@param count 		Number of bits to scan
+
+	@return Completion token. Waiting on it throws if the scan failed.
+ */
+JtagFuture JtagInterface::ScanDRAsync(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+{
+	if(!m_async)
+		m_async = new JtagAsyncEngine;
+
+	vector<unsigned char> txd(send_data, send_data + (count + 7) / 8);
+	return m_async->Submit([this, device, txd, rcv_data, count]()
+	{
+		ScanDR(device, &txd[0], rcv_data, count);
+	});
+}
+
+/**
+	@brief Waits until every queued asynchronous operation has run
+ */
+void JtagInterface::FlushAsync()
+{
+	if(m_async)
+		m_async->Flush();
+}
+
 bool JtagInterface::ShiftDataWriteOnly(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
 {
 	//default to ShiftData() in base class
@@ -741,6 +919,284 @@ void JtagInterface::SwapOutDummy(size_t pos, JtagDevice* realdev)
 	m_devices[pos] = realdev;
 }
 #endif
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scan integrity checking
+
+/**
+	@brief Starts checking register-level scans for bit errors, and retrying the ones that fail
+
+	Each checked scan costs pattern_bits extra clocks, so checking only long scans (min_bits) keeps the overhead down
+	where little data is at risk anyway.
+
+	@throw JtagException if pattern_bits is out of range
+
+	@param pattern_bits	Length of the pattern, rounded up to whole bytes
+	@param retries		Times a failed scan is retried before throwing
+	@param min_bits		Scans (including bypass padding) shorter than this aren't checked
+ */
+void JtagInterface::EnableScanIntegrity(size_t pattern_bits, unsigned int retries, size_t min_bits)
+{
+	if( (pattern_bits == 0) || (pattern_bits > JTAG_INTEGRITY_MAX_BITS) )
+	{
+		throw JtagExceptionWrapper(
+			"Integrity pattern length out of range",
+			"");
+	}
+
+	m_integrityBits = (pattern_bits + 7) & ~7;
+	m_integrityRetries = retries;
+	m_integrityMinBits = min_bits;
+}
+
+/**
+	@brief Stops checking scans
+ */
+void JtagInterface::DisableScanIntegrity()
+{
+	m_integrityBits = 0;
+}
+
+/**
+	@brief Checks scans the same way as another interface, e.g. so a cost estimate includes the same overhead
+
+	@param other	Interface to copy the pattern length, retries and minimum scan length from
+ */
+void JtagInterface::CopyScanIntegrity(const JtagInterface* other)
+{
+	m_integrityBits = other->m_integrityBits;
+	m_integrityRetries = other->m_integrityRetries;
+	m_integrityMinBits = other->m_integrityMinBits;
+}
+
+/**
+	@brief Shifts data like ShiftData(), checking the link with a pattern if integrity checking is enabled
+
+	The pattern goes in ahead of the data. After count bits it has been all the way round the chain (which must be
+	exactly count bits long), leaving the registers holding send_data as usual, and comes back out of TDO right behind
+	the captured data. Clocking errors, bit flips, stuck lines and a wrong idea of the chain length all disturb it.
+
+	@throw JtagException if the shift fails
+
+	@param last_tms		Different TMS value to use for last bit
+	@param send_data	Data to shift into TDI
+	@param rcv_data		Data to shift out of TDO (may be NULL)
+	@param count		Number of bits to shift
+
+	@return False if the pattern came back wrong
+ */
+bool JtagInterface::ShiftChecked(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+{
+	if( (m_integrityBits == 0) || (count < m_integrityMinBits) )
+	{
+		ShiftData(last_tms, send_data, rcv_data, count);
+		return true;
+	}
+
+	size_t pattern_bytes = m_integrityBits / 8;
+	size_t data_bytes = (count + 7) / 8;
+	m_integrityTx.resize(pattern_bytes + data_bytes);
+	m_integrityRx.resize(pattern_bytes + data_bytes);
+
+	//A fresh pattern every scan (xorshift64), so data left over from an earlier one can't pass. It always has both a
+	//zero and a one, so a stuck TDO can't either.
+	m_integritySeed ^= m_integritySeed << 13;
+	m_integritySeed ^= m_integritySeed >> 7;
+	m_integritySeed ^= m_integritySeed << 17;
+	for(size_t i=0; i<pattern_bytes; i++)
+		m_integrityTx[i] = m_integritySeed >> (i * 8);
+	m_integrityTx[0] = (m_integrityTx[0] & ~3) | 1;
+	memcpy(&m_integrityTx[pattern_bytes], send_data, data_bytes);
+
+	ShiftData(last_tms, &m_integrityTx[0], &m_integrityRx[0], count + m_integrityBits);
+	m_perfIntegrityChecks ++;
+
+	if(rcv_data)
+	{
+		memcpy(rcv_data, &m_integrityRx[0], data_bytes);
+		if(count & 7)
+			rcv_data[data_bytes - 1] &= (1 << (count & 7)) - 1;
+	}
+
+	for(size_t i=0; i<m_integrityBits; i++)
+	{
+		if(PeekBit(&m_integrityRx[0], count + i) != PeekBit(&m_integrityTx[0], i))
+		{
+			//Inside a transaction the whole thing is retried instead
+			if(m_transactionDepth)
+			{
+				m_transactionFailed = true;
+				return true;
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+	@brief Gets the chain back to a known state after a scan fails its integrity check, ready to retry it
+
+	The chain is reset, since nothing else is sure to bring every TAP back into step whatever went wrong. That resets
+	the instruction registers too, so the last IR set with SetIR() is loaded again (itself checked, and retried).
+
+	@throw JtagException once the scan has been retried as many times as allowed, or if the IR to load again isn't
+			known because something else has loaded one since
+
+	@param attempt		Number of retries of this scan already made
+	@param what			Name of the operation, for messages
+	@param restore_ir	True to load the last IR again (false when it's the IR scan itself being retried)
+
+	@return True if the scan should be retried. False in RunNoThrow() once the error has been reported (or if
+			something else already has been), in which case the caller should give up.
+ */
+bool JtagInterface::RecoverFromScanError(unsigned int attempt, const char* what, bool restore_ir)
+{
+	//A wire-level error would only fail the retries too
+	if(Failed())
+		return false;
+
+	vector<uint8_t> ir(m_lastIR);
+	unsigned int ir_device = m_lastIRDevice;
+	size_t ir_bits = restore_ir ? m_lastIRBits : 0;
+
+	if(restore_ir && !m_lastIRKnown)
+	{
+		m_perfIntegrityFailures ++;
+		ReportError(JtagStatusWrapper(
+			JTAG_STATUS_INTEGRITY,
+			"%s failed its integrity check, and can't be retried since the IR was loaded other than with SetIR()",
+			what,
+			0));
+		return false;
+	}
+
+	while(true)
+	{
+		if(attempt >= m_integrityRetries)
+		{
+			m_perfIntegrityFailures ++;
+			ReportError(JtagStatusWrapper(
+				JTAG_STATUS_INTEGRITY,
+				"%s failed its integrity check %u times",
+				what,
+				attempt + 1));
+			return false;
+		}
+
+		m_perfRecoverableErrors ++;
+		LogVerbose("%s failed its integrity check, retrying (%u of %u)\n", what, attempt + 1, m_integrityRetries);
+
+		ResetToIdle();
+		if( (ir_bits == 0) || ShiftIR(ir_device, &ir[0], NULL, ir_bits) )
+			return !Failed();
+		attempt ++;
+	}
+}
+
+/**
+	@brief Reports an error: throws it, unless in RunNoThrow(), where the first one is kept for the status
+
+	Adapters call this for wire-level errors they can carry on from, so the non-throwing functions needn't throw. In
+	RunNoThrow() they should then return without doing anything more, or at least without waiting on the target.
+
+	@throw JtagException outside RunNoThrow()
+
+	@param status	What went wrong
+ */
+void JtagInterface::ReportError(const JtagStatus& status)
+{
+	if(m_noThrowDepth == 0)
+		status.Throw();
+	if(m_status.IsOk())
+		m_status = status;
+}
+
+/**
+	@brief Starts a transaction
+
+	@param iface	The adapter. Must outlive the transaction.
+	@param what		Name of the operation, for messages
+ */
+JtagTransaction::JtagTransaction(JtagInterface* iface, const char* what)
+	: m_iface(iface)
+	, m_what(what)
+	, m_attempt(0)
+{
+	if(m_iface->m_transactionDepth++ == 0)
+		m_iface->m_transactionFailed = false;
+}
+
+JtagTransaction::~JtagTransaction()
+{
+	m_iface->m_transactionDepth --;
+}
+
+/**
+	@brief Checks whether every scan since the transaction started (or was last retried) passed its integrity check
+
+	@throw JtagException if a scan failed and the transaction has already been retried as many times as allowed
+
+	@return True if they all passed (or this is a nested transaction, or the error has been reported in
+			RunNoThrow()). False if the chain has been reset and the transaction must be run again from the start.
+ */
+bool JtagTransaction::Done()
+{
+	if( (m_iface->m_transactionDepth > 1) || !m_iface->m_transactionFailed)
+		return true;
+
+	m_iface->m_transactionFailed = false;
+	return !m_iface->RecoverFromScanError(m_attempt++, m_what, false);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Non-throwing variants
+
+/**
+	@brief ShiftData(), reporting errors as a status rather than throwing
+
+	@param last_tms		Different TMS value to use for last bit
+	@param send_data	Data to shift into TDI
+	@param rcv_data		Data to shift out of TDO (may be NULL)
+	@param count		Number of bits to shift
+
+	@return What went wrong, if anything
+ */
+JtagStatus JtagInterface::TryShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+	noexcept
+{
+	return RunNoThrow([&]() { ShiftData(last_tms, send_data, rcv_data, count); });
+}
+
+/**
+	@brief SetIR(), reporting errors as a status rather than throwing
+
+	@param device	Zero-based index of the target device. All other devices are set to BYPASS mode.
+	@param data		The IR value to scan (see ShiftData() for bit/byte ordering)
+	@param count 	Instruction register length, in bits
+
+	@return What went wrong, if anything
+ */
+JtagStatus JtagInterface::TrySetIR(unsigned int device, const unsigned char* data, size_t count) noexcept
+{
+	return RunNoThrow([&]() { SetIR(device, data, count); });
+}
+
+/**
+	@brief ScanDR(), reporting errors as a status rather than throwing
+
+	@param device		Zero-based index of the target device
+	@param send_data	The data value to scan (see ShiftData() for bit/byte ordering)
+	@param rcv_data		Output data to scan, or NULL
+	@param count 		Number of bits to scan
+
+	@return What went wrong, if anything. rcv_data is undefined if something did.
+ */
+JtagStatus JtagInterface::TryScanDR(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+	noexcept
+{
+	return RunNoThrow([&]() { ScanDR(device, send_data, rcv_data, count); });
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Performance profiling
 
@@ -793,13 +1249,63 @@ size_t JtagInterface::GetDummyClockCount()
 }
 
 /**
-	@brief Gets the number of dummy clocks this interface has sent
+	@brief Gets the time this interface has spent on shift operations and dummy clocks
 
 	@throw JtagException on failure
 
-	@return Number of dummy clocks sent
+	@return Shift time, in seconds
  */
 double JtagInterface::GetShiftTime()
 {
-	return m_perfShiftTime;
+	return m_perfShiftTime * 1e-9;
+}
+
+/**
+	@brief Gets the number of errors this interface has recovered from (for example by retrying a scan)
+
+	@throw JtagException on failure
+
+	@return Number of recoverable errors
+ */
+size_t JtagInterface::GetRecoverableErrorCount()
+{
+	return m_perfRecoverableErrors;
+}
+
+/**
+	@brief Copies all counters and latency histograms
+
+	@param snap		Snapshot to fill in
+ */
+void JtagInterface::GetPerfSnapshot(JtagPerfSnapshot& snap)
+{
+	snap.shift_ops = m_perfShiftOps;
+	snap.data_bits = m_perfDataBits;
+	snap.mode_bits = m_perfModeBits;
+	snap.dummy_clocks = m_perfDummyClocks;
+	snap.recoverable_errors = m_perfRecoverableErrors;
+	snap.integrity_checks = m_perfIntegrityChecks;
+	snap.integrity_failures = m_perfIntegrityFailures;
+	snap.shift_time = m_perfShiftTime * 1e-9;
+	snap.shift_data = m_perfShiftDataLatency;
+	snap.shift_tms = m_perfShiftTMSLatency;
+	snap.rtck_wait = m_perfRtckWait;
+}
+
+/**
+	@brief Zeroes all counters and latency histograms
+ */
+void JtagInterface::ResetPerfCounters()
+{
+	m_perfShiftOps = 0;
+	m_perfDataBits = 0;
+	m_perfModeBits = 0;
+	m_perfDummyClocks = 0;
+	m_perfShiftTime = 0;
+	m_perfRecoverableErrors = 0;
+	m_perfIntegrityChecks = 0;
+	m_perfIntegrityFailures = 0;
+	m_perfShiftDataLatency.Reset();
+	m_perfShiftTMSLatency.Reset();
+	m_perfRtckWait.Reset();
 }
@@ -38,6 +38,15 @@
 
 #include <vector>
 
+///@brief Default length of the pattern appended to checked scans
+#define JTAG_INTEGRITY_PATTERN_BITS		16
+
+///@brief Longest pattern EnableScanIntegrity() accepts
+#define JTAG_INTEGRITY_MAX_BITS			64
+
+///@brief Default number of times a checked scan is retried before giving up
+#define JTAG_INTEGRITY_RETRIES			3
+
 /**
 	@brief Abstract representation of a JTAG adapter.
 
@@ -60,6 +69,8 @@
 	\li ShiftTMS()
 	\li SendDummyClocks()
 
+	Adapters which can sample TDO between clocks may also implement ReadTDO(), which pin-level protocol bridges use.
+
 	The low-level interface also includes support for pipelined / queued command execution. This can improve
 	performance when using adapters connected to high-latency links such as USB.
 
@@ -104,6 +115,59 @@
 	\li ScanDRSplitRead()
 	\li ScanDRSplitWrite()
 
+	### Scan integrity checking
+
+	Bit errors on the link are otherwise silent, which makes it risky to clock it as fast as it will go. With
+	integrity checking enabled, SetIR(), SetIRDeferred(), ScanDR() and ScanDRDeferred() shift a fresh pattern in
+	ahead of their data. Once the data is in place the pattern has been right round the chain, through the target
+	register and any bypassed TAPs, and comes back out of TDO behind the captured bits, where it is checked. A scan
+	that fails is retried from Test-Logic-Reset, loading the last IR set with SetIR() again first, and counted by
+	GetRecoverableErrorCount(). Split scans and code driving the wire level directly (scan plans, SVF) aren't checked,
+	and call ForgetIR(), since they may have loaded any IR; a ScanDR() that fails after that, before the next SetIR()
+	or reset, throws rather than being retried against a guessed IR. Deferred scans read back when checked.
+
+	The pattern checks the link rather than the data: what a link clocked too fast does wrong (sampling TDO early,
+	losing or gaining clocks, a stuck line) shows up in every scan and is caught outright, but an isolated flip in the
+	data bits themselves only is if it reaches the pattern too. Either way the retry rate tracks the link's error rate,
+	which is what to watch when choosing how fast to run it.
+
+	Every path out of Shift-DR goes through Update-DR, so a failed scan has already taken effect by the time it is
+	checked. Retrying it alone is only right for registers without side effects; a sequence that e.g. auto-increments
+	an address must be retried as a whole, from the start, by grouping it in a JtagTransaction.
+
+	\li EnableScanIntegrity()
+	\li DisableScanIntegrity()
+	\li CopyScanIntegrity()
+
+	### Non-throwing variants
+
+	The hot paths also come in noexcept versions, which return a JtagStatus instead of throwing. A failed status is a
+	code and a few pointers, formatted only if asked for, where a JtagException copies five strings and looks up errno
+	as it is built, and then has to be thrown: callers that expect errors, and handle them by trying again or
+	carrying on, should use these. Once something fails, nothing more goes out on the wire until the call returns.
+
+	Adapters report wire-level errors through ReportError(), which throws from the throwing functions and records the
+	error for the status otherwise. Adapters that throw anyway still work: the exception is caught, and the status
+	says so. RunNoThrow() gives any sequence of calls (e.g. CevaDebugPort's Try*() functions) the same treatment.
+
+	\li TryShiftData()
+	\li TrySetIR()
+	\li TryScanDR()
+	\li RunNoThrow()
+
+	### Asynchronous (register level)
+
+	These queue a register-level operation on a worker thread and return a JtagFuture right away, so the caller can
+	get on with host-side work (file I/O, symbolization, decompression) while the bits are clocked. Operations run in
+	submission order. Scan data is copied at submission; readback buffers must stay valid until the future completes.
+
+	The synchronous register-level functions wait for anything still queued before touching the adapter, so mixing
+	the two is safe from a single thread. When nothing was ever queued they cost one extra branch.
+
+	\li SetIRAsync()
+	\li ScanDRAsync()
+	\li FlushAsync()
+
 	### Device management
 
 	These functions provide access to individual devices on the chain.
@@ -120,12 +184,18 @@
 
 	These may be useful to compare different programming algorithms and optimizations to reduce unnecessary activity.
 
+	Adapters keep them up to date from their wire-level functions, along with latency histograms of each ShiftData()
+	and ShiftTMS() call (and of each RTCK wait, for adapters with adaptive clocking). GetPerfSnapshot() copies all of
+	it at once, and ResetPerfCounters() starts over.
+
 	\li GetShiftOpCount()
 	\li GetRecoverableErrorCount()
 	\li GetDataBitCount()
 	\li GetModeBitCount()
 	\li GetDummyClockCount()
 	\li GetShiftTime()
+	\li GetPerfSnapshot()
+	\li ResetPerfCounters()
 
 	### NOTES
 
@@ -176,7 +246,37 @@ public:
 	 */
 	virtual void SendDummyClocksDeferred(size_t n);
 
+	/**
+		@brief Samples TDO without clocking.
+
+		Only pin-level protocol bridges need this, since their clients may sample TDO at points where no scan is in
+		progress. The default implementation throws.
+
+		@throw JtagException if the adapter can't sample TDO directly
+
+		@return Current value of TDO
+	 */
+	virtual bool ReadTDO();
+
 protected:
+	//Pin-level protocol bridges forward raw TMS sequences from their clients
+	friend class RemoteBitbangServer;
+	friend class XvcServer;
+
+	//Compiled plans drive TMS directly, to merge consecutive state changes
+	friend class JtagScanPlan;
+
+	//SVF files spell out their own TAP paths, and so do the vector files compiled from them
+	friend class SvfPlayer;
+	friend class JtagVectorPlayer;
+
+	//Tracing forwards and replays every wire-level operation
+	friend class TracingJtagInterface;
+	friend class JtagTraceReplayer;
+
+	//Cost models are calibrated with idle TMS clocks
+	friend struct JtagCostModel;
+
 	/**
 		@brief Shifts data into TMS to change TAP state
 
@@ -255,19 +355,188 @@ public:
 	void ScanDRSplitWrite(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
 	void ScanDRSplitRead(unsigned int device, unsigned char* rcv_data, size_t count);
 
+	//Asynchronous register-level interface
+	JtagFuture SetIRAsync(unsigned int device, const unsigned char* data, unsigned char* data_out, size_t count);
+	JtagFuture ScanDRAsync(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
+	void FlushAsync();
+
+	//Scan integrity checking
+	void EnableScanIntegrity(
+		size_t pattern_bits = JTAG_INTEGRITY_PATTERN_BITS,
+		unsigned int retries = JTAG_INTEGRITY_RETRIES,
+		size_t min_bits = 0);
+	void DisableScanIntegrity();
+	void CopyScanIntegrity(const JtagInterface* other);
+
+	///@brief Returns true if register-level scans are being checked
+	bool IsScanIntegrityEnabled()
+	{ return m_integrityBits != 0; }
+
+	///@brief Call after loading an IR other than with SetIR(), so a failed scan isn't retried against the wrong one
+	void ForgetIR()
+	{ m_lastIRKnown = false; }
+
+	friend class JtagTransaction;
+
+	//Non-throwing variants
+	JtagStatus TryShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+		noexcept;
+	JtagStatus TrySetIR(unsigned int device, const unsigned char* data, size_t count) noexcept;
+	JtagStatus TryScanDR(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+		noexcept;
+
+	/**
+		@brief Runs f() with errors reported as a status rather than thrown
+
+		The first error stops everything else f() would put on the wire. Calls may nest; the inner ones return the
+		outer one's first error, if it has had one.
+
+		@param f		What to run, returning nothing
+
+		@return What went wrong first, if anything
+	 */
+	template<typename F>
+	JtagStatus RunNoThrow(const F& f) noexcept
+	{
+		m_noThrowDepth ++;
+		try
+		{
+			if(!Failed())
+				f();
+		}
+		catch(const JtagException& e)
+		{
+			LogDebug("%s", e.GetDescription().c_str());
+			ReportError(JtagStatusWrapper(JTAG_STATUS_ADAPTER, "The adapter threw an exception", NULL, 0));
+		}
+
+		//Anything else (e.g. std::bad_alloc) must not escape a noexcept function either
+		catch(const std::exception& e)
+		{
+			LogDebug("%s\n", e.what());
+			ReportError(JtagStatusWrapper(JTAG_STATUS_ADAPTER, "The adapter threw an exception", NULL, 0));
+		}
+		catch(...)
+		{
+			ReportError(JtagStatusWrapper(JTAG_STATUS_ADAPTER, "The adapter threw an exception", NULL, 0));
+		}
+		JtagStatus status = m_status;
+		if(--m_noThrowDepth == 0)
+			m_status = JtagStatus();
+		return status;
+	}
+
+	///@brief Returns the number of TAPs found by InitializeChain()
+	size_t GetChainLength()
+	{ return m_idcodes.size(); }
+
+	///@brief Returns the total IR length of the chain, as found by InitializeChain()
+	size_t GetIRLength()
+	{ return m_irtotal; }
+
 protected:
 	//Helpers for initialization
 	void CreateDummyDevices();
 
+	///@brief Waits for queued asynchronous operations, if there ever were any
+	void WaitForAsync()
+	{
+		if(m_async)
+			FlushAsync();
+	}
+
+	void ShutdownAsync();
+
+	///@brief Execution engine for the asynchronous interface, created on first use
+	JtagAsyncEngine* m_async;
+
+	//Helpers for the register-level functions, which return false if the integrity check failed
+	bool ShiftChecked(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
+	bool ShiftIR(unsigned int device, const unsigned char* data, unsigned char* data_out, size_t count);
+	bool ShiftDR(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
+	bool RecoverFromScanError(unsigned int attempt, const char* what, bool restore_ir);
+
+	void ReportError(const JtagStatus& status);
+
+	///@brief Returns true if something has failed since the outermost RunNoThrow() started (never outside one)
+	bool Failed()
+	{ return __builtin_expect(!m_status.IsOk(), 0); }
+
+	///@brief First error since the outermost RunNoThrow() started
+	JtagStatus m_status;
+
+	///@brief Number of RunNoThrow() calls in progress. ReportError() throws when there are none.
+	unsigned int m_noThrowDepth;
+
+	///@brief Length of the integrity pattern, in bits (a multiple of 8), or 0 if scans aren't checked
+	size_t m_integrityBits;
+
+	///@brief Retries of a failed scan before giving up
+	unsigned int m_integrityRetries;
+
+	///@brief Scans shorter than this aren't checked
+	size_t m_integrityMinBits;
+
+	///@brief State of the pattern generator
+	uint64_t m_integritySeed;
+
+	///@brief Scratch buffers for checked scans
+	std::vector<uint8_t> m_integrityTx;
+	std::vector<uint8_t> m_integrityRx;
+
+	///@brief Number of JtagTransaction objects in scope. Failed scans in a transaction aren't retried on their own.
+	unsigned int m_transactionDepth;
+
+	///@brief Set when a scan in the current transaction fails its integrity check
+	bool m_transactionFailed;
+
+	///@brief Last IR value set with SetIR(), loaded again when a scan is retried (empty after a reset)
+	std::vector<uint8_t> m_lastIR;
+
+	///@brief Device m_lastIR was for
+	unsigned int m_lastIRDevice;
+
+	///@brief Length of m_lastIR, in bits (0 after a reset, when there is nothing to load)
+	size_t m_lastIRBits;
+
+	///@brief False if the IR may have been loaded since, other than with SetIR() or a reset
+	bool m_lastIRKnown;
+
 protected:
 
 	///@brief Total IR length of the chain
 	size_t m_irtotal;
 
-	///@brief Array of device ID codes
+	/**
+		@brief Array of device ID codes
+
+		No TestableDevice objects are created for the chain yet, so this is also what the register-level functions
+		use to find the number of devices when computing BYPASS padding.
+	 */
 	std::vector<unsigned int> m_idcodes;
 
-	//Performance profiling
+	//Performance profiling, for use by adapters. Each wire-level function counts itself, and times itself with a
+	//JtagScopedTimer on m_perfShiftTime and the matching latency histogram.
+
+	///@brief Accounts for a ShiftData() call of count bits
+	void CountShiftData(size_t count)
+	{
+		m_perfShiftOps ++;
+		m_perfDataBits += count;
+	}
+
+	///@brief Accounts for a ShiftTMS() call of count bits
+	void CountShiftTMS(size_t count)
+	{
+		m_perfShiftOps ++;
+		m_perfModeBits += count;
+	}
+
+	///@brief Accounts for n dummy clocks
+	void CountDummyClocks(size_t n)
+	{
+		m_perfDummyClocks += n;
+	}
 
 	//Debug helpers
 	void PrintChainFaultMessage();
@@ -285,16 +554,78 @@ protected:
 	///Number of dummy clocks shifted
 	size_t m_perfDummyClocks;
 
-	///Total time spent on shift operations
-	double m_perfShiftTime;
+	///Total time spent on shift operations and dummy clocks, in ns
+	uint64_t m_perfShiftTime;
+
+	///Number of errors recovered from
+	size_t m_perfRecoverableErrors;
+
+	///Number of scans integrity checked
+	size_t m_perfIntegrityChecks;
+
+	///Number of scans that still failed their integrity check after every retry
+	size_t m_perfIntegrityFailures;
+
+	///Latency of each ShiftData() call
+	JtagLatencyHistogram m_perfShiftDataLatency;
+
+	///Latency of each ShiftTMS() call
+	JtagLatencyHistogram m_perfShiftTMSLatency;
+
+	///Time spent waiting for each returned TCK edge
+	JtagLatencyHistogram m_perfRtckWait;
 
 public:
 	virtual size_t GetShiftOpCount();
+	virtual size_t GetRecoverableErrorCount();
 	virtual size_t GetDataBitCount();
 	virtual size_t GetModeBitCount();
 	virtual size_t GetDummyClockCount();
 
 	virtual double GetShiftTime();
+
+	virtual void GetPerfSnapshot(JtagPerfSnapshot& snap);
+	virtual void ResetPerfCounters();
+};
+
+/**
+	@brief A sequence of register-level scans that is retried as a whole when integrity checking finds an error
+
+	Use it as a loop, so the body can run again from the start:
+
+	\code
+	for(JtagTransaction transaction(iface, "ReadMemory"); ; )
+	{
+		//set the address, read the words...
+		if(transaction.Done())
+			break;
+		//forget any state the chain reset invalidated, e.g. cached IR values
+	}
+	\endcode
+
+	Scans in the transaction that fail their check aren't retried on their own, which would repeat their side effects.
+	Done() reports whether any failed; if one did it resets the chain, ready for the whole body to run again, or
+	throws once the interface's retries are used up (in RunNoThrow(), it records the error and returns true).
+	Transactions may nest, in which case only the outermost one is retried. Without integrity checking, Done() is
+	always true.
+ */
+class JtagTransaction
+{
+public:
+	JtagTransaction(JtagInterface* iface, const char* what);
+	~JtagTransaction();
+
+	bool Done();
+
+protected:
+	///@brief The adapter
+	JtagInterface* m_iface;
+
+	///@brief Name of the operation, for messages
+	const char* m_what;
+
+	///@brief Number of retries so far
+	unsigned int m_attempt;
 };
 
 #endif
@@ -0,0 +1,489 @@
+/**
+	@file
+	@brief Implementation of JtagLogger
+ */
+
+#include "jtaghal.h"
+#include <stdarg.h>
+#include <pthread.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+static int GetInitialLogLevel();
+
+int g_jtagLogLevel = GetInitialLogLevel();
+int JtagLogger::m_flushLevel = JTAG_LOG_NOTICE;
+__thread JtagLogRing* JtagLogger::t_ring = NULL;
+
+/**
+	@brief State shared by all threads, created along with the first ring
+ */
+struct JtagLogSink
+{
+	///@brief Every thread's ring
+	vector<JtagLogRing*> rings;
+
+	///@brief Signalled to stop the sink thread
+	condition_variable wake;
+
+	///@brief The sink thread
+	thread writer;
+
+	///@brief Set to make the sink thread exit
+	bool stop;
+
+	///@brief JtagCycleClock count that debug timestamps are relative to
+	uint64_t start;
+
+	///@brief Frees a thread's ring when it exits
+	pthread_key_t key;
+};
+
+///@brief Protects g_logSink and everything in it, and is held while draining the rings
+static mutex g_logMutex;
+
+///@brief Shared state, or NULL if nothing has been logged yet
+static JtagLogSink* g_logSink = NULL;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Levels
+
+/**
+	@brief Reads the initial level from the JTAG_LOG environment variable
+ */
+static int GetInitialLogLevel()
+{
+	const char* env = getenv("JTAG_LOG");
+	if(env && *env)
+	{
+		int level = JtagLogger::ParseLevel(env);
+		if(level >= 0)
+			return level;
+		fprintf(stderr, "Ignoring unknown JTAG_LOG level \"%s\"\n", env);
+	}
+	return JTAG_LOG_NOTICE;
+}
+
+/**
+	@brief Converts a level name (error, warning, notice, verbose, debug, trace) or number to a JtagLogLevel
+
+	@return The level, or -1 if the name isn't one
+ */
+int JtagLogger::ParseLevel(const char* name)
+{
+	static const char* const names[] = { "error", "warning", "notice", "verbose", "debug", "trace" };
+	for(int i=0; i<=JTAG_LOG_TRACE; i++)
+	{
+		if(!strcasecmp(name, names[i]))
+			return i;
+	}
+	if( (name[0] >= '0') && (name[0] <= '0' + JTAG_LOG_TRACE) && (name[1] == '\0') )
+		return name[0] - '0';
+	return -1;
+}
+
+/**
+	@brief Sets the most verbose level shown
+
+	Levels above JTAG_LOG_MAX_LEVEL were compiled out, and stay off.
+ */
+void JtagLogger::SetLevel(int level)
+{
+	g_jtagLogLevel = level;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Formatting
+
+/**
+	@brief Formats one conversion with snprintf and appends the result
+ */
+template<typename T>
+static void AppendFormatted(string& out, const char* spec, T value)
+{
+	char buf[256];
+	snprintf(buf, sizeof(buf), spec, value);
+	out += buf;
+}
+
+/**
+	@brief Appends an integer conversion, converting the value to the type its length modifier asks for
+ */
+static void AppendInteger(string& out, const char* spec, const string& length, bool is_signed, uint64_t value)
+{
+	if(length == "l")
+	{
+		if(is_signed)
+			AppendFormatted(out, spec, static_cast<long>(value));
+		else
+			AppendFormatted(out, spec, static_cast<unsigned long>(value));
+	}
+	else if( (length == "ll") || (length == "q") || (length == "j") )
+	{
+		if(is_signed)
+			AppendFormatted(out, spec, static_cast<long long>(value));
+		else
+			AppendFormatted(out, spec, static_cast<unsigned long long>(value));
+	}
+	else if( (length == "z") || (length == "t") )
+	{
+		if(is_signed)
+			AppendFormatted(out, spec, static_cast<ptrdiff_t>(value));
+		else
+			AppendFormatted(out, spec, static_cast<size_t>(value));
+	}
+
+	//No modifier, h and hh all take an int
+	else if(is_signed)
+		AppendFormatted(out, spec, static_cast<int>(value));
+	else
+		AppendFormatted(out, spec, static_cast<unsigned int>(value));
+}
+
+/**
+	@brief Formats a deferred message, as printf would have when it was logged
+
+	Each conversion in the format is handed to snprintf on its own, with the stored argument converted back to the
+	type the conversion expects. Arguments that are missing or of the wrong kind print as "(?)". Widths and
+	precisions given as '*' aren't supported.
+ */
+static string FormatRecord(const JtagLogRecord& rec)
+{
+	string out;
+	const char* f = rec.format;
+	unsigned int arg = 0;
+	while(*f)
+	{
+		//Literal text
+		if(*f != '%')
+		{
+			const char* next = strchr(f, '%');
+			size_t len = next ? (next - f) : strlen(f);
+			out.append(f, len);
+			f += len;
+			continue;
+		}
+		if(f[1] == '%')
+		{
+			out += '%';
+			f += 2;
+			continue;
+		}
+
+		//Split up the conversion: flags, width, precision, length, conversion
+		const char* start = f++;
+		f += strspn(f, "-+ #0'");
+		f += strspn(f, "0123456789");
+		if(*f == '.')
+		{
+			f++;
+			f += strspn(f, "0123456789");
+		}
+		const char* length_start = f;
+		f += strspn(f, "hlLqjzt");
+		string length(length_start, f);
+		char conv = *f;
+		if(conv == '\0')
+			break;
+		f++;
+
+		char spec[32];
+		size_t speclen = f - start;
+		if(speclen >= sizeof(spec))
+		{
+			out.append(start, speclen);
+			continue;
+		}
+		memcpy(spec, start, speclen);
+		spec[speclen] = '\0';
+
+		if(conv == 'n')
+			continue;
+		if(arg >= rec.nargs)
+		{
+			out += "(?)";
+			continue;
+		}
+		uint8_t type = rec.types[arg];
+		uint64_t value = rec.args[arg].u;
+		double dvalue = rec.args[arg].d;
+		arg ++;
+
+		bool is_int = (type == JtagLogRecord::ARG_INT) || (type == JtagLogRecord::ARG_POINTER);
+		switch(conv)
+		{
+			case 'd':
+			case 'i':
+				if(is_int)
+					AppendInteger(out, spec, length, true, value);
+				else
+					out += "(?)";
+				break;
+
+			case 'o':
+			case 'u':
+			case 'x':
+			case 'X':
+				if(is_int)
+					AppendInteger(out, spec, length, false, value);
+				else
+					out += "(?)";
+				break;
+
+			case 'c':
+				if(is_int)
+					AppendFormatted(out, spec, static_cast<int>(value));
+				else
+					out += "(?)";
+				break;
+
+			case 'e':
+			case 'E':
+			case 'f':
+			case 'F':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				if(type != JtagLogRecord::ARG_DOUBLE)
+					out += "(?)";
+				else if(length == "L")
+					AppendFormatted(out, spec, static_cast<long double>(dvalue));
+				else
+					AppendFormatted(out, spec, dvalue);
+				break;
+
+			case 's':
+				if(type == JtagLogRecord::ARG_STRING)
+					AppendFormatted(out, spec, rec.strings + value);
+				else
+					out += "(?)";
+				break;
+
+			case 'p':
+				if(is_int)
+					AppendFormatted(out, spec, reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+				else
+					out += "(?)";
+				break;
+
+			default:
+				out += spec;
+				break;
+		}
+	}
+	return out;
+}
+
+/**
+	@brief Copies a string argument into the message, truncating it if the message is out of space
+ */
+void JtagLogger::CaptureOne(JtagLogRecord& rec, const char* value)
+{
+	if(value == NULL)
+		value = "(null)";
+
+	//The last byte is always kept free for the terminator, so there is always room for an empty string
+	size_t avail = JTAG_LOG_STRING_BYTES - rec.strused;
+	size_t len = strnlen(value, avail - 1);
+	memcpy(rec.strings + rec.strused, value, len);
+	rec.strings[rec.strused + len] = '\0';
+
+	rec.types[rec.nargs] = JtagLogRecord::ARG_STRING;
+	rec.args[rec.nargs++].u = rec.strused;
+	rec.strused = min<size_t>(rec.strused + len + 1, JTAG_LOG_STRING_BYTES - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Output
+
+/**
+	@brief Writes one formatted message to stderr, with a prefix depending on its level
+ */
+static void WriteMessage(int level, uint64_t time, const char* text)
+{
+	switch(level)
+	{
+		case JTAG_LOG_ERROR:
+			fputs("Error: ", stderr);
+			break;
+
+		case JTAG_LOG_WARNING:
+			fputs("Warning: ", stderr);
+			break;
+
+		case JTAG_LOG_DEBUG:
+		case JTAG_LOG_TRACE:
+			if(g_logSink)
+				fprintf(stderr, "[%12.6f] ", JtagCycleClock::ToNs(time - g_logSink->start) * 1e-9);
+			break;
+
+		default:
+			break;
+	}
+	fputs(text, stderr);
+}
+
+/**
+	@brief Formats and writes everything queued in every ring, oldest first. g_logMutex must be held.
+ */
+static void DrainRings()
+{
+	if(!g_logSink)
+		return;
+
+	vector< pair<uint64_t, pair<int, string> > > messages;
+	vector<JtagLogRing*>& rings = g_logSink->rings;
+	for(size_t i=0; i<rings.size(); )
+	{
+		JtagLogRing* ring = rings[i];
+
+		//Check for exit first, so nothing logged just before it is missed
+		bool orphaned = ring->m_orphaned.load(memory_order_acquire);
+
+		uint32_t tail = ring->m_tail.load(memory_order_relaxed);
+		uint32_t head = ring->m_head.load(memory_order_acquire);
+		for(; tail != head; tail++)
+		{
+			const JtagLogRecord& rec = ring->m_records[tail & (JTAG_LOG_RING_RECORDS - 1)];
+			messages.push_back(make_pair(rec.time, make_pair(static_cast<int>(rec.level), FormatRecord(rec))));
+		}
+		ring->m_tail.store(tail, memory_order_release);
+
+		uint32_t dropped = ring->m_dropped.exchange(0, memory_order_relaxed);
+		if(dropped)
+		{
+			char text[64];
+			snprintf(text, sizeof(text), "(%u log messages dropped)\n", dropped);
+			messages.push_back(make_pair(JtagCycleClock::Now(), make_pair(static_cast<int>(JTAG_LOG_WARNING), string(text))));
+		}
+
+		if(orphaned)
+		{
+			delete ring;
+			rings.erase(rings.begin() + i);
+		}
+		else
+			i++;
+	}
+
+	stable_sort(messages.begin(), messages.end(),
+		[](const pair<uint64_t, pair<int, string> >& a, const pair<uint64_t, pair<int, string> >& b)
+		{ return a.first < b.first; });
+	for(size_t i=0; i<messages.size(); i++)
+		WriteMessage(messages[i].second.first, messages[i].first, messages[i].second.second.c_str());
+}
+
+/**
+	@brief Writes out queued messages every few milliseconds until told to stop
+ */
+static void SinkThread()
+{
+	unique_lock<mutex> lock(g_logMutex);
+	while(!g_logSink->stop)
+	{
+		g_logSink->wake.wait_for(lock, chrono::milliseconds(20));
+		DrainRings();
+	}
+}
+
+/**
+	@brief Stops the sink at exit, after writing out everything still queued
+ */
+static void StopSink()
+{
+	{
+		lock_guard<mutex> lock(g_logMutex);
+		g_logSink->stop = true;
+	}
+	g_logSink->wake.notify_one();
+	g_logSink->writer.join();
+
+	//From here on there is no sink, so every message is written immediately
+	JtagLogger::Flush();
+	JtagLogger::StopDeferring();
+}
+
+/**
+	@brief Marks an exiting thread's ring for the sink to free
+ */
+static void OrphanRing(void* ring)
+{
+	static_cast<JtagLogRing*>(ring)->m_orphaned.store(true, memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rings
+
+/**
+	@brief Creates the calling thread's ring, and the sink along with the first one
+ */
+JtagLogRing* JtagLogger::NewRing()
+{
+	JtagLogRing* ring = new JtagLogRing;
+	ring->m_head.store(0);
+	ring->m_tail.store(0);
+	ring->m_dropped.store(0);
+	ring->m_orphaned.store(false);
+
+	lock_guard<mutex> lock(g_logMutex);
+	if(!g_logSink)
+	{
+		g_logSink = new JtagLogSink;
+		g_logSink->stop = false;
+		g_logSink->start = JtagCycleClock::Now();
+		pthread_key_create(&g_logSink->key, OrphanRing);
+		g_logSink->writer = thread(SinkThread);
+		atexit(StopSink);
+	}
+	g_logSink->rings.push_back(ring);
+	pthread_setspecific(g_logSink->key, ring);
+
+	t_ring = ring;
+	return ring;
+}
+
+/**
+	@brief Writes out everything queued by every thread, and returns once it has been
+ */
+void JtagLogger::Flush()
+{
+	lock_guard<mutex> lock(g_logMutex);
+	DrainRings();
+}
+
+/**
+	@brief Makes every message flush as soon as it is logged, once the sink thread is gone
+ */
+void JtagLogger::StopDeferring()
+{
+	m_flushLevel = JTAG_LOG_TRACE;
+}
+
+/**
+	@brief Logs an already formatted message, for C code
+
+	Messages that would be flushed anyway are written directly, so are not limited to JTAG_LOG_STRING_BYTES.
+ */
+void JtagLogPrintf(int level, const char* format, ...)
+{
+	char text[1024];
+	va_list list;
+	va_start(list, format);
+	vsnprintf(text, sizeof(text), format, list);
+	va_end(list);
+
+	if(level <= JtagLogger::GetFlushLevel())
+	{
+		//Write out older messages before this one
+		lock_guard<mutex> lock(g_logMutex);
+		DrainRings();
+		WriteMessage(level, JtagCycleClock::Now(), text);
+	}
+	else
+		JtagLogger::Log(level, "%s", text);
+}
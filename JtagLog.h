@@ -0,0 +1,271 @@
+/**
+	@file
+	@brief Declaration of JtagLogger and the logging macros
+ */
+
+#ifndef JtagLog_h
+#define JtagLog_h
+
+/**
+	@brief Log levels, most severe first
+ */
+enum JtagLogLevel
+{
+	JTAG_LOG_ERROR,			///< Something failed
+	JTAG_LOG_WARNING,		///< Something looks wrong, but we carry on
+	JTAG_LOG_NOTICE,		///< Normal output, shown by default
+	JTAG_LOG_VERBOSE,		///< More detail about what is going on
+	JTAG_LOG_DEBUG,			///< Detail only useful when debugging jtaghal
+	JTAG_LOG_TRACE			///< Individual scan operations
+};
+
+/*
+	Most verbose level compiled in. Calls to anything more verbose are removed by the compiler, arguments and all, so
+	e.g. -DJTAG_LOG_MAX_LEVEL=JTAG_LOG_VERBOSE leaves no trace logging in the shift paths at all. Everything up to
+	this level can be turned on at run time with JTAG_LOG=error|warning|notice|verbose|debug|trace (default notice).
+ */
+#ifndef JTAG_LOG_MAX_LEVEL
+#define JTAG_LOG_MAX_LEVEL		JTAG_LOG_TRACE
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///@brief Most verbose level currently enabled
+extern int g_jtagLogLevel;
+
+void JtagLogPrintf(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+#ifdef __cplusplus
+}
+#endif
+
+///@brief True if a message at the given level would be shown. Constant false above JTAG_LOG_MAX_LEVEL.
+#define JTAG_LOG_ENABLED(level) \
+	( ((level) <= JTAG_LOG_MAX_LEVEL) && __builtin_expect((level) <= g_jtagLogLevel, 0) )
+
+#if defined(__cplusplus) && defined(jtaghal_h)
+
+#include <atomic>
+#include <type_traits>
+
+///@brief Most arguments a deferred log message may have
+#define JTAG_LOG_MAX_ARGS		8
+
+///@brief Space for copies of string arguments in each deferred log message
+#define JTAG_LOG_STRING_BYTES	160
+
+///@brief Messages each thread can have waiting for the sink (a power of two)
+#define JTAG_LOG_RING_RECORDS	256
+
+/**
+	@brief One log message, not yet formatted
+ */
+struct JtagLogRecord
+{
+	///@brief Argument types
+	enum ArgType
+	{
+		ARG_INT,
+		ARG_DOUBLE,
+		ARG_STRING,
+		ARG_POINTER
+	};
+
+	///@brief JtagCycleClock count when the message was logged
+	uint64_t time;
+
+	///@brief The format string. Must outlive the message, so is normally a literal.
+	const char* format;
+
+	///@brief Log level
+	uint8_t level;
+
+	///@brief Number of arguments
+	uint8_t nargs;
+
+	///@brief Bytes of strings used
+	uint16_t strused;
+
+	///@brief Type of each argument
+	uint8_t types[JTAG_LOG_MAX_ARGS];
+
+	///@brief The arguments: integers and pointers widened to 64 bits, doubles, or offsets into strings
+	union
+	{
+		uint64_t u;
+		double d;
+	} args[JTAG_LOG_MAX_ARGS];
+
+	///@brief Copies of string arguments, so the caller's buffers can go away
+	char strings[JTAG_LOG_STRING_BYTES];
+};
+
+/**
+	@brief Messages logged by one thread, waiting for the sink
+
+	Single-producer / single-consumer ring: the owning thread advances m_head, the sink (holding JtagLogger's lock)
+	advances m_tail, and neither ever blocks the other.
+ */
+struct JtagLogRing
+{
+	///@brief Index of the next record to write
+	std::atomic<uint32_t> m_head;
+
+	///@brief Index of the next record to read
+	std::atomic<uint32_t> m_tail;
+
+	///@brief Messages dropped because the ring was full
+	std::atomic<uint32_t> m_dropped;
+
+	///@brief Set when the owning thread exits; the sink frees the ring once it is empty
+	std::atomic<bool> m_orphaned;
+
+	///@brief The records
+	JtagLogRecord m_records[JTAG_LOG_RING_RECORDS];
+};
+
+/**
+	@brief Leveled logging with deferred formatting
+
+	Use the LogError() ... LogTrace() macros rather than calling this directly. A disabled message costs a load and a
+	branch (or nothing at all above JTAG_LOG_MAX_LEVEL), and its arguments are not evaluated.
+
+	An enabled message is not formatted by the caller. The format string pointer and the raw argument values are
+	stored in a ring owned by the calling thread, without locking, and a background sink thread formats and writes
+	them to stderr, in timestamp order across threads. Messages at JTAG_LOG_NOTICE and above are for people, so they
+	also flush everything queued so far before returning, keeping the output in order with the caller's own.
+
+	Arguments may be integers, enums, floating point, C strings (copied, up to JTAG_LOG_STRING_BYTES per message in
+	total) and pointers, matched against the format at output time the way printf would. If a thread logs faster than
+	the sink can write, messages are dropped rather than stalling it, and the count is reported.
+ */
+class JtagLogger
+{
+public:
+
+	///@brief Logs a message. Call through the Log*() macros, which check the level first.
+	template<typename... Args>
+	static void Log(int level, const char* format, Args... args)
+	{
+		static_assert(sizeof...(Args) <= JTAG_LOG_MAX_ARGS, "too many arguments for a log message");
+
+		JtagLogRing* ring = GetRing();
+		uint32_t head = ring->m_head.load(std::memory_order_relaxed);
+		if( (head - ring->m_tail.load(std::memory_order_acquire)) >= JTAG_LOG_RING_RECORDS)
+			ring->m_dropped.fetch_add(1, std::memory_order_relaxed);
+		else
+		{
+			JtagLogRecord& rec = ring->m_records[head & (JTAG_LOG_RING_RECORDS - 1)];
+			rec.time = JtagCycleClock::Now();
+			rec.format = format;
+			rec.level = level;
+			rec.nargs = 0;
+			rec.strused = 0;
+			Capture(rec, args...);
+			ring->m_head.store(head + 1, std::memory_order_release);
+		}
+
+		if(level <= m_flushLevel)
+			Flush();
+	}
+
+	///@brief Returns the most verbose level that is flushed as soon as it is logged
+	static int GetFlushLevel()
+	{ return m_flushLevel; }
+
+	static void Flush();
+	static void StopDeferring();
+	static void SetLevel(int level);
+	static int ParseLevel(const char* name);
+
+protected:
+
+	///@brief Returns the calling thread's ring
+	static JtagLogRing* GetRing()
+	{
+		if(__builtin_expect(t_ring == NULL, 0))
+			return NewRing();
+		return t_ring;
+	}
+
+	static JtagLogRing* NewRing();
+
+	static void Capture(JtagLogRecord& /*rec*/)
+	{}
+
+	template<typename T, typename... Args>
+	static void Capture(JtagLogRecord& rec, T value, Args... args)
+	{
+		CaptureOne(rec, value);
+		Capture(rec, args...);
+	}
+
+	///@brief Stores an integer or enum argument
+	template<typename T>
+	static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+	CaptureOne(JtagLogRecord& rec, T value)
+	{
+		rec.types[rec.nargs] = JtagLogRecord::ARG_INT;
+		rec.args[rec.nargs++].u = static_cast<uint64_t>(value);
+	}
+
+	///@brief Stores a floating point argument
+	template<typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type
+	CaptureOne(JtagLogRecord& rec, T value)
+	{
+		rec.types[rec.nargs] = JtagLogRecord::ARG_DOUBLE;
+		rec.args[rec.nargs++].d = value;
+	}
+
+	///@brief Stores a pointer argument
+	static void CaptureOne(JtagLogRecord& rec, const void* value)
+	{
+		rec.types[rec.nargs] = JtagLogRecord::ARG_POINTER;
+		rec.args[rec.nargs++].u = reinterpret_cast<uintptr_t>(value);
+	}
+
+	static void CaptureOne(JtagLogRecord& rec, const char* value);
+
+	///@brief Most verbose level flushed as soon as it is logged
+	static int m_flushLevel;
+
+	///@brief The calling thread's ring, or NULL if it hasn't logged anything yet
+	static __thread JtagLogRing* t_ring;
+};
+
+/**
+	@brief Never called; lets the compiler check a deferred message's arguments against its format like printf's
+ */
+static inline void __attribute__((format(printf, 1, 2))) JtagLogCheckFormat(const char* /*format*/, ...)
+{
+}
+
+//The dead branch type-checks the arguments without evaluating them
+#define JTAG_LOG(level, ...) \
+	do \
+	{ \
+		if(JTAG_LOG_ENABLED(level)) \
+			JtagLogger::Log(level, __VA_ARGS__); \
+		else if(0) \
+			JtagLogCheckFormat(__VA_ARGS__); \
+	} while(0)
+
+#else
+
+//C sources, and C++ ones that don't use jtaghal.h, format in the caller
+#define JTAG_LOG(level, ...) \
+	do { if(JTAG_LOG_ENABLED(level)) JtagLogPrintf(level, __VA_ARGS__); } while(0)
+
+#endif
+
+#define LogError(...)		JTAG_LOG(JTAG_LOG_ERROR, __VA_ARGS__)
+#define LogWarning(...)		JTAG_LOG(JTAG_LOG_WARNING, __VA_ARGS__)
+#define LogNotice(...)		JTAG_LOG(JTAG_LOG_NOTICE, __VA_ARGS__)
+#define LogVerbose(...)		JTAG_LOG(JTAG_LOG_VERBOSE, __VA_ARGS__)
+#define LogDebug(...)		JTAG_LOG(JTAG_LOG_DEBUG, __VA_ARGS__)
+#define LogTrace(...)		JTAG_LOG(JTAG_LOG_TRACE, __VA_ARGS__)
+
+#endif
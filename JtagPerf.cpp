@@ -0,0 +1,105 @@
+/**
+	@file
+	@brief Implementation of JtagLatencyHistogram and JtagPerfSnapshot
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// JtagLatencyHistogram
+
+JtagLatencyHistogram::JtagLatencyHistogram()
+{
+	Reset();
+}
+
+/**
+	@brief Forgets everything recorded so far
+ */
+void JtagLatencyHistogram::Reset()
+{
+	memset(m_buckets, 0, sizeof(m_buckets));
+	m_count = 0;
+	m_sum = 0;
+	m_max = 0;
+}
+
+/**
+	@brief Adds another histogram's latencies to this one
+ */
+void JtagLatencyHistogram::Merge(const JtagLatencyHistogram& rhs)
+{
+	for(unsigned int i=0; i<JTAG_HISTOGRAM_BUCKETS; i++)
+		m_buckets[i] += rhs.m_buckets[i];
+	m_count += rhs.m_count;
+	m_sum += rhs.m_sum;
+	if(rhs.m_max > m_max)
+		m_max = rhs.m_max;
+}
+
+/**
+	@brief Returns the largest value that falls in a bucket
+ */
+uint64_t JtagLatencyHistogram::BucketTop(unsigned int index)
+{
+	if(index < (1U << JTAG_HISTOGRAM_SUB_BITS))
+		return index;
+	unsigned int shift = (index >> JTAG_HISTOGRAM_SUB_BITS) - 1;
+	uint64_t mantissa = index - (shift << JTAG_HISTOGRAM_SUB_BITS);
+	return ( (mantissa + 1) << shift) - 1;
+}
+
+/**
+	@brief Returns a percentile of the recorded latencies
+
+	@param pct		The percentile, 0 to 100
+
+	@return The latency, in ns, that pct percent of the recorded ones are no greater than (0 if nothing was recorded)
+ */
+uint64_t JtagLatencyHistogram::GetPercentile(double pct) const
+{
+	if(m_count == 0)
+		return 0;
+
+	uint64_t rank = static_cast<uint64_t>(ceil(pct / 100 * m_count));
+	if(rank < 1)
+		rank = 1;
+	uint64_t seen = 0;
+	for(unsigned int i=0; i<JTAG_HISTOGRAM_BUCKETS; i++)
+	{
+		seen += m_buckets[i];
+		if(seen >= rank)
+			return min(BucketTop(i), m_max);
+	}
+	return m_max;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// JtagPerfSnapshot
+
+/**
+	@brief Prints the counters and a latency summary as text
+ */
+void JtagPerfSnapshot::Print(FILE* fp) const
+{
+	fprintf(fp, "shift ops:          %zu\n", shift_ops);
+	fprintf(fp, "data bits:          %zu\n", data_bits);
+	fprintf(fp, "mode bits:          %zu\n", mode_bits);
+	fprintf(fp, "dummy clocks:       %zu\n", dummy_clocks);
+	fprintf(fp, "recoverable errors: %zu\n", recoverable_errors);
+	fprintf(fp, "integrity checks:   %zu\n", integrity_checks);
+	fprintf(fp, "integrity failures: %zu\n", integrity_failures);
+	fprintf(fp, "shift time:         %.6f s\n", shift_time);
+
+	const char* names[] = { "ShiftData", "ShiftTMS", "RTCK wait" };
+	const JtagLatencyHistogram* hists[] = { &shift_data, &shift_tms, &rtck_wait };
+	fprintf(fp, "%-12s %12s %12s %12s %12s %12s\n", "latency (ns)", "count", "mean", "p50", "p99", "max");
+	for(int i=0; i<3; i++)
+	{
+		const JtagLatencyHistogram& h = *hists[i];
+		fprintf(fp, "%-12s %12" PRIu64 " %12.0f %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+			names[i], h.GetCount(), h.GetMean(), h.GetPercentile(50), h.GetPercentile(99), h.GetMax());
+	}
+}
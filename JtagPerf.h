@@ -0,0 +1,137 @@
+/**
+	@file
+	@brief Declaration of JtagLatencyHistogram and JtagPerfSnapshot
+ */
+
+#ifndef JtagPerf_h
+#define JtagPerf_h
+
+///@brief log2 of the number of buckets per power of two in a JtagLatencyHistogram (about 3% resolution)
+#define JTAG_HISTOGRAM_SUB_BITS		5
+
+///@brief Largest latency a JtagLatencyHistogram resolves, as a power of two in ns (about 18 minutes); longer ones clamp
+#define JTAG_HISTOGRAM_MAX_BITS		40
+
+///@brief Number of buckets in a JtagLatencyHistogram
+#define JTAG_HISTOGRAM_BUCKETS \
+	( (JTAG_HISTOGRAM_MAX_BITS - JTAG_HISTOGRAM_SUB_BITS + 1) << JTAG_HISTOGRAM_SUB_BITS)
+
+/**
+	@brief HDR-style latency histogram, in nanoseconds
+
+	Values below 2^JTAG_HISTOGRAM_SUB_BITS get a bucket each. Above that, every power of two is split into
+	2^JTAG_HISTOGRAM_SUB_BITS linear buckets, so the relative error is the same from nanoseconds to minutes. Record()
+	is a count-leading-zeros, a shift and two adds, cheap enough for every wire-level operation.
+
+	Percentiles are reported as the top of the bucket they fall in (never above the exact maximum), so they are
+	conservative by at most one bucket.
+ */
+class JtagLatencyHistogram
+{
+public:
+	JtagLatencyHistogram();
+
+	///@brief Records one latency, in ns
+	void Record(uint64_t ns)
+	{
+		if(ns >= (1ULL << JTAG_HISTOGRAM_MAX_BITS))
+			ns = (1ULL << JTAG_HISTOGRAM_MAX_BITS) - 1;
+		m_buckets[BucketIndex(ns)] ++;
+		m_count ++;
+		m_sum += ns;
+		if(ns > m_max)
+			m_max = ns;
+	}
+
+	void Reset();
+	void Merge(const JtagLatencyHistogram& rhs);
+
+	uint64_t GetPercentile(double pct) const;
+
+	///@brief Returns the number of latencies recorded
+	uint64_t GetCount() const
+	{ return m_count; }
+
+	///@brief Returns the sum of all latencies recorded, in ns
+	uint64_t GetSum() const
+	{ return m_sum; }
+
+	///@brief Returns the largest latency recorded, in ns
+	uint64_t GetMax() const
+	{ return m_max; }
+
+	///@brief Returns the mean latency, in ns
+	double GetMean() const
+	{ return m_count ? (static_cast<double>(m_sum) / m_count) : 0; }
+
+protected:
+
+	///@brief Returns the bucket a value falls in
+	static unsigned int BucketIndex(uint64_t ns)
+	{
+		if(ns < (1ULL << JTAG_HISTOGRAM_SUB_BITS))
+			return ns;
+		unsigned int shift = (63 - __builtin_clzll(ns)) - JTAG_HISTOGRAM_SUB_BITS;
+		return (shift << JTAG_HISTOGRAM_SUB_BITS) + (ns >> shift);
+	}
+
+	static uint64_t BucketTop(unsigned int index);
+
+	///@brief Number of latencies in each bucket
+	uint64_t m_buckets[JTAG_HISTOGRAM_BUCKETS];
+
+	///@brief Number of latencies recorded
+	uint64_t m_count;
+
+	///@brief Sum of all latencies recorded, in ns
+	uint64_t m_sum;
+
+	///@brief Largest latency recorded, in ns
+	uint64_t m_max;
+};
+
+/**
+	@brief Everything a JtagInterface has counted, as of one point in time
+
+	Returned by JtagInterface::GetPerfSnapshot(). Snapshots are plain copies, so two can be taken around a piece of
+	work and compared, without resetting the adapter's own counters.
+ */
+struct JtagPerfSnapshot
+{
+	///@brief Number of shift operations (ShiftData() and ShiftTMS() calls)
+	size_t shift_ops;
+
+	///@brief Number of data bits shifted
+	size_t data_bits;
+
+	///@brief Number of mode (TMS) bits shifted
+	size_t mode_bits;
+
+	///@brief Number of dummy clocks sent
+	size_t dummy_clocks;
+
+	///@brief Number of errors recovered from
+	size_t recoverable_errors;
+
+	///@brief Number of scans integrity checked
+	size_t integrity_checks;
+
+	///@brief Number of scans that failed their integrity check even after retrying
+	size_t integrity_failures;
+
+	///@brief Total time spent on shift operations, in seconds
+	double shift_time;
+
+	///@brief Latency of each ShiftData() call
+	JtagLatencyHistogram shift_data;
+
+	///@brief Latency of each ShiftTMS() call
+	JtagLatencyHistogram shift_tms;
+
+	///@brief Time spent waiting for the target to return each TCK edge, for adapters with adaptive clocking
+	JtagLatencyHistogram rtck_wait;
+
+	void Print(FILE* fp) const;
+};
+
+#endif
@@ -0,0 +1,90 @@
+/**
+	@file
+	@brief USDT (user-level statically defined tracing) probes
+ */
+
+#ifndef JtagProbes_h
+#define JtagProbes_h
+
+#include <stdint.h>
+
+/*
+	Each probe is a single nop, plus a .note.stapsdt entry describing where it is and which registers hold its
+	arguments: the same format as <sys/sdt.h>, written out here so neither toolchain needs systemtap headers. perf,
+	bpftrace and systemtap find the probes in the binary, and patch the nop with a breakpoint only while tracing, so a
+	probe nobody is watching costs the nop and having its arguments in registers.
+
+	All probes belong to the "jtag" provider. Arguments are passed as uintptr_t, so they are 32 bits wide on 32-bit
+	ARM; pointers are C strings unless noted.
+
+	jtag:shift_data_start	(bits, last_tms)
+	jtag:shift_data_done	(bits, ns)
+	jtag:shift_tms			(bits, ns)
+	jtag:dummy_clocks		(clocks, ns)
+	jtag:tap_state			(JtagTapState entered, TMS bits)		from the state-level functions
+	jtag:rtck_wait			(level, ns)								only when the first STRTCK poll missed
+	jtag:rtck_drift			(old echo ns, new echo ns)				DSP clock change detected from RTCK echo latency
+	jtag:devm_map			(physical address, length, virtual address)
+	jtag:devm_unmap			(virtual address, length)
+	jtag:exception			(message, file, line)
+
+	Build with -DJTAG_NO_PROBES to leave them out entirely.
+ */
+
+#if defined(__linux__) && defined(__GNUC__) && !defined(JTAG_NO_PROBES) && \
+	(defined(__i386__) || defined(__x86_64__) || defined(__arm__) || defined(__aarch64__))
+
+#if defined(__LP64__)
+#define JTAG_PROBE_ADDR		".8byte"
+#define JTAG_PROBE_ARG(n)	"8@%" #n
+#else
+#define JTAG_PROBE_ADDR		".4byte"
+#define JTAG_PROBE_ARG(n)	"4@%" #n
+#endif
+
+#define JTAG_PROBE_ASM(name, args) \
+	"990:	nop\n" \
+	"	.pushsection .note.stapsdt,\"\",\"note\"\n" \
+	"	.balign 4\n" \
+	"	.4byte 992f-991f, 994f-993f, 3\n" \
+	"991:	.asciz \"stapsdt\"\n" \
+	"992:	.balign 4\n" \
+	"993:	" JTAG_PROBE_ADDR " 990b\n" \
+	"	" JTAG_PROBE_ADDR " _.stapsdt.base\n" \
+	"	" JTAG_PROBE_ADDR " 0\n" \
+	"	.asciz \"jtag\"\n" \
+	"	.asciz \"" #name "\"\n" \
+	"	.asciz \"" args "\"\n" \
+	"994:	.balign 4\n" \
+	"	.popsection\n" \
+	"	.ifndef _.stapsdt.base\n" \
+	"	.pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+	"	.weak _.stapsdt.base\n" \
+	"	.hidden _.stapsdt.base\n" \
+	"_.stapsdt.base:	.space 1\n" \
+	"	.size _.stapsdt.base, 1\n" \
+	"	.popsection\n" \
+	"	.endif\n"
+
+#define JTAG_PROBE(name) \
+	__asm__ __volatile__(JTAG_PROBE_ASM(name, "") : : )
+#define JTAG_PROBE1(name, a) \
+	__asm__ __volatile__(JTAG_PROBE_ASM(name, JTAG_PROBE_ARG(0)) \
+		: : "r"((uintptr_t)(a)))
+#define JTAG_PROBE2(name, a, b) \
+	__asm__ __volatile__(JTAG_PROBE_ASM(name, JTAG_PROBE_ARG(0) " " JTAG_PROBE_ARG(1)) \
+		: : "r"((uintptr_t)(a)), "r"((uintptr_t)(b)))
+#define JTAG_PROBE3(name, a, b, c) \
+	__asm__ __volatile__(JTAG_PROBE_ASM(name, JTAG_PROBE_ARG(0) " " JTAG_PROBE_ARG(1) " " JTAG_PROBE_ARG(2)) \
+		: : "r"((uintptr_t)(a)), "r"((uintptr_t)(b)), "r"((uintptr_t)(c)))
+
+#else
+
+#define JTAG_PROBE(name)				do {} while(0)
+#define JTAG_PROBE1(name, a)			do {} while(0)
+#define JTAG_PROBE2(name, a, b)			do {} while(0)
+#define JTAG_PROBE3(name, a, b, c)		do {} while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,334 @@
+/**
+	@file
+	@brief Implementation of JtagScanPlan
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+///@brief Step::rxOffset of steps that don't read back
+#define JTAG_PLAN_NO_READBACK	SIZE_MAX
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates an empty plan
+
+	@param iface	The adapter to run on. Must outlive the plan.
+ */
+JtagScanPlan::JtagScanPlan(JtagInterface* iface)
+	: m_iface(iface)
+	, m_compiled(false)
+	, m_tmsCount(0)
+{
+}
+
+JtagScanPlan::~JtagScanPlan()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Recording
+
+/**
+	@brief Forgets everything recorded so far
+ */
+void JtagScanPlan::Clear()
+{
+	m_ops.clear();
+	m_compiled = false;
+}
+
+/**
+	@brief Records a TAP reset, ending in Run-Test-Idle (see JtagInterface::ResetToIdle())
+ */
+void JtagScanPlan::ResetToIdle()
+{
+	Op op;
+	op.type = OP_RESET;
+	op.device = 0;
+	op.count = 0;
+	op.input = JTAG_PLAN_NONE;
+	op.output = JTAG_PLAN_NONE;
+	m_ops.push_back(op);
+	m_compiled = false;
+}
+
+/**
+	@brief Records an IR load (see JtagInterface::SetIR())
+
+	@param device	Zero-based index of the target device. All other devices are set to BYPASS mode.
+	@param data		The IR value, copied
+	@param count	Instruction register length, in bits
+ */
+void JtagScanPlan::SetIR(unsigned int device, const unsigned char* data, size_t count)
+{
+	Op op;
+	op.type = OP_IR;
+	op.device = device;
+	op.count = count;
+	op.input = JTAG_PLAN_NONE;
+	op.output = JTAG_PLAN_NONE;
+	op.data.assign(data, data + (count + 7) / 8);
+	m_ops.push_back(op);
+	m_compiled = false;
+}
+
+/**
+	@brief Records a DR scan (see JtagInterface::ScanDR())
+
+	@param device		Zero-based index of the target device. All other devices are assumed to be in BYPASS mode.
+	@param send_data	Data to scan in, copied. May be NULL for zeros, or if an input slot supplies the data.
+	@param count		Number of bits to scan
+	@param input		Index into the inputs array of Execute() to take the data from on every run, or JTAG_PLAN_NONE
+	@param output		Index into the outputs array of Execute() to put the captured bits in, or JTAG_PLAN_NONE
+ */
+void JtagScanPlan::ScanDR(unsigned int device, const unsigned char* send_data, size_t count, int input, int output)
+{
+	Op op;
+	op.type = OP_DR;
+	op.device = device;
+	op.count = count;
+	op.input = input;
+	op.output = output;
+	if(send_data)
+		op.data.assign(send_data, send_data + (count + 7) / 8);
+	else
+		op.data.resize( (count + 7) / 8);
+	m_ops.push_back(op);
+	m_compiled = false;
+}
+
+/**
+	@brief Records n clocks in Run-Test-Idle
+ */
+void JtagScanPlan::SendDummyClocks(size_t n)
+{
+	Op op;
+	op.type = OP_IDLE;
+	op.device = 0;
+	op.count = n;
+	op.input = JTAG_PLAN_NONE;
+	op.output = JTAG_PLAN_NONE;
+	m_ops.push_back(op);
+	m_compiled = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Compilation
+
+/**
+	@brief Turns the recorded operations into a flat program
+
+	Execute() compiles automatically if needed; calling this up front keeps the allocations out of the first run.
+
+	@throw JtagException if an operation refers to a device that isn't on the chain
+ */
+void JtagScanPlan::Compile()
+{
+	m_steps.clear();
+	m_tmsBits.clear();
+	m_tmsCount = 0;
+	m_tdiBits.clear();
+	m_tdoBits.clear();
+	m_inputs.clear();
+	m_outputs.clear();
+
+	size_t chain = m_iface->GetChainLength();
+	size_t irtotal = m_iface->GetIRLength();
+
+	//TMS sequences, shifted out LSB first (see the state-level functions of JtagInterface)
+	static const unsigned char reset_tms = 0x3f;	//six ones to Test-Logic-Reset, then Run-Test-Idle
+	static const unsigned char enter_ir = 0x03;		//Select-DR, Select-IR, Capture-IR, Shift-IR
+	static const unsigned char enter_dr = 0x01;		//Select-DR, Capture-DR, Shift-DR
+	static const unsigned char leave = 0x01;		//Update, Run-Test-Idle
+	static const unsigned char idle = 0x00;
+
+	for(size_t i=0; i<m_ops.size(); i++)
+	{
+		const Op& op = m_ops[i];
+		if( (op.type == OP_IR) || (op.type == OP_DR) )
+		{
+			if(op.device >= chain)
+			{
+				throw JtagExceptionWrapper(
+					"Device index out of range",
+					"");
+			}
+			if( (op.count == 0) || ( (op.type == OP_IR) && (chain > 1) && (op.count > irtotal) ) )
+			{
+				throw JtagExceptionWrapper(
+					"Bad register length",
+					"");
+			}
+		}
+
+		switch(op.type)
+		{
+			case OP_RESET:
+				AppendTMS(&reset_tms, 7);
+				break;
+
+			case OP_IDLE:
+				for(size_t n=0; n<op.count; n++)
+					AppendTMS(&idle, 1);
+				break;
+
+			//Other devices get all ones (BYPASS), our IR goes first
+			case OP_IR:
+				{
+					AppendTMS(&enter_ir, 4);
+					size_t offset = (chain == 1) ? AppendData(op.count, false) : AppendData(irtotal, true);
+					CopyBitArray(&m_tdiBits[offset], 0, &op.data[0], 0, op.count);
+					AppendTMS(&leave, 2);
+				}
+				break;
+
+			//Devices before ours each add one bypass bit in front of our DR
+			case OP_DR:
+				{
+					AppendTMS(&enter_dr, 3);
+					size_t lead = (chain == 1) ? 0 : op.device;
+					size_t bits = (chain == 1) ? op.count : (chain - 1 + op.count);
+					size_t offset = AppendData(bits, false);
+					CopyBitArray(&m_tdiBits[offset], lead, &op.data[0], 0, op.count);
+
+					if(op.input != JTAG_PLAN_NONE)
+					{
+						Splice s;
+						s.slot = op.input;
+						s.bit = offset*8 + lead;
+						s.count = op.count;
+						m_inputs.push_back(s);
+					}
+					if(op.output != JTAG_PLAN_NONE)
+					{
+						size_t rx = m_tdoBits.size();
+						m_tdoBits.resize(rx + (bits + 7) / 8);
+						m_steps.back().rxOffset = rx;
+
+						Splice s;
+						s.slot = op.output;
+						s.bit = rx*8 + lead;
+						s.count = op.count;
+						m_outputs.push_back(s);
+					}
+					AppendTMS(&leave, 2);
+				}
+				break;
+		}
+	}
+
+	//CopyBitArray() may touch the byte after the last bit it copies
+	m_tmsBits.push_back(0);
+	m_tdiBits.push_back(0);
+	m_tdoBits.push_back(0);
+	m_compiled = true;
+}
+
+/**
+	@brief Appends TMS bits, extending the previous step if it was also a ShiftTMS()
+ */
+void JtagScanPlan::AppendTMS(const unsigned char* bits, size_t count)
+{
+	if(m_steps.empty() || !m_steps.back().tms)
+	{
+		//Each step's bits start on a byte boundary, since ShiftTMS() takes a byte pointer
+		m_tmsCount = (m_tmsCount + 7) & ~static_cast<size_t>(7);
+
+		Step step;
+		step.tms = true;
+		step.offset = m_tmsCount / 8;
+		step.rxOffset = JTAG_PLAN_NO_READBACK;
+		step.count = 0;
+		m_steps.push_back(step);
+	}
+
+	for(size_t i=0; i<count; i++)
+	{
+		if(m_tmsCount / 8 >= m_tmsBits.size())
+			m_tmsBits.push_back(0);
+		PokeBit(&m_tmsBits[0], m_tmsCount, PeekBit(bits, i));
+		m_tmsCount ++;
+	}
+	m_steps.back().count += count;
+}
+
+/**
+	@brief Appends a ShiftData() step, ending in Exit1, with a fresh TDI vector
+
+	@param count	Number of bits
+	@param fill		Initial value of the TDI bits
+
+	@return Byte offset of the TDI vector in m_tdiBits
+ */
+size_t JtagScanPlan::AppendData(size_t count, bool fill)
+{
+	Step step;
+	step.tms = false;
+	step.offset = m_tdiBits.size();
+	step.rxOffset = JTAG_PLAN_NO_READBACK;
+	step.count = count;
+	m_steps.push_back(step);
+
+	m_tdiBits.resize(step.offset + (count + 7) / 8, fill ? 0xff : 0x00);
+	return step.offset;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Execution
+
+/**
+	@brief Runs the plan once
+
+	@param inputs	One bit string per input slot, each as long as the scan it feeds. May be NULL if there are none.
+	@param outputs	One buffer per output slot, each as long as the scan it captures. May be NULL if there are none.
+
+	@throw JtagException if the plan doesn't compile, a slot is missing, or a scan fails
+ */
+void JtagScanPlan::Execute(const unsigned char* const* inputs, unsigned char* const* outputs)
+{
+	JtagTimelineSpan span("JtagScanPlan");
+	if(!m_compiled)
+		Compile();
+	if( (!inputs && !m_inputs.empty()) || (!outputs && !m_outputs.empty()) )
+	{
+		throw JtagExceptionWrapper(
+			"Plan has placeholders but no slots were supplied",
+			"");
+	}
+
+	m_iface->WaitForAsync();
+
+	//The plan's IR scans don't go through SetIR()
+	m_iface->ForgetIR();
+
+	for(size_t i=0; i<m_inputs.size(); i++)
+	{
+		const Splice& s = m_inputs[i];
+		CopyBitArray(&m_tdiBits[0], s.bit, inputs[s.slot], 0, s.count);
+	}
+
+	for(size_t i=0; i<m_steps.size(); i++)
+	{
+		const Step& s = m_steps[i];
+		if(s.tms)
+			m_iface->ShiftTMS(false, &m_tmsBits[s.offset], s.count);
+		else if(s.rxOffset == JTAG_PLAN_NO_READBACK)
+			m_iface->ShiftData(true, &m_tdiBits[s.offset], NULL, s.count);
+		else
+			m_iface->ShiftData(true, &m_tdiBits[s.offset], &m_tdoBits[s.rxOffset], s.count);
+	}
+	m_iface->Commit();
+
+	//Partial last bytes come back zero padded, like from ShiftData()
+	for(size_t i=0; i<m_outputs.size(); i++)
+	{
+		const Splice& s = m_outputs[i];
+		if(s.count & 7)
+			outputs[s.slot][s.count / 8] = 0;
+		CopyBitArray(outputs[s.slot], 0, &m_tdoBits[0], s.bit, s.count);
+	}
+}
@@ -0,0 +1,159 @@
+/**
+	@file
+	@brief Declaration of JtagScanPlan
+ */
+
+#ifndef JtagScanPlan_h
+#define JtagScanPlan_h
+
+///@brief Slot index meaning "no placeholder" for JtagScanPlan::ScanDR()
+#define JTAG_PLAN_NONE		-1
+
+/**
+	@brief A recorded sequence of register-level operations, compiled once and replayed many times
+
+	Monitoring loops tend to repeat the same IR/DR sequence over and over. Going through SetIR() / ScanDR() each time
+	recomputes the BYPASS padding, allocates padding vectors on longer chains and makes a separate adapter call for
+	every TAP state change. A plan does all of that once, in Compile():
+
+	\li Consecutive TAP state changes (leaving one register and entering the next, resets, idle clocks) are merged
+		into a single ShiftTMS() call.
+	\li Padded TDI vectors, including all constant data, are laid out in one buffer.
+	\li DR scans can take their data from an input slot and/or deliver the captured bits to an output slot. Execute()
+		splices the inputs into the prebuilt vectors, runs one adapter call per step and splices the outputs back
+		out, without allocating.
+
+	The plan starts and ends in Run-Test-Idle, like the register-level calls, and needs an adapter that implements
+	ShiftTMS() (every adapter in this tree does). The chain must have been initialized before Compile().
+ */
+class JtagScanPlan
+{
+public:
+	JtagScanPlan(JtagInterface* iface);
+	virtual ~JtagScanPlan();
+
+	//Recording
+	void Clear();
+	void ResetToIdle();
+	void SetIR(unsigned int device, const unsigned char* data, size_t count);
+	void ScanDR(
+		unsigned int device,
+		const unsigned char* send_data,
+		size_t count,
+		int input = JTAG_PLAN_NONE,
+		int output = JTAG_PLAN_NONE);
+	void SendDummyClocks(size_t n);
+
+	//Execution
+	void Compile();
+	void Execute(const unsigned char* const* inputs = NULL, unsigned char* const* outputs = NULL);
+
+	///@brief Returns the number of adapter calls one Execute() makes
+	size_t GetStepCount()
+	{ return m_steps.size(); }
+
+protected:
+
+	/**
+		@brief Kinds of recorded operation
+	 */
+	enum OpType
+	{
+		OP_RESET,
+		OP_IR,
+		OP_DR,
+		OP_IDLE
+	};
+
+	/**
+		@brief One recorded operation
+	 */
+	struct Op
+	{
+		///@brief What to do
+		OpType type;
+
+		///@brief Target device
+		unsigned int device;
+
+		///@brief Register length in bits, or number of idle clocks
+		size_t count;
+
+		///@brief Input slot, or JTAG_PLAN_NONE
+		int input;
+
+		///@brief Output slot, or JTAG_PLAN_NONE
+		int output;
+
+		///@brief Constant data (zeros if none was given)
+		std::vector<unsigned char> data;
+	};
+
+	/**
+		@brief One adapter call of the compiled program
+	 */
+	struct Step
+	{
+		///@brief True for ShiftTMS(), false for ShiftData()
+		bool tms;
+
+		///@brief Byte offset of the TMS bits (in m_tmsBits) or TDI bits (in m_tdiBits)
+		size_t offset;
+
+		///@brief Byte offset in m_tdoBits to capture into, or SIZE_MAX if nothing is read back
+		size_t rxOffset;
+
+		///@brief Number of clocks
+		size_t count;
+	};
+
+	/**
+		@brief A placeholder: a slot spliced into (or out of) the compiled vectors
+	 */
+	struct Splice
+	{
+		///@brief Slot index
+		int slot;
+
+		///@brief Bit offset in m_tdiBits (inputs) or m_tdoBits (outputs)
+		size_t bit;
+
+		///@brief Number of bits
+		size_t count;
+	};
+
+	void AppendTMS(const unsigned char* bits, size_t count);
+	size_t AppendData(size_t count, bool fill);
+
+	///@brief The adapter
+	JtagInterface* m_iface;
+
+	///@brief The recorded operations
+	std::vector<Op> m_ops;
+
+	///@brief True if the compiled program is up to date with m_ops
+	bool m_compiled;
+
+	///@brief The compiled program
+	std::vector<Step> m_steps;
+
+	///@brief TMS bits of all ShiftTMS() steps
+	std::vector<unsigned char> m_tmsBits;
+
+	///@brief Number of TMS bits used in m_tmsBits, while compiling
+	size_t m_tmsCount;
+
+	///@brief TDI vectors of all ShiftData() steps, each starting on a byte boundary
+	std::vector<unsigned char> m_tdiBits;
+
+	///@brief Capture buffers of all ShiftData() steps that read back, each starting on a byte boundary
+	std::vector<unsigned char> m_tdoBits;
+
+	///@brief Where input slots go
+	std::vector<Splice> m_inputs;
+
+	///@brief Where output slots come from
+	std::vector<Splice> m_outputs;
+};
+
+#endif
@@ -0,0 +1,228 @@
+/**
+	@file
+	@brief Implementation of JtagScheduler
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// JtagSchedulerQueue
+
+JtagSchedulerQueue::JtagSchedulerQueue()
+	: m_priority(JTAGD_PRIORITY_NORMAL)
+	, m_pid(0)
+	, m_connected(GetTime())
+	, m_lastServed(0)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+	memset(m_latencyHistogram, 0, sizeof(m_latencyHistogram));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+JtagScheduler::JtagScheduler()
+	: m_owner(NULL)
+	, m_ownerDeadline(0)
+	, m_sequence(0)
+{
+}
+
+JtagScheduler::~JtagScheduler()
+{
+}
+
+/**
+	@brief Starts scheduling a client. The queue must stay valid until RemoveClient().
+ */
+void JtagScheduler::AddClient(JtagSchedulerQueue* queue)
+{
+	m_queues.push_back(queue);
+}
+
+/**
+	@brief Stops scheduling a client, ending its transaction if it has one
+ */
+void JtagScheduler::RemoveClient(JtagSchedulerQueue* queue)
+{
+	m_queues.remove(queue);
+	if(m_owner == queue)
+		m_owner = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scheduling
+
+/**
+	@brief Picks the client whose front request should get the next slice
+
+	@param now		Current time
+
+	@return The client, or NULL if nothing can run right now
+ */
+JtagSchedulerQueue* JtagScheduler::PickNext(double now)
+{
+	//A transaction in progress excludes everyone else, until it ends or its client falls silent for too long
+	if(m_owner)
+	{
+		if(!m_owner->m_items.empty())
+		{
+			m_owner->m_lastServed = ++m_sequence;
+			return m_owner;
+		}
+		if(now < m_ownerDeadline)
+			return NULL;
+		m_owner = NULL;
+	}
+
+	JtagSchedulerQueue* best = NULL;
+	int best_class = 0;
+	for(list<JtagSchedulerQueue*>::iterator it = m_queues.begin(); it != m_queues.end(); ++it)
+	{
+		JtagSchedulerQueue* queue = *it;
+		if(queue->m_items.empty())
+			continue;
+
+		//Waiting promotes: every JTAGD_AGING_TIME counts as one class
+		int cls = static_cast<int>(queue->m_priority) -
+			static_cast<int>( (now - queue->m_items.front().waiting) / JTAGD_AGING_TIME);
+		if(cls < 0)
+			cls = 0;
+
+		if( !best || (cls < best_class) || ( (cls == best_class) && (queue->m_lastServed < best->m_lastServed) ) )
+		{
+			best = queue;
+			best_class = cls;
+		}
+	}
+
+	if(best)
+		best->m_lastServed = ++m_sequence;
+	return best;
+}
+
+/**
+	@brief Checks if a transaction is holding the adapter while its client has nothing queued
+ */
+bool JtagScheduler::IsBlocked(double now)
+{
+	return m_owner && m_owner->m_items.empty() && (now < m_ownerDeadline);
+}
+
+/**
+	@brief Returns when IsBlocked() will stop being true on its own
+ */
+double JtagScheduler::GetWakeupTime()
+{
+	return m_ownerDeadline;
+}
+
+/**
+	@brief Called before running a slice of a client's front request
+ */
+void JtagScheduler::OnSliceStart(JtagSchedulerQueue* queue, const JtagdWorkItem& item)
+{
+	if(item.req.opcode & JTAGD_FLAG_TRANSACTION)
+		m_owner = queue;
+}
+
+/**
+	@brief Called after running a slice of a client's front request
+
+	@param queue	The client
+	@param item		The request
+	@param start	When the slice started
+	@param now		When the slice ended
+ */
+void JtagScheduler::OnSliceEnd(JtagSchedulerQueue* queue, JtagdWorkItem& item, double start, double now)
+{
+	queue->m_stats.slices ++;
+	queue->m_stats.busy_time += now - start;
+
+	//The rest of a long transfer competes afresh: it doesn't get promoted for the time it spent running
+	item.waiting = now;
+}
+
+/**
+	@brief Called when a client's front request has been answered
+
+	@param queue	The client
+	@param item		The request
+	@param rxlen	Size of the reply
+	@param now		Current time
+ */
+void JtagScheduler::OnComplete(JtagSchedulerQueue* queue, const JtagdWorkItem& item, size_t rxlen, double now)
+{
+	if(m_owner == queue)
+	{
+		if(item.req.opcode & JTAGD_FLAG_TRANSACTION)
+			m_ownerDeadline = now + JTAGD_TRANSACTION_TIMEOUT;
+		else
+			m_owner = NULL;
+	}
+
+	JtagdClientStats& stats = queue->m_stats;
+	stats.requests ++;
+	stats.tx_bytes += item.txlen;
+	stats.rx_bytes += rxlen;
+
+	double latency = now - item.queued;
+	stats.latency_sum += latency;
+	if(latency > stats.latency_max)
+		stats.latency_max = latency;
+
+	double us = latency * 1e6;
+	int bucket = 0;
+	while( (bucket < JTAGD_LATENCY_BUCKETS - 1) && (us >= static_cast<double>(1u << bucket)) )
+		bucket ++;
+	queue->m_latencyHistogram[bucket] ++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Statistics
+
+/**
+	@brief Estimates a latency percentile from a client's histogram
+
+	@return Upper bound of the bucket the percentile falls in, capped at the worst latency seen, in seconds
+ */
+double JtagScheduler::GetPercentile(const JtagSchedulerQueue* queue, double fraction)
+{
+	uint64_t total = queue->m_stats.requests;
+	if(total == 0)
+		return 0;
+
+	uint64_t target = static_cast<uint64_t>(ceil(total * fraction));
+	uint64_t sum = 0;
+	for(int i=0; i<JTAGD_LATENCY_BUCKETS; i++)
+	{
+		sum += queue->m_latencyHistogram[i];
+		if(sum >= target)
+			return min(static_cast<double>(1u << i) * 1e-6, queue->m_stats.latency_max);
+	}
+	return queue->m_stats.latency_max;
+}
+
+/**
+	@brief Exports the statistics of every client, in connection order
+ */
+void JtagScheduler::GetStats(vector<JtagdClientStats>& stats, double now)
+{
+	stats.clear();
+	for(list<JtagSchedulerQueue*>::iterator it = m_queues.begin(); it != m_queues.end(); ++it)
+	{
+		JtagSchedulerQueue* queue = *it;
+		JtagdClientStats s = queue->m_stats;
+		memset(s.name, 0, sizeof(s.name));
+		strncpy(s.name, queue->m_name.c_str(), sizeof(s.name) - 1);
+		s.pid = queue->m_pid;
+		s.priority = queue->m_priority;
+		s.queued = queue->m_items.size();
+		s.connected_time = now - queue->m_connected;
+		s.latency_p50 = GetPercentile(queue, 0.5);
+		s.latency_p99 = GetPercentile(queue, 0.99);
+		stats.push_back(s);
+	}
+}
@@ -0,0 +1,157 @@
+/**
+	@file
+	@brief Declaration of JtagScheduler
+ */
+
+#ifndef JtagScheduler_h
+#define JtagScheduler_h
+
+#include <deque>
+
+///@brief Words per slice of a long memory transfer
+#define JTAGD_SLICE_WORDS			256
+
+///@brief How long the daemon may keep scanning before it looks for newly arrived requests, in seconds
+#define JTAGD_SCHEDULE_BUDGET		0.002
+
+///@brief How long a request waits before it is promoted one scheduling class, in seconds
+#define JTAGD_AGING_TIME			0.25
+
+///@brief How long a transaction may keep the adapter reserved while waiting for the client's next request, in seconds
+#define JTAGD_TRANSACTION_TIMEOUT	1.0
+
+///@brief Number of buckets in the latency histograms. Bucket N counts latencies below 2^N microseconds.
+#define JTAGD_LATENCY_BUCKETS		32
+
+/**
+	@brief One queued daemon request, from either transport
+ */
+struct JtagdWorkItem
+{
+	///@brief The request, with JTAGD_FLAG_TRANSACTION still in the opcode
+	JtagdRequestHeader req;
+
+	///@brief True if the request came from the shared memory ring
+	bool ring;
+
+	///@brief Ring tag to complete with
+	uint64_t tag;
+
+	///@brief Socket payload (ring payloads stay in shared memory)
+	std::vector<uint8_t> payload;
+
+	///@brief Socket reply buffer (ring replies go straight to shared memory)
+	std::vector<uint8_t> reply;
+
+	///@brief Request payload
+	const uint8_t* tx;
+
+	///@brief Size of the request payload
+	size_t txlen;
+
+	///@brief Reply buffer
+	uint8_t* rx;
+
+	///@brief Size of the reply buffer
+	size_t rxcap;
+
+	///@brief Words transferred so far, for requests executed in slices
+	uint32_t done;
+
+	///@brief Result, if already known before execution (validation failures)
+	uint32_t status;
+
+	///@brief Reason for failure
+	std::string message;
+
+	///@brief When the daemon read the request
+	double queued;
+
+	///@brief When the request last became ready to run (arrival, or the end of its previous slice), for aging
+	double waiting;
+};
+
+/**
+	@brief Per-client state of a JtagScheduler
+ */
+class JtagSchedulerQueue
+{
+public:
+	JtagSchedulerQueue();
+
+	///@brief Requests waiting to run, oldest first. The front one may be partially executed.
+	std::deque<JtagdWorkItem> m_items;
+
+	///@brief Scheduling class (JtagdPriority)
+	uint32_t m_priority;
+
+	///@brief Client name for statistics
+	std::string m_name;
+
+	///@brief Process ID of the client, 0 if unknown
+	uint32_t m_pid;
+
+	///@brief When the client connected
+	double m_connected;
+
+	///@brief Value of the scheduler's sequence counter when this client last got a slice
+	uint64_t m_lastServed;
+
+	///@brief Accumulated statistics (name, pid, priority, queued and the percentiles are filled in on export)
+	JtagdClientStats m_stats;
+
+	///@brief Latency histogram
+	uint64_t m_latencyHistogram[JTAGD_LATENCY_BUCKETS];
+};
+
+/**
+	@brief Decides which client's request the daemon runs next
+
+	The unit of scheduling is a slice: one request, or JTAGD_SLICE_WORDS words of a long memory transfer. Between
+	slices the daemon checks for new requests, so a long dump doesn't delay an interactive PC read by more than one
+	slice.
+
+	\li A transaction in progress (see JTAGD_FLAG_TRANSACTION) owns the adapter: only its client runs until the
+		transaction ends, so IR/DR pairs never interleave with anyone else.
+	\li Otherwise the highest scheduling class with work wins, with each JTAGD_AGING_TIME of waiting promoting a
+		request one class.
+	\li Within a class, the client served longest ago goes next.
+
+	The scheduler also keeps per-client latency and throughput statistics.
+ */
+class JtagScheduler
+{
+public:
+	JtagScheduler();
+	virtual ~JtagScheduler();
+
+	void AddClient(JtagSchedulerQueue* queue);
+	void RemoveClient(JtagSchedulerQueue* queue);
+
+	JtagSchedulerQueue* PickNext(double now);
+	bool IsBlocked(double now);
+	double GetWakeupTime();
+
+	void OnSliceStart(JtagSchedulerQueue* queue, const JtagdWorkItem& item);
+	void OnSliceEnd(JtagSchedulerQueue* queue, JtagdWorkItem& item, double start, double now);
+	void OnComplete(JtagSchedulerQueue* queue, const JtagdWorkItem& item, size_t rxlen, double now);
+
+	void GetStats(std::vector<JtagdClientStats>& stats, double now);
+
+protected:
+	static double GetPercentile(const JtagSchedulerQueue* queue, double fraction);
+
+	///@brief All clients, in connection order
+	std::list<JtagSchedulerQueue*> m_queues;
+
+	///@brief Client whose transaction is in progress, or NULL
+	JtagSchedulerQueue* m_owner;
+
+	///@brief When the transaction owner loses the adapter if it hasn't sent anything
+	double m_ownerDeadline;
+
+	///@brief Incremented for every slice handed out
+	uint64_t m_sequence;
+};
+
+#endif
@@ -0,0 +1,420 @@
+/**
+	@file
+	@brief Implementation of JtagShmChannel
+ */
+
+#include "jtaghal.h"
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+//File sealing, spelled out since older libcs don't define it
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS			1033
+#define F_SEAL_SHRINK		0x0002
+#endif
+
+using namespace std;
+
+///@brief Space at the end of the data area that bulk transfers use for error messages
+#define JTAGD_SHM_MESSAGE_SIZE		256
+
+/**
+	@brief Creates an anonymous file to back the shared memory
+
+	It has to be a memfd: the daemon only maps memory that is sealed against shrinking, and nothing else can be sealed.
+
+	@return File descriptor, or -1 if the kernel has no memfd
+ */
+static int CreateSharedMemoryFile()
+{
+	int fd = -1;
+#ifdef __NR_memfd_create
+	//MFD_CLOEXEC | MFD_ALLOW_SEALING, spelled out since older libcs don't define them
+	fd = syscall(__NR_memfd_create, "jtagd-shm", 3);
+#endif
+	return fd;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+JtagShmChannel::JtagShmChannel()
+	: m_controlFd(-1)
+	, m_base(NULL)
+	, m_size(0)
+	, m_doorbell(-1)
+	, m_completion(-1)
+	, m_entries(0)
+	, m_header(NULL)
+	, m_sq(NULL)
+	, m_cq(NULL)
+	, m_data(NULL)
+	, m_dataSize(0)
+	, m_sqTail(0)
+	, m_cqHead(0)
+	, m_outstanding(0)
+	, m_unflushed(false)
+{
+}
+
+JtagShmChannel::~JtagShmChannel()
+{
+	Detach();
+}
+
+/**
+	@brief Sets up the shared memory and hands it to the daemon
+
+	@param client		Connected client. Must be on a Unix socket, and must stay connected while the channel is used.
+	@param data_size	Size of the data area, in bytes
+	@param entries		Queue depth, a power of two no larger than JTAGD_SHM_MAX_ENTRIES
+
+	@throw JtagException if the memory can't be set up or the daemon refuses it
+ */
+void JtagShmChannel::Attach(JtagClient& client, size_t data_size, unsigned int entries)
+{
+	Detach();
+
+	if( (entries == 0) || (entries > JTAGD_SHM_MAX_ENTRIES) || (entries & (entries - 1)) )
+	{
+		throw JtagExceptionWrapper(
+			"Ring size must be a power of two",
+			"");
+	}
+	data_size = (data_size + 3) & ~static_cast<size_t>(3);
+	if( (data_size <= JTAGD_SHM_MESSAGE_SIZE) || (data_size > 0x7fffffff) )
+	{
+		throw JtagExceptionWrapper(
+			"Bad shared memory data size",
+			"");
+	}
+
+	size_t rings = sizeof(JtagdShmHeader) + entries * (sizeof(JtagdShmRequest) + sizeof(JtagdShmCompletion));
+	size_t data_offset = (rings + 4095) & ~static_cast<size_t>(4095);
+	size_t size = data_offset + data_size;
+
+	int memfd = CreateSharedMemoryFile();
+	if( (memfd < 0) || (ftruncate(memfd, size) != 0) )
+	{
+		if(memfd >= 0)
+			close(memfd);
+		throw JtagExceptionWrapper(
+			"Failed to create shared memory",
+			"");
+	}
+	if(fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) != 0)
+	{
+		close(memfd);
+		throw JtagExceptionWrapper(
+			"Failed to seal shared memory",
+			"");
+	}
+
+	void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	if(base == MAP_FAILED)
+	{
+		close(memfd);
+		throw JtagExceptionWrapper(
+			"Failed to map shared memory",
+			"");
+	}
+
+	m_base = static_cast<uint8_t*>(base);
+	m_size = size;
+	m_entries = entries;
+	m_header = static_cast<JtagdShmHeader*>(base);
+	m_sq = reinterpret_cast<JtagdShmRequest*>(m_base + sizeof(JtagdShmHeader));
+	m_cq = reinterpret_cast<JtagdShmCompletion*>(m_base + sizeof(JtagdShmHeader) + entries * sizeof(JtagdShmRequest));
+	m_data = m_base + data_offset;
+	m_dataSize = data_size;
+	m_sqTail = 0;
+	m_cqHead = 0;
+	m_outstanding = 0;
+	m_unflushed = false;
+
+	m_header->magic = JTAGD_SHM_MAGIC;
+	m_header->version = JTAGD_PROTOCOL_VERSION;
+	m_header->ring_entries = entries;
+	m_header->data_offset = data_offset;
+	m_header->data_size = data_size;
+
+	m_doorbell = eventfd(0, EFD_CLOEXEC);
+	m_completion = eventfd(0, EFD_CLOEXEC);
+	if( (m_doorbell < 0) || (m_completion < 0) )
+	{
+		close(memfd);
+		Detach();
+		throw JtagExceptionWrapper(
+			"Failed to create eventfds",
+			"");
+	}
+
+	int fds[3] = {memfd, m_doorbell, m_completion};
+	vector<uint8_t> reply;
+	try
+	{
+		client.Transact(JTAGD_OP_ATTACH_SHM, 0, entries, 0, NULL, 0, reply, fds, 3);
+	}
+	catch(const JtagException&)
+	{
+		close(memfd);
+		Detach();
+		throw;
+	}
+
+	//The daemon has its own mapping now, and the mapping keeps the memory alive on our side
+	close(memfd);
+	m_controlFd = client.GetFD();
+}
+
+/**
+	@brief Releases the shared memory on our side
+
+	The daemon keeps its mapping until the control connection closes.
+ */
+void JtagShmChannel::Detach()
+{
+	if(m_base)
+		munmap(m_base, m_size);
+	if(m_doorbell >= 0)
+		close(m_doorbell);
+	if(m_completion >= 0)
+		close(m_completion);
+
+	m_controlFd = -1;
+	m_base = NULL;
+	m_size = 0;
+	m_doorbell = -1;
+	m_completion = -1;
+	m_header = NULL;
+	m_sq = NULL;
+	m_cq = NULL;
+	m_data = NULL;
+	m_dataSize = 0;
+	m_outstanding = 0;
+	m_unflushed = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Queueing
+
+/**
+	@brief Queues a request. It isn't guaranteed to start until Flush() or Wait() is called.
+
+	@return False if the maximum number of requests is already outstanding
+
+	@throw JtagException if not attached
+ */
+bool JtagShmChannel::Submit(const JtagdShmRequest& req)
+{
+	if(!m_base)
+	{
+		throw JtagExceptionWrapper(
+			"Shared memory channel not attached",
+			"");
+	}
+
+	//Limiting outstanding requests (rather than free submission slots) also keeps the completion queue from overflowing
+	if(m_outstanding >= m_entries)
+		return false;
+
+	m_sq[m_sqTail & (m_entries - 1)] = req;
+	m_sqTail ++;
+	__atomic_store_n(&m_header->sq_tail, m_sqTail, __ATOMIC_RELEASE);
+	m_outstanding ++;
+	m_unflushed = true;
+	return true;
+}
+
+/**
+	@brief Wakes the daemon if anything was queued since the last call
+ */
+void JtagShmChannel::Flush()
+{
+	if(!m_unflushed)
+		return;
+
+	uint64_t one = 1;
+	if(write(m_doorbell, &one, sizeof(one)) < 0)
+	{
+		//Only fails if the counter saturates, and then the daemon is awake anyway
+	}
+	m_unflushed = false;
+}
+
+/**
+	@brief Waits for the oldest outstanding request to complete
+
+	Completions arrive in submission order.
+
+	@param cpl		The completion
+
+	@throw JtagException if nothing is outstanding or the daemon goes away
+ */
+void JtagShmChannel::Wait(JtagdShmCompletion& cpl)
+{
+	if(m_outstanding == 0)
+	{
+		throw JtagExceptionWrapper(
+			"No requests outstanding",
+			"");
+	}
+	Flush();
+
+	while(true)
+	{
+		uint32_t tail = __atomic_load_n(&m_header->cq_tail, __ATOMIC_ACQUIRE);
+		if(tail != m_cqHead)
+		{
+			cpl = m_cq[m_cqHead & (m_entries - 1)];
+			m_cqHead ++;
+			__atomic_store_n(&m_header->cq_head, m_cqHead, __ATOMIC_RELEASE);
+			m_outstanding --;
+			return;
+		}
+
+		//Sleep until the daemon posts something, or hangs up
+		struct pollfd fds[2];
+		fds[0].fd = m_completion;
+		fds[0].events = POLLIN;
+		fds[1].fd = m_controlFd;
+		fds[1].events = POLLRDHUP;
+		if(poll(fds, 2, -1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			throw JtagExceptionWrapper(
+				"poll() failed",
+				"");
+		}
+		if(fds[0].revents & POLLIN)
+		{
+			uint64_t count;
+			if(read(m_completion, &count, sizeof(count)) < 0)
+			{
+				//Raced with nothing, the queue is checked again anyway
+			}
+		}
+		else if(fds[1].revents & (POLLRDHUP | POLLHUP | POLLERR) )
+		{
+			throw JtagExceptionWrapper(
+				"Lost connection to the daemon",
+				"");
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Bulk transfers
+
+/**
+	@brief Reads DSP memory, see CevaDebugPort::ReadMemory()
+
+	@throw JtagException if the daemon reports an error
+ */
+void JtagShmChannel::ReadMemory(uint32_t addr, uint32_t* words, size_t count)
+{
+	TransferMemory(false, addr, words, count);
+}
+
+/**
+	@brief Writes DSP memory, see CevaDebugPort::WriteMemory()
+
+	@throw JtagException if the daemon reports an error
+ */
+void JtagShmChannel::WriteMemory(uint32_t addr, const uint32_t* words, size_t count)
+{
+	TransferMemory(true, addr, const_cast<uint32_t*>(words), count);
+}
+
+/**
+	@brief Moves a block of DSP memory in chunks, keeping up to JTAGD_SHM_PIPELINE_DEPTH of them in flight
+
+	The data area is split into one slot per chunk in flight, plus room for an error message at the end. Since
+	completions come back in order, a slot is always free again by the time its turn comes around.
+
+	@param write	True to write words to the target, false to read them
+	@param addr		Target address of the first word
+	@param words	Data to write, or buffer to read into
+	@param count	Number of words
+
+	@throw JtagException if the daemon reports an error
+ */
+void JtagShmChannel::TransferMemory(bool write, uint32_t addr, uint32_t* words, size_t count)
+{
+	if(m_outstanding != 0)
+	{
+		throw JtagExceptionWrapper(
+			"Bulk transfers can't be mixed with requests already in flight",
+			"");
+	}
+
+	size_t slots = min(static_cast<size_t>(JTAGD_SHM_PIPELINE_DEPTH), static_cast<size_t>(m_entries));
+	size_t slot_words = (m_dataSize - JTAGD_SHM_MESSAGE_SIZE) / slots / 4;
+	uint32_t message_offset = m_dataSize - JTAGD_SHM_MESSAGE_SIZE;
+
+	size_t next = 0;
+	size_t done = 0;
+	string error;
+	while(done < count)
+	{
+		//Top up the pipeline, unless something already failed
+		while(error.empty() && (next < count) && (m_outstanding < slots))
+		{
+			size_t n = min(slot_words, count - next);
+			uint32_t offset = ( (next / slot_words) % slots) * slot_words * 4;
+
+			JtagdShmRequest req;
+			memset(&req, 0, sizeof(req));
+			req.arg = addr + next*4;
+			req.tag = next;
+			if(write)
+			{
+				memcpy(m_data + offset, words + next, n*4);
+				req.opcode = JTAGD_OP_CEVA_WRITE_MEM;
+				req.tx_offset = offset;
+				req.tx_length = n*4;
+				req.rx_offset = message_offset;
+				req.rx_length = JTAGD_SHM_MESSAGE_SIZE;
+			}
+			else
+			{
+				req.opcode = JTAGD_OP_CEVA_READ_MEM;
+				req.bits = n;
+				req.rx_offset = offset;
+				req.rx_length = n*4;
+			}
+			Submit(req);
+			next += n;
+		}
+		if(m_outstanding == 0)
+			break;
+
+		JtagdShmCompletion cpl;
+		Wait(cpl);
+		size_t first = cpl.tag;
+		size_t n = min(slot_words, count - first);
+		uint32_t offset = ( (first / slot_words) % slots) * slot_words * 4;
+		if(cpl.status != JTAGD_STATUS_OK)
+		{
+			if(error.empty())
+			{
+				uint32_t msgoff = write ? message_offset : offset;
+				error = string(reinterpret_cast<char*>(m_data + msgoff), cpl.length);
+			}
+		}
+		else if(!write)
+			memcpy(words + first, m_data + offset, n*4);
+		done += n;
+	}
+
+	if(!error.empty())
+	{
+		throw JtagExceptionWrapper(
+			string("Daemon: ") + error,
+			"");
+	}
+}
@@ -0,0 +1,114 @@
+/**
+	@file
+	@brief Declaration of JtagShmChannel
+ */
+
+#ifndef JtagShmChannel_h
+#define JtagShmChannel_h
+
+///@brief Default size of the data area of a JtagShmChannel
+#define JTAGD_SHM_DEFAULT_DATA_SIZE		(4 * 1024 * 1024)
+
+///@brief Default queue depth of a JtagShmChannel
+#define JTAGD_SHM_DEFAULT_ENTRIES		64
+
+///@brief Number of requests ReadMemory() / WriteMemory() keep in flight
+#define JTAGD_SHM_PIPELINE_DEPTH		4
+
+/**
+	@brief Client side of the shared memory data plane of a JtagDaemon
+
+	Attach() creates a memfd holding the rings and a data area, and hands it to the daemon over an existing
+	JtagClient connection together with two eventfds. From then on requests are queued in shared memory and the
+	daemon reads TDI from, and writes TDO into, the data area directly.
+
+	For true zero-copy operation, build the scan data in GetData() and Submit() requests pointing at it; results
+	appear in place when Wait() returns their completion. ReadMemory() and WriteMemory() are conveniences for bulk
+	transfers to and from ordinary buffers: they cost one memcpy on the client side and keep several chunks in flight
+	so the adapter never waits for the client.
+
+	The channel lives as long as the JtagClient connection it was attached over.
+ */
+class JtagShmChannel
+{
+public:
+	JtagShmChannel();
+	virtual ~JtagShmChannel();
+
+	void Attach(
+		JtagClient& client,
+		size_t data_size = JTAGD_SHM_DEFAULT_DATA_SIZE,
+		unsigned int entries = JTAGD_SHM_DEFAULT_ENTRIES);
+	void Detach();
+
+	///@brief Returns the data area, which requests refer to by offset
+	uint8_t* GetData()
+	{ return m_data; }
+
+	///@brief Returns the size of the data area
+	size_t GetDataSize()
+	{ return m_dataSize; }
+
+	///@brief Returns the number of submitted requests whose completions haven't been consumed yet
+	size_t GetOutstanding()
+	{ return m_outstanding; }
+
+	//Queueing
+	bool Submit(const JtagdShmRequest& req);
+	void Flush();
+	void Wait(JtagdShmCompletion& cpl);
+
+	//Bulk transfers
+	void ReadMemory(uint32_t addr, uint32_t* words, size_t count);
+	void WriteMemory(uint32_t addr, const uint32_t* words, size_t count);
+
+protected:
+	void TransferMemory(bool write, uint32_t addr, uint32_t* words, size_t count);
+
+	///@brief Control socket of the client we attached over, watched for the daemon going away
+	int m_controlFd;
+
+	///@brief Start of the mapping, or NULL if not attached
+	uint8_t* m_base;
+
+	///@brief Size of the mapping
+	size_t m_size;
+
+	///@brief eventfd we write after queueing requests
+	int m_doorbell;
+
+	///@brief eventfd the daemon writes after posting completions
+	int m_completion;
+
+	///@brief Queue depth
+	uint32_t m_entries;
+
+	///@brief The header
+	JtagdShmHeader* m_header;
+
+	///@brief Submission queue
+	JtagdShmRequest* m_sq;
+
+	///@brief Completion queue
+	JtagdShmCompletion* m_cq;
+
+	///@brief Data area
+	uint8_t* m_data;
+
+	///@brief Size of the data area
+	size_t m_dataSize;
+
+	///@brief Private copy of the submission queue tail
+	uint32_t m_sqTail;
+
+	///@brief Private copy of the completion queue head
+	uint32_t m_cqHead;
+
+	///@brief Requests submitted but not yet completed and consumed
+	size_t m_outstanding;
+
+	///@brief True if requests were queued since the last doorbell
+	bool m_unflushed;
+};
+
+#endif
@@ -0,0 +1,79 @@
+/**
+	@file
+	@brief Implementation of JtagStatus
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+/**
+	@brief Gets the name of a status code
+ */
+const char* JtagStatus::GetCodeName(JtagStatusCode code)
+{
+	switch(code)
+	{
+		case JTAG_STATUS_OK:			return "ok";
+		case JTAG_STATUS_INTEGRITY:		return "integrity";
+		case JTAG_STATUS_RTCK_TIMEOUT:	return "rtck_timeout";
+		case JTAG_STATUS_ADAPTER:		return "adapter";
+		default:						return "unknown";
+	}
+}
+
+/**
+	@brief Formats the error message
+
+	@return The message, or an empty string if the operation succeeded
+ */
+string JtagStatus::GetMessage() const
+{
+	if(IsOk() || !m_message)
+		return "";
+
+	char msg[256];
+	snprintf(msg, sizeof(msg), m_message, m_name ? m_name : "", m_count);
+	return msg;
+}
+
+/**
+	@brief Gets the description of a failed status, laid out like JtagException::GetDescription()
+
+	@return Printable description
+ */
+string JtagStatus::GetDescription() const
+{
+	if(IsOk())
+		return "JtagStatus ok\n";
+
+	char temp_buf[1024];
+	snprintf(
+		temp_buf,
+		sizeof(temp_buf),
+		"JtagStatus %s returned from %s\n"
+		"    File        : %s\n"
+		"    Line        : %d\n"
+		"    System err  : %s\n"
+		"    Message     : %s\n",
+			GetCodeName(m_code),
+			m_prettyfunction,
+			m_file,
+			m_line,
+			strerror(m_errno),
+			GetMessage().c_str()
+		);
+	return string(temp_buf);
+}
+
+/**
+	@brief Throws the JtagException the throwing version of the function would have
+
+	@throw JtagException always
+ */
+void JtagStatus::Throw() const
+{
+	string msg = GetMessage();
+	errno = m_errno;
+	throw JtagException(msg, "", m_prettyfunction ? m_prettyfunction : "", m_file ? m_file : "", m_line);
+}
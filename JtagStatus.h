@@ -0,0 +1,116 @@
+/**
+	@file
+	@brief Declaration of JtagStatus
+ */
+
+#ifndef JtagStatus_h
+#define JtagStatus_h
+
+/**
+	@brief What went wrong, in a JtagStatus
+ */
+enum JtagStatusCode
+{
+	JTAG_STATUS_OK,					///< Nothing
+	JTAG_STATUS_INTEGRITY,			///< A scan kept failing its integrity check
+	JTAG_STATUS_RTCK_TIMEOUT,		///< RTCK stopped following TCK
+	JTAG_STATUS_ADAPTER				///< The adapter threw an exception (the details are logged at debug level)
+};
+
+/**
+	@brief Outcome of one of the noexcept Try*() functions: JtagException's details, without the cost of building it
+
+	A failed status holds nothing but a code and pointers to string literals, so it is cheap to create and copy, and
+	nothing is formatted until the caller asks for it. The message is a printf format which is passed the status'
+	name (a string) and count (an unsigned int), in that order, and may use either, both or neither of them.
+
+	Throw() turns it into the JtagException the throwing version of the function would have thrown.
+ */
+class JtagStatus
+{
+public:
+
+	///@brief Creates a successful status
+	JtagStatus()
+		: m_code(JTAG_STATUS_OK)
+		, m_message(NULL)
+		, m_name(NULL)
+		, m_count(0)
+		, m_errno(0)
+		, m_prettyfunction(NULL)
+		, m_file(NULL)
+		, m_line(0)
+	{}
+
+	///@brief Creates a failed status. Use JtagStatusWrapper(), which fills in the last three parameters.
+	JtagStatus(
+		JtagStatusCode code,
+		const char* message,
+		const char* name,
+		unsigned int count,
+		const char* prettyfunction,
+		const char* file,
+		int line)
+		: m_code(code)
+		, m_message(message)
+		, m_name(name)
+		, m_count(count)
+		, m_errno(errno)
+		, m_prettyfunction(prettyfunction)
+		, m_file(file)
+		, m_line(line)
+	{}
+
+	///@brief Returns true if the operation succeeded
+	bool IsOk() const
+	{ return m_code == JTAG_STATUS_OK; }
+
+	///@brief Returns what went wrong
+	JtagStatusCode GetCode() const
+	{ return m_code; }
+
+	static const char* GetCodeName(JtagStatusCode code);
+
+	std::string GetMessage() const;
+	std::string GetDescription() const;
+	void Throw() const __attribute__((noreturn));
+
+protected:
+
+	///@brief What went wrong
+	JtagStatusCode m_code;
+
+	///@brief Error message format
+	const char* m_message;
+
+	///@brief Name for the message (normally the operation that failed), or NULL
+	const char* m_name;
+
+	///@brief Count for the message (normally attempts made)
+	unsigned int m_count;
+
+	///@brief errno when the status was created
+	int m_errno;
+
+	///@brief Pretty-printed function name
+	const char* m_prettyfunction;
+
+	///@brief File name
+	const char* m_file;
+
+	///@brief Line number
+	int m_line;
+};
+
+/**
+	@brief Wrapper for the failed JtagStatus constructor that passes function, file, and line number automatically
+
+	@param code		What went wrong
+	@param msg		Error message format (a string literal, see JtagStatus)
+	@param name		Name for the message, or NULL
+	@param count	Count for the message
+ */
+#define JtagStatusWrapper(code, msg, name, count) \
+	JtagStatus(code, msg, name, count, __PRETTY_FUNCTION__, __FILE__, __LINE__)
+
+#endif
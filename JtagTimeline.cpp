@@ -0,0 +1,166 @@
+/**
+	@file
+	@brief Implementation of JtagTimeline
+ */
+
+#include "jtaghal.h"
+#include <algorithm>
+#include <sys/syscall.h>
+
+using namespace std;
+
+JtagTimeline* JtagTimeline::m_active = NULL;
+uint64_t JtagTimeline::m_nextGeneration = 0;
+__thread JtagTimelineChunk* JtagTimeline::t_chunk = NULL;
+__thread uint64_t JtagTimeline::t_generation = 0;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates the trace file and makes this the active timeline
+
+	@param path		The trace file
+
+	@throw JtagException if the file can't be created
+ */
+JtagTimeline::JtagTimeline(const string& path)
+	: m_generation(++m_nextGeneration)
+	, m_fp(fopen(path.c_str(), "w"))
+	, m_wroteEvent(false)
+	, m_startCycles(JtagCycleClock::Now())
+	, m_allocated(0)
+	, m_dropped(0)
+	, m_stop(false)
+{
+	if(!m_fp)
+	{
+		throw JtagExceptionWrapper(
+			string("Failed to create timeline file ") + path,
+			"");
+	}
+	fprintf(m_fp, "{\"traceEvents\":[\n");
+	fprintf(m_fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"jtag\"}}", getpid());
+	m_wroteEvent = true;
+
+	m_writer = thread(&JtagTimeline::WriterThread, this);
+	m_active = this;
+}
+
+/**
+	@brief Writes out everything recorded and closes the file
+ */
+JtagTimeline::~JtagTimeline()
+{
+	m_active = NULL;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_ready.notify_one();
+	m_writer.join();
+
+	for(size_t i=0; i<m_filling.size(); i++)
+	{
+		Write(m_filling[i]);
+		delete m_filling[i];
+	}
+	for(size_t i=0; i<m_free.size(); i++)
+		delete m_free[i];
+
+	fprintf(m_fp, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":\"%" PRIu64 "\"}}\n", m_dropped);
+	fclose(m_fp);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Buffering
+
+/**
+	@brief Queues the calling thread's full buffer (if any) for writing, and gives it an empty one
+
+	If the writer is JTAG_TIMELINE_MAX_CHUNKS buffers behind, the full buffer is emptied and reused instead.
+ */
+JtagTimelineChunk* JtagTimeline::NextChunk()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	JtagTimelineChunk* old = (t_generation == m_generation) ? t_chunk : NULL;
+	JtagTimelineChunk* chunk = NULL;
+	if(!m_free.empty())
+	{
+		chunk = m_free.back();
+		m_free.pop_back();
+	}
+	else if( (m_allocated < JTAG_TIMELINE_MAX_CHUNKS) || !old)
+	{
+		chunk = new JtagTimelineChunk;
+		m_allocated ++;
+	}
+
+	if(old)
+	{
+		m_filling.erase(find(m_filling.begin(), m_filling.end(), old));
+		if(chunk)
+		{
+			m_full.push_back(old);
+			m_ready.notify_one();
+		}
+		else
+		{
+			m_dropped += old->used;
+			chunk = old;
+		}
+	}
+
+	chunk->tid = syscall(SYS_gettid);
+	chunk->used = 0;
+	m_filling.push_back(chunk);
+	t_chunk = chunk;
+	t_generation = m_generation;
+	return chunk;
+}
+
+/**
+	@brief Writes out full buffers until the timeline is destroyed
+ */
+void JtagTimeline::WriterThread()
+{
+	unique_lock<mutex> lock(m_mutex);
+	while(true)
+	{
+		while(m_full.empty() && !m_stop)
+			m_ready.wait(lock);
+		if(m_full.empty())
+			break;
+
+		JtagTimelineChunk* chunk = m_full.front();
+		m_full.pop_front();
+		lock.unlock();
+		Write(chunk);
+		lock.lock();
+		m_free.push_back(chunk);
+	}
+}
+
+/**
+	@brief Converts a buffer's events to JSON and writes them out
+ */
+void JtagTimeline::Write(const JtagTimelineChunk* chunk)
+{
+	int pid = getpid();
+	for(size_t i=0; i<chunk->used; i++)
+	{
+		const JtagTimelineEvent& ev = chunk->events[i];
+		fprintf(m_fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+			m_wroteEvent ? ",\n" : "",
+			ev.name,
+			pid,
+			chunk->tid,
+			JtagCycleClock::ToNs(ev.start - m_startCycles) * 1e-3,
+			JtagCycleClock::ToNs(ev.end - ev.start) * 1e-3);
+		if(ev.argname)
+			fprintf(m_fp, ",\"args\":{\"%s\":%" PRIu64 "}", ev.argname, ev.arg);
+		fputc('}', m_fp);
+		m_wroteEvent = true;
+	}
+}
@@ -0,0 +1,208 @@
+/**
+	@file
+	@brief Declaration of JtagTimeline and JtagTimelineSpan
+ */
+
+#ifndef JtagTimeline_h
+#define JtagTimeline_h
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+///@brief Events per JtagTimeline buffer
+#define JTAG_TIMELINE_CHUNK_EVENTS	4096
+
+///@brief Most buffers a JtagTimeline allocates (10 MB) before it starts dropping events
+#define JTAG_TIMELINE_MAX_CHUNKS	64
+
+/**
+	@brief One completed span
+ */
+struct JtagTimelineEvent
+{
+	///@brief Name of the operation (a string literal)
+	const char* name;
+
+	///@brief Name of the argument (a string literal), or NULL if there is none
+	const char* argname;
+
+	///@brief Argument value
+	uint64_t arg;
+
+	///@brief JtagCycleClock count at the start of the span
+	uint64_t start;
+
+	///@brief JtagCycleClock count at the end of the span
+	uint64_t end;
+};
+
+/**
+	@brief A buffer of events recorded by one thread
+ */
+struct JtagTimelineChunk
+{
+	///@brief Kernel thread ID of the thread that filled it
+	int tid;
+
+	///@brief Number of events used
+	size_t used;
+
+	///@brief The events
+	JtagTimelineEvent events[JTAG_TIMELINE_CHUNK_EVENTS];
+};
+
+/**
+	@brief Records a timeline of JTAG activity as a Chrome trace (JSON), for chrome://tracing or ui.perfetto.dev
+
+	While a timeline exists, every JtagTimelineSpan in the library records a complete ("X") event: high-level
+	operations (InitializeChain(), SetIR(), ScanDR(), scan plans, debug port register and memory block transfers) and
+	the wire-level shifts they are made of, so the viewer shows them nested, per thread.
+
+	Recording an event is two cycle counter reads and a store into a buffer owned by the calling thread; no lock is
+	taken. Full buffers are handed to a background thread that converts them to JSON and writes them out, so the file
+	I/O stays off the scan path and a timeline can be left on during real dumps. If the writer falls behind by more
+	than JTAG_TIMELINE_MAX_CHUNKS buffers, events are dropped rather than stalling the scan, and the number dropped is
+	noted in the file.
+
+	Only one timeline is active at a time. It should be destroyed once the adapters are idle; buffers still being
+	filled are written out by the destructor.
+ */
+class JtagTimeline
+{
+public:
+	JtagTimeline(const std::string& path);
+	virtual ~JtagTimeline();
+
+	///@brief Returns the active timeline, or NULL if none is
+	static JtagTimeline* GetActive()
+	{ return m_active; }
+
+	///@brief Records a completed span
+	void Record(const char* name, const char* argname, uint64_t arg, uint64_t start, uint64_t end)
+	{
+		JtagTimelineChunk* chunk = GetChunk();
+		JtagTimelineEvent& ev = chunk->events[chunk->used ++];
+		ev.name = name;
+		ev.argname = argname;
+		ev.arg = arg;
+		ev.start = start;
+		ev.end = end;
+	}
+
+	///@brief Returns the number of events dropped because the writer fell behind
+	uint64_t GetDroppedCount()
+	{ return m_dropped; }
+
+protected:
+
+	///@brief Returns the calling thread's buffer, with room for at least one event
+	JtagTimelineChunk* GetChunk()
+	{
+		if( (t_generation == m_generation) && (t_chunk->used < JTAG_TIMELINE_CHUNK_EVENTS) )
+			return t_chunk;
+		return NextChunk();
+	}
+
+	JtagTimelineChunk* NextChunk();
+	void WriterThread();
+	void Write(const JtagTimelineChunk* chunk);
+
+	///@brief The active timeline
+	static JtagTimeline* m_active;
+
+	///@brief Incremented for each timeline, so threads notice their buffer belongs to an old one
+	static uint64_t m_nextGeneration;
+
+	///@brief This timeline's generation
+	uint64_t m_generation;
+
+	///@brief The calling thread's buffer
+	static __thread JtagTimelineChunk* t_chunk;
+
+	///@brief Generation of the timeline t_chunk belongs to
+	static __thread uint64_t t_generation;
+
+	///@brief The output file
+	FILE* m_fp;
+
+	///@brief True once the first event has been written (for the commas between them)
+	bool m_wroteEvent;
+
+	///@brief Cycle count that timestamps are relative to
+	uint64_t m_startCycles;
+
+	///@brief Protects everything below
+	std::mutex m_mutex;
+
+	///@brief Signalled when a buffer is queued for writing, or on shutdown
+	std::condition_variable m_ready;
+
+	///@brief Full buffers waiting to be written
+	std::deque<JtagTimelineChunk*> m_full;
+
+	///@brief Written buffers, ready for reuse
+	std::vector<JtagTimelineChunk*> m_free;
+
+	///@brief Buffers threads are filling
+	std::vector<JtagTimelineChunk*> m_filling;
+
+	///@brief Number of buffers allocated
+	size_t m_allocated;
+
+	///@brief Number of events dropped
+	uint64_t m_dropped;
+
+	///@brief Set to make the writer thread exit
+	bool m_stop;
+
+	///@brief The writer thread
+	std::thread m_writer;
+};
+
+/**
+	@brief Records its own lifetime as a span on the active timeline, if there is one
+
+	With no timeline active this costs a load and a branch at each end.
+ */
+class JtagTimelineSpan
+{
+public:
+	///@brief Starts the span
+	JtagTimelineSpan(const char* name, const char* argname = NULL, uint64_t arg = 0)
+		: m_timeline(JtagTimeline::GetActive())
+		, m_name(name)
+		, m_argname(argname)
+		, m_arg(arg)
+		, m_start(0)
+	{
+		if(__builtin_expect(m_timeline != NULL, 0))
+			m_start = JtagCycleClock::Now();
+	}
+
+	///@brief Ends the span
+	~JtagTimelineSpan()
+	{
+		if(__builtin_expect(m_timeline != NULL, 0))
+			m_timeline->Record(m_name, m_argname, m_arg, m_start, JtagCycleClock::Now());
+	}
+
+protected:
+	///@brief Timeline to record on, or NULL
+	JtagTimeline* m_timeline;
+
+	///@brief Name of the operation
+	const char* m_name;
+
+	///@brief Name of the argument, or NULL
+	const char* m_argname;
+
+	///@brief Argument value
+	uint64_t m_arg;
+
+	///@brief Cycle count at the start of the span
+	uint64_t m_start;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/**
+	@file
+	@brief Trace file format, written by TracingJtagInterface and read by JtagTraceReplayer
+ */
+
+#ifndef JtagTraceFormat_h
+#define JtagTraceFormat_h
+
+///@brief "JTRC", as read in host byte order
+#define JTAG_TRACE_MAGIC		0x4352544a
+
+///@brief Format version
+#define JTAG_TRACE_VERSION		1
+
+/**
+	@brief File header
+
+	The header is followed by records, each a JtagTraceRecord, then the TDI bits (if any), then the TDO bits (if
+	any), zero padded to a multiple of 8 bytes so every record header is aligned in a mapping of the file. A record
+	with op JTAG_TRACE_OP_NONE, or the end of the file, ends the trace: a trace cut short by a crash is read up to
+	the last record that was completely written.
+
+	All fields are in host byte order.
+ */
+struct JtagTraceHeader
+{
+	///@brief JTAG_TRACE_MAGIC
+	uint32_t magic;
+
+	///@brief JTAG_TRACE_VERSION
+	uint32_t version;
+
+	///@brief Wall clock time the trace started, in ns since the epoch
+	uint64_t start_time;
+
+	///@brief Name of the adapter that was traced
+	char adapter[48];
+};
+
+/**
+	@brief Traced operations
+ */
+enum JtagTraceOp
+{
+	JTAG_TRACE_OP_NONE			= 0x00,		///< End of trace
+	JTAG_TRACE_OP_SHIFT_DATA	= 0x01,		///< ShiftData(). count bits of TDI, then TDO if JTAG_TRACE_HAS_TDO
+	JTAG_TRACE_OP_SHIFT_TMS		= 0x02,		///< ShiftTMS(). count bits of TMS, TDI level in JTAG_TRACE_TDI
+	JTAG_TRACE_OP_DUMMY_CLOCKS	= 0x03,		///< SendDummyClocks() of count clocks, no data
+	JTAG_TRACE_OP_READ_TDO		= 0x04		///< ReadTDO(), the value read in JTAG_TRACE_TDO
+};
+
+/**
+	@brief Record flags
+ */
+enum JtagTraceFlags
+{
+	JTAG_TRACE_LAST_TMS		= 0x01,		///< ShiftData() with last_tms set
+	JTAG_TRACE_HAS_TDO		= 0x02,		///< ShiftData() read TDO back, and it follows the TDI bits
+	JTAG_TRACE_TDI			= 0x04,		///< ShiftTMS() TDI level
+	JTAG_TRACE_TDO			= 0x08		///< ReadTDO() result
+};
+
+/**
+	@brief Fixed part of one record
+ */
+struct JtagTraceRecord
+{
+	///@brief A JtagTraceOp
+	uint8_t op;
+
+	///@brief JtagTraceFlags
+	uint8_t flags;
+
+	uint16_t reserved;
+
+	///@brief Number of bits or clocks
+	uint32_t count;
+
+	///@brief Start of the operation, in ns since the start of the trace
+	uint64_t timestamp;
+
+	///@brief How long the adapter took, in ns
+	uint32_t duration;
+
+	///@brief Size of the whole record including this header and padding, in bytes
+	uint32_t length;
+};
+
+#endif
@@ -0,0 +1,238 @@
+/**
+	@file
+	@brief Implementation of JtagTraceReplayer
+ */
+
+#include "jtaghal.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a replayer
+
+	@param iface	The adapter to replay on. Must outlive the replayer.
+ */
+JtagTraceReplayer::JtagTraceReplayer(JtagInterface* iface)
+	: m_iface(iface)
+	, m_ops(0)
+	, m_compared(0)
+	, m_mismatches(0)
+	, m_recordedTime(0)
+	, m_replayTime(0)
+{
+}
+
+JtagTraceReplayer::~JtagTraceReplayer()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Replay
+
+/**
+	@brief Replays a trace from start to end
+
+	TDO differences don't stop the replay; see GetMismatchCount() and GetDiffs().
+
+	@param path		The trace file
+	@param paced	Start each operation no earlier than it started in the recording
+
+	@throw JtagException if the file can't be read or isn't a well-formed trace, or if an operation fails
+ */
+void JtagTraceReplayer::Replay(const string& path, bool paced)
+{
+	m_ops = 0;
+	m_compared = 0;
+	m_mismatches = 0;
+	m_diffs.clear();
+	m_recordedTime = 0;
+	m_replayTime = 0;
+
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if( (fd < 0) || (fstat(fd, &st) != 0) )
+	{
+		if(fd >= 0)
+			close(fd);
+		throw JtagExceptionWrapper(
+			string("Failed to open ") + path,
+			"");
+	}
+	size_t size = st.st_size;
+	void* base = MAP_FAILED;
+	if(size >= sizeof(JtagTraceHeader))
+		base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+	{
+		throw JtagExceptionWrapper(
+			path + " is not a trace file",
+			"");
+	}
+	madvise(base, size, MADV_SEQUENTIAL);
+	const unsigned char* p = static_cast<const unsigned char*>(base);
+	const unsigned char* end = p + size;
+
+	try
+	{
+		const JtagTraceHeader* header = reinterpret_cast<const JtagTraceHeader*>(p);
+		if( (header->magic != JTAG_TRACE_MAGIC) || (header->version != JTAG_TRACE_VERSION) )
+		{
+			throw JtagExceptionWrapper(
+				path + " is not a trace file, or an unsupported version",
+				"");
+		}
+		m_adapter.assign(header->adapter, strnlen(header->adapter, sizeof(header->adapter)));
+		p += sizeof(JtagTraceHeader);
+
+		m_iface->WaitForAsync();
+		m_iface->ForgetIR();
+		uint64_t start = GetTimeNs();
+		while(static_cast<size_t>(end - p) >= sizeof(JtagTraceRecord))
+		{
+			const JtagTraceRecord& rec = *reinterpret_cast<const JtagTraceRecord*>(p);
+			if( (rec.op == JTAG_TRACE_OP_NONE) || (rec.length < sizeof(rec)) ||
+				(rec.length > static_cast<size_t>(end - p)) )
+			{
+				break;
+			}
+			const unsigned char* data = p + sizeof(rec);
+			size_t nbytes = (static_cast<size_t>(rec.count) + 7) / 8;
+
+			//The bit count has to agree with the data actually in the record
+			size_t payload = 0;
+			if(rec.op == JTAG_TRACE_OP_SHIFT_DATA)
+				payload = (rec.flags & JTAG_TRACE_HAS_TDO) ? (2 * nbytes) : nbytes;
+			else if(rec.op == JTAG_TRACE_OP_SHIFT_TMS)
+				payload = nbytes;
+			if(rec.length - sizeof(rec) < payload)
+			{
+				throw JtagExceptionWrapper(
+					path + " is a corrupt trace: a record is shorter than its bit count",
+					"");
+			}
+
+			if(paced)
+			{
+				uint64_t elapsed = GetTimeNs() - start;
+				if(rec.timestamp > elapsed)
+				{
+					uint64_t wait = rec.timestamp - elapsed;
+					struct timespec ts;
+					ts.tv_sec = wait / 1000000000ULL;
+					ts.tv_nsec = wait % 1000000000ULL;
+					nanosleep(&ts, NULL);
+				}
+			}
+
+			uint64_t t = GetTimeNs();
+			switch(rec.op)
+			{
+				case JTAG_TRACE_OP_SHIFT_DATA:
+					if(rec.flags & JTAG_TRACE_HAS_TDO)
+					{
+						if(m_tdo.size() < nbytes)
+							m_tdo.resize(nbytes);
+						m_iface->ShiftData( (rec.flags & JTAG_TRACE_LAST_TMS) != 0, data, &m_tdo[0], rec.count);
+						m_replayTime += GetTimeNs() - t;
+
+						//Bits past the end of the scan aren't defined
+						m_compared ++;
+						const unsigned char* expected = data + nbytes;
+						bool differ = (memcmp(&m_tdo[0], expected, rec.count / 8) != 0);
+						if( (rec.count & 7) && ( (m_tdo[nbytes-1] ^ expected[nbytes-1]) & ( (1 << (rec.count & 7)) - 1) ) )
+							differ = true;
+						if(differ)
+							Diff(m_ops, rec, expected, &m_tdo[0]);
+					}
+					else
+					{
+						m_iface->ShiftData( (rec.flags & JTAG_TRACE_LAST_TMS) != 0, data, NULL, rec.count);
+						m_replayTime += GetTimeNs() - t;
+					}
+					break;
+
+				case JTAG_TRACE_OP_SHIFT_TMS:
+					m_iface->ShiftTMS( (rec.flags & JTAG_TRACE_TDI) != 0, data, rec.count);
+					m_replayTime += GetTimeNs() - t;
+					break;
+
+				case JTAG_TRACE_OP_DUMMY_CLOCKS:
+					m_iface->SendDummyClocks(rec.count);
+					m_replayTime += GetTimeNs() - t;
+					break;
+
+				case JTAG_TRACE_OP_READ_TDO:
+					{
+						unsigned char expected = (rec.flags & JTAG_TRACE_TDO) ? 1 : 0;
+						unsigned char actual = m_iface->ReadTDO() ? 1 : 0;
+						m_replayTime += GetTimeNs() - t;
+						m_compared ++;
+						if(actual != expected)
+							Diff(m_ops, rec, &expected, &actual);
+					}
+					break;
+
+				default:
+					throw JtagExceptionWrapper(
+						path + " has an unknown record type",
+						"");
+			}
+
+			m_recordedTime += rec.duration;
+			m_ops ++;
+			p += rec.length;
+		}
+		m_iface->Commit();
+	}
+	catch(const JtagException& ex)
+	{
+		munmap(base, size);
+		throw;
+	}
+	munmap(base, size);
+}
+
+/**
+	@brief Counts a TDO difference and describes the first few
+ */
+void JtagTraceReplayer::Diff(
+	uint64_t index,
+	const JtagTraceRecord& rec,
+	const unsigned char* expected,
+	const unsigned char* actual)
+{
+	m_mismatches ++;
+	if(m_diffs.size() >= JTAG_TRACE_MAX_DIFFS)
+		return;
+
+	char desc[160];
+	if(rec.op == JTAG_TRACE_OP_READ_TDO)
+	{
+		snprintf(desc, sizeof(desc), "op %" PRIu64 " at %.6f s: ReadTDO() recorded %d, replayed %d",
+			index, rec.timestamp * 1e-9, expected[0], actual[0]);
+	}
+	else
+	{
+		size_t bit = 0;
+		while(PeekBit(expected, bit) == PeekBit(actual, bit))
+			bit ++;
+		size_t differing = 0;
+		for(size_t i=0; i<rec.count; i++)
+		{
+			if(PeekBit(expected, i) != PeekBit(actual, i))
+				differing ++;
+		}
+		snprintf(desc, sizeof(desc),
+			"op %" PRIu64 " at %.6f s: ShiftData() of %u bits, %zu differ, first at bit %zu (recorded %d, replayed %d)",
+			index, rec.timestamp * 1e-9, rec.count, differing, bit,
+			PeekBit(expected, bit) ? 1 : 0, PeekBit(actual, bit) ? 1 : 0);
+	}
+	m_diffs.push_back(desc);
+}
@@ -0,0 +1,80 @@
+/**
+	@file
+	@brief Declaration of JtagTraceReplayer
+ */
+
+#ifndef JtagTraceReplayer_h
+#define JtagTraceReplayer_h
+
+///@brief Most TDO differences JtagTraceReplayer keeps descriptions of
+#define JTAG_TRACE_MAX_DIFFS	16
+
+/**
+	@brief Plays a trace recorded by TracingJtagInterface back on an adapter, and diffs the TDO
+
+	Every operation is issued again exactly as recorded. Wherever the trace has TDO, the replayed TDO is compared
+	against it, so a trace from a misbehaving unit can be checked against good hardware or the software model. The
+	time each operation took is measured too, making traces usable as performance workloads: the totals can be
+	compared with the recorded ones.
+
+	Replay runs as fast as the adapter allows, or paced so that each operation starts no earlier than it did in the
+	recording.
+ */
+class JtagTraceReplayer
+{
+public:
+	JtagTraceReplayer(JtagInterface* iface);
+	virtual ~JtagTraceReplayer();
+
+	void Replay(const std::string& path, bool paced = false);
+
+	///@brief Returns the name of the adapter the trace was recorded on
+	const std::string& GetRecordedAdapter()
+	{ return m_adapter; }
+
+	///@brief Returns the number of operations replayed
+	uint64_t GetOpCount()
+	{ return m_ops; }
+
+	///@brief Returns the number of operations whose TDO was compared
+	uint64_t GetComparedCount()
+	{ return m_compared; }
+
+	///@brief Returns the number of operations whose TDO differed
+	uint64_t GetMismatchCount()
+	{ return m_mismatches; }
+
+	///@brief Returns descriptions of the first JTAG_TRACE_MAX_DIFFS differences
+	const std::vector<std::string>& GetDiffs()
+	{ return m_diffs; }
+
+	///@brief Returns the total adapter time of the recording, in seconds
+	double GetRecordedTime()
+	{ return m_recordedTime * 1e-9; }
+
+	///@brief Returns the total adapter time of the replay, in seconds
+	double GetReplayTime()
+	{ return m_replayTime * 1e-9; }
+
+protected:
+	void Diff(uint64_t index, const JtagTraceRecord& rec, const unsigned char* expected, const unsigned char* actual);
+
+	///@brief The adapter
+	JtagInterface* m_iface;
+
+	///@brief Name of the adapter the trace was recorded on
+	std::string m_adapter;
+
+	///@brief Replayed TDO
+	std::vector<unsigned char> m_tdo;
+
+	//Results (times in ns)
+	uint64_t m_ops;
+	uint64_t m_compared;
+	uint64_t m_mismatches;
+	std::vector<std::string> m_diffs;
+	uint64_t m_recordedTime;
+	uint64_t m_replayTime;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/**
+	@file
+	@brief Binary vector file format, written by SvfCompiler and played by JtagVectorPlayer
+ */
+
+#ifndef JtagVectorFormat_h
+#define JtagVectorFormat_h
+
+///@brief "JVEC", as read in little-endian order
+#define JVEC_MAGIC				0x4345564a
+
+///@brief Format version
+#define JVEC_VERSION			1
+
+///@brief Largest scan record, in bits
+#define JVEC_MAX_SCAN_BITS		SVF_CHUNK_BITS
+
+/**
+	@brief File header
+
+	The header is followed by records, each starting with a JvecOpcode byte and ending with a JVEC_OP_END record.
+	All fields are little-endian and unaligned.
+
+	\li JVEC_OP_TMS: u32 count, then (count+7)/8 bytes of TMS bits for ShiftTMS(). TAP paths are already resolved
+		and consecutive state changes merged.
+	\li JVEC_OP_SCAN: u8 flags (JvecScanFlags), u32 SVF line, u32 count (at most JVEC_MAX_SCAN_BITS), then the TDI
+		vector, the expected TDO vector if JVEC_SCAN_COMPARE, and the mask vector if JVEC_SCAN_MASK. Each vector
+		is a JvecEncoding byte and (count+7)/8 bytes of data: raw, or as u16 number of runs followed by that many
+		(u16 length, u8 value) byte runs.
+	\li JVEC_OP_RUN: u8 TMS level, u64 clocks, u64 minimum time in nanoseconds (see SvfPlayer::RunClocks())
+ */
+struct JvecHeader
+{
+	///@brief JVEC_MAGIC
+	uint32_t magic;
+
+	///@brief JVEC_VERSION
+	uint32_t version;
+
+	///@brief Number of records, not counting JVEC_OP_END
+	uint64_t records;
+
+	///@brief Total scan bits
+	uint64_t scan_bits;
+
+	///@brief Total scan bits compared against TDO
+	uint64_t compared_bits;
+};
+
+/**
+	@brief Record types
+ */
+enum JvecOpcode
+{
+	JVEC_OP_END		= 0x00,
+	JVEC_OP_TMS		= 0x01,
+	JVEC_OP_SCAN	= 0x02,
+	JVEC_OP_RUN		= 0x03
+};
+
+/**
+	@brief JVEC_OP_SCAN flags
+ */
+enum JvecScanFlags
+{
+	JVEC_SCAN_LAST		= 0x01,		///< Leave Shift for Exit1 on the last bit
+	JVEC_SCAN_COMPARE	= 0x02,		///< Expected TDO follows the TDI vector
+	JVEC_SCAN_MASK		= 0x04		///< A mask follows the expected TDO (all ones otherwise)
+};
+
+/**
+	@brief How a vector is stored
+ */
+enum JvecEncoding
+{
+	JVEC_ENC_RAW	= 0x00,
+	JVEC_ENC_RLE	= 0x01
+};
+
+#endif
@@ -0,0 +1,268 @@
+/**
+	@file
+	@brief Implementation of JtagVectorPlayer
+ */
+
+#include "jtaghal.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a player
+
+	@param iface	The adapter to play on. Must outlive the player.
+ */
+JtagVectorPlayer::JtagVectorPlayer(JtagInterface* iface)
+	: m_iface(iface)
+	, m_base(NULL)
+	, m_pos(NULL)
+	, m_end(NULL)
+	, m_released(NULL)
+	, m_records(0)
+	, m_scanBits(0)
+	, m_comparedBits(0)
+{
+}
+
+JtagVectorPlayer::~JtagVectorPlayer()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Playback
+
+/**
+	@brief Checks if a file starts like a vector file
+ */
+bool JtagVectorPlayer::IsVectorFile(const string& path)
+{
+	FILE* fp = fopen(path.c_str(), "rb");
+	if(!fp)
+		return false;
+	uint32_t magic = 0;
+	bool ok = (fread(&magic, sizeof(magic), 1, fp) == 1) && (magic == JVEC_MAGIC);
+	fclose(fp);
+	return ok;
+}
+
+/**
+	@brief Plays a file from start to end
+
+	@throw JtagException if the file can't be read, is corrupt, or a TDO check fails
+ */
+void JtagVectorPlayer::Play(const string& path)
+{
+	m_path = path;
+	m_records = 0;
+	m_scanBits = 0;
+	m_comparedBits = 0;
+
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if( (fd < 0) || (fstat(fd, &st) != 0) )
+	{
+		if(fd >= 0)
+			close(fd);
+		throw JtagExceptionWrapper(
+			string("Failed to open ") + path,
+			"");
+	}
+	size_t size = st.st_size;
+	if(size < sizeof(JvecHeader))
+	{
+		close(fd);
+		throw JtagExceptionWrapper(
+			path + " is not a vector file",
+			"");
+	}
+	void* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+	{
+		throw JtagExceptionWrapper(
+			string("Failed to map ") + path,
+			"");
+	}
+	madvise(base, size, MADV_SEQUENTIAL);
+
+	m_base = static_cast<const unsigned char*>(base);
+	m_pos = m_base;
+	m_end = m_base + size;
+	m_released = m_base;
+
+	try
+	{
+		JvecHeader header;
+		memcpy(&header, Take(sizeof(header)), sizeof(header));
+		if( (header.magic != JVEC_MAGIC) || (header.version != JVEC_VERSION) )
+			Fail("Not a vector file, or an unsupported version");
+
+		m_iface->WaitForAsync();
+		m_iface->ForgetIR();
+		Run();
+		m_iface->Commit();
+	}
+	catch(const JtagException& ex)
+	{
+		munmap(const_cast<unsigned char*>(m_base), size);
+		m_base = NULL;
+		throw;
+	}
+	munmap(const_cast<unsigned char*>(m_base), size);
+	m_base = NULL;
+}
+
+/**
+	@brief Executes records up to JVEC_OP_END
+ */
+void JtagVectorPlayer::Run()
+{
+	while(true)
+	{
+		uint8_t op = *Take(1);
+		switch(op)
+		{
+			case JVEC_OP_END:
+				return;
+
+			case JVEC_OP_TMS:
+				{
+					uint32_t count;
+					memcpy(&count, Take(4), 4);
+					m_iface->ShiftTMS(false, Take( (count + 7) / 8), count);
+				}
+				break;
+
+			case JVEC_OP_SCAN:
+				{
+					uint8_t flags = *Take(1);
+					uint32_t line;
+					uint32_t count;
+					memcpy(&line, Take(4), 4);
+					memcpy(&count, Take(4), 4);
+					if( (count == 0) || (count > JVEC_MAX_SCAN_BITS) )
+						Fail("Bad scan length");
+
+					const unsigned char* tdi = ReadVector(count, m_tdiChunk);
+					bool compare = (flags & JVEC_SCAN_COMPARE) != 0;
+					m_iface->ShiftData( (flags & JVEC_SCAN_LAST) != 0, tdi, compare ? m_tdoChunk : NULL, count);
+					m_scanBits += count;
+					if(!compare)
+						break;
+
+					const unsigned char* expect = ReadVector(count, m_expectChunk);
+					const unsigned char* mask = m_maskChunk;
+					if(flags & JVEC_SCAN_MASK)
+						mask = ReadVector(count, m_maskChunk);
+					else
+						memset(m_maskChunk, 0xff, (count + 7) / 8);
+
+					size_t bit = SvfPlayer::FindMismatch(m_tdoChunk, expect, mask, count);
+					if(bit != SVF_NO_MISMATCH)
+					{
+						char message[128];
+						snprintf(message, sizeof(message),
+							"TDO mismatch at bit %zu of the scan from SVF line %u: expected %d, got %d",
+							bit,
+							line,
+							PeekBit(expect, bit) ? 1 : 0,
+							PeekBit(m_tdoChunk, bit) ? 1 : 0);
+						Fail(message);
+					}
+					m_comparedBits += count;
+				}
+				break;
+
+			case JVEC_OP_RUN:
+				{
+					uint8_t level = *Take(1);
+					uint64_t clocks;
+					uint64_t ns;
+					memcpy(&clocks, Take(8), 8);
+					memcpy(&ns, Take(8), 8);
+					SvfPlayer::RunClocks(m_iface, level != 0, clocks, ns * 1e-9);
+				}
+				break;
+
+			default:
+				Fail("Bad record type");
+		}
+		m_records ++;
+
+		//Drop what we've played, see SvfPlayer
+		if(static_cast<size_t>(m_pos - m_released) >= SVF_RELEASE_INTERVAL)
+		{
+			size_t page = sysconf(_SC_PAGESIZE);
+			const unsigned char* upto = m_base + ( (m_pos - m_base) / page) * page;
+			madvise(const_cast<unsigned char*>(m_released), upto - m_released, MADV_DONTNEED);
+			m_released = upto;
+		}
+	}
+}
+
+/**
+	@brief Consumes bytes from the file
+
+	@return Pointer to them, in the mapping
+ */
+const unsigned char* JtagVectorPlayer::Take(size_t len)
+{
+	if(static_cast<size_t>(m_end - m_pos) < len)
+		Fail("Truncated file");
+	const unsigned char* p = m_pos;
+	m_pos += len;
+	return p;
+}
+
+/**
+	@brief Reads a vector
+
+	@param count	Number of bits
+	@param buf		Where to expand a run-length encoded vector
+
+	@return The bits: in the mapping for a raw vector, otherwise buf
+ */
+const unsigned char* JtagVectorPlayer::ReadVector(size_t count, unsigned char* buf)
+{
+	size_t nbytes = (count + 7) / 8;
+	uint8_t enc = *Take(1);
+	if(enc == JVEC_ENC_RAW)
+		return Take(nbytes);
+	if(enc != JVEC_ENC_RLE)
+		Fail("Bad vector encoding");
+
+	uint16_t runs;
+	memcpy(&runs, Take(2), 2);
+	size_t pos = 0;
+	for(uint16_t i=0; i<runs; i++)
+	{
+		const unsigned char* run = Take(3);
+		uint16_t len;
+		memcpy(&len, run, 2);
+		if(len > nbytes - pos)
+			Fail("Bad vector run");
+		memset(buf + pos, run[2], len);
+		pos += len;
+	}
+	if(pos != nbytes)
+		Fail("Bad vector run");
+	return buf;
+}
+
+/**
+	@brief Throws a JtagException pointing at the current file offset
+ */
+void JtagVectorPlayer::Fail(const string& message)
+{
+	char where[32];
+	snprintf(where, sizeof(where), ":%zu: ", static_cast<size_t>(m_pos - m_base));
+	throw JtagExceptionWrapper(
+		m_path + where + message,
+		"");
+}
@@ -0,0 +1,76 @@
+/**
+	@file
+	@brief Declaration of JtagVectorPlayer
+ */
+
+#ifndef JtagVectorPlayer_h
+#define JtagVectorPlayer_h
+
+/**
+	@brief Plays binary vector files (see JtagVectorFormat.h) on an adapter
+
+	Playback is a tight loop over the records: raw vectors are handed to ShiftData() straight from the mapped file,
+	run-length encoded ones are expanded into a chunk buffer, and TAP paths come precomputed. The file is mapped and
+	pages behind the player are dropped every SVF_RELEASE_INTERVAL, like SvfPlayer does, so memory use is constant.
+
+	Like SvfPlayer, a TDO mismatch stops playback with a JtagException, naming the SVF line the scan came from.
+ */
+class JtagVectorPlayer
+{
+public:
+	JtagVectorPlayer(JtagInterface* iface);
+	virtual ~JtagVectorPlayer();
+
+	void Play(const std::string& path);
+
+	static bool IsVectorFile(const std::string& path);
+
+	///@brief Returns the number of records executed by the last Play()
+	uint64_t GetRecordCount()
+	{ return m_records; }
+
+	///@brief Returns the number of scan bits shifted by the last Play()
+	uint64_t GetScanBits()
+	{ return m_scanBits; }
+
+	///@brief Returns the number of scan bits checked against TDO by the last Play()
+	uint64_t GetComparedBits()
+	{ return m_comparedBits; }
+
+protected:
+	void Run();
+	const unsigned char* Take(size_t len);
+	const unsigned char* ReadVector(size_t count, unsigned char* buf);
+	void Fail(const std::string& message);
+
+	///@brief The adapter
+	JtagInterface* m_iface;
+
+	///@brief The mapped file
+	const unsigned char* m_base;
+
+	///@brief Player position
+	const unsigned char* m_pos;
+
+	///@brief End of the file
+	const unsigned char* m_end;
+
+	///@brief Everything before this has been released with madvise()
+	const unsigned char* m_released;
+
+	///@brief Name of the file being played, for error messages
+	std::string m_path;
+
+	///@brief Chunk buffers
+	unsigned char m_tdiChunk[JVEC_MAX_SCAN_BITS / 8];
+	unsigned char m_tdoChunk[JVEC_MAX_SCAN_BITS / 8];
+	unsigned char m_expectChunk[JVEC_MAX_SCAN_BITS / 8];
+	unsigned char m_maskChunk[JVEC_MAX_SCAN_BITS / 8];
+
+	//Statistics
+	uint64_t m_records;
+	uint64_t m_scanBits;
+	uint64_t m_comparedBits;
+};
+
+#endif
@@ -0,0 +1,224 @@
+/**
+	@file
+	@brief Implementation of RemoteBitbangServer
+ */
+
+#include "jtaghal.h"
+#include <sys/socket.h>
+
+using namespace std;
+
+///@brief Size of the receive buffer, i.e. the largest batch decoded at once
+#define BITBANG_RX_BUFFER_SIZE	65536
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+RemoteBitbangServer::RemoteBitbangServer(JtagInterface* iface)
+	: m_iface(iface)
+	, m_tck(false)
+	, m_tms(false)
+	, m_tdi(false)
+	, m_pendingReads(0)
+	, m_statBytes(0)
+	, m_statCycles(0)
+	, m_statReads(0)
+	, m_statShifts(0)
+{
+}
+
+RemoteBitbangServer::~RemoteBitbangServer()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Connection handling
+
+/**
+	@brief Accepts and serves clients, one at a time, forever
+
+	@throw JtagException if accepting fails or the adapter fails
+ */
+void RemoteBitbangServer::Serve(ServerSocket& sock)
+{
+	while(true)
+	{
+		int fd = sock.Accept();
+		LogNotice("remote_bitbang client connected\n");
+		ServeClient(fd);
+		close(fd);
+	}
+}
+
+/**
+	@brief Serves one client until it quits or disconnects, then logs throughput stats
+
+	@throw JtagException if the adapter fails
+ */
+void RemoteBitbangServer::ServeClient(int fd)
+{
+	m_tck = false;
+	m_tms = false;
+	m_tdi = false;
+	m_pendingReads = 0;
+	m_cycles.clear();
+	m_statBytes = 0;
+	m_statCycles = 0;
+	m_statReads = 0;
+	m_statShifts = 0;
+
+	//The client drives the TAP itself, IR scans included
+	m_iface->ForgetIR();
+
+	vector<uint8_t> rxbuf(BITBANG_RX_BUFFER_SIZE);
+	string reply;
+	uint64_t start = GetTimeNs();
+	while(true)
+	{
+		ssize_t n = recv(fd, &rxbuf[0], rxbuf.size(), 0);
+		if( (n < 0) && (errno == EINTR) )
+			continue;
+		if(n <= 0)
+			break;
+		m_statBytes += n;
+
+		bool more = Decode(&rxbuf[0], n);
+		reply.clear();
+		Execute(reply);
+		if(!reply.empty() && !ServerSocket::SendAll(fd, reply.c_str(), reply.length()))
+			break;
+		if(!more)
+			break;
+	}
+
+	//Don't lose anything the client wrote before hanging up
+	reply.clear();
+	Execute(reply);
+
+	double dt = (GetTimeNs() - start) * 1e-9;
+	LogNotice("remote_bitbang client disconnected: %" PRIu64 " bytes, %" PRIu64 " TCK cycles, %" PRIu64 " reads, "
+		"%" PRIu64 " shift calls in %.3f s (%.1f kHz effective TCK)\n",
+		m_statBytes, m_statCycles, m_statReads, m_statShifts, dt, (dt > 0) ? (m_statCycles / dt / 1000) : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Protocol decoding
+
+/**
+	@brief Decodes a chunk of the byte stream into TCK cycles
+
+	@return False if the client sent 'Q'
+ */
+bool RemoteBitbangServer::Decode(const uint8_t* data, size_t len)
+{
+	for(size_t i=0; i<len; i++)
+	{
+		uint8_t c = data[i];
+		if( (c >= '0') && (c <= '7') )
+		{
+			uint8_t pins = c - '0';
+			bool tck = (pins & 4) ? true : false;
+
+			//Rising edge: the cycle uses TMS/TDI as they are now
+			if(tck && !m_tck)
+			{
+				m_tms = (pins & 2) ? true : false;
+				m_tdi = (pins & 1) ? true : false;
+
+				BitbangCycle cycle;
+				cycle.tms = m_tms;
+				cycle.tdi = m_tdi;
+				cycle.reads = m_pendingReads;
+				m_cycles.push_back(cycle);
+				m_pendingReads = 0;
+			}
+			m_tck = tck;
+			m_tms = (pins & 2) ? true : false;
+			m_tdi = (pins & 1) ? true : false;
+		}
+		else if(c == 'R')
+			m_pendingReads ++;
+		else if(c == 'Q')
+			return false;
+
+		//Anything else (reset, blink) has no equivalent here
+	}
+	return true;
+}
+
+/**
+	@brief Executes all decoded cycles as ShiftData() / ShiftTMS() runs, and answers all reads
+
+	@param reply	'0' / '1' characters are appended for each read, in order
+ */
+void RemoteBitbangServer::Execute(string& reply)
+{
+	size_t n = m_cycles.size();
+	m_sendBits.resize( (n + 7) / 8);
+	m_rcvBits.resize( (n + 7) / 8);
+
+	size_t i = 0;
+	while(i < n)
+	{
+		const BitbangCycle& first = m_cycles[i];
+		size_t j = i;
+
+		//Data run: TMS low all the way, except possibly the last cycle. Reads force a data run since only
+		//ShiftData() can capture TDO.
+		if(!first.tms || first.reads)
+		{
+			bool want_read = false;
+			while(j < n)
+			{
+				if(m_cycles[j].reads)
+					want_read = true;
+				bool last = m_cycles[j].tms;
+				j ++;
+				if(last)
+					break;
+			}
+
+			size_t count = j - i;
+			memset(&m_sendBits[0], 0, (count + 7) / 8);
+			for(size_t k=0; k<count; k++)
+				PokeBit(&m_sendBits[0], k, m_cycles[i+k].tdi);
+			m_iface->ShiftData(m_cycles[j-1].tms, &m_sendBits[0], want_read ? &m_rcvBits[0] : NULL, count);
+
+			if(want_read)
+			{
+				for(size_t k=0; k<count; k++)
+				{
+					char bit = PeekBit(&m_rcvBits[0], k) ? '1' : '0';
+					reply.append(m_cycles[i+k].reads, bit);
+					m_statReads += m_cycles[i+k].reads;
+				}
+			}
+		}
+
+		//TMS run: constant TDI and no reads
+		else
+		{
+			while( (j < n) && !m_cycles[j].reads && (m_cycles[j].tdi == first.tdi) )
+				j ++;
+
+			size_t count = j - i;
+			memset(&m_sendBits[0], 0, (count + 7) / 8);
+			for(size_t k=0; k<count; k++)
+				PokeBit(&m_sendBits[0], k, m_cycles[i+k].tms);
+			m_iface->ShiftTMS(first.tdi, &m_sendBits[0], count);
+		}
+
+		m_statShifts ++;
+		i = j;
+	}
+	m_statCycles += n;
+	m_cycles.clear();
+
+	//Reads with no rising edge after them yet see TDO as it is right now
+	if(m_pendingReads)
+	{
+		reply.append(m_pendingReads, m_iface->ReadTDO() ? '1' : '0');
+		m_statReads += m_pendingReads;
+		m_pendingReads = 0;
+	}
+}
@@ -0,0 +1,89 @@
+/**
+	@file
+	@brief Declaration of RemoteBitbangServer
+ */
+
+#ifndef RemoteBitbangServer_h
+#define RemoteBitbangServer_h
+
+/**
+	@brief One TCK cycle decoded from a remote_bitbang stream
+ */
+struct BitbangCycle
+{
+	///@brief TMS value at the rising edge
+	uint8_t tms;
+
+	///@brief TDI value at the rising edge
+	uint8_t tdi;
+
+	///@brief Number of 'R' requests made while TCK was low before this rising edge
+	uint32_t reads;
+};
+
+/**
+	@brief Server for OpenOCD's remote_bitbang protocol
+
+	The protocol is one byte per pin change ('0'-'7' to set TCK/TMS/TDI, 'R' to sample TDO), which would mean a
+	syscall and a virtual call per edge if executed naively. Instead, everything the client has sent so far is read
+	in one go and decoded into whole TCK cycles, then replayed as runs:
+
+	\li cycles with TMS low (plus the TMS-high cycle ending them) go out as one ShiftData(), with TDO captured only if
+		the run contains reads
+	\li TMS-only cycles with constant TDI and no reads go out as one ShiftTMS()
+
+	All 'R' replies for the batch are then returned in a single send. TDO is sampled right before the rising edge
+	following the 'R', which matches how OpenOCD's bitbang driver issues reads. Reset ('r'-'u') and blink ('B', 'b')
+	commands are accepted and ignored, since the SW-JTAG block has neither TRST/SRST nor an LED.
+ */
+class RemoteBitbangServer
+{
+public:
+	RemoteBitbangServer(JtagInterface* iface);
+	virtual ~RemoteBitbangServer();
+
+	void Serve(ServerSocket& sock);
+	void ServeClient(int fd);
+
+protected:
+	bool Decode(const uint8_t* data, size_t len);
+	void Execute(std::string& reply);
+
+	///@brief The adapter
+	JtagInterface* m_iface;
+
+	///@brief Last TCK value written by the client
+	bool m_tck;
+
+	///@brief Last TMS value written by the client
+	bool m_tms;
+
+	///@brief Last TDI value written by the client
+	bool m_tdi;
+
+	///@brief Number of reads since the last rising edge
+	uint32_t m_pendingReads;
+
+	///@brief Cycles decoded but not yet executed
+	std::vector<BitbangCycle> m_cycles;
+
+	///@brief Scratch buffer for packed TDI / TMS bits
+	std::vector<unsigned char> m_sendBits;
+
+	///@brief Scratch buffer for packed TDO bits
+	std::vector<unsigned char> m_rcvBits;
+
+	///@brief Bytes received in this session
+	uint64_t m_statBytes;
+
+	///@brief TCK cycles executed in this session
+	uint64_t m_statCycles;
+
+	///@brief TDO reads in this session
+	uint64_t m_statReads;
+
+	///@brief Number of ShiftData() / ShiftTMS() calls made in this session
+	uint64_t m_statShifts;
+};
+
+#endif
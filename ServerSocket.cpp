@@ -0,0 +1,388 @@
+/**
+	@file
+	@brief Implementation of ServerSocket
+ */
+
+#include "jtaghal.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+ServerSocket::ServerSocket()
+	: m_fd(-1)
+{
+	//Clients going away mid-reply should show up as a failed send, not kill the server
+	signal(SIGPIPE, SIG_IGN);
+}
+
+ServerSocket::~ServerSocket()
+{
+	Close();
+}
+
+/**
+	@brief Stops listening, and removes the socket file for Unix sockets
+ */
+void ServerSocket::Close()
+{
+	if(m_fd >= 0)
+		close(m_fd);
+	m_fd = -1;
+
+	if(!m_unixPath.empty())
+		unlink(m_unixPath.c_str());
+	m_unixPath = "";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Connection handling
+
+/**
+	@brief Parses an endpoint string into a socket address
+
+	@param endpoint		"unix:/path", "host:port" or "port" (see class description)
+	@param addr			The parsed address
+	@param addrlen		Length of the parsed address
+
+	@throw JtagException if the endpoint is malformed
+ */
+void ServerSocket::ParseEndpoint(const string& endpoint, struct sockaddr_storage& addr, socklen_t& addrlen)
+{
+	memset(&addr, 0, sizeof(addr));
+
+	if(endpoint.compare(0, 5, "unix:") == 0)
+	{
+		string path = endpoint.substr(5);
+		struct sockaddr_un* addrun = reinterpret_cast<struct sockaddr_un*>(&addr);
+		addrun->sun_family = AF_UNIX;
+		if(path.empty() || (path.length() >= sizeof(addrun->sun_path)) )
+		{
+			throw JtagExceptionWrapper(
+				"Bad Unix socket path",
+				"");
+		}
+		strcpy(addrun->sun_path, path.c_str());
+		addrlen = sizeof(*addrun);
+		return;
+	}
+
+	string host = "127.0.0.1";
+	string port = endpoint;
+	size_t colon = endpoint.rfind(':');
+	if(colon != string::npos)
+	{
+		host = endpoint.substr(0, colon);
+		port = endpoint.substr(colon + 1);
+	}
+
+	//Numeric addresses only: the binary is linked statically, so there is no resolver to speak of
+	if( (host == "localhost") || host.empty() )
+		host = "127.0.0.1";
+	struct sockaddr_in* addr4 = reinterpret_cast<struct sockaddr_in*>(&addr);
+	struct sockaddr_in6* addr6 = reinterpret_cast<struct sockaddr_in6*>(&addr);
+	char* end;
+	unsigned long portnum = strtoul(port.c_str(), &end, 10);
+	if( port.empty() || (*end != '\0') || (portnum > 65535) )
+	{
+		throw JtagExceptionWrapper(
+			"Bad TCP port number",
+			"");
+	}
+	if(inet_pton(AF_INET, host.c_str(), &addr4->sin_addr) == 1)
+	{
+		addr4->sin_family = AF_INET;
+		addr4->sin_port = htons(portnum);
+		addrlen = sizeof(*addr4);
+	}
+	else if(inet_pton(AF_INET6, host.c_str(), &addr6->sin6_addr) == 1)
+	{
+		addr6->sin6_family = AF_INET6;
+		addr6->sin6_port = htons(portnum);
+		addrlen = sizeof(*addr6);
+	}
+	else
+	{
+		throw JtagExceptionWrapper(
+			"Bad address (must be numeric)",
+			"");
+	}
+}
+
+/**
+	@brief Starts listening on an endpoint
+
+	@param endpoint		"unix:/path", "host:port" or "port" (see class description)
+
+	@throw JtagException if the endpoint is malformed or can't be bound
+ */
+void ServerSocket::Listen(const string& endpoint)
+{
+	Close();
+
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	ParseEndpoint(endpoint, addr, addrlen);
+
+	m_fd = socket(addr.ss_family, SOCK_STREAM, 0);
+	if(m_fd < 0)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to create socket",
+			"");
+	}
+
+	if(addr.ss_family == AF_UNIX)
+	{
+		//A stale socket file from a previous run would make bind() fail
+		const char* path = reinterpret_cast<struct sockaddr_un*>(&addr)->sun_path;
+		unlink(path);
+		if(bind(m_fd, reinterpret_cast<struct sockaddr*>(&addr), addrlen) != 0)
+		{
+			Close();
+			throw JtagExceptionWrapper(
+				"Failed to bind Unix socket",
+				"");
+		}
+		m_unixPath = path;
+	}
+
+	else
+	{
+		int yes = 1;
+		if( (setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) != 0) ||
+			(bind(m_fd, reinterpret_cast<struct sockaddr*>(&addr), addrlen) != 0) )
+		{
+			Close();
+			throw JtagExceptionWrapper(
+				"Failed to bind TCP socket",
+				"");
+		}
+	}
+
+	if(listen(m_fd, 4) != 0)
+	{
+		Close();
+		throw JtagExceptionWrapper(
+			"Failed to listen on socket",
+			"");
+	}
+}
+
+/**
+	@brief Waits for a client to connect
+
+	@return File descriptor of the new connection. The caller owns it.
+
+	@throw JtagException if accept() fails
+ */
+int ServerSocket::Accept()
+{
+	int fd;
+	do
+	{
+		fd = accept(m_fd, NULL, NULL);
+	} while( (fd < 0) && (errno == EINTR) );
+
+	if(fd < 0)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to accept connection",
+			"");
+	}
+
+	//No-op (and harmless) on Unix sockets
+	int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	return fd;
+}
+
+/**
+	@brief Connects to a server listening on an endpoint
+
+	@param endpoint		"unix:/path", "host:port" or "port" (see class description)
+
+	@return File descriptor of the connection. The caller owns it.
+
+	@throw JtagException if the endpoint is malformed or nothing is listening there
+ */
+int ServerSocket::Connect(const string& endpoint)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	ParseEndpoint(endpoint, addr, addrlen);
+
+	int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+	if(fd < 0)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to create socket",
+			"");
+	}
+
+	int ret;
+	do
+	{
+		ret = connect(fd, reinterpret_cast<struct sockaddr*>(&addr), addrlen);
+	} while( (ret != 0) && (errno == EINTR) );
+
+	if(ret != 0)
+	{
+		close(fd);
+		throw JtagExceptionWrapper(
+			"Failed to connect to " + endpoint,
+			"");
+	}
+
+	//Also ignore SIGPIPE on the client side, and disable Nagle for TCP
+	signal(SIGPIPE, SIG_IGN);
+	int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	return fd;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// I/O helpers
+
+/**
+	@brief Sends a whole buffer, retrying on short writes
+
+	@return True on success, false if the connection went away
+ */
+bool ServerSocket::SendAll(int fd, const void* data, size_t len)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	while(len > 0)
+	{
+		ssize_t n = send(fd, p, len, 0);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+/**
+	@brief Receives exactly len bytes, retrying on short reads
+
+	@return True on success, false if the connection went away
+ */
+bool ServerSocket::RecvAll(int fd, void* data, size_t len)
+{
+	uint8_t* p = static_cast<uint8_t*>(data);
+	while(len > 0)
+	{
+		ssize_t n = recv(fd, p, len, 0);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		if(n == 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+/**
+	@brief Sends a whole buffer with file descriptors attached to its first byte (Unix sockets only)
+
+	@return True on success, false if the connection went away or can't carry descriptors
+ */
+bool ServerSocket::SendWithFds(int fd, const void* data, size_t len, const int* fds, size_t nfds)
+{
+	if( (len == 0) || (nfds == 0) || (nfds > SERVER_SOCKET_MAX_FDS) )
+		return false;
+
+	char control[CMSG_SPACE(SERVER_SOCKET_MAX_FDS * sizeof(int))];
+	memset(control, 0, sizeof(control));
+
+	struct iovec iov;
+	iov.iov_base = const_cast<void*>(data);
+	iov.iov_len = len;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+
+	ssize_t n;
+	do
+	{
+		n = sendmsg(fd, &msg, 0);
+	} while( (n < 0) && (errno == EINTR) );
+	if(n <= 0)
+		return false;
+
+	//The descriptors went with the first chunk, the rest is plain data
+	return SendAll(fd, static_cast<const uint8_t*>(data) + n, len - n);
+}
+
+/**
+	@brief Receives whatever is available, collecting any file descriptors that come with it
+
+	@param fd		Socket to read from
+	@param data		Receive buffer
+	@param len		Size of the receive buffer
+	@param fds		Received descriptors are appended here. The caller owns them.
+
+	@return As for recv()
+ */
+ssize_t ServerSocket::RecvWithFds(int fd, void* data, size_t len, vector<int>& fds)
+{
+	char control[CMSG_SPACE(SERVER_SOCKET_MAX_FDS * sizeof(int))];
+
+	struct iovec iov;
+	iov.iov_base = data;
+	iov.iov_len = len;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ssize_t n;
+	do
+	{
+		n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	} while( (n < 0) && (errno == EINTR) );
+
+	for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if( (cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS) )
+			continue;
+		size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for(size_t i=0; i<count; i++)
+		{
+			int newfd;
+			memcpy(&newfd, CMSG_DATA(cmsg) + i*sizeof(int), sizeof(int));
+			fds.push_back(newfd);
+		}
+	}
+	return n;
+}
@@ -0,0 +1,57 @@
+/**
+	@file
+	@brief Declaration of ServerSocket
+ */
+
+#ifndef ServerSocket_h
+#define ServerSocket_h
+
+#include <sys/socket.h>
+
+///@brief Most file descriptors passed along with one message
+#define SERVER_SOCKET_MAX_FDS	4
+
+/**
+	@brief A listening socket for the protocol servers (TCP or Unix domain)
+
+	Endpoints are given as strings:
+
+	\li "unix:/path/to/socket" for a Unix domain socket
+	\li "addr:port" for TCP on a specific numeric address
+	\li "port" for TCP on localhost only
+
+	Accepted TCP connections have Nagle disabled, since every protocol spoken here is request/response. Connect()
+	takes the same endpoint strings, for the client side of our own protocols.
+ */
+class ServerSocket
+{
+public:
+	ServerSocket();
+	virtual ~ServerSocket();
+
+	void Listen(const std::string& endpoint);
+	int Accept();
+	void Close();
+
+	///@brief Returns the listening file descriptor, or -1
+	int GetFD()
+	{ return m_fd; }
+
+	static int Connect(const std::string& endpoint);
+	static void ParseEndpoint(const std::string& endpoint, struct sockaddr_storage& addr, socklen_t& addrlen);
+
+	static bool SendAll(int fd, const void* data, size_t len);
+	static bool RecvAll(int fd, void* data, size_t len);
+	static bool SendWithFds(int fd, const void* data, size_t len, const int* fds, size_t nfds);
+	static ssize_t RecvWithFds(int fd, void* data, size_t len, std::vector<int>& fds);
+
+protected:
+
+	///@brief The listening socket
+	int m_fd;
+
+	///@brief Path of the Unix socket, removed again on close
+	std::string m_unixPath;
+};
+
+#endif
@@ -0,0 +1,94 @@
+/**
+	@file
+	@brief Implementation of SimJtagInterface
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+SimJtagInterface::SimJtagInterface()
+{
+}
+
+SimJtagInterface::~SimJtagInterface()
+{
+	ShutdownAsync();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Adapter information
+
+string SimJtagInterface::GetName()
+{
+	return "Simulated CEVA debug port";
+}
+
+string SimJtagInterface::GetSerial()
+{
+	return "";
+}
+
+string SimJtagInterface::GetUserID()
+{
+	return "";
+}
+
+int SimJtagInterface::GetFrequency()
+{
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Low-level JTAG interface
+
+void SimJtagInterface::ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+{
+	JTAG_PROBE2(shift_data_start, count, last_tms);
+	LogTrace("ShiftData: %zu bits, last TMS %d\n", count, last_tms);
+	JtagTimelineSpan span("ShiftData", "bits", count);
+	JtagScopedTimer timer(m_perfShiftTime, &m_perfShiftDataLatency);
+	CountShiftData(count);
+
+	//Same pin sequence as the hardware drivers: sample TDO, then clock out the next TDI bit
+	if(rcv_data != NULL)
+		memset(rcv_data, 0, (count + 7) / 8);
+
+	for(size_t i=0; i<count; i++)
+	{
+		if(rcv_data != NULL)
+			PokeBit(rcv_data, i, m_model.GetTDO());
+		m_model.Clock( (i == count-1) ? last_tms : false, PeekBit(send_data, i));
+	}
+
+	JTAG_PROBE2(shift_data_done, count, timer.Stop());
+}
+
+void SimJtagInterface::SendDummyClocks(size_t n)
+{
+	JtagTimelineSpan span("SendDummyClocks", "clocks", n);
+	JtagScopedTimer timer(m_perfShiftTime);
+	CountDummyClocks(n);
+	for(size_t i=0; i<n; i++)
+		m_model.Clock(false, false);
+	JTAG_PROBE2(dummy_clocks, n, timer.Stop());
+}
+
+bool SimJtagInterface::ReadTDO()
+{
+	return m_model.GetTDO();
+}
+
+void SimJtagInterface::ShiftTMS(bool tdi, const unsigned char* send_data, size_t count)
+{
+	LogTrace("ShiftTMS: %zu bits\n", count);
+	JtagTimelineSpan span("ShiftTMS", "bits", count);
+	JtagScopedTimer timer(m_perfShiftTime, &m_perfShiftTMSLatency);
+	CountShiftTMS(count);
+	for(size_t i=0; i<count; i++)
+		m_model.Clock(PeekBit(send_data, i), tdi);
+	JTAG_PROBE2(shift_tms, count, timer.Stop());
+}
@@ -0,0 +1,42 @@
+/**
+	@file
+	@brief Declaration of SimJtagInterface
+ */
+
+#ifndef SimJtagInterface_h
+#define SimJtagInterface_h
+
+/**
+	@brief A JtagInterface with no hardware behind it, driving a CevaTapModel instead
+
+	Lets the whole debug stack (and anything talking to it over a socket) be exercised on a development host.
+ */
+class SimJtagInterface : public JtagInterface
+{
+public:
+	SimJtagInterface();
+	virtual ~SimJtagInterface();
+
+	//shims that just push stuff up to base class
+	virtual std::string GetName();
+	virtual std::string GetSerial();
+	virtual std::string GetUserID();
+	virtual int GetFrequency();
+
+	//Low-level JTAG interface
+	virtual void ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
+	virtual void SendDummyClocks(size_t n);
+	virtual bool ReadTDO();
+
+	///@brief Returns the simulated target
+	CevaTapModel& GetModel()
+	{ return m_model; }
+
+protected:
+	virtual void ShiftTMS(bool tdi, const unsigned char* send_data, size_t count);
+
+	///@brief The simulated target
+	CevaTapModel m_model;
+};
+
+#endif
@@ -0,0 +1,177 @@
+/**
+	@file
+	@brief Implementation of SprdJtagProfileRegistry
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The profiles
+
+/**
+	@brief Gets the table of known SoCs, the first being the default
+
+	Built on first use, so interfaces created during static initialization still find it.
+ */
+static const SprdJtagProfileEntry* GetProfiles(size_t& count)
+{
+	static const SprdJtagProfileEntry profiles[] =
+	{
+		SprdJtagProfileEntry::Make<SprdJtagProfileSc8810>("sc8810", "SC8810 / SC6820 DSP (AHB 0x20900280)")
+	};
+
+	count = sizeof(profiles) / sizeof(profiles[0]);
+	return profiles;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Lookup
+
+/**
+	@brief Gets the number of known SoCs
+ */
+size_t SprdJtagProfileRegistry::GetCount()
+{
+	size_t count;
+	GetProfiles(count);
+	return count;
+}
+
+/**
+	@brief Gets a known SoC by index
+
+	@throw JtagException if the index is out of range
+ */
+const SprdJtagProfileEntry& SprdJtagProfileRegistry::Get(size_t i)
+{
+	size_t count;
+	const SprdJtagProfileEntry* profiles = GetProfiles(count);
+	if(i >= count)
+	{
+		throw JtagExceptionWrapper(
+			"SoC profile index out of range",
+			"");
+	}
+	return profiles[i];
+}
+
+/**
+	@brief Looks a SoC up by ID (case insensitive)
+
+	@return The profile, or NULL if the SoC isn't known
+ */
+const SprdJtagProfileEntry* SprdJtagProfileRegistry::Find(const string& id)
+{
+	size_t count;
+	const SprdJtagProfileEntry* profiles = GetProfiles(count);
+	for(size_t i = 0; i < count; i++)
+	{
+		if(!strcasecmp(profiles[i].id, id.c_str()))
+			return &profiles[i];
+	}
+	return NULL;
+}
+
+/**
+	@brief Gets the profile of the block the driver was written against
+ */
+const SprdJtagProfileEntry& SprdJtagProfileRegistry::GetDefault()
+{
+	return Get(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Detection
+
+/**
+	@brief Reads a text file, lower case, with NULs (as in device tree string lists) turned into spaces
+ */
+static string ReadPlatformFile(const char* path)
+{
+	string text;
+	FILE* fp = fopen(path, "rb");
+	if(!fp)
+		return text;
+
+	char buf[4096];
+	size_t len;
+	while((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+	{
+		for(size_t i = 0; i < len; i++)
+			text += buf[i] ? tolower(buf[i]) : ' ';
+	}
+	fclose(fp);
+	return text;
+}
+
+/**
+	@brief Finds the first known SoC whose ID appears in some text
+
+	@return The profile, or NULL if there's none
+ */
+static const SprdJtagProfileEntry* MatchProfile(const string& text)
+{
+	for(size_t i = 0; i < SprdJtagProfileRegistry::GetCount(); i++)
+	{
+		const SprdJtagProfileEntry& profile = SprdJtagProfileRegistry::Get(i);
+		if(text.find(profile.id) != string::npos)
+			return &profile;
+	}
+	return NULL;
+}
+
+/**
+	@brief Looks for the SoC in the device tree's compatible list, then the "Hardware" line of /proc/cpuinfo
+
+	@return The profile, falling back to the default
+ */
+static const SprdJtagProfileEntry& DetectPlatform()
+{
+	const SprdJtagProfileEntry* profile = MatchProfile(ReadPlatformFile("/proc/device-tree/compatible"));
+	if(!profile)
+	{
+		string cpuinfo = ReadPlatformFile("/proc/cpuinfo");
+		size_t hw = cpuinfo.find("hardware");
+		if(hw != string::npos)
+			profile = MatchProfile(cpuinfo.substr(hw, cpuinfo.find('\n', hw) - hw));
+	}
+
+	if(profile)
+	{
+		LogVerbose("SoC profile: %s (%s)\n", profile->id, profile->description);
+		return *profile;
+	}
+
+	const SprdJtagProfileEntry& fallback = SprdJtagProfileRegistry::GetDefault();
+	LogVerbose("SoC not recognized, using the %s profile (%s)\n", fallback.id, fallback.description);
+	return fallback;
+}
+
+/**
+	@brief Works out which SoC this is running on
+
+	The JTAG_SOC environment variable, if set, names the SoC outright. Otherwise the platform is only looked at the
+	first time (see DetectPlatform()).
+
+	@throw JtagException if JTAG_SOC names an unknown SoC
+ */
+const SprdJtagProfileEntry& SprdJtagProfileRegistry::Detect()
+{
+	const char* env = getenv("JTAG_SOC");
+	if(env && *env)
+	{
+		const SprdJtagProfileEntry* profile = Find(env);
+		if(!profile)
+		{
+			throw JtagExceptionWrapper(
+				"Unknown SoC in JTAG_SOC",
+				env);
+		}
+		return *profile;
+	}
+
+	static const SprdJtagProfileEntry& detected = DetectPlatform();
+	return detected;
+}
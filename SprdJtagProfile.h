@@ -0,0 +1,136 @@
+/**
+	@file
+	@brief Declaration of SprdJtagProfile, SprdJtagProfileEntry and SprdJtagProfileRegistry
+ */
+
+#ifndef SprdJtagProfile_h
+#define SprdJtagProfile_h
+
+class SprdMmioDJtagInterface;
+
+/**
+	@brief Where an SW-JTAG control block is mapped, and which bit of its register carries each signal
+
+	This is the run-time copy of a SprdJtagProfile, for the parts of SprdMmioDJtagInterface that aren't worth
+	specializing (enabling the block, characterizing the link, waiting for RTCK).
+ */
+struct SprdJtagRegisterLayout
+{
+	///@brief Physical address of the control register
+	uint32_t address;
+
+	///@brief Bit that hands the TAP pins over to the register
+	uint32_t enable;
+
+	///@brief Signal bits (rtck is 0 if the block has no returned clock)
+	uint32_t tdi;
+	uint32_t tck;
+	uint32_t tms;
+	uint32_t tdo;
+	uint32_t rtck;
+};
+
+/**
+	@brief A SoC's SW-JTAG control block, as compile-time constants
+
+	SprdShiftKernel is instantiated for each profile, so the masks are folded into the shift loops as immediates, and
+	the RTCK handling is left out altogether for blocks without one.
+
+	@tparam Address		Physical address of the control register
+	@tparam Enable		Bit number of the enable bit
+	@tparam Tdi			Bit number of TDI (and so on for the other signals)
+	@tparam Rtck		Bit number of the returned clock, or -1 if the block has none, in which case TCK isn't paced by
+						the target and RTCK isn't watched for clock changes
+ */
+template<uint32_t Address, int Enable, int Tdi, int Tck, int Tms, int Tdo, int Rtck>
+struct SprdJtagProfile
+{
+	static constexpr uint32_t address = Address;
+	static constexpr uint32_t enable = 1u << Enable;
+	static constexpr uint32_t tdi = 1u << Tdi;
+	static constexpr uint32_t tck = 1u << Tck;
+	static constexpr uint32_t tms = 1u << Tms;
+	static constexpr uint32_t tdo = 1u << Tdo;
+	static constexpr bool has_rtck = (Rtck >= 0);
+	static constexpr uint32_t rtck = has_rtck ? (1u << (Rtck & 31)) : 0;
+
+	///@brief Returns the run-time copy of the profile
+	static SprdJtagRegisterLayout GetLayout()
+	{
+		SprdJtagRegisterLayout layout;
+		layout.address = address;
+		layout.enable = enable;
+		layout.tdi = tdi;
+		layout.tck = tck;
+		layout.tms = tms;
+		layout.tdo = tdo;
+		layout.rtck = rtck;
+		return layout;
+	}
+};
+
+/**
+	@brief SC8810 / SC6820 DSP block: REG_AHB_DSP_JTAG_CTRL in the AHB registers, with the CEVA SW-JTAG enable
+
+	This is the block the driver was written against, and what SprdJtagRegisterModel implements. TDI on bit 4 has
+	been doubted; if it turns out wrong, this is the one place to fix it.
+ */
+typedef SprdJtagProfile<0x20900280, 8, 4, 3, 2, 1, 0> SprdJtagProfileSc8810;
+
+/**
+	@brief The wire-level loops of SprdMmioDJtagInterface, specialized for one profile and one way of reaching the
+	register (see SprdShiftKernel)
+ */
+struct SprdShiftKernels
+{
+	void (*shift_data)(
+		SprdMmioDJtagInterface* iface,
+		bool last_tms,
+		const unsigned char* send_data,
+		unsigned char* rcv_data,
+		size_t count);
+	void (*shift_tms)(SprdMmioDJtagInterface* iface, bool tdi, const unsigned char* send_data, size_t count);
+	void (*dummy_clocks)(SprdMmioDJtagInterface* iface, size_t n);
+};
+
+/**
+	@brief One SoC in SprdJtagProfileRegistry: its layout, and the kernels instantiated for it
+ */
+struct SprdJtagProfileEntry
+{
+	///@brief SoC ID, as matched against the platform's hardware name (e.g. "sc8810")
+	const char* id;
+
+	///@brief Which block this is, for people
+	const char* description;
+
+	///@brief Run-time copy of the profile
+	SprdJtagRegisterLayout layout;
+
+	///@brief Kernels driving the mapped register
+	SprdShiftKernels mmio;
+
+	///@brief Kernels driving a SprdJtagRegisterModel with the same layout
+	SprdShiftKernels model;
+
+	template<class Profile>
+	static SprdJtagProfileEntry Make(const char* id, const char* description);
+};
+
+/**
+	@brief The SoCs SprdMmioDJtagInterface supports, looked up by ID at run time
+
+	Supporting a new chip takes a SprdJtagProfile for its block and a line in the table in SprdJtagProfile.cpp. The
+	choice is made once, when the interface is created; the shift loops themselves never branch on it.
+ */
+class SprdJtagProfileRegistry
+{
+public:
+	static size_t GetCount();
+	static const SprdJtagProfileEntry& Get(size_t i);
+	static const SprdJtagProfileEntry* Find(const std::string& id);
+	static const SprdJtagProfileEntry& GetDefault();
+	static const SprdJtagProfileEntry& Detect();
+};
+
+#endif
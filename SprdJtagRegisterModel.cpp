@@ -0,0 +1,176 @@
+/**
+	@file
+	@brief Implementation of SprdJtagRegisterModel
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+//The block being modelled
+typedef SprdJtagProfileSc8810 Layout;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+SprdJtagRegisterModel::SprdJtagRegisterModel()
+	: m_value(0)
+	, m_rtck(false)
+	, m_rtckDelay(0)
+	, m_rtckPending(0)
+	, m_faulty(false)
+	, m_seed(1)
+	, m_tdoFlip(false)
+	, m_reads(0)
+	, m_writes(0)
+	, m_injected(0)
+{
+}
+
+SprdJtagRegisterModel::~SprdJtagRegisterModel()
+{
+}
+
+SprdJtagFaults::SprdJtagFaults()
+	: tdo_stuck(-1)
+	, tdo_stuck_states(0xffff)
+	, tdo_ber(0)
+	, tdi_ber(0)
+	, desync_rate(0)
+	, rtck_dropped(false)
+	, rtck_jitter(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Register access
+
+/**
+	@brief Reads the register
+ */
+uint32_t SprdJtagRegisterModel::Read()
+{
+	m_reads ++;
+	if(__builtin_expect(m_faulty, 0))
+		return ReadFaulty();
+
+	bool tck = (m_value & Layout::tck) != 0;
+	if(m_rtck != tck)
+	{
+		if(m_rtckPending)
+			m_rtckPending --;
+		else
+			m_rtck = tck;
+	}
+
+	return m_value | (m_model.GetTDO() ? Layout::tdo : 0) | (m_rtck ? Layout::rtck : 0);
+}
+
+/**
+	@brief Writes the register. STDO and STRTCK are read only.
+ */
+void SprdJtagRegisterModel::Write(uint32_t value)
+{
+	m_writes ++;
+
+	uint32_t old = m_value;
+	m_value = value & ~(Layout::tdo | Layout::rtck);
+	if(!(m_value & Layout::enable))
+		return;
+
+	if( (old ^ m_value) & Layout::tck )
+	{
+		//The driver samples TDO before the rising edge, so a whole cycle here is indistinguishable from the pins
+		if(__builtin_expect(m_faulty, 0))
+			ClockFaulty( (m_value & Layout::tms) != 0, (m_value & Layout::tdi) != 0);
+		else
+		{
+			if(m_value & Layout::tck)
+				m_model.Clock( (m_value & Layout::tms) != 0, (m_value & Layout::tdi) != 0);
+			m_rtckPending = m_rtckDelay;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Fault injection
+
+/**
+	@brief Starts injecting faults
+
+	@param faults	Faults to inject
+	@param seed		Seed for the random ones (nonzero); the same seed gives the same faults for the same accesses
+ */
+void SprdJtagRegisterModel::SetFaults(const SprdJtagFaults& faults, uint64_t seed)
+{
+	m_faults = faults;
+	m_seed = seed ? seed : 1;
+	m_tdoFlip = false;
+	m_faulty =
+		(faults.tdo_stuck >= 0) ||
+		(faults.tdo_ber > 0) ||
+		(faults.tdi_ber > 0) ||
+		(faults.desync_rate > 0) ||
+		faults.rtck_dropped ||
+		(faults.rtck_jitter > 0);
+}
+
+/**
+	@brief Stops injecting faults. The TAP may well be out of step with the driver afterwards.
+ */
+void SprdJtagRegisterModel::ClearFaults()
+{
+	m_faults = SprdJtagFaults();
+	m_faulty = false;
+	m_tdoFlip = false;
+}
+
+/**
+	@brief Read(), with faults
+ */
+uint32_t SprdJtagRegisterModel::ReadFaulty()
+{
+	bool tck = (m_value & Layout::tck) != 0;
+	if( (m_rtck != tck) && !m_faults.rtck_dropped)
+	{
+		if(m_rtckPending)
+			m_rtckPending --;
+		else
+			m_rtck = tck;
+	}
+
+	bool tdo = m_model.GetTDO() != m_tdoFlip;
+	if( (m_faults.tdo_stuck >= 0) && (m_faults.tdo_stuck_states & (1 << m_model.GetState())) )
+		tdo = (m_faults.tdo_stuck != 0);
+
+	return m_value | (tdo ? Layout::tdo : 0) | (m_rtck ? Layout::rtck : 0);
+}
+
+/**
+	@brief Handles a TCK edge, with faults
+ */
+void SprdJtagRegisterModel::ClockFaulty(bool tms, bool tdi)
+{
+	m_rtckPending = m_rtckDelay;
+	if(m_faults.rtck_jitter)
+		m_rtckPending += Random() % (m_faults.rtck_jitter + 1);
+
+	if(!(m_value & Layout::tck))
+		return;
+
+	if( (m_faults.desync_rate > 0) && Chance(m_faults.desync_rate) )
+	{
+		m_injected ++;
+		return;
+	}
+	if( (m_faults.tdi_ber > 0) && Chance(m_faults.tdi_ber) )
+	{
+		m_injected ++;
+		tdi = !tdi;
+	}
+	m_model.Clock(tms, tdi);
+
+	m_tdoFlip = (m_faults.tdo_ber > 0) && Chance(m_faults.tdo_ber);
+	if(m_tdoFlip)
+		m_injected ++;
+}
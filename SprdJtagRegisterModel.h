@@ -0,0 +1,138 @@
+/**
+	@file
+	@brief Declaration of SprdJtagRegisterModel
+ */
+
+#ifndef SprdJtagRegisterModel_h
+#define SprdJtagRegisterModel_h
+
+/**
+	@brief Faults SprdJtagRegisterModel can inject, to exercise the driver's error detection and recovery
+
+	Probabilities are per TCK rising edge.
+ */
+struct SprdJtagFaults
+{
+	SprdJtagFaults();
+
+	///@brief -1 for a working TDO, or the level STDO is stuck at
+	int tdo_stuck;
+
+	///@brief TAP states (bitmask of 1 << JtagTapState) TDO is stuck in, so a fault can show in e.g. Shift-DR only
+	uint32_t tdo_stuck_states;
+
+	///@brief Probability of the TDO sample for a bit being inverted
+	double tdo_ber;
+
+	///@brief Probability of the TAP seeing TDI inverted
+	double tdi_ber;
+
+	///@brief Probability of the TAP missing the edge altogether (STRTCK still follows), putting it out of step
+	double desync_rate;
+
+	///@brief STRTCK never follows STCK, as if the DSP had stopped
+	bool rtck_dropped;
+
+	///@brief STRTCK lags each edge by up to this many more reads than the set delay, chosen at random
+	unsigned int rtck_jitter;
+};
+
+/**
+	@brief Software model of the SW-JTAG control register, with a CevaTapModel behind the pins
+
+	SprdMmioDJtagInterface can be pointed at one of these instead of the hardware register, so that its bit-banging
+	code (and everything above it) runs unchanged on any host. TCK rising edges clock the TAP model with the current
+	TMS / TDI; STDO shows the model's TDO and STRTCK follows STCK, optionally only after a number of reads, like a
+	slow target would. The bits are those of SprdJtagProfileSc8810, and clocks are ignored while its enable bit is clear.
+
+	SetFaults() makes the link misbehave in the ways real ones do (see SprdJtagFaults), from a seeded generator so a
+	failing run can be repeated. Without faults, the only cost is one predictable branch per access.
+ */
+class SprdJtagRegisterModel
+{
+public:
+	SprdJtagRegisterModel();
+	virtual ~SprdJtagRegisterModel();
+
+	virtual uint32_t Read();
+	virtual void Write(uint32_t value);
+
+	///@brief Returns the simulated target
+	CevaTapModel& GetModel()
+	{ return m_model; }
+
+	///@brief Makes STRTCK lag STCK by a number of register reads
+	void SetRtckDelay(unsigned int reads)
+	{ m_rtckDelay = reads; }
+
+	void SetFaults(const SprdJtagFaults& faults, uint64_t seed = 1);
+	void ClearFaults();
+
+	///@brief Returns the faults being injected
+	const SprdJtagFaults& GetFaults()
+	{ return m_faults; }
+
+	///@brief Returns the number of faulty bits or edges injected so far (stuck TDO not included)
+	uint64_t GetInjectedCount()
+	{ return m_injected; }
+
+	///@brief Returns the number of register reads so far
+	uint64_t GetReadCount()
+	{ return m_reads; }
+
+	///@brief Returns the number of register writes so far
+	uint64_t GetWriteCount()
+	{ return m_writes; }
+
+protected:
+
+	///@brief The simulated target
+	CevaTapModel m_model;
+
+	///@brief Writable bits, as last written
+	uint32_t m_value;
+
+	///@brief Current STRTCK
+	bool m_rtck;
+
+	///@brief Reads STRTCK lags STCK by
+	unsigned int m_rtckDelay;
+
+	///@brief Reads left until STRTCK follows STCK
+	unsigned int m_rtckPending;
+
+	uint32_t ReadFaulty();
+	void ClockFaulty(bool tms, bool tdi);
+
+	///@brief Returns the next number from the fault generator (xorshift64)
+	uint64_t Random()
+	{
+		m_seed ^= m_seed << 13;
+		m_seed ^= m_seed >> 7;
+		m_seed ^= m_seed << 17;
+		return m_seed;
+	}
+
+	///@brief Returns true with probability p
+	bool Chance(double p)
+	{ return (Random() >> 11) * (1.0 / 9007199254740992.0) < p; }
+
+	///@brief True if any fault is being injected
+	bool m_faulty;
+
+	///@brief Faults being injected
+	SprdJtagFaults m_faults;
+
+	///@brief State of the fault generator
+	uint64_t m_seed;
+
+	///@brief True if the TDO sample for the current bit is to be inverted
+	bool m_tdoFlip;
+
+	//Statistics
+	uint64_t m_reads;
+	uint64_t m_writes;
+	uint64_t m_injected;
+};
+
+#endif
@@ -1,101 +1,208 @@
 #include "jtaghal.h"
 #include "devmem.h"
-#include "debug.h"
+#include <sched.h>
 
 using namespace std;
 
-DEBUG_SET_LEVEL(DEBUG_LEVEL_ERR);
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Register access
 
-#define BIT(x)                      ( 1 <<(x) )
-#define REG_AHB_DSP_JTAG_CTRL       ( 0x20900280 )
-#define BIT_CEVA_SW_JTAG_ENA        ( BIT(8) )
-#define BIT_STDI                    ( BIT(4) ) //oh fuck
-#define BIT_STCK                    ( BIT(3) )
-#define BIT_STMS                    ( BIT(2) )
-#define BIT_STDO                    ( BIT(1) )
-#define BIT_STRTCK                  ( BIT(0) )
+inline uint32_t SprdMmioDJtagInterface::ReadReg()
+{
+    if(__builtin_expect(m_regModel != NULL, 0))
+        return m_regModel->Read();
+    return (*m_reg);
+}
 
-volatile uint32_t *jtagreg;
+inline void SprdMmioDJtagInterface::WriteReg(uint32_t reg)
+{
+    if(__builtin_expect(m_regModel != NULL, 0))
+        m_regModel->Write(reg);
+    else
+        (*m_reg) = reg;
+}
 
-void SetEnableMmioDJtag(bool en)
+void SprdMmioDJtagInterface::SetEnable(bool en)
 {
     uint32_t reg;
 
-    reg = (*jtagreg);
-    reg &= ~BIT_CEVA_SW_JTAG_ENA;
-    reg |= (en ? BIT_CEVA_SW_JTAG_ENA : 0);
-    (*jtagreg) = reg;
+    reg = ReadReg();
+    reg &= ~m_layout.enable;
+    reg |= (en ? m_layout.enable : 0);
+    WriteReg(reg);
 }
 
-void SetTCK(bool tck)
+/*
+ * Waits until RTCK reaches the given level. Only called once the first poll has missed, so a target that keeps up
+ * never pays for the timestamps. Spins for m_rtckSpin, then yields the CPU between polls, so a DSP slowed right down
+ * doesn't hog a core; past m_rtckTimeout the DSP is assumed to have stopped, rather than hanging forever, and
+ * m_rtckStalled is set for ReportRtckStall() once the operation in progress has finished clocking.
+ */
+void __attribute__((noinline)) SprdMmioDJtagInterface::WaitRTCK(bool level)
+{
+    if(m_rtckStalled)
+        return;
+
+    uint64_t start = JtagCycleClock::Now();
+    while(((ReadReg() & m_layout.rtck) != 0) != level)
+    {
+        uint64_t waited = JtagCycleClock::ToNs(JtagCycleClock::Now() - start);
+        if(waited >= m_rtckSpin)
+        {
+            if(waited >= m_rtckTimeout)
+            {
+                m_rtckStalled = true;
+                return;
+            }
+            sched_yield();
+        }
+    }
+    uint64_t ns = JtagCycleClock::ToNs(JtagCycleClock::Now() - start);
+    if(m_rtckWait)
+        m_rtckWait->Record(ns);
+    JTAG_PROBE2(rtck_wait, level, ns);
+    LogTrace("Waited %" PRIu64 " ns for RTCK to go %s\n", ns, level ? "high" : "low");
+}
+
+/*
+ * Writes a TCK edge and returns how long RTCK took to follow it, in ns
+ */
+uint64_t SprdMmioDJtagInterface::TimeRTCK(uint32_t reg)
+{
+    bool level = (reg & m_layout.tck) != 0;
+    uint64_t start = JtagCycleClock::Now();
+    WriteReg(reg);
+    if(m_layout.rtck && ((ReadReg() & m_layout.rtck) != 0) != level)
+        WaitRTCK(level);
+    return JtagCycleClock::ToNs(JtagCycleClock::Now() - start);
+}
+
+/*
+ * Writes a TCK rising edge, timing its echo for the clock change detection
+ */
+void __attribute__((noinline)) SprdMmioDJtagInterface::SampleRTCK(uint32_t reg)
+{
+    m_rtckSample = SPRD_RTCK_SAMPLE_INTERVAL;
+    uint64_t ns = TimeRTCK(reg);
+    if(m_monitorLink && !m_rtckStalled)
+        RecordRtckEcho(ns);
+}
+
+inline void SprdMmioDJtagInterface::SetTCK(bool tck)
 {
     uint32_t reg;
 
     if(tck)
     {
-        reg = (*jtagreg);
-        reg |= BIT_STCK;
-        (*jtagreg) = reg;
-        while(((*jtagreg) & BIT_STRTCK) == 0);
+        reg = ReadReg();
+        reg |= m_layout.tck;
+        if(__builtin_expect(--m_rtckSample == 0, 0))
+        {
+            SampleRTCK(reg);
+            return;
+        }
+        WriteReg(reg);
+        if(m_layout.rtck && (ReadReg() & m_layout.rtck) == 0)
+            WaitRTCK(true);
     } 
     else
     {
-        reg = (*jtagreg);
-        reg &= ~BIT_STCK;
-        (*jtagreg) = reg;
-        while((*jtagreg) & BIT_STRTCK);
+        reg = ReadReg();
+        reg &= ~m_layout.tck;
+        WriteReg(reg);
+        if(m_layout.rtck && (ReadReg() & m_layout.rtck))
+            WaitRTCK(false);
     }
 }
 
-void SetTDI(bool tdi)
+inline void SprdMmioDJtagInterface::SetTDI(bool tdi)
 {
     uint32_t reg;
 
-    reg = (*jtagreg);
-    reg &= ~BIT_STDI;
-    reg |= (tdi ? BIT_STDI : 0);
-    (*jtagreg) = reg;
+    reg = ReadReg();
+    reg &= ~m_layout.tdi;
+    reg |= (tdi ? m_layout.tdi : 0);
+    WriteReg(reg);
 }
 
-void SetTMS(bool tms)
+inline void SprdMmioDJtagInterface::SetTMS(bool tms)
 {
     uint32_t reg;
 
-    reg = (*jtagreg);
-    reg &= ~BIT_STMS;
-    reg |= (tms ? BIT_STMS : 0);
-    (*jtagreg) = reg;
+    reg = ReadReg();
+    reg &= ~m_layout.tms;
+    reg |= (tms ? m_layout.tms : 0);
+    WriteReg(reg);
 }
 
-bool GetTDO()
+inline bool SprdMmioDJtagInterface::GetTDO()
 {
-    uint32_t reg;
-
-    return ((*jtagreg) & BIT_STDO ? true : false);
+    return (ReadReg() & m_layout.tdo ? true : false);
 }
 
-SprdMmioDJtagInterface::SprdMmioDJtagInterface()
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/*
+ * Maps the control block of the given SoC profile (by default the one SprdJtagProfileRegistry::Detect() finds) and
+ * enables it. Each interface has its own mapping and state, so several control blocks can be driven at once, each
+ * from its own thread (or asynchronous worker). Two interfaces must not share a block.
+ */
+SprdMmioDJtagInterface::SprdMmioDJtagInterface(const SprdJtagProfileEntry& profile)
+    : m_profile(&profile)
+    , m_layout(profile.layout)
+    , m_kernels(&profile.mmio)
 {
 	void *virt_addr;
 
-	virt_addr = devm_map(REG_AHB_DSP_JTAG_CTRL, 4);
+	virt_addr = devm_map(m_layout.address, 4);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		exit(0);
 	}
-    jtagreg = (uint32_t *)virt_addr;
-	
-    SetEnableMmioDJtag(true);
+    m_reg = (uint32_t *)virt_addr;
+    m_regModel = NULL;
+    Init();
+}
+
+/*
+ * Drives a software model of the control register instead of the hardware, so the bit-banging code can be run
+ * and benchmarked on any host. The model must outlive the interface, and implements the SC8810 layout; other
+ * profiles only make sense against it if they move nothing but the address (or drop RTCK).
+ */
+SprdMmioDJtagInterface::SprdMmioDJtagInterface(SprdJtagRegisterModel* model, const SprdJtagProfileEntry& profile)
+    : m_profile(&profile)
+    , m_layout(profile.layout)
+    , m_kernels(&profile.model)
+{
+    m_reg = NULL;
+    m_regModel = model;
+    Init();
+}
+
+/*
+ * Common part of the constructors, once the register is accessible
+ */
+void SprdMmioDJtagInterface::Init()
+{
+    m_rtckWait = &m_perfRtckWait;
+    m_rtckSpin = SPRD_RTCK_MIN_SPIN_NS;
+    m_rtckTimeout = SPRD_RTCK_MIN_TIMEOUT_NS;
+    m_rtckStalled = false;
+    m_monitorLink = true;
+    m_rtckSample = SPRD_RTCK_SAMPLE_INTERVAL;
+
+    SetEnable(true);
+    TryCharacterize();
 }
 
 SprdMmioDJtagInterface::~SprdMmioDJtagInterface()
 {
-    SetEnableMmioDJtag(false);
-    if(jtagreg)
-    {
-        devm_unmap(jtagreg, 4);
-    }
+    ShutdownAsync();
+    SetEnable(false);
+    if(m_reg)
+        devm_unmap((void*)m_reg, 4);
 }
 
 string SprdMmioDJtagInterface::GetName()
@@ -113,61 +220,288 @@ string SprdMmioDJtagInterface::GetUserID()
 	return "";
 }
 
+/*
+ * Effective TCK frequency measured by Characterize(), following DSP clock changes seen since. 0 if the link couldn't
+ * be characterized.
+ */
 int SprdMmioDJtagInterface::GetFrequency()
 {
-	return 0;
+	return static_cast<int>(m_frequency);
 }
 
-void SprdMmioDJtagInterface::ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Link characterization
+
+SprdLinkStats::SprdLinkStats()
+    : frequency(0)
+    , jitter_ns(0)
+    , spin_ns(SPRD_RTCK_MIN_SPIN_NS)
+    , timeout_ns(SPRD_RTCK_MIN_TIMEOUT_NS)
 {
-    int i;
+}
 
-	bool want_read = true;
-	if(rcv_data == NULL)
-		want_read = false;
+void SprdLinkStats::Print(FILE* fp) const
+{
+    fprintf(fp, "TCK frequency:      %.3f MHz\n", frequency * 1e-6);
+    fprintf(fp, "TCK jitter:         %.1f ns\n", jitter_ns);
+    fprintf(fp, "RTCK spin:          %" PRIu64 " ns\n", spin_ns);
+    fprintf(fp, "RTCK timeout:       %" PRIu64 " ns\n", timeout_ns);
 
-	//Purge the output data with zeros (in case we arent receving an integer number of bytes)
-	if(want_read)
-	{
-		int bytecount = ceil(count/8.0f);
-		memset(rcv_data, 0, bytecount);
-	}
+    const char* names[] = { "MMIO read", "MMIO write", "RTCK echo", "TCK period" };
+    const JtagLatencyHistogram* hists[] = { &read, &write, &rtck, &period };
+    fprintf(fp, "%-12s %12s %12s %12s %12s %12s\n", "latency (ns)", "count", "mean", "p50", "p99", "max");
+    for(int i=0; i<4; i++)
+    {
+        const JtagLatencyHistogram& h = *hists[i];
+        fprintf(fp, "%-12s %12" PRIu64 " %12.0f %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+            names[i], h.GetCount(), h.GetMean(), h.GetPercentile(50), h.GetPercentile(99), h.GetMax());
+    }
+}
 
-    SetTMS(false);
+/*
+ * Measures the timing of the link: individual control register reads and writes, the RTCK echo of each TCK edge,
+ * and whole ShiftData() bits. From these come the effective TCK frequency and its jitter (GetFrequency(),
+ * GetLinkStats()), the baseline echo latency the clock change detection compares against, and the RTCK wait policy.
+ *
+ * Only clocks TCK with TMS and TDI low, which between scans leaves the TAP in Run-Test/Idle (or moves it there from
+ * Test-Logic-Reset). Throws if RTCK doesn't follow TCK.
+ */
+void SprdMmioDJtagInterface::Characterize(size_t samples)
+{
+    SprdLinkStats stats;
+
+    //Our own waits aren't the target's, and sampled echoes need a baseline to compare against
+    JtagLatencyHistogram *wait = m_rtckWait;
+    bool monitor = m_monitorLink;
+    m_rtckWait = NULL;
+    m_monitorLink = false;
+    m_rtckSpin = stats.spin_ns;
+    m_rtckTimeout = stats.timeout_ns;
 
-    for(i = 0; i < count; i++)
+    try
     {
-        if(i == count - 1)
+        //Cost of the timestamps themselves, taken off the register access times
+        uint64_t overhead = UINT64_MAX;
+        for(size_t i = 0; i < samples; i++)
         {
-            SetTMS(last_tms);
+            uint64_t start = JtagCycleClock::Now();
+            uint64_t ns = JtagCycleClock::ToNs(JtagCycleClock::Now() - start);
+            if(ns < overhead)
+                overhead = ns;
         }
-        if(want_read)
+
+        SetTMS(false);
+        SetTDI(false);
+        uint32_t reg = ReadReg() & ~(m_layout.tck | m_layout.tdo | m_layout.rtck);
+
+        double sum = 0;
+        double sumsq = 0;
+        for(size_t i = 0; i < samples; i++)
         {
-            PokeBit(rcv_data, i, GetTDO());
+            uint64_t start = JtagCycleClock::Now();
+            ReadReg();
+            uint64_t ns = JtagCycleClock::ToNs(JtagCycleClock::Now() - start);
+            stats.read.Record( (ns > overhead) ? (ns - overhead) : 0 );
+
+            start = JtagCycleClock::Now();
+            WriteReg(reg);
+            ns = JtagCycleClock::ToNs(JtagCycleClock::Now() - start);
+            stats.write.Record( (ns > overhead) ? (ns - overhead) : 0 );
+
+            //Timed the same way SampleRTCK() does, so the baseline compares like with like
+            stats.rtck.Record(TimeRTCK(reg | m_layout.tck));
+            stats.rtck.Record(TimeRTCK(reg));
+
+            //One bit exactly as ShiftData() clocks it
+            start = JtagCycleClock::Now();
+            GetTDO();
+            SetTDI(false);
+            SetTCK(true);
+            SetTCK(false);
+            ns = JtagCycleClock::ToNs(JtagCycleClock::Now() - start);
+            stats.period.Record(ns);
+            sum += ns;
+            sumsq += static_cast<double>(ns) * ns;
+
+            if(m_rtckStalled)
+            {
+                m_rtckStalled = false;
+                throw JtagExceptionWrapper(
+                    "RTCK did not follow TCK (is the DSP clocked?)",
+                    "");
+            }
         }
-        SetTDI(PeekBit(send_data, i));
-        SetTCK(true);
-        SetTCK(false);
+
+        double mean = sum / samples;
+        stats.frequency = 1e9 / mean;
+        double var = sumsq / samples - mean * mean;
+        stats.jitter_ns = (var > 0) ? sqrt(var) : 0;
+
+        //Spin through a few of the slowest normal echoes, but allow a DSP far slower than now before giving up
+        uint64_t p99 = stats.rtck.GetPercentile(99);
+        if(8 * p99 > stats.spin_ns)
+            stats.spin_ns = 8 * p99;
+        if(10000 * p99 > stats.timeout_ns)
+            stats.timeout_ns = 10000 * p99;
+    }
+    catch(const JtagException&)
+    {
+        m_rtckWait = wait;
+        m_monitorLink = monitor;
+        throw;
     }
+
+    m_rtckWait = wait;
+    m_monitorLink = monitor;
+    m_rtckSpin = stats.spin_ns;
+    m_rtckTimeout = stats.timeout_ns;
+    m_rtckSample = SPRD_RTCK_SAMPLE_INTERVAL;
+
+    m_link = stats;
+    m_frequency = stats.frequency;
+    m_rtckBaseline = stats.rtck.GetPercentile(50);
+    m_driftSamples = 0;
+    m_driftSum = 0;
+    m_clockChanges = 0;
+
+    LogVerbose("Link: TCK %.3f MHz, jitter %.1f ns, RTCK echo %" PRIu64 " ns (p99 %" PRIu64 " ns)\n",
+        stats.frequency * 1e-6, stats.jitter_ns, stats.rtck.GetPercentile(50), stats.rtck.GetPercentile(99));
+}
+
+/*
+ * Characterizes the link as the interface is opened. A DSP that isn't clocked yet mustn't stop the interface being
+ * opened, so this only warns; GetFrequency() reports 0 until Characterize() succeeds.
+ */
+void SprdMmioDJtagInterface::TryCharacterize()
+{
+    m_frequency = 0;
+    m_rtckBaseline = 0;
+    m_driftSamples = 0;
+    m_driftSum = 0;
+    m_clockChanges = 0;
+
+    try
+    {
+        Characterize();
+    }
+    catch(const JtagException&)
+    {
+        LogWarning("Couldn't characterize the link: RTCK doesn't follow TCK (is the DSP clocked?)\n");
+    }
+}
+
+/*
+ * Takes one RTCK echo latency, sampled every SPRD_RTCK_SAMPLE_INTERVAL rising edges while clocking. A run of
+ * SPRD_RTCK_DRIFT_SAMPLES well away from the baseline, all on the same side, means the DSP clock has changed (DVFS):
+ * the run's mean becomes the new baseline, the frequency estimate moves by the change in the two echoes of each TCK
+ * cycle, and the RTCK wait policy scales with the echo.
+ */
+void SprdMmioDJtagInterface::RecordRtckEcho(uint64_t ns)
+{
+    if(m_frequency <= 0)
+        return;
+
+    double base = (m_rtckBaseline > 1) ? m_rtckBaseline : 1;
+    bool slower = (ns > base * SPRD_RTCK_DRIFT_RATIO) && (ns > base + SPRD_RTCK_DRIFT_MIN_NS);
+    bool faster = (ns * SPRD_RTCK_DRIFT_RATIO < base) && (ns + SPRD_RTCK_DRIFT_MIN_NS < base);
+    bool wasSlower = m_driftSum > m_driftSamples * base;
+    if( (!slower && !faster) || (m_driftSamples && (slower != wasSlower)) )
+    {
+        m_driftSamples = 0;
+        m_driftSum = 0;
+        if(!slower && !faster)
+            return;
+    }
+
+    m_driftSum += ns;
+    if(++m_driftSamples < SPRD_RTCK_DRIFT_SAMPLES)
+        return;
+
+    double echo = m_driftSum / m_driftSamples;
+    double period = 1e9 / m_frequency + 2 * (echo - m_rtckBaseline);
+    if(period > 0)
+        m_frequency = 1e9 / period;
+
+    double scale = echo / base;
+    m_rtckSpin = static_cast<uint64_t>(m_rtckSpin * scale);
+    if(m_rtckSpin < SPRD_RTCK_MIN_SPIN_NS)
+        m_rtckSpin = SPRD_RTCK_MIN_SPIN_NS;
+    m_rtckTimeout = static_cast<uint64_t>(m_rtckTimeout * scale);
+    if(m_rtckTimeout < SPRD_RTCK_MIN_TIMEOUT_NS)
+        m_rtckTimeout = SPRD_RTCK_MIN_TIMEOUT_NS;
+
+    JTAG_PROBE2(rtck_drift, static_cast<uint64_t>(m_rtckBaseline), static_cast<uint64_t>(echo));
+    LogVerbose("DSP clock change: RTCK echo %.0f ns -> %.0f ns, TCK now %.3f MHz\n",
+        m_rtckBaseline, echo, m_frequency * 1e-6);
+
+    m_rtckBaseline = echo;
+    m_clockChanges ++;
+    m_driftSamples = 0;
+    m_driftSum = 0;
+}
+
+/*
+ * Reports the RTCK timeout that stopped the operation just clocked
+ */
+void SprdMmioDJtagInterface::ReportRtckStall()
+{
+    m_rtckStalled = false;
+    ReportError(JtagStatusWrapper(
+        JTAG_STATUS_RTCK_TIMEOUT,
+        "RTCK did not follow TCK (is the DSP clocked?)",
+        NULL,
+        0));
+}
+
+void SprdMmioDJtagInterface::ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+{
+    if(Failed())
+        return;
+    JTAG_PROBE2(shift_data_start, count, last_tms);
+    LogTrace("ShiftData: %zu bits, last TMS %d\n", count, last_tms);
+    JtagTimelineSpan span("ShiftData", "bits", count);
+    JtagScopedTimer timer(m_perfShiftTime, &m_perfShiftDataLatency);
+    CountShiftData(count);
+
+    m_kernels->shift_data(this, last_tms, send_data, rcv_data, count);
+    if(m_rtckStalled)
+        ReportRtckStall();
+
+    JTAG_PROBE2(shift_data_done, count, timer.Stop());
 }
 
 void SprdMmioDJtagInterface::SendDummyClocks(size_t n)
 {
-    throw JtagExceptionWrapper(
-        "SendDummyClocks unimplemented.\n",
-        "");
+    if(Failed())
+        return;
+    JtagTimelineSpan span("SendDummyClocks", "clocks", n);
+    JtagScopedTimer timer(m_perfShiftTime);
+    CountDummyClocks(n);
+
+    m_kernels->dummy_clocks(this, n);
+    if(m_rtckStalled)
+        ReportRtckStall();
+
+    JTAG_PROBE2(dummy_clocks, n, timer.Stop());
+}
+
+bool SprdMmioDJtagInterface::ReadTDO()
+{
+    return GetTDO();
 }
 
 void SprdMmioDJtagInterface::ShiftTMS(bool tdi, const unsigned char* send_data, size_t count)
 {
-    int i;
+    if(Failed())
+        return;
+    LogTrace("ShiftTMS: %zu bits\n", count);
+    JtagTimelineSpan span("ShiftTMS", "bits", count);
+    JtagScopedTimer timer(m_perfShiftTime, &m_perfShiftTMSLatency);
+    CountShiftTMS(count);
 
-    SetTDI(tdi);
+    m_kernels->shift_tms(this, tdi, send_data, count);
+    if(m_rtckStalled)
+        ReportRtckStall();
 
-    for(i = 0; i < count; i++)
-    {
-        SetTMS(PeekBit(send_data, i));
-        SetTCK(true);
-        SetTCK(false);
-    }
+    JTAG_PROBE2(shift_tms, count, timer.Stop());
 }
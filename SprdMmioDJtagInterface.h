@@ -1,10 +1,70 @@
 #ifndef SprdMmioDJtagInterface_h
 #define SprdMmioDJtagInterface_h
 
+///@brief Samples of each measurement taken by Characterize()
+#define SPRD_LINK_SAMPLES           256
+
+///@brief TCK rising edges between the RTCK echo samples that watch for DSP clock changes
+#define SPRD_RTCK_SAMPLE_INTERVAL   4096
+
+///@brief Consecutive drifted echo samples before a DSP clock change is reported
+#define SPRD_RTCK_DRIFT_SAMPLES     4
+
+///@brief How far (as a ratio, either way) an echo sample must be from the baseline to count as drifted
+#define SPRD_RTCK_DRIFT_RATIO       1.5
+
+///@brief ...and by at least this many ns, so noise on a fast echo isn't mistaken for a clock change
+#define SPRD_RTCK_DRIFT_MIN_NS      50
+
+///@brief Shortest time to spin polling STRTCK before yielding the CPU between polls
+#define SPRD_RTCK_MIN_SPIN_NS       2000ULL
+
+///@brief Shortest time to wait for STRTCK before deciding the DSP isn't clocked
+#define SPRD_RTCK_MIN_TIMEOUT_NS    100000000ULL
+
+class SprdJtagRegisterModel;
+
+/**
+	@brief Timing of the MMIO JTAG link, measured by SprdMmioDJtagInterface::Characterize()
+ */
+struct SprdLinkStats
+{
+	SprdLinkStats();
+
+	///@brief Latency of one control register read, in ns
+	JtagLatencyHistogram read;
+
+	///@brief Latency of one control register write, in ns
+	JtagLatencyHistogram write;
+
+	///@brief Time from writing a TCK edge until STRTCK follows it, in ns
+	JtagLatencyHistogram rtck;
+
+	///@brief Duration of one ShiftData() bit (TDO read, TDI write and both TCK edges), in ns
+	JtagLatencyHistogram period;
+
+	///@brief Effective TCK frequency while shifting data, in Hz
+	double frequency;
+
+	///@brief Standard deviation of the TCK period, in ns
+	double jitter_ns;
+
+	///@brief How long WaitRTCK() spins before it starts yielding the CPU, in ns
+	uint64_t spin_ns;
+
+	///@brief How long WaitRTCK() waits before giving up on the DSP, in ns
+	uint64_t timeout_ns;
+
+	void Print(FILE* fp) const;
+};
+
 class SprdMmioDJtagInterface : public JtagInterface
 {
 public:
-	SprdMmioDJtagInterface();
+	SprdMmioDJtagInterface(const SprdJtagProfileEntry& profile = SprdJtagProfileRegistry::Detect());
+	SprdMmioDJtagInterface(
+		SprdJtagRegisterModel* model,
+		const SprdJtagProfileEntry& profile = SprdJtagProfileRegistry::GetDefault());
 	virtual ~SprdMmioDJtagInterface();
 
 	//shims that just push stuff up to base class
@@ -13,9 +73,34 @@ public:
 	virtual std::string GetUserID();
 	virtual int GetFrequency();
 
+	//Link characterization
+	void Characterize(size_t samples = SPRD_LINK_SAMPLES);
+	void RecordRtckEcho(uint64_t ns);
+
+	///@brief Returns the link timing measured by the last Characterize()
+	const SprdLinkStats& GetLinkStats()
+	{ return m_link; }
+
+	///@brief Returns the number of DSP clock changes seen since the last Characterize()
+	size_t GetClockChangeCount()
+	{ return m_clockChanges; }
+
+	///@brief Returns the SoC profile being driven
+	const SprdJtagProfileEntry& GetProfile()
+	{ return *m_profile; }
+
+	///@brief Returns the layout of the control block being driven
+	const SprdJtagRegisterLayout& GetLayout()
+	{ return m_layout; }
+
+	///@brief Returns the mapped control register, or NULL when driving a SprdJtagRegisterModel
+	volatile uint32_t* GetRegister()
+	{ return m_reg; }
+
 	//Low-level JTAG interface
 	virtual void ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
 	virtual void SendDummyClocks(size_t n);
+	virtual bool ReadTDO();
 //	virtual void SendDummyClocksDeferred(size_t n);
 //	virtual void Commit();
 //	virtual bool IsSplitScanSupported();
@@ -24,7 +109,78 @@ public:
 
 	//Explicit TMS shifting is no longer allowed, only state-level interface
 private:
+	template<class Profile, class Access> friend class SprdShiftKernel;
+	friend struct SprdMmioAccess;
+	friend struct SprdModelAccess;
+
 	virtual void ShiftTMS(bool tdi, const unsigned char* send_data, size_t count);
+
+	void Init();
+	void TryCharacterize();
+	void ReportRtckStall();
+
+	//Bit-banging
+	uint32_t ReadReg();
+	void WriteReg(uint32_t reg);
+	void SetEnable(bool en);
+	void SetTCK(bool tck);
+	void SetTDI(bool tdi);
+	void SetTMS(bool tms);
+	bool GetTDO();
+	void WaitRTCK(bool level);
+	uint64_t TimeRTCK(uint32_t reg);
+	void SampleRTCK(uint32_t reg);
+
+	///@brief The SoC profile being driven
+	const SprdJtagProfileEntry* m_profile;
+
+	///@brief Which bits do what, for the slow paths
+	SprdJtagRegisterLayout m_layout;
+
+	///@brief The shift loops specialized for m_profile, and for the register or the model
+	const SprdShiftKernels* m_kernels;
+
+	///@brief The mapped control register, or NULL when driving m_regModel
+	volatile uint32_t* m_reg;
+
+	///@brief Register model standing in for the hardware, if any
+	SprdJtagRegisterModel* m_regModel;
+
+	///@brief Where RTCK waits are recorded (NULL while characterizing, when they aren't the target's)
+	JtagLatencyHistogram* m_rtckWait;
+
+	///@brief How long WaitRTCK() spins before it yields the CPU between polls, in ns (tuned by Characterize())
+	uint64_t m_rtckSpin;
+
+	///@brief How long WaitRTCK() waits before giving up on the DSP, in ns
+	uint64_t m_rtckTimeout;
+
+	///@brief Set when a wait times out, until ReportRtckStall(). RTCK isn't waited on again in the meantime.
+	bool m_rtckStalled;
+
+	///@brief True if sampled RTCK echoes are checked for DSP clock changes (not while characterizing)
+	bool m_monitorLink;
+
+	///@brief TCK rising edges until the next RTCK echo sample
+	unsigned int m_rtckSample;
+
+	///@brief Link timing from the last Characterize()
+	SprdLinkStats m_link;
+
+	///@brief Current TCK frequency estimate, in Hz: m_link.frequency adjusted for clock changes since
+	double m_frequency;
+
+	///@brief Median RTCK echo latency at the current DSP clock, in ns
+	double m_rtckBaseline;
+
+	///@brief Consecutive echo samples that have drifted from m_rtckBaseline
+	size_t m_driftSamples;
+
+	///@brief Sum of those samples, in ns
+	double m_driftSum;
+
+	///@brief DSP clock changes seen since the last Characterize()
+	size_t m_clockChanges;
 /*
 protected:
 
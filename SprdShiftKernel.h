@@ -0,0 +1,172 @@
+/**
+	@file
+	@brief Declaration of SprdShiftKernel
+ */
+
+#ifndef SprdShiftKernel_h
+#define SprdShiftKernel_h
+
+/**
+	@brief Register access for SprdShiftKernel: the mapped hardware register
+ */
+struct SprdMmioAccess
+{
+	static uint32_t Read(SprdMmioDJtagInterface* iface)
+	{ return *iface->m_reg; }
+
+	static void Write(SprdMmioDJtagInterface* iface, uint32_t value)
+	{ *iface->m_reg = value; }
+};
+
+/**
+	@brief Register access for SprdShiftKernel: a SprdJtagRegisterModel standing in for it
+ */
+struct SprdModelAccess
+{
+	static uint32_t Read(SprdMmioDJtagInterface* iface)
+	{ return iface->m_regModel->Read(); }
+
+	static void Write(SprdMmioDJtagInterface* iface, uint32_t value)
+	{ iface->m_regModel->Write(value); }
+};
+
+/**
+	@brief The bit-banging loops of SprdMmioDJtagInterface, for one SprdJtagProfile and one way of reaching the
+	register
+
+	Each bit is the same read-modify-write sequence as ever, but with the profile's masks as constants and no test of
+	which register is being driven. Waiting for RTCK (and the periodic echo sample that watches for DSP clock changes)
+	stays out of line, and is compiled out for profiles without RTCK.
+
+	@tparam Profile		A SprdJtagProfile
+	@tparam Access		SprdMmioAccess or SprdModelAccess
+ */
+template<class Profile, class Access>
+class SprdShiftKernel
+{
+public:
+
+	///@brief Returns the kernels, for SprdJtagProfileEntry
+	static SprdShiftKernels GetKernels()
+	{
+		SprdShiftKernels kernels;
+		kernels.shift_data = &ShiftData;
+		kernels.shift_tms = &ShiftTMS;
+		kernels.dummy_clocks = &DummyClocks;
+		return kernels;
+	}
+
+	///@brief The loop of SprdMmioDJtagInterface::ShiftData()
+	static void ShiftData(
+		SprdMmioDJtagInterface* iface,
+		bool last_tms,
+		const unsigned char* send_data,
+		unsigned char* rcv_data,
+		size_t count)
+	{
+		//Purge the output data with zeros (in case we arent receving an integer number of bytes)
+		bool want_read = (rcv_data != NULL);
+		if(want_read)
+			memset(rcv_data, 0, (count + 7) / 8);
+
+		SetTMS(iface, false);
+
+		for(size_t i = 0; i < count; i++)
+		{
+			if(i == count - 1)
+				SetTMS(iface, last_tms);
+			if(want_read)
+				PokeBit(rcv_data, i, GetTDO(iface));
+			SetTDI(iface, PeekBit(send_data, i));
+			SetTCK(iface, true);
+			SetTCK(iface, false);
+		}
+	}
+
+	///@brief The loop of SprdMmioDJtagInterface::ShiftTMS()
+	static void ShiftTMS(SprdMmioDJtagInterface* iface, bool tdi, const unsigned char* send_data, size_t count)
+	{
+		SetTDI(iface, tdi);
+
+		for(size_t i = 0; i < count; i++)
+		{
+			SetTMS(iface, PeekBit(send_data, i));
+			SetTCK(iface, true);
+			SetTCK(iface, false);
+		}
+	}
+
+	///@brief The loop of SprdMmioDJtagInterface::SendDummyClocks()
+	static void DummyClocks(SprdMmioDJtagInterface* iface, size_t n)
+	{
+		SetTMS(iface, false);
+
+		for(size_t i = 0; i < n; i++)
+		{
+			SetTCK(iface, true);
+			SetTCK(iface, false);
+		}
+	}
+
+protected:
+
+	static void SetTCK(SprdMmioDJtagInterface* iface, bool tck)
+	{
+		uint32_t reg;
+
+		if(tck)
+		{
+			reg = Access::Read(iface) | Profile::tck;
+			if(Profile::has_rtck && __builtin_expect(--iface->m_rtckSample == 0, 0))
+			{
+				iface->SampleRTCK(reg);
+				return;
+			}
+			Access::Write(iface, reg);
+			if(Profile::has_rtck && !(Access::Read(iface) & Profile::rtck))
+				iface->WaitRTCK(true);
+		}
+		else
+		{
+			reg = Access::Read(iface) & ~Profile::tck;
+			Access::Write(iface, reg);
+			if(Profile::has_rtck && (Access::Read(iface) & Profile::rtck))
+				iface->WaitRTCK(false);
+		}
+	}
+
+	static void SetTDI(SprdMmioDJtagInterface* iface, bool tdi)
+	{
+		uint32_t reg = Access::Read(iface) & ~Profile::tdi;
+		Access::Write(iface, reg | (tdi ? Profile::tdi : 0));
+	}
+
+	static void SetTMS(SprdMmioDJtagInterface* iface, bool tms)
+	{
+		uint32_t reg = Access::Read(iface) & ~Profile::tms;
+		Access::Write(iface, reg | (tms ? Profile::tms : 0));
+	}
+
+	static bool GetTDO(SprdMmioDJtagInterface* iface)
+	{ return (Access::Read(iface) & Profile::tdo) != 0; }
+};
+
+/**
+	@brief Creates the registry entry for a profile, instantiating its kernels
+
+	@param id			SoC ID
+	@param description	Which block this is, for people
+ */
+template<class Profile>
+SprdJtagProfileEntry SprdJtagProfileEntry::Make(const char* id, const char* description)
+{
+	SprdJtagProfileEntry entry;
+	entry.id = id;
+	entry.description = description;
+	entry.layout = Profile::GetLayout();
+	entry.mmio = SprdShiftKernel<Profile, SprdMmioAccess>::GetKernels();
+	entry.model = SprdShiftKernel<Profile, SprdModelAccess>::GetKernels();
+	return entry;
+}
+
+#endif
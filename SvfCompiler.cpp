@@ -0,0 +1,238 @@
+/**
+	@file
+	@brief Implementation of SvfCompiler
+ */
+
+#include "jtaghal.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+SvfCompiler::SvfCompiler()
+	: SvfPlayer(NULL)
+	, m_out(NULL)
+	, m_tmsCount(0)
+	, m_outputSize(0)
+{
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+SvfCompiler::~SvfCompiler()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Compilation
+
+/**
+	@brief Compiles an SVF file
+
+	@param svf_path		The SVF file
+	@param out_path		The vector file to write. Removed again if compilation fails.
+
+	@throw JtagException if the SVF file doesn't parse or the output can't be written
+ */
+void SvfCompiler::Compile(const string& svf_path, const string& out_path)
+{
+	m_out = fopen(out_path.c_str(), "wb");
+	if(!m_out)
+	{
+		throw JtagExceptionWrapper(
+			string("Failed to create ") + out_path,
+			"");
+	}
+	setvbuf(m_out, NULL, _IOFBF, 1024 * 1024);
+
+	memset(&m_header, 0, sizeof(m_header));
+	m_header.magic = JVEC_MAGIC;
+	m_header.version = JVEC_VERSION;
+	m_tms.clear();
+	m_tmsCount = 0;
+
+	try
+	{
+		Write(&m_header, sizeof(m_header));
+		Play(svf_path);
+
+		//Now that the totals are known
+		m_header.scan_bits = GetScanBits();
+		m_header.compared_bits = GetComparedBits();
+		m_outputSize = ftell(m_out);
+		if( (fseek(m_out, 0, SEEK_SET) != 0) || (fwrite(&m_header, sizeof(m_header), 1, m_out) != 1) )
+		{
+			throw JtagExceptionWrapper(
+				string("Failed to write ") + out_path,
+				"");
+		}
+	}
+	catch(const JtagException& ex)
+	{
+		fclose(m_out);
+		m_out = NULL;
+		unlink(out_path.c_str());
+		throw;
+	}
+
+	int err = fclose(m_out);
+	m_out = NULL;
+	if(err != 0)
+	{
+		unlink(out_path.c_str());
+		throw JtagExceptionWrapper(
+			string("Failed to write ") + out_path,
+			"");
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Output
+
+void SvfCompiler::BeginOutput()
+{
+}
+
+void SvfCompiler::EndOutput()
+{
+	FlushTMS();
+	uint8_t op = JVEC_OP_END;
+	Write(&op, 1);
+}
+
+/**
+	@brief Queues TMS bits, to be written along with any that directly follow
+ */
+void SvfCompiler::EmitTMS(const unsigned char* bits, size_t count)
+{
+	for(size_t i=0; i<count; i++)
+	{
+		if(m_tmsCount / 8 >= m_tms.size())
+			m_tms.push_back(0);
+		PokeBit(&m_tms[0], m_tmsCount, PeekBit(bits, i));
+		m_tmsCount ++;
+	}
+}
+
+/**
+	@brief Writes a scan record for the chunk in m_tdiChunk (and m_expectChunk / m_maskChunk)
+
+	@return Always SVF_NO_MISMATCH, checking is up to the player
+ */
+size_t SvfCompiler::EmitScan(bool last, size_t count, bool compare, bool has_mask)
+{
+	FlushTMS();
+
+	uint8_t op = JVEC_OP_SCAN;
+	uint8_t flags = (last ? JVEC_SCAN_LAST : 0) | (compare ? JVEC_SCAN_COMPARE : 0) |
+		( (compare && has_mask) ? JVEC_SCAN_MASK : 0);
+	uint32_t line = m_line;
+	uint32_t bits = count;
+	Write(&op, 1);
+	Write(&flags, 1);
+	Write(&line, 4);
+	Write(&bits, 4);
+
+	WriteVector(m_tdiChunk, count);
+	if(compare)
+		WriteVector(m_expectChunk, count);
+	if(flags & JVEC_SCAN_MASK)
+		WriteVector(m_maskChunk, count);
+
+	m_header.records ++;
+	return SVF_NO_MISMATCH;
+}
+
+/**
+	@brief Writes a RUNTEST record
+ */
+void SvfCompiler::EmitRun(bool tms, uint64_t clocks, double min_time)
+{
+	FlushTMS();
+
+	uint8_t op = JVEC_OP_RUN;
+	uint8_t level = tms ? 1 : 0;
+	uint64_t ns = static_cast<uint64_t>(ceil(min_time * 1e9));
+	Write(&op, 1);
+	Write(&level, 1);
+	Write(&clocks, 8);
+	Write(&ns, 8);
+	m_header.records ++;
+}
+
+/**
+	@brief Writes the queued TMS bits, if any, as one record
+ */
+void SvfCompiler::FlushTMS()
+{
+	if(!m_tmsCount)
+		return;
+
+	uint8_t op = JVEC_OP_TMS;
+	uint32_t count = m_tmsCount;
+	Write(&op, 1);
+	Write(&count, 4);
+	Write(&m_tms[0], (m_tmsCount + 7) / 8);
+	m_header.records ++;
+
+	m_tms.clear();
+	m_tmsCount = 0;
+}
+
+/**
+	@brief Writes a vector, run-length encoded if that's smaller
+
+	@param data		The bits, with the unused bits of the last byte zero
+	@param count	Number of bits
+ */
+void SvfCompiler::WriteVector(const unsigned char* data, size_t count)
+{
+	size_t nbytes = (count + 7) / 8;
+
+	size_t runs = 0;
+	for(size_t i=0; i<nbytes; runs++)
+	{
+		size_t j = i + 1;
+		while( (j < nbytes) && (data[j] == data[i]) )
+			j ++;
+		i = j;
+	}
+
+	if(2 + runs*3 >= nbytes)
+	{
+		uint8_t enc = JVEC_ENC_RAW;
+		Write(&enc, 1);
+		Write(data, nbytes);
+		return;
+	}
+
+	uint8_t enc = JVEC_ENC_RLE;
+	uint16_t nruns = runs;
+	Write(&enc, 1);
+	Write(&nruns, 2);
+	for(size_t i=0; i<nbytes; )
+	{
+		size_t j = i + 1;
+		while( (j < nbytes) && (data[j] == data[i]) )
+			j ++;
+		uint16_t len = j - i;
+		Write(&len, 2);
+		Write(&data[i], 1);
+		i = j;
+	}
+}
+
+/**
+	@brief Writes raw bytes to the output
+
+	@throw JtagException on a write error
+ */
+void SvfCompiler::Write(const void* data, size_t len)
+{
+	if(fwrite(data, 1, len, m_out) != len)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to write vector file",
+			"");
+	}
+}
@@ -0,0 +1,57 @@
+/**
+	@file
+	@brief Declaration of SvfCompiler
+ */
+
+#ifndef SvfCompiler_h
+#define SvfCompiler_h
+
+/**
+	@brief Compiles SVF files into binary vector files (see JtagVectorFormat.h) ahead of time
+
+	The compiler is an SvfPlayer whose output goes to a file instead of an adapter, so it accepts exactly what the
+	player does and produces exactly the same JTAG traffic. Everything the text player does per run is done once
+	here: parsing, hex decoding, TAP path search and sticky parameter handling. TDI, TDO and mask vectors are stored
+	packed, run-length encoded when that's smaller (long constant fills are the norm in SVF), and consecutive TMS
+	sequences are merged into single records.
+ */
+class SvfCompiler : public SvfPlayer
+{
+public:
+	SvfCompiler();
+	virtual ~SvfCompiler();
+
+	void Compile(const std::string& svf_path, const std::string& out_path);
+
+	///@brief Returns the size of the last output file, in bytes
+	uint64_t GetOutputSize()
+	{ return m_outputSize; }
+
+protected:
+	virtual void BeginOutput();
+	virtual void EndOutput();
+	virtual void EmitTMS(const unsigned char* bits, size_t count);
+	virtual size_t EmitScan(bool last, size_t count, bool compare, bool has_mask);
+	virtual void EmitRun(bool tms, uint64_t clocks, double min_time);
+
+	void FlushTMS();
+	void WriteVector(const unsigned char* data, size_t count);
+	void Write(const void* data, size_t len);
+
+	///@brief The output file
+	FILE* m_out;
+
+	///@brief TMS bits not written yet, so that consecutive sequences end up in one record
+	std::vector<unsigned char> m_tms;
+
+	///@brief Number of bits in m_tms
+	size_t m_tmsCount;
+
+	///@brief Header, filled in as records are written
+	JvecHeader m_header;
+
+	///@brief Size of the last output file
+	uint64_t m_outputSize;
+};
+
+#endif
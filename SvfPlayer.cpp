@@ -0,0 +1,765 @@
+/**
+	@file
+	@brief Implementation of SvfPlayer
+ */
+
+#include "jtaghal.h"
+#include <algorithm>
+#include <ctype.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+	@brief SVF names of the TAP states, indexed by JtagTapState
+ */
+static const char* const g_svfStateNames[16] =
+{
+	"RESET",
+	"IDLE",
+	"DRSELECT",
+	"DRCAPTURE",
+	"DRSHIFT",
+	"DREXIT1",
+	"DRPAUSE",
+	"DREXIT2",
+	"DRUPDATE",
+	"IRSELECT",
+	"IRCAPTURE",
+	"IRSHIFT",
+	"IREXIT1",
+	"IRPAUSE",
+	"IREXIT2",
+	"IRUPDATE"
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a player
+
+	@param iface	The adapter to play on. Must outlive the player.
+ */
+SvfPlayer::SvfPlayer(JtagInterface* iface)
+	: m_iface(iface)
+	, m_base(NULL)
+	, m_size(0)
+	, m_pos(NULL)
+	, m_end(NULL)
+	, m_released(NULL)
+	, m_line(0)
+	, m_state(SVF_STATE_UNKNOWN)
+	, m_commands(0)
+	, m_scanBits(0)
+	, m_comparedBits(0)
+{
+}
+
+SvfPlayer::~SvfPlayer()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Playback
+
+/**
+	@brief Plays a file from start to end
+
+	@throw JtagException if the file can't be read, doesn't parse, or a TDO check fails
+ */
+void SvfPlayer::Play(const string& path)
+{
+	m_path = path;
+	m_line = 1;
+	m_commands = 0;
+	m_scanBits = 0;
+	m_comparedBits = 0;
+
+	//SVF defaults
+	m_state = SVF_STATE_UNKNOWN;
+	m_endIR = TAP_RUN_TEST_IDLE;
+	m_endDR = TAP_RUN_TEST_IDLE;
+	m_runState = TAP_RUN_TEST_IDLE;
+	m_runEndState = TAP_RUN_TEST_IDLE;
+	SvfScanParams* params[6] = {&m_hir, &m_sir, &m_tir, &m_hdr, &m_sdr, &m_tdr};
+	for(int i=0; i<6; i++)
+		memset(params[i], 0, sizeof(SvfScanParams));
+
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if( (fd < 0) || (fstat(fd, &st) != 0) )
+	{
+		if(fd >= 0)
+			close(fd);
+		throw JtagExceptionWrapper(
+			string("Failed to open ") + path,
+			"");
+	}
+	m_size = st.st_size;
+	if(m_size == 0)
+	{
+		close(fd);
+		return;
+	}
+	void* base = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+	{
+		throw JtagExceptionWrapper(
+			string("Failed to map ") + path,
+			"");
+	}
+	madvise(base, m_size, MADV_SEQUENTIAL);
+
+	m_base = static_cast<const char*>(base);
+	m_pos = m_base;
+	m_end = m_base + m_size;
+	m_released = m_base;
+
+	BeginOutput();
+	try
+	{
+		while(true)
+		{
+			Token cmd = NextToken();
+			if(cmd.type == TOKEN_EOF)
+				break;
+			if(cmd.type != TOKEN_WORD)
+				Fail("Expected a command");
+			Execute(cmd);
+			m_commands ++;
+
+			//Drop what we've parsed, so playing a huge file doesn't slowly fill memory with its pages. Sticky hex
+			//fields may still point back into the released range; those pages just fault back in from the file.
+			if(static_cast<size_t>(m_pos - m_released) >= SVF_RELEASE_INTERVAL)
+			{
+				size_t page = sysconf(_SC_PAGESIZE);
+				const char* upto = m_base + ( (m_pos - m_base) / page) * page;
+				madvise(const_cast<char*>(m_released), upto - m_released, MADV_DONTNEED);
+				m_released = upto;
+			}
+		}
+		EndOutput();
+	}
+	catch(const JtagException& ex)
+	{
+		munmap(const_cast<char*>(m_base), m_size);
+		m_base = NULL;
+		throw;
+	}
+	munmap(const_cast<char*>(m_base), m_size);
+	m_base = NULL;
+}
+
+/**
+	@brief Executes one statement, given its first word
+ */
+void SvfPlayer::Execute(const Token& cmd)
+{
+	if(IsWord(cmd, "SIR"))
+	{
+		ParseScan(m_sir, true);
+		Scan(true);
+	}
+	else if(IsWord(cmd, "SDR"))
+	{
+		ParseScan(m_sdr, true);
+		Scan(false);
+	}
+	else if(IsWord(cmd, "HIR"))
+		ParseScan(m_hir, true);
+	else if(IsWord(cmd, "HDR"))
+		ParseScan(m_hdr, true);
+	else if(IsWord(cmd, "TIR"))
+		ParseScan(m_tir, true);
+	else if(IsWord(cmd, "TDR"))
+		ParseScan(m_tdr, true);
+
+	else if(IsWord(cmd, "ENDIR") || IsWord(cmd, "ENDDR"))
+	{
+		JtagTapState state = ParseState(NextToken());
+		if( (state != TAP_TEST_LOGIC_RESET) && (state != TAP_RUN_TEST_IDLE) &&
+			(state != TAP_PAUSE_DR) && (state != TAP_PAUSE_IR) )
+		{
+			Fail("End state must be stable");
+		}
+		if(IsWord(cmd, "ENDIR"))
+			m_endIR = state;
+		else
+			m_endDR = state;
+		ExpectEnd();
+	}
+
+	//Either a stable state, or an explicit path ending in one
+	else if(IsWord(cmd, "STATE"))
+	{
+		while(true)
+		{
+			Token tok = NextToken();
+			if(tok.type == TOKEN_END)
+				break;
+			GoTo(ParseState(tok));
+		}
+	}
+
+	else if(IsWord(cmd, "RUNTEST"))
+		RunTest();
+
+	//The SW-JTAG block has a fixed TCK and no TRST pin
+	else if(IsWord(cmd, "FREQUENCY") || IsWord(cmd, "TRST"))
+	{
+		while(true)
+		{
+			Token tok = NextToken();
+			if(tok.type == TOKEN_END)
+				break;
+			if(tok.type == TOKEN_EOF)
+				Fail("Missing ;");
+		}
+	}
+
+	else
+		Fail(string("Unsupported command ") + string(cmd.begin, cmd.end));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Parsing
+
+/**
+	@brief Reads the next token, skipping whitespace and comments
+
+	Hex fields are checked for bad characters here, but not decoded.
+ */
+SvfPlayer::Token SvfPlayer::NextToken()
+{
+	while(true)
+	{
+		while( (m_pos < m_end) && isspace(static_cast<unsigned char>(*m_pos)) )
+		{
+			if(*m_pos == '\n')
+				m_line ++;
+			m_pos ++;
+		}
+		if(m_pos >= m_end)
+			break;
+
+		//Comments run to the end of the line
+		if( (*m_pos == '!') || ( (*m_pos == '/') && (m_pos + 1 < m_end) && (m_pos[1] == '/') ) )
+		{
+			while( (m_pos < m_end) && (*m_pos != '\n') )
+				m_pos ++;
+			continue;
+		}
+		break;
+	}
+
+	Token tok;
+	tok.begin = m_pos;
+	tok.end = m_pos;
+	if(m_pos >= m_end)
+		tok.type = TOKEN_EOF;
+
+	else if(*m_pos == ';')
+	{
+		tok.type = TOKEN_END;
+		m_pos ++;
+	}
+
+	else if(*m_pos == '(')
+	{
+		tok.type = TOKEN_HEX;
+		m_pos ++;
+		tok.begin = m_pos;
+		while( (m_pos < m_end) && (*m_pos != ')') )
+		{
+			unsigned char c = *m_pos;
+			if(c == '\n')
+				m_line ++;
+			else if(!isxdigit(c) && !isspace(c))
+				Fail("Bad character in hex data");
+			m_pos ++;
+		}
+		if(m_pos >= m_end)
+			Fail("Unterminated hex data");
+		tok.end = m_pos;
+		m_pos ++;
+	}
+
+	else
+	{
+		tok.type = TOKEN_WORD;
+		while( (m_pos < m_end) && !isspace(static_cast<unsigned char>(*m_pos)) &&
+			(*m_pos != ';') && (*m_pos != '(') && (*m_pos != ')') )
+		{
+			m_pos ++;
+		}
+		tok.end = m_pos;
+	}
+	return tok;
+}
+
+/**
+	@brief Reads the ; that must end the current statement
+ */
+void SvfPlayer::ExpectEnd()
+{
+	if(NextToken().type != TOKEN_END)
+		Fail("Expected ;");
+}
+
+/**
+	@brief Checks if a token is a given keyword, ignoring case
+ */
+bool SvfPlayer::IsWord(const Token& tok, const char* word)
+{
+	size_t len = strlen(word);
+	return (tok.type == TOKEN_WORD) && (static_cast<size_t>(tok.end - tok.begin) == len) &&
+		(strncasecmp(tok.begin, word, len) == 0);
+}
+
+/**
+	@brief Parses a number, integer or real (1E-3, 0.5, 100)
+ */
+double SvfPlayer::ParseNumber(const Token& tok)
+{
+	char buf[64];
+	size_t len = tok.end - tok.begin;
+	if( (tok.type != TOKEN_WORD) || (len == 0) || (len >= sizeof(buf)) )
+		Fail("Expected a number");
+	memcpy(buf, tok.begin, len);
+	buf[len] = 0;
+
+	char* end;
+	double value = strtod(buf, &end);
+	if( (*end != 0) || (value < 0) )
+		Fail(string("Bad number ") + buf);
+	return value;
+}
+
+/**
+	@brief Parses a TAP state name
+ */
+JtagTapState SvfPlayer::ParseState(const Token& tok)
+{
+	for(int i=0; i<16; i++)
+	{
+		if(IsWord(tok, g_svfStateNames[i]))
+			return static_cast<JtagTapState>(i);
+	}
+	Fail("Expected a TAP state");
+	return TAP_TEST_LOGIC_RESET;
+}
+
+/**
+	@brief Parses the rest of a SIR/SDR/HIR/HDR/TIR/TDR statement into its parameter set
+
+	TDI and MASK carry over from the previous statement of the same kind while the length stays the same; TDO only
+	applies to the statement it appears in. A new length needs a new TDI and resets MASK to all ones.
+
+	@param params	The parameter set of the statement
+	@param sticky	Unused, every scan statement is sticky
+ */
+void SvfPlayer::ParseScan(SvfScanParams& params, bool /*sticky*/)
+{
+	double length = ParseNumber(NextToken());
+	if(length != floor(length))
+		Fail("Scan length must be an integer");
+
+	SvfHex none = {NULL, NULL};
+	SvfHex tdi = none;
+	SvfHex tdo = none;
+	SvfHex mask = none;
+	while(true)
+	{
+		Token tok = NextToken();
+		if(tok.type == TOKEN_END)
+			break;
+
+		Token hex = NextToken();
+		if(hex.type != TOKEN_HEX)
+			Fail("Expected hex data in parentheses");
+		if(IsWord(tok, "TDI"))
+			tdi.begin = hex.begin, tdi.end = hex.end;
+		else if(IsWord(tok, "TDO"))
+			tdo.begin = hex.begin, tdo.end = hex.end;
+		else if(IsWord(tok, "MASK"))
+			mask.begin = hex.begin, mask.end = hex.end;
+		else if(IsWord(tok, "SMASK"))
+		{
+			//Only says which TDI bits matter, and we send them all anyway
+		}
+		else
+			Fail("Expected TDI, TDO, MASK or SMASK");
+	}
+
+	size_t bits = static_cast<size_t>(length);
+	if(bits != params.length)
+	{
+		if( (bits != 0) && !tdi.begin)
+			Fail("TDI is required when the scan length changes");
+		params.mask = none;
+	}
+	params.length = bits;
+	if(tdi.begin)
+		params.tdi = tdi;
+	if(mask.begin)
+		params.mask = mask;
+	params.tdo = tdo;
+}
+
+/**
+	@brief Throws a JtagException pointing at the current line
+ */
+void SvfPlayer::Fail(const string& message)
+{
+	char line[32];
+	snprintf(line, sizeof(line), ":%zu: ", m_line);
+	throw JtagExceptionWrapper(
+		m_path + line + message,
+		"");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Execution
+
+/**
+	@brief Runs an IR or DR scan: header, body and trailer back to back, then on to the end state
+ */
+void SvfPlayer::Scan(bool ir)
+{
+	const SvfScanParams* segments[3];
+	segments[0] = ir ? &m_hir : &m_hdr;
+	segments[1] = ir ? &m_sir : &m_sdr;
+	segments[2] = ir ? &m_tir : &m_tdr;
+	JtagTapState end = ir ? m_endIR : m_endDR;
+
+	uint64_t total = 0;
+	for(int i=0; i<3; i++)
+		total += segments[i]->length;
+	if(total == 0)
+	{
+		GoTo(end);
+		return;
+	}
+
+	GoTo(ir ? TAP_SHIFT_IR : TAP_SHIFT_DR);
+
+	uint64_t done = 0;
+	for(int i=0; i<3; i++)
+	{
+		const SvfScanParams& p = *segments[i];
+		const char* tdi = p.tdi.end;
+		const char* tdo = p.tdo.end;
+		const char* mask = p.mask.end;
+		bool compare = (p.tdo.begin != NULL);
+
+		for(size_t pos=0; pos<p.length; )
+		{
+			size_t count = min(p.length - pos, static_cast<size_t>(SVF_CHUNK_BITS));
+			DecodeHex(p.tdi, tdi, m_tdiChunk, count);
+			if(compare)
+			{
+				DecodeHex(p.tdo, tdo, m_expectChunk, count);
+				if(p.mask.begin)
+					DecodeHex(p.mask, mask, m_maskChunk, count);
+				else
+					memset(m_maskChunk, 0xff, sizeof(m_maskChunk));
+			}
+
+			//Stop right here: whatever comes next was written assuming this scan worked
+			bool last = (done + count == total);
+			size_t bit = EmitScan(last, count, compare, p.mask.begin != NULL);
+			if(bit != SVF_NO_MISMATCH)
+			{
+				m_state = SVF_STATE_UNKNOWN;
+				char message[128];
+				snprintf(message, sizeof(message), "TDO mismatch in %s at bit %" PRIu64 ": expected %d, got %d",
+					(i == 0) ? (ir ? "HIR" : "HDR") : (i == 1) ? (ir ? "SIR" : "SDR") : (ir ? "TIR" : "TDR"),
+					static_cast<uint64_t>(pos + bit),
+					PeekBit(m_expectChunk, bit) ? 1 : 0,
+					PeekBit(m_tdoChunk, bit) ? 1 : 0);
+				Fail(message);
+			}
+			if(compare)
+				m_comparedBits += count;
+
+			pos += count;
+			done += count;
+		}
+	}
+	m_scanBits += total;
+
+	m_state = ir ? TAP_EXIT1_IR : TAP_EXIT1_DR;
+	GoTo(end);
+}
+
+/**
+	@brief Executes the rest of a RUNTEST statement
+
+	RUNTEST [run_state] [run_count TCK|SCK] [min_time SEC [MAXIMUM max_time SEC]] [ENDSTATE end_state];
+
+	SCK counts can't be honored (there's no separate system clock to count) and are ignored, as is the maximum time.
+	After the TCK clocks the player waits out whatever is left of the minimum time.
+ */
+void SvfPlayer::RunTest()
+{
+	Token tok = NextToken();
+
+	//Giving a run state also makes it the default end state
+	if( (tok.type == TOKEN_WORD) && isalpha(static_cast<unsigned char>(*tok.begin)) )
+	{
+		m_runState = ParseState(tok);
+		m_runEndState = m_runState;
+		tok = NextToken();
+	}
+
+	uint64_t clocks = 0;
+	double min_time = 0;
+	while(tok.type != TOKEN_END)
+	{
+		if(IsWord(tok, "ENDSTATE"))
+			m_runEndState = ParseState(NextToken());
+
+		else if(IsWord(tok, "MAXIMUM"))
+		{
+			ParseNumber(NextToken());
+			if(!IsWord(NextToken(), "SEC"))
+				Fail("Expected SEC");
+		}
+
+		else
+		{
+			double value = ParseNumber(tok);
+			Token unit = NextToken();
+			if(IsWord(unit, "TCK"))
+				clocks = static_cast<uint64_t>(value);
+			else if(IsWord(unit, "SEC"))
+				min_time = value;
+			else if(!IsWord(unit, "SCK"))
+				Fail("Expected TCK, SCK or SEC");
+		}
+		tok = NextToken();
+	}
+
+	JtagTapState stable[4] = {TAP_TEST_LOGIC_RESET, TAP_RUN_TEST_IDLE, TAP_PAUSE_DR, TAP_PAUSE_IR};
+	if( (find(stable, stable + 4, m_runState) == stable + 4) || (find(stable, stable + 4, m_runEndState) == stable + 4) )
+		Fail("RUNTEST states must be stable");
+
+	//Test-Logic-Reset is held with TMS high, the others with TMS low
+	GoTo(m_runState);
+	EmitRun(m_runState == TAP_TEST_LOGIC_RESET, clocks, min_time);
+	GoTo(m_runEndState);
+}
+
+/**
+	@brief Moves the TAP to a state along the shortest path
+
+	The TAP is reset first if its state isn't known.
+ */
+void SvfPlayer::GoTo(JtagTapState target)
+{
+	if(m_state == SVF_STATE_UNKNOWN)
+	{
+		unsigned char ones = 0xff;
+		EmitTMS(&ones, 6);
+		m_state = TAP_TEST_LOGIC_RESET;
+	}
+	if(m_state == target)
+		return;
+
+	//Breadth-first search over the 16 states; paths are never longer than 7 clocks
+	int prev[16];
+	bool via[16];
+	for(int i=0; i<16; i++)
+		prev[i] = -1;
+	int queue[16];
+	int head = 0;
+	int tail = 0;
+	queue[tail++] = m_state;
+	prev[m_state] = m_state;
+	while( (head < tail) && (prev[target] < 0) )
+	{
+		int s = queue[head++];
+		for(int tms=0; tms<2; tms++)
+		{
+			int next = g_tapNextState[s][tms];
+			if(prev[next] >= 0)
+				continue;
+			prev[next] = s;
+			via[next] = tms ? true : false;
+			queue[tail++] = next;
+		}
+	}
+
+	//Walk back from the target to get the TMS sequence, last bit first
+	bool path[16];
+	size_t len = 0;
+	for(int s = target; s != m_state; s = prev[s])
+		path[len++] = via[s];
+
+	unsigned char tms[2] = {0, 0};
+	for(size_t i=0; i<len; i++)
+		PokeBit(tms, i, path[len - 1 - i]);
+	EmitTMS(tms, len);
+	m_state = target;
+}
+
+/**
+	@brief Clocks TCK with TMS held, then waits out whatever is left of a minimum time
+
+	Shared with JtagVectorPlayer, which replays RUNTEST the same way.
+
+	@param iface	The adapter
+	@param tms		TMS level to hold
+	@param clocks	Number of TCK cycles
+	@param min_time	Minimum time from the first clock to returning, in seconds
+ */
+void SvfPlayer::RunClocks(JtagInterface* iface, bool tms, uint64_t clocks, double min_time)
+{
+	unsigned char level[SVF_CHUNK_BITS / 8];
+	memset(level, tms ? 0xff : 0x00, sizeof(level));
+
+	uint64_t start = GetTimeNs();
+	while(clocks)
+	{
+		size_t count = min(clocks, static_cast<uint64_t>(SVF_CHUNK_BITS));
+		iface->ShiftTMS(false, level, count);
+		clocks -= count;
+	}
+	iface->Commit();
+
+	double remaining = min_time - (GetTimeNs() - start) * 1e-9;
+	if(remaining > 0)
+	{
+		struct timespec ts;
+		ts.tv_sec = static_cast<time_t>(remaining);
+		ts.tv_nsec = static_cast<long>( (remaining - ts.tv_sec) * 1e9);
+		while( (nanosleep(&ts, &ts) != 0) && (errno == EINTR) )
+		{}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Output
+
+/**
+	@brief Called before the first statement is executed
+ */
+void SvfPlayer::BeginOutput()
+{
+	m_iface->WaitForAsync();
+	m_iface->ForgetIR();
+}
+
+/**
+	@brief Called after the last statement was executed
+ */
+void SvfPlayer::EndOutput()
+{
+	m_iface->Commit();
+}
+
+/**
+	@brief Clocks TMS bits through the TAP
+ */
+void SvfPlayer::EmitTMS(const unsigned char* bits, size_t count)
+{
+	m_iface->ShiftTMS(false, bits, count);
+}
+
+/**
+	@brief Shifts the chunk in m_tdiChunk and checks what comes out
+
+	@param last			True if this is the last chunk of the scan (leave Shift for Exit1 on its last bit)
+	@param count		Number of bits
+	@param compare		True if m_expectChunk / m_maskChunk hold TDO to check against
+	@param has_mask		True if the mask came from the file, rather than being all ones
+
+	@return Index of the first mismatching bit, or SVF_NO_MISMATCH
+ */
+size_t SvfPlayer::EmitScan(bool last, size_t count, bool compare, bool /*has_mask*/)
+{
+	m_iface->ShiftData(last, m_tdiChunk, compare ? m_tdoChunk : NULL, count);
+	if(!compare)
+		return SVF_NO_MISMATCH;
+	return FindMismatch(m_tdoChunk, m_expectChunk, m_maskChunk, count);
+}
+
+/**
+	@brief Runs RUNTEST clocks and the minimum wait, in the current (stable) state
+ */
+void SvfPlayer::EmitRun(bool tms, uint64_t clocks, double min_time)
+{
+	RunClocks(m_iface, tms, clocks, min_time);
+}
+
+/**
+	@brief Compares captured TDO against the expected value under a mask
+
+	@return Index of the first mismatching bit, or SVF_NO_MISMATCH
+ */
+size_t SvfPlayer::FindMismatch(
+	const unsigned char* tdo,
+	const unsigned char* expect,
+	const unsigned char* mask,
+	size_t count)
+{
+	size_t nbytes = (count + 7) / 8;
+	for(size_t j=0; j<nbytes; j++)
+	{
+		unsigned char diff = (tdo[j] ^ expect[j]) & mask[j];
+		if( (j == nbytes - 1) && (count & 7) )
+			diff &= (1 << (count & 7)) - 1;
+		if(!diff)
+			continue;
+
+		size_t bit = j*8;
+		while(!(diff & 1))
+			diff >>= 1, bit ++;
+		return bit;
+	}
+	return SVF_NO_MISMATCH;
+}
+
+/**
+	@brief Decodes the next bits of a hex field, walking backwards from a cursor
+
+	SVF hex strings are written MSB first, so the first bit to shift is the last digit. Decoding from the end lets
+	a scan be streamed in chunks without ever holding the whole string in binary. Missing leading digits read as
+	zeros and surplus ones are ignored.
+
+	@param hex		The field. If absent, the output is all zeros.
+	@param cursor	Position just after the next digit to decode; moved back past the digits consumed
+	@param out		Output bits
+	@param nbits	Number of bits to decode. Must be a multiple of 4, except at the end of the field.
+ */
+void SvfPlayer::DecodeHex(const SvfHex& hex, const char*& cursor, unsigned char* out, size_t nbits)
+{
+	size_t nbytes = (nbits + 7) / 8;
+	memset(out, 0, nbytes);
+	if(!hex.begin)
+		return;
+
+	for(size_t bit=0; bit<nbits; bit+=4)
+	{
+		while( (cursor > hex.begin) && !isxdigit(static_cast<unsigned char>(cursor[-1])) )
+			cursor --;
+		if(cursor == hex.begin)
+			break;
+
+		char c = *--cursor;
+		int nibble;
+		if(c <= '9')
+			nibble = c - '0';
+		else
+			nibble = (c | 0x20) - 'a' + 10;
+		out[bit / 8] |= nibble << (bit & 4);
+	}
+
+	if(nbits & 7)
+		out[nbytes - 1] &= (1 << (nbits & 7)) - 1;
+}
@@ -0,0 +1,201 @@
+/**
+	@file
+	@brief Declaration of SvfPlayer
+ */
+
+#ifndef SvfPlayer_h
+#define SvfPlayer_h
+
+///@brief Bits shifted per adapter call while streaming a scan (a multiple of 8)
+#define SVF_CHUNK_BITS			8192
+
+///@brief How much of the file is read before the pages behind the parser are dropped, in bytes
+#define SVF_RELEASE_INTERVAL	(8 * 1024 * 1024)
+
+///@brief SvfPlayer TAP state when it isn't known (before the first command, or after a failure)
+#define SVF_STATE_UNKNOWN		-1
+
+///@brief Returned by SvfPlayer::EmitScan() when TDO matched
+#define SVF_NO_MISMATCH			SIZE_MAX
+
+/**
+	@brief A hex string of an SVF file, as the text between the parentheses
+ */
+struct SvfHex
+{
+	///@brief First character after "(", or NULL if the field is absent
+	const char* begin;
+
+	///@brief The closing ")"
+	const char* end;
+};
+
+/**
+	@brief Scan parameters of one of SIR, SDR, HIR, HDR, TIR, TDR, which SVF partly carries over between commands
+ */
+struct SvfScanParams
+{
+	///@brief Length in bits
+	size_t length;
+
+	///@brief Data to shift in
+	SvfHex tdi;
+
+	///@brief Expected data, only for the command it appears in
+	SvfHex tdo;
+
+	///@brief Compare mask (all ones if absent)
+	SvfHex mask;
+};
+
+/**
+	@brief Plays Serial Vector Format files on an adapter
+
+	The file is mapped rather than read and parsed one statement at a time, and scan data is never converted as a
+	whole: hex strings are decoded straight from the mapping, SVF_CHUNK_BITS at a time starting from the end (which is
+	where the first bit shifted lives), and each chunk is shifted and checked against TDO / MASK before the next one
+	is decoded. Header, data and trailer (HIR/HDR, SIR/SDR, TIR/TDR) are streamed one after another within the same
+	Shift state, so they never get concatenated either. Memory use is therefore constant whatever the size of the
+	file or of its largest scan, and pages already parsed are dropped every SVF_RELEASE_INTERVAL.
+
+	Supported: SIR, SDR, HIR, HDR, TIR, TDR, ENDIR, ENDDR, STATE, RUNTEST (TCK counts and minimum times), and
+	FREQUENCY / TRST, which are accepted and ignored since the SW-JTAG block has neither. PIO and PIOMAP are
+	rejected. The player drives the raw chain, so it works without InitializeChain().
+
+	A TDO mismatch stops playback immediately with a JtagException giving the line and the first failing bit. The TAP
+	is then considered to be in an unknown state and is reset before the next command.
+
+	Everything that reaches the adapter goes through the Emit*() functions, which SvfCompiler overrides to write a
+	binary vector file instead.
+ */
+class SvfPlayer
+{
+public:
+	SvfPlayer(JtagInterface* iface);
+	virtual ~SvfPlayer();
+
+	void Play(const std::string& path);
+
+	///@brief Returns the number of statements executed by the last Play()
+	size_t GetCommandCount()
+	{ return m_commands; }
+
+	///@brief Returns the number of scan bits shifted by the last Play()
+	uint64_t GetScanBits()
+	{ return m_scanBits; }
+
+	///@brief Returns the number of scan bits checked against TDO by the last Play()
+	uint64_t GetComparedBits()
+	{ return m_comparedBits; }
+
+	static void RunClocks(JtagInterface* iface, bool tms, uint64_t clocks, double min_time);
+	static size_t FindMismatch(
+		const unsigned char* tdo,
+		const unsigned char* expect,
+		const unsigned char* mask,
+		size_t count);
+
+protected:
+
+	/**
+		@brief Kinds of token in an SVF statement
+	 */
+	enum TokenType
+	{
+		TOKEN_WORD,
+		TOKEN_HEX,
+		TOKEN_END,
+		TOKEN_EOF
+	};
+
+	/**
+		@brief One token
+	 */
+	struct Token
+	{
+		TokenType type;
+		const char* begin;
+		const char* end;
+	};
+
+	//Parsing
+	Token NextToken();
+	void ExpectEnd();
+	bool IsWord(const Token& tok, const char* word);
+	double ParseNumber(const Token& tok);
+	JtagTapState ParseState(const Token& tok);
+	void ParseScan(SvfScanParams& params, bool sticky);
+	void Fail(const std::string& message);
+
+	//Execution
+	void Execute(const Token& cmd);
+	void Scan(bool ir);
+	void RunTest();
+	void GoTo(JtagTapState target);
+	static void DecodeHex(const SvfHex& hex, const char*& cursor, unsigned char* out, size_t nbits);
+
+	//Output
+	virtual void BeginOutput();
+	virtual void EndOutput();
+	virtual void EmitTMS(const unsigned char* bits, size_t count);
+	virtual size_t EmitScan(bool last, size_t count, bool compare, bool has_mask);
+	virtual void EmitRun(bool tms, uint64_t clocks, double min_time);
+
+	///@brief The adapter
+	JtagInterface* m_iface;
+
+	///@brief The mapped file
+	const char* m_base;
+
+	///@brief Size of the mapped file
+	size_t m_size;
+
+	///@brief Parser position
+	const char* m_pos;
+
+	///@brief End of the file
+	const char* m_end;
+
+	///@brief Everything before this has been released with madvise()
+	const char* m_released;
+
+	///@brief Current line, for error messages
+	size_t m_line;
+
+	///@brief Name of the file being played, for error messages
+	std::string m_path;
+
+	///@brief TAP state (a JtagTapState), or SVF_STATE_UNKNOWN
+	int m_state;
+
+	///@brief State to end IR scans in
+	JtagTapState m_endIR;
+
+	///@brief State to end DR scans in
+	JtagTapState m_endDR;
+
+	///@brief State RUNTEST clocks in
+	JtagTapState m_runState;
+
+	///@brief State RUNTEST ends in
+	JtagTapState m_runEndState;
+
+	///@brief Header, body and trailer of IR scans
+	SvfScanParams m_hir, m_sir, m_tir;
+
+	///@brief Header, body and trailer of DR scans
+	SvfScanParams m_hdr, m_sdr, m_tdr;
+
+	///@brief Chunk buffers
+	unsigned char m_tdiChunk[SVF_CHUNK_BITS / 8];
+	unsigned char m_tdoChunk[SVF_CHUNK_BITS / 8];
+	unsigned char m_expectChunk[SVF_CHUNK_BITS / 8];
+	unsigned char m_maskChunk[SVF_CHUNK_BITS / 8];
+
+	//Statistics
+	size_t m_commands;
+	uint64_t m_scanBits;
+	uint64_t m_comparedBits;
+};
+
+#endif
@@ -0,0 +1,317 @@
+/**
+	@file
+	@brief Implementation of TracingJtagInterface
+ */
+
+#include "jtaghal.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Starts tracing an adapter
+
+	@param iface	The adapter to trace. The wrapper takes ownership of it.
+	@param path		Trace file to create (or truncate)
+
+	@throw JtagException if the trace file can't be created
+ */
+TracingJtagInterface::TracingJtagInterface(JtagInterface* iface, const string& path)
+	: m_iface(iface)
+	, m_fd(-1)
+	, m_window(NULL)
+	, m_windowOffset(0)
+	, m_windowUsed(0)
+	, m_oldWindow(NULL)
+	, m_pending(NULL)
+	, m_start(Now())
+{
+	m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(m_fd < 0)
+	{
+		delete m_iface;
+		throw JtagExceptionWrapper(
+			string("Failed to create trace file ") + path,
+			"");
+	}
+	if(ftruncate(m_fd, JTAG_TRACE_WINDOW) != 0)
+	{
+		close(m_fd);
+		delete m_iface;
+		throw JtagExceptionWrapper(
+			string("Failed to size trace file ") + path,
+			"");
+	}
+	void* window = mmap(NULL, JTAG_TRACE_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, 0);
+	if(window == MAP_FAILED)
+	{
+		close(m_fd);
+		delete m_iface;
+		throw JtagExceptionWrapper(
+			string("Failed to map trace file ") + path,
+			"");
+	}
+	m_window = static_cast<unsigned char*>(window);
+
+	JtagTraceHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = JTAG_TRACE_MAGIC;
+	header.version = JTAG_TRACE_VERSION;
+	struct timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	header.start_time = t.tv_sec * 1000000000ULL + t.tv_nsec;
+	strncpy(header.adapter, m_iface->GetName().c_str(), sizeof(header.adapter) - 1);
+	Append(&header, sizeof(header));
+}
+
+/**
+	@brief Finishes the trace, trimming the file to what was recorded, and closes the traced adapter
+ */
+TracingJtagInterface::~TracingJtagInterface()
+{
+	//Our own async worker drives the wrapper, so it has to stop before the trace does
+	ShutdownAsync();
+
+	munmap(m_window, JTAG_TRACE_WINDOW);
+	if(ftruncate(m_fd, m_windowOffset + m_windowUsed) != 0)
+		LogWarning("Failed to trim trace file\n");
+	close(m_fd);
+
+	delete m_iface;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Forwarded to the traced adapter
+
+string TracingJtagInterface::GetName()
+{
+	return m_iface->GetName();
+}
+
+string TracingJtagInterface::GetSerial()
+{
+	return m_iface->GetSerial();
+}
+
+string TracingJtagInterface::GetUserID()
+{
+	return m_iface->GetUserID();
+}
+
+int TracingJtagInterface::GetFrequency()
+{
+	return m_iface->GetFrequency();
+}
+
+void TracingJtagInterface::Commit()
+{
+	m_iface->Commit();
+}
+
+size_t TracingJtagInterface::GetShiftOpCount()
+{
+	return m_iface->GetShiftOpCount();
+}
+
+size_t TracingJtagInterface::GetDataBitCount()
+{
+	return m_iface->GetDataBitCount();
+}
+
+size_t TracingJtagInterface::GetModeBitCount()
+{
+	return m_iface->GetModeBitCount();
+}
+
+size_t TracingJtagInterface::GetDummyClockCount()
+{
+	return m_iface->GetDummyClockCount();
+}
+
+double TracingJtagInterface::GetShiftTime()
+{
+	return m_iface->GetShiftTime();
+}
+
+//Scans are integrity checked (and retried) at whichever level the caller uses, so add ours to the adapter's
+size_t TracingJtagInterface::GetRecoverableErrorCount()
+{
+	return m_iface->GetRecoverableErrorCount() + m_perfRecoverableErrors;
+}
+
+void TracingJtagInterface::GetPerfSnapshot(JtagPerfSnapshot& snap)
+{
+	m_iface->GetPerfSnapshot(snap);
+	snap.recoverable_errors += m_perfRecoverableErrors;
+	snap.integrity_checks += m_perfIntegrityChecks;
+	snap.integrity_failures += m_perfIntegrityFailures;
+}
+
+void TracingJtagInterface::ResetPerfCounters()
+{
+	m_iface->ResetPerfCounters();
+	JtagInterface::ResetPerfCounters();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Traced operations
+
+void TracingJtagInterface::ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
+{
+	uint64_t start = Now();
+	m_iface->ShiftData(last_tms, send_data, rcv_data, count);
+	uint64_t end = Now();
+	Record(
+		JTAG_TRACE_OP_SHIFT_DATA,
+		(last_tms ? JTAG_TRACE_LAST_TMS : 0) | (rcv_data ? JTAG_TRACE_HAS_TDO : 0),
+		count,
+		send_data,
+		rcv_data,
+		start,
+		end);
+}
+
+void TracingJtagInterface::ShiftTMS(bool tdi, const unsigned char* send_data, size_t count)
+{
+	uint64_t start = Now();
+	m_iface->ShiftTMS(tdi, send_data, count);
+	uint64_t end = Now();
+	Record(JTAG_TRACE_OP_SHIFT_TMS, tdi ? JTAG_TRACE_TDI : 0, count, send_data, NULL, start, end);
+}
+
+void TracingJtagInterface::SendDummyClocks(size_t n)
+{
+	uint64_t start = Now();
+	m_iface->SendDummyClocks(n);
+	uint64_t end = Now();
+	Record(JTAG_TRACE_OP_DUMMY_CLOCKS, 0, n, NULL, NULL, start, end);
+}
+
+bool TracingJtagInterface::ReadTDO()
+{
+	uint64_t start = Now();
+	bool tdo = m_iface->ReadTDO();
+	uint64_t end = Now();
+	Record(JTAG_TRACE_OP_READ_TDO, tdo ? JTAG_TRACE_TDO : 0, 0, NULL, NULL, start, end);
+	return tdo;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Recording
+
+/**
+	@brief Appends one record
+
+	The op byte is written last, so a reader never sees a record whose data isn't all there. start and end are Now()
+	values.
+ */
+void TracingJtagInterface::Record(
+	uint8_t op,
+	uint8_t flags,
+	size_t count,
+	const unsigned char* tdi,
+	const unsigned char* tdo,
+	uint64_t start,
+	uint64_t end)
+{
+	size_t nbytes = (count + 7) / 8;
+	size_t data = (tdi ? nbytes : 0) + (tdo ? nbytes : 0);
+	size_t length = (sizeof(JtagTraceRecord) + data + 7) & ~static_cast<size_t>(7);
+
+	JtagTraceRecord rec;
+	rec.op = JTAG_TRACE_OP_NONE;
+	rec.flags = flags;
+	rec.reserved = 0;
+	rec.count = count;
+	rec.timestamp = JtagCycleClock::ToNs(start - m_start);
+	rec.duration = min(JtagCycleClock::ToNs(end - start), static_cast<uint64_t>(UINT32_MAX));
+	rec.length = length;
+
+	m_pending = Append(&rec, sizeof(rec));
+	if(tdi)
+		Append(tdi, nbytes);
+	if(tdo)
+		Append(tdo, nbytes);
+
+	//The file is zero filled, so skipping the padding leaves zeros
+	size_t pad = length - sizeof(rec) - data;
+	while(pad)
+	{
+		if(m_windowUsed == JTAG_TRACE_WINDOW)
+			NextWindow();
+		size_t n = min(pad, JTAG_TRACE_WINDOW - m_windowUsed);
+		m_windowUsed += n;
+		pad -= n;
+	}
+
+	__atomic_store_n(m_pending, op, __ATOMIC_RELEASE);
+	m_pending = NULL;
+	if(m_oldWindow)
+	{
+		munmap(m_oldWindow, JTAG_TRACE_WINDOW);
+		m_oldWindow = NULL;
+	}
+}
+
+/**
+	@brief Copies bytes to the end of the trace
+
+	@return Where the first byte went
+ */
+unsigned char* TracingJtagInterface::Append(const void* data, size_t len)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	unsigned char* first = NULL;
+	while(len)
+	{
+		if(m_windowUsed == JTAG_TRACE_WINDOW)
+			NextWindow();
+		size_t n = min(len, JTAG_TRACE_WINDOW - m_windowUsed);
+		if(!first)
+			first = m_window + m_windowUsed;
+		memcpy(m_window + m_windowUsed, p, n);
+		m_windowUsed += n;
+		p += n;
+		len -= n;
+	}
+	return first;
+}
+
+/**
+	@brief Grows the file and maps the next window of it
+ */
+void TracingJtagInterface::NextWindow()
+{
+	//Keep the window holding the op byte of the record in progress until the record is done
+	bool pending = m_pending && (m_pending >= m_window) && (m_pending < m_window + JTAG_TRACE_WINDOW);
+	if(pending)
+		m_oldWindow = m_window;
+	else
+		munmap(m_window, JTAG_TRACE_WINDOW);
+	m_window = NULL;
+
+	m_windowOffset += JTAG_TRACE_WINDOW;
+	m_windowUsed = 0;
+	void* window = MAP_FAILED;
+	if(ftruncate(m_fd, m_windowOffset + JTAG_TRACE_WINDOW) == 0)
+		window = mmap(NULL, JTAG_TRACE_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, m_windowOffset);
+	if(window == MAP_FAILED)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to extend trace file",
+			"");
+	}
+	m_window = static_cast<unsigned char*>(window);
+}
+
+/**
+	@brief Cycle counter, converted to ns only when a record is written
+ */
+uint64_t TracingJtagInterface::Now()
+{
+	return JtagCycleClock::Now();
+}
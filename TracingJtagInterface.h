@@ -0,0 +1,95 @@
+/**
+	@file
+	@brief Declaration of TracingJtagInterface
+ */
+
+#ifndef TracingJtagInterface_h
+#define TracingJtagInterface_h
+
+///@brief How much of the trace file is mapped at a time, in bytes (a multiple of the page size)
+#define JTAG_TRACE_WINDOW		(16 * 1024 * 1024)
+
+/**
+	@brief A JtagInterface that records every wire-level operation of another one into a trace file
+
+	Wraps an adapter and forwards everything to it; each ShiftData(), ShiftTMS(), SendDummyClocks() and ReadTDO() is
+	also appended to the trace (see JtagTraceFormat.h) with its TDI, its TDO and when and how long it ran. Everything
+	above the wire level (InitializeChain(), SetIR(), scan plans, ...) runs on the wrapper and so ends up in the trace
+	as the wire-level traffic it generates.
+
+	Records are copied straight into a shared mapping of the file, so tracing costs two clock reads and a memcpy per
+	operation, and what was recorded survives a crash of the process. JtagTraceReplayer plays traces back.
+ */
+class TracingJtagInterface : public JtagInterface
+{
+public:
+	TracingJtagInterface(JtagInterface* iface, const std::string& path);
+	virtual ~TracingJtagInterface();
+
+	//Forwarded to the traced adapter
+	virtual std::string GetName();
+	virtual std::string GetSerial();
+	virtual std::string GetUserID();
+	virtual int GetFrequency();
+
+	//Low-level JTAG interface
+	virtual void ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
+	virtual void SendDummyClocks(size_t n);
+	virtual bool ReadTDO();
+	virtual void Commit();
+
+	//Performance profiling
+	virtual size_t GetShiftOpCount();
+	virtual size_t GetDataBitCount();
+	virtual size_t GetModeBitCount();
+	virtual size_t GetDummyClockCount();
+	virtual double GetShiftTime();
+	virtual size_t GetRecoverableErrorCount();
+	virtual void GetPerfSnapshot(JtagPerfSnapshot& snap);
+	virtual void ResetPerfCounters();
+
+	///@brief Returns the traced adapter
+	JtagInterface* GetTracedInterface()
+	{ return m_iface; }
+
+protected:
+	virtual void ShiftTMS(bool tdi, const unsigned char* send_data, size_t count);
+
+	void Record(
+		uint8_t op,
+		uint8_t flags,
+		size_t count,
+		const unsigned char* tdi,
+		const unsigned char* tdo,
+		uint64_t start,
+		uint64_t end);
+	unsigned char* Append(const void* data, size_t len);
+	void NextWindow();
+	static uint64_t Now();
+
+	///@brief The traced adapter, owned by the wrapper
+	JtagInterface* m_iface;
+
+	///@brief The trace file
+	int m_fd;
+
+	///@brief Current mapped window of the file
+	unsigned char* m_window;
+
+	///@brief File offset of m_window
+	uint64_t m_windowOffset;
+
+	///@brief Bytes of m_window used so far
+	size_t m_windowUsed;
+
+	///@brief Previous window, kept mapped while the record being written started in it
+	unsigned char* m_oldWindow;
+
+	///@brief Op byte of the record being written, or NULL
+	unsigned char* m_pending;
+
+	///@brief Cycle count at the start of the trace
+	uint64_t m_start;
+};
+
+#endif
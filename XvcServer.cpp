@@ -0,0 +1,275 @@
+/**
+	@file
+	@brief Implementation of XvcServer
+ */
+
+#include "jtaghal.h"
+#include <sys/socket.h>
+
+using namespace std;
+
+/**
+	@brief Finds the first set bit in [start, end) of a bit string, skipping zero bytes whole
+
+	@return Index of the bit, or end if there is none
+ */
+static size_t FindSetBit(const unsigned char* data, size_t start, size_t end)
+{
+	size_t i = start;
+	while(i < end)
+	{
+		if( ((i & 7) == 0) && (data[i/8] == 0) )
+		{
+			i += 8;
+			continue;
+		}
+		if(PeekBit(data, i))
+			return i;
+		i ++;
+	}
+	return end;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+XvcServer::XvcServer(JtagInterface* iface)
+	: m_iface(iface)
+	, m_fd(-1)
+	, m_rxbuf(2*XVC_MAX_VECTOR_BYTES + 64)
+	, m_rxpos(0)
+	, m_rxlen(0)
+	, m_tms(XVC_MAX_VECTOR_BYTES)
+	, m_tdi(XVC_MAX_VECTOR_BYTES)
+	, m_tdo(XVC_MAX_VECTOR_BYTES)
+	, m_scratchIn(XVC_MAX_VECTOR_BYTES + 1)
+	, m_scratchOut(XVC_MAX_VECTOR_BYTES + 1)
+	, m_statCommands(0)
+	, m_statBits(0)
+	, m_statShifts(0)
+	, m_statShiftTime(0)
+{
+}
+
+XvcServer::~XvcServer()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Connection handling
+
+/**
+	@brief Accepts and serves clients, one at a time, forever
+
+	@throw JtagException if accepting fails or the adapter fails
+ */
+void XvcServer::Serve(ServerSocket& sock)
+{
+	while(true)
+	{
+		int fd = sock.Accept();
+		LogNotice("XVC client connected\n");
+		ServeClient(fd);
+		close(fd);
+	}
+}
+
+/**
+	@brief Serves one client until it disconnects, then logs throughput stats
+
+	@throw JtagException if the adapter fails
+ */
+void XvcServer::ServeClient(int fd)
+{
+	m_fd = fd;
+	m_rxpos = 0;
+	m_rxlen = 0;
+	m_statCommands = 0;
+	m_statBits = 0;
+	m_statShifts = 0;
+	m_statShiftTime = 0;
+
+	//The client drives the TAP itself, IR scans included
+	m_iface->ForgetIR();
+
+	string cmd;
+	uint64_t start = GetTimeNs();
+	while(ReadCommand(cmd))
+	{
+		if(cmd == "getinfo:")
+		{
+			char info[64];
+			snprintf(info, sizeof(info), "xvcServer_v1.0:%d\n", XVC_MAX_VECTOR_BYTES);
+			if(!ServerSocket::SendAll(fd, info, strlen(info)))
+				break;
+		}
+
+		else if(cmd == "settck:")
+		{
+			uint8_t period[4];
+			if(!Read(period, 4))
+				break;
+			int freq = m_iface->GetFrequency();
+			if(freq > 0)
+			{
+				uint32_t ns = 1000000000 / freq;
+				for(int i=0; i<4; i++)
+					period[i] = ns >> (8*i);
+			}
+			if(!ServerSocket::SendAll(fd, period, 4))
+				break;
+		}
+
+		else if(cmd == "shift:")
+		{
+			uint8_t len[4];
+			if(!Read(len, 4))
+				break;
+			size_t nbits = len[0] | (len[1] << 8) | (len[2] << 16) | (static_cast<uint32_t>(len[3]) << 24);
+			size_t nbytes = (nbits + 7) / 8;
+			if(nbytes > XVC_MAX_VECTOR_BYTES)
+			{
+				LogWarning("XVC client sent a %zu-bit vector, more than advertised\n", nbits);
+				break;
+			}
+			if(!Read(&m_tms[0], nbytes) || !Read(&m_tdi[0], nbytes))
+				break;
+
+			{
+				JtagScopedTimer timer(m_statShiftTime);
+				Shift(nbits);
+			}
+			m_statCommands ++;
+			m_statBits += nbits;
+
+			if(!ServerSocket::SendAll(fd, &m_tdo[0], nbytes))
+				break;
+		}
+
+		else
+		{
+			LogWarning("Unknown XVC command \"%s\"\n", cmd.c_str());
+			break;
+		}
+	}
+
+	double dt = (GetTimeNs() - start) * 1e-9;
+	LogNotice("XVC client disconnected: %" PRIu64 " shift commands, %" PRIu64 " bits, %" PRIu64 " shift calls in %.3f s "
+		"(%.3f s shifting, %.1f kbit/s overall)\n",
+		m_statCommands, m_statBits, m_statShifts, dt, m_statShiftTime * 1e-9, (dt > 0) ? (m_statBits / dt / 1000) : 0);
+	m_fd = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Protocol layer
+
+/**
+	@brief Reads exactly len bytes, from the receive buffer first
+
+	@return False if the client went away
+ */
+bool XvcServer::Read(void* data, size_t len)
+{
+	uint8_t* p = static_cast<uint8_t*>(data);
+	while(len > 0)
+	{
+		if(m_rxpos == m_rxlen)
+		{
+			ssize_t n = recv(m_fd, &m_rxbuf[0], m_rxbuf.size(), 0);
+			if( (n < 0) && (errno == EINTR) )
+				continue;
+			if(n <= 0)
+				return false;
+			m_rxpos = 0;
+			m_rxlen = n;
+		}
+
+		size_t chunk = m_rxlen - m_rxpos;
+		if(chunk > len)
+			chunk = len;
+		memcpy(p, &m_rxbuf[m_rxpos], chunk);
+		m_rxpos += chunk;
+		p += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+/**
+	@brief Reads a command name, up to and including the colon
+
+	@return False if the client went away or sent garbage
+ */
+bool XvcServer::ReadCommand(string& cmd)
+{
+	cmd = "";
+	while(cmd.length() < 16)
+	{
+		char c;
+		if(!Read(&c, 1))
+			return false;
+		cmd += c;
+		if(c == ':')
+			return true;
+	}
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Shifting
+
+/**
+	@brief Executes the TMS/TDI vectors in m_tms / m_tdi and fills in m_tdo
+
+	@throw JtagException if the adapter fails
+ */
+void XvcServer::Shift(size_t nbits)
+{
+	static const unsigned char all_ones[8] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+	const unsigned char* tms = &m_tms[0];
+	const unsigned char* tdi = &m_tdi[0];
+	unsigned char* tdo = &m_tdo[0];
+
+	size_t i = 0;
+	while(i < nbits)
+	{
+		//Data run, up to and including the next TMS-high bit
+		if(!PeekBit(tms, i))
+		{
+			size_t j = FindSetBit(tms, i, nbits);
+			bool last_tms = (j < nbits);
+			size_t count = (last_tms ? (j+1) : nbits) - i;
+
+			//Shift straight from / into the vectors if the run is byte aligned
+			if( (i & 7) == 0)
+				m_iface->ShiftData(last_tms, tdi + i/8, tdo + i/8, count);
+			else
+			{
+				CopyBitArray(&m_scratchIn[0], 0, tdi, i, count);
+				m_iface->ShiftData(last_tms, &m_scratchIn[0], &m_scratchOut[0], count);
+				CopyBitArray(tdo, i, &m_scratchOut[0], 0, count);
+			}
+
+			i += count;
+		}
+
+		//TMS run: TMS high and TDI constant
+		else
+		{
+			bool tdi_val = PeekBit(tdi, i);
+			size_t j = i + 1;
+			while( (j < nbits) && PeekBit(tms, j) && (PeekBit(tdi, j) == tdi_val) )
+				j ++;
+
+			bool tdo_val = m_iface->ReadTDO();
+			for(size_t k=i; k<j; k += 64)
+				m_iface->ShiftTMS(tdi_val, all_ones, (j-k > 64) ? 64 : (j-k));
+			for(size_t k=i; k<j; k++)
+				PokeBit(tdo, k, tdo_val);
+
+			i = j;
+		}
+
+		m_statShifts ++;
+	}
+}
@@ -0,0 +1,85 @@
+/**
+	@file
+	@brief Declaration of XvcServer
+ */
+
+#ifndef XvcServer_h
+#define XvcServer_h
+
+///@brief Largest shift: vector accepted, in bytes per vector (advertised through getinfo:)
+#define XVC_MAX_VECTOR_BYTES	32768
+
+/**
+	@brief Xilinx Virtual Cable 1.0 server
+
+	Each shift: command carries complete TMS and TDI vectors, which are split into runs and executed without
+	touching individual bits more than once:
+
+	\li data runs, i.e. bits with TMS low plus the TMS-high bit that ends them, go out as one ShiftData() with TDO
+		captured straight into the reply vector
+	\li runs of TMS-high bits with constant TDI go out as one ShiftTMS(). The TAP is never in a shift state during
+		these bits, so TDO is not being driven; the reply carries the value sampled with ReadTDO() before the run.
+
+	All buffers are sized for XVC_MAX_VECTOR_BYTES up front, so no allocation happens per command or per bit.
+
+	settck: is acknowledged with the adapter's actual TCK period if it knows it, otherwise with the requested period,
+	since the bit-bang rate can't be set.
+ */
+class XvcServer
+{
+public:
+	XvcServer(JtagInterface* iface);
+	virtual ~XvcServer();
+
+	void Serve(ServerSocket& sock);
+	void ServeClient(int fd);
+
+protected:
+	bool Read(void* data, size_t len);
+	bool ReadCommand(std::string& cmd);
+	void Shift(size_t nbits);
+
+	///@brief The adapter
+	JtagInterface* m_iface;
+
+	///@brief Socket of the current client
+	int m_fd;
+
+	///@brief Receive buffer
+	std::vector<uint8_t> m_rxbuf;
+
+	///@brief Read position within m_rxbuf
+	size_t m_rxpos;
+
+	///@brief Number of valid bytes in m_rxbuf
+	size_t m_rxlen;
+
+	///@brief TMS vector of the current command
+	std::vector<unsigned char> m_tms;
+
+	///@brief TDI vector of the current command
+	std::vector<unsigned char> m_tdi;
+
+	///@brief TDO vector for the reply
+	std::vector<unsigned char> m_tdo;
+
+	///@brief Scratch buffer for runs which don't start on a byte boundary
+	std::vector<unsigned char> m_scratchIn;
+
+	///@brief Scratch buffer for TDO of runs which don't start on a byte boundary
+	std::vector<unsigned char> m_scratchOut;
+
+	///@brief Number of shift: commands in this session
+	uint64_t m_statCommands;
+
+	///@brief Number of bits shifted in this session
+	uint64_t m_statBits;
+
+	///@brief Number of ShiftData() / ShiftTMS() calls in this session
+	uint64_t m_statShifts;
+
+	///@brief Time spent executing shifts in this session, in ns
+	uint64_t m_statShiftTime;
+};
+
+#endif
@@ -1,2 +1,8 @@
 #!/bin/sh
-g++ -O3 -s -static devmem.c main.cpp JtagInterface.cpp jtaghal.cpp JtagException.cpp TestInterface.cpp SprdMmioDJtagInterface.cpp -o jtag -fpermissive
+# Usage: build.sh [jtag|jtag-bench]
+SRCS="devmem.c JtagLog.cpp JtagInterface.cpp JtagAsyncEngine.cpp JtagPerf.cpp JtagClock.cpp JtagScanPlan.cpp SvfPlayer.cpp SvfCompiler.cpp JtagVectorPlayer.cpp TracingJtagInterface.cpp JtagTimeline.cpp JtagTraceReplayer.cpp JtagCostEstimator.cpp jtaghal.cpp JtagException.cpp JtagStatus.cpp TestInterface.cpp SprdMmioDJtagInterface.cpp SprdJtagProfile.cpp ElfSymbolIndex.cpp CevaDebugPort.cpp CevaTapModel.cpp SimJtagInterface.cpp SprdJtagRegisterModel.cpp ServerSocket.cpp GdbServer.cpp RemoteBitbangServer.cpp XvcServer.cpp JtagDaemon.cpp JtagClient.cpp JtagShmChannel.cpp JtagScheduler.cpp"
+case "${1:-jtag}" in
+jtag)       g++ -O3 -s -static main.cpp $SRCS -o jtag -fpermissive -Wformat -pthread ;;
+jtag-bench) g++ -O3 -s -static JtagBench.cpp $SRCS -o jtag-bench -fpermissive -Wformat -pthread ;;
+*)          echo "Unknown target $1" >&2; exit 1 ;;
+esac
@@ -1,3 +1,11 @@
 #!/bin/sh
-~/toolchains/gcc-linaro-4.9.4-2017.01-x86_64_arm-linux-gnueabihf/bin/arm-linux-gnueabihf-g++ -O3 -s -static -fpermissive devmem.c main.cpp JtagInterface.cpp jtaghal.cpp JtagException.cpp TestInterface.cpp SprdMmioDJtagInterface.cpp -o jtag
-scp jtag pi@192.168.1.114:/home/pi/sheep
+# Usage: build_arm.sh [jtag|jtag-bench]
+CXX=~/toolchains/gcc-linaro-4.9.4-2017.01-x86_64_arm-linux-gnueabihf/bin/arm-linux-gnueabihf-g++
+SRCS="devmem.c JtagLog.cpp JtagInterface.cpp JtagAsyncEngine.cpp JtagPerf.cpp JtagClock.cpp JtagScanPlan.cpp SvfPlayer.cpp SvfCompiler.cpp JtagVectorPlayer.cpp TracingJtagInterface.cpp JtagTimeline.cpp JtagTraceReplayer.cpp JtagCostEstimator.cpp jtaghal.cpp JtagException.cpp JtagStatus.cpp TestInterface.cpp SprdMmioDJtagInterface.cpp SprdJtagProfile.cpp ElfSymbolIndex.cpp CevaDebugPort.cpp CevaTapModel.cpp SimJtagInterface.cpp SprdJtagRegisterModel.cpp ServerSocket.cpp GdbServer.cpp RemoteBitbangServer.cpp XvcServer.cpp JtagDaemon.cpp JtagClient.cpp JtagShmChannel.cpp JtagScheduler.cpp"
+TARGET="${1:-jtag}"
+case "$TARGET" in
+jtag)       $CXX -O3 -s -static -fpermissive -Wformat -std=gnu++11 -pthread main.cpp $SRCS -o jtag ;;
+jtag-bench) $CXX -O3 -s -static -fpermissive -Wformat -std=gnu++11 -pthread JtagBench.cpp $SRCS -o jtag-bench ;;
+*)          echo "Unknown target $TARGET" >&2; exit 1 ;;
+esac
+scp $TARGET pi@192.168.1.114:/home/pi/sheep
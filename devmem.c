@@ -25,28 +25,21 @@
 #include <sys/types.h>
 #include <sys/mman.h>
   
-#include "debug.h"
-
 #include "devmem.h"
-
-/*
- * define the debug level of this file,
- * please see 'debug.h' for detail info
- */
-DEBUG_SET_LEVEL(DEBUG_LEVEL_ERR);
-
-static int		devmem_fd;
+#include "JtagProbes.h"
+#include "JtagLog.h"
 
 void *devm_map(unsigned long addr, int len)
 {
+	int devmem_fd;
 	off_t offset;
 	void *map_base; 
 
 	if ((devmem_fd = open("/dev/mem", O_RDWR | O_SYNC)) == -1) {
-		ERR("cannot open '/dev/mem'\n");
+		LogError("cannot open '/dev/mem'\n");
 		goto err_open;
 	}
-	DEBUG("/dev/mem opened.\n");
+	LogDebug("/dev/mem opened.\n");
 
 	/*
 	 * Map it
@@ -58,10 +51,16 @@ void *devm_map(unsigned long addr, int len)
 	map_base = mmap(NULL, len + addr - offset, PROT_READ | PROT_WRITE,
 			MAP_SHARED, devmem_fd, offset);
 	if (map_base == MAP_FAILED) {
-		ERR("mmap failed\n");
+		LogError("mmap failed\n");
 		goto err_mmap;
 	}
-	DEBUG("Memory mapped at address %p.\n", map_base); 
+	LogDebug("Memory mapped at address %p.\n", map_base); 
+	JTAG_PROBE3(devm_map, addr, len, (char *)map_base + addr - offset);
+
+	/*
+	 * The mapping outlives the descriptor, so several can be open at once
+	 */
+	close(devmem_fd);
 
 	return map_base + addr - offset;
 
@@ -76,15 +75,11 @@ void devm_unmap(void *virt_addr, int len)
 {
 	unsigned long addr;
 
-	if (devmem_fd == -1) {
-		ERR("'/dev/mem' is closed\n");
-		return;
-	}
+	JTAG_PROBE2(devm_unmap, virt_addr, len);
 
 	/* page align */
 	addr = (((unsigned long)virt_addr) & ~(sysconf(_SC_PAGE_SIZE) - 1));
 	munmap((void *)addr, len + (unsigned long)virt_addr - addr);
-	close(devmem_fd);
 }
 
 /*==================================================================
@@ -100,7 +95,7 @@ uint8_t devmem_readb(unsigned long addr)
 	virt_addr = devm_map(addr, 1);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		return 0;
 	}
 
@@ -118,7 +113,7 @@ void devmem_writeb(unsigned long addr, uint8_t val)
 	virt_addr = devm_map(addr, 1);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		return;
 	}
 
@@ -136,7 +131,7 @@ uint16_t devmem_readw(unsigned long addr)
 	virt_addr = devm_map(addr, 2);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		return 0;
 	}
 
@@ -154,7 +149,7 @@ void devmem_writew(unsigned long addr, uint16_t val)
 	virt_addr = devm_map(addr, 2);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		return;
 	}
 
@@ -172,7 +167,7 @@ uint32_t devmem_readl(unsigned long addr)
 	virt_addr = devm_map(addr, 4);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		return 0;
 	}
 
@@ -190,7 +185,7 @@ void devmem_writel(unsigned long addr, uint32_t val)
 	virt_addr = devm_map(addr, 4);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		return;
 	}
 
@@ -208,7 +203,7 @@ uint64_t devmem_readq(unsigned long addr)
 	virt_addr = devm_map(addr, 8);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		return 0;
 	}
 
@@ -226,7 +221,7 @@ void devmem_writeq(unsigned long addr, uint64_t val)
 	virt_addr = devm_map(addr, 8);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		return;
 	}
 
@@ -245,7 +240,7 @@ void devmem_readsb(unsigned long addr, void *buf, int count)
 	virt_addr = devm_map(addr, len);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 	}
 
 	if (count) {
@@ -268,7 +263,7 @@ void devmem_writesb(unsigned long addr, void *buf, int count)
 	virt_addr = devm_map(addr, len);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 	}
 
 	if (count) {
@@ -292,7 +287,7 @@ void devmem_readsw(unsigned long addr, void *buf, int count)
 	virt_addr = devm_map(addr, len);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 	}
 
 	if (count) {
@@ -315,7 +310,7 @@ void devmem_writesw(unsigned long addr, void *buf, int count)
 	virt_addr = devm_map(addr, len);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 	}
 
 	if (count) {
@@ -339,7 +334,7 @@ void devmem_readsl(unsigned long addr, void *buf, int count)
 	virt_addr = devm_map(addr, len);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 	}
 
 	if (count) {
@@ -362,7 +357,7 @@ void devmem_writesl(unsigned long addr, void *buf, int count)
 	virt_addr = devm_map(addr, len);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 	}
 
 	if (count) {
@@ -386,7 +381,7 @@ void devmem_readsq(unsigned long addr, void *buf, int count)
 	virt_addr = devm_map(addr, len);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 	}
 
 	if (count) {
@@ -409,7 +404,7 @@ void devmem_writesq(unsigned long addr, void *buf, int count)
 	virt_addr = devm_map(addr, len);
 
 	if (virt_addr == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 	}
 
 	if (count) {
@@ -430,7 +425,7 @@ void devmem_set(unsigned long addr, uint8_t value, int count)
 
 	dst = devm_map(addr, count);
 	if (dst == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		return;
 	}
 
@@ -448,7 +443,7 @@ void devmem_set32(unsigned long addr, uint32_t value, int count)
 
 	dst = devm_map(addr, count * 4);
 	if (dst == NULL) {
-		ERR("addr map failed");
+		LogError("addr map failed\n");
 		return;
 	}
 
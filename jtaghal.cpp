@@ -153,6 +153,57 @@ void MirrorBitArray(unsigned char* data, int bitlen)
 	delete[] temp;
 }
 
+/**
+	@brief Copies a range of bits between two bit strings
+
+	Bit ordering is the same as for PeekBit(). Whole bytes are moved at a time if either side is byte aligned, so
+	splicing a field into (or out of) a long scan vector doesn't cost a PeekBit()/PokeBit() pair per bit.
+
+	@param dst		Destination bit string
+	@param dstbit	Index of the first bit to write in dst
+	@param src		Source bit string
+	@param srcbit	Index of the first bit to read in src
+	@param count	Number of bits to copy
+
+	\ingroup libjtaghal
+ */
+void CopyBitArray(unsigned char* dst, size_t dstbit, const unsigned char* src, size_t srcbit, size_t count)
+{
+	size_t nbytes = count / 8;
+	unsigned char* d = dst + dstbit/8;
+	const unsigned char* s = src + srcbit/8;
+	unsigned int dshift = dstbit & 7;
+	unsigned int sshift = srcbit & 7;
+
+	if( (dshift == 0) && (sshift == 0) )
+		memcpy(d, s, nbytes);
+
+	//Destination aligned: each output byte comes from two adjacent source bytes
+	else if(dshift == 0)
+	{
+		for(size_t i=0; i<nbytes; i++)
+			d[i] = (s[i] >> sshift) | (s[i+1] << (8 - sshift));
+	}
+
+	//Source aligned: each input byte straddles two destination bytes
+	else if(sshift == 0)
+	{
+		unsigned char lowmask = (1 << dshift) - 1;
+		for(size_t i=0; i<nbytes; i++)
+		{
+			d[i] = (d[i] & lowmask) | (s[i] << dshift);
+			d[i+1] = (d[i+1] & ~lowmask) | (s[i] >> (8 - dshift));
+		}
+	}
+
+	else
+		nbytes = 0;
+
+	//Whatever is left (or everything, if neither side is aligned) goes a bit at a time
+	for(size_t i=nbytes*8; i<count; i++)
+		PokeBit(dst, dstbit + i, PeekBit(src, srcbit + i));
+}
+
 /**
 	@brief Swaps endianness in an array of 16-bit values
 
@@ -260,27 +311,39 @@ uint32_t GetBigEndianUint32FromByteArray(const unsigned char* data, size_t offse
 /**
 	@brief Returns a timestamp suitable for performance measurement.
 
-	The base unit is seconds.
+	The base unit is nanoseconds. The clock is monotonic (it doesn't follow adjustments to the time of day) and its
+	epoch is arbitrary, so only differences are meaningful.
 
 	@return The timestamp.
 
 	\ingroup libjtaghal
  */
-double GetTime()
+uint64_t GetTimeNs()
 {
 #ifdef _WIN32
 	uint64_t tm;
 	static uint64_t freq = 0;
 	QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&tm));
-	double ret = tm;
 	if(freq == 0)
 		QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&freq));
-	return ret / freq;
+	return (tm / freq) * 1000000000ULL + (tm % freq) * 1000000000ULL / freq;
 #else
 	timespec t;
-	clock_gettime(CLOCK_REALTIME,&t);
-	double d = static_cast<double>(t.tv_nsec) / 1E9f;
-	d += t.tv_sec;
-	return d;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
 #endif
 }
+
+/**
+	@brief Returns a timestamp suitable for performance measurement.
+
+	The base unit is seconds. Same clock as GetTimeNs().
+
+	@return The timestamp.
+
+	\ingroup libjtaghal
+ */
+double GetTime()
+{
+	return GetTimeNs() * 1e-9;
+}
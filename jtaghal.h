@@ -67,6 +67,7 @@
 #include <math.h>
 #include <memory.h>
 #include <time.h>
+#include <signal.h>
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // libstdc++ headers
@@ -94,14 +95,57 @@
 
 //Error handling
 #include "JtagException.h"
+#include "JtagStatus.h"
 
 //Base interfaces
 #include "TestInterface.h"
 
+#include "JtagAsyncEngine.h"
+#include "JtagPerf.h"
+#include "JtagClock.h"
+#include "JtagProbes.h"
+#include "JtagLog.h"
 #include "JtagInterface.h"
+#include "JtagScanPlan.h"
 
+#include "SprdJtagProfile.h"
 #include "SprdMmioDJtagInterface.h"
 
+//CEVA DSP debug support
+#include "CevaDebugPort.h"
+#include "CevaTapModel.h"
+#include "SimJtagInterface.h"
+#include "SprdJtagRegisterModel.h"
+#include "SvfPlayer.h"
+#include "JtagVectorFormat.h"
+#include "SvfCompiler.h"
+#include "JtagVectorPlayer.h"
+
+//Operation tracing
+#include "JtagTimeline.h"
+#include "JtagTraceFormat.h"
+#include "TracingJtagInterface.h"
+#include "JtagTraceReplayer.h"
+
+//Performance estimation
+#include "JtagCostEstimator.h"
+
+//Protocol servers
+#include "ServerSocket.h"
+#include "GdbServer.h"
+#include "RemoteBitbangServer.h"
+#include "XvcServer.h"
+
+//Persistent daemon
+#include "JtagDaemonProtocol.h"
+#include "JtagScheduler.h"
+#include "JtagDaemon.h"
+#include "JtagClient.h"
+#include "JtagShmChannel.h"
+
+//Firmware symbolization
+#include "ElfSymbolIndex.h"
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Global functions
 
@@ -119,11 +163,16 @@ extern "C" void FlipBitAndEndianArray(unsigned char* data, int len);
 extern "C" void FlipBitAndEndian32Array(unsigned char* data, int len);
 
 extern "C" void MirrorBitArray(unsigned char* data, int bitlen);
+extern "C" void CopyBitArray(unsigned char* dst, size_t dstbit, const unsigned char* src, size_t srcbit, size_t count);
 
 extern "C" uint16_t GetBigEndianUint16FromByteArray(const unsigned char* data, size_t offset);
 extern "C" uint32_t GetBigEndianUint32FromByteArray(const unsigned char* data, size_t offset);
 
 //Performance measurement
+extern "C" uint64_t GetTimeNs();
 extern "C" double GetTime();
 
+//Shift kernels for the SoC profiles (they use the bit manipulation above)
+#include "SprdShiftKernel.h"
+
 #endif
@@ -6,7 +6,1007 @@
 
 using namespace std;
 
-int main(){
+/*
+ * symbolize <elf> [index]
+ * Reads one hex address per line on stdin and prints "address function+offset" for each.
+ */
+static int SymbolizeMain(int argc, char* argv[])
+{
+    if(argc < 1)
+    {
+        fprintf(stderr, "usage: jtag symbolize <firmware.elf> [index]\n");
+        return 1;
+    }
+
+    ElfSymbolIndex index;
+    try
+    {
+        index.Load(argv[0], (argc >= 2) ? argv[1] : "");
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        return 1;
+    }
+
+    static char outbuf[1 << 16];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+
+    char line[64];
+    while(fgets(line, sizeof(line), stdin))
+    {
+        uint32_t addr = strtoul(line, NULL, 16);
+        uint32_t offset;
+        const char* name = index.Lookup(addr, &offset);
+        if(name)
+            printf("%08x %s+0x%x\n", addr, name, offset);
+        else
+            printf("%08x ??\n", addr);
+    }
+    return 0;
+}
+
+//Timeline being recorded, if JTAG_TIMELINE is set
+static JtagTimeline* g_timeline = NULL;
+
+/*
+ * Opens the adapter: the MMIO SW-JTAG block, or the software model of the DSP if sim is set
+ */
+static JtagInterface* OpenInterface(bool sim)
+{
+    //JTAG_TIMELINE=file.json records a timeline of every operation, for chrome://tracing or ui.perfetto.dev
+    const char* timeline = getenv("JTAG_TIMELINE");
+    if(timeline && *timeline && !g_timeline)
+        g_timeline = new JtagTimeline(timeline);
+
+    JtagInterface* iface;
+    if(sim)
+        iface = new SimJtagInterface;
+    else
+    {
+        //JTAG_SOC=id picks the SoC profile, if the platform doesn't identify itself
+        iface = new SprdMmioDJtagInterface;
+    }
+
+    //JTAG_TRACE=file records every wire-level operation, for "replay" to play back later
+    const char* trace = getenv("JTAG_TRACE");
+    if(trace && *trace)
+        iface = new TracingJtagInterface(iface, trace);
+
+    //JTAG_INTEGRITY=bits[,retries[,min_bits]] checks register-level scans with a pattern of that many bits
+    const char* integrity = getenv("JTAG_INTEGRITY");
+    if(integrity && *integrity && strcmp(integrity, "0"))
+    {
+        unsigned long bits = JTAG_INTEGRITY_PATTERN_BITS;
+        unsigned long retries = JTAG_INTEGRITY_RETRIES;
+        unsigned long min_bits = 0;
+        sscanf(integrity, "%lu,%lu,%lu", &bits, &retries, &min_bits);
+        iface->EnableScanIntegrity(bits, retries, min_bits);
+    }
+    return iface;
+}
+
+/*
+ * Closes the adapter. JTAG_PERF=1 prints its performance counters and latency histograms to stderr first.
+ */
+static void CloseInterface(JtagInterface* iface)
+{
+    const char* perf = getenv("JTAG_PERF");
+    if(perf && *perf && strcmp(perf, "0"))
+    {
+        JtagPerfSnapshot snap;
+        iface->GetPerfSnapshot(snap);
+        fprintf(stderr, "JTAG performance (%s):\n", iface->GetName().c_str());
+        snap.Print(stderr);
+    }
+    delete iface;
+
+    delete g_timeline;
+    g_timeline = NULL;
+}
+
+/*
+ * Common arguments of the server modes: [--sim] [endpoint]
+ */
+static void ParseServerArgs(int argc, char* argv[], bool& sim, string& endpoint)
+{
+    sim = false;
+    for(int i = 0; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--sim"))
+            sim = true;
+        else
+            endpoint = argv[i];
+    }
+
+    //Servers run for a long time, usually with stdout going to a log
+    setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+/*
+ * gdbserver [--sim] [endpoint]
+ * Serves the GDB remote protocol for the DSP. endpoint is "port", "addr:port" or "unix:/path" (default 3333).
+ */
+static int GdbServerMain(int argc, char* argv[])
+{
+    bool sim;
+    string endpoint = "3333";
+    ParseServerArgs(argc, argv, sim, endpoint);
+
+    JtagInterface* iface = OpenInterface(sim);
+    int ret = 0;
+    try
+    {
+        iface->InitializeChain();
+
+        CevaDebugPort port(iface);
+        GdbServer server(&port);
+        ServerSocket sock;
+        sock.Listen(endpoint);
+        printf("Listening for gdb on %s\n", endpoint.c_str());
+        server.Serve(sock);
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    CloseInterface(iface);
+    return ret;
+}
+
+/*
+ * remote_bitbang [--sim] [endpoint]
+ * Serves OpenOCD's remote_bitbang protocol on the raw pins (default port 5555).
+ */
+static int RemoteBitbangMain(int argc, char* argv[])
+{
+    bool sim;
+    string endpoint = "5555";
+    ParseServerArgs(argc, argv, sim, endpoint);
+
+    JtagInterface* iface = OpenInterface(sim);
+    int ret = 0;
+    try
+    {
+        RemoteBitbangServer server(iface);
+        ServerSocket sock;
+        sock.Listen(endpoint);
+        printf("Listening for remote_bitbang on %s\n", endpoint.c_str());
+        server.Serve(sock);
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    CloseInterface(iface);
+    return ret;
+}
+
+/*
+ * xvc [--sim] [endpoint]
+ * Serves Xilinx Virtual Cable 1.0 on the raw pins (default port 2542).
+ */
+static int XvcMain(int argc, char* argv[])
+{
+    bool sim;
+    string endpoint = "2542";
+    ParseServerArgs(argc, argv, sim, endpoint);
+
+    JtagInterface* iface = OpenInterface(sim);
+    int ret = 0;
+    try
+    {
+        XvcServer server(iface);
+        ServerSocket sock;
+        sock.Listen(endpoint);
+        printf("Listening for XVC on %s\n", endpoint.c_str());
+        server.Serve(sock);
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    CloseInterface(iface);
+    return ret;
+}
+
+/*
+ * daemon [--sim] [endpoint]
+ * Keeps the adapter open and serves JtagClient requests (default $JTAGD_SOCKET or JTAGD_DEFAULT_ENDPOINT).
+ */
+static void OnStopSignal(int /*sig*/)
+{
+    JtagDaemon::RequestStop();
+}
+
+static int DaemonMain(int argc, char* argv[])
+{
+    bool sim;
+    string endpoint = JtagClient::GetDefaultEndpoint();
+    ParseServerArgs(argc, argv, sim, endpoint);
+
+    //No SA_RESTART, so the signal knocks the daemon out of poll() and the destructors get to run
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnStopSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    JtagInterface* iface = OpenInterface(sim);
+    int ret = 0;
+    try
+    {
+        iface->InitializeChain(true);
+
+        JtagDaemon daemon(iface);
+        ServerSocket sock;
+        sock.Listen(endpoint);
+        printf("jtag daemon listening on %s, %zu device(s) on the chain\n",
+            endpoint.c_str(), iface->GetChainLength());
+        daemon.Serve(sock);
+        printf("jtag daemon exiting\n");
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    CloseInterface(iface);
+    return ret;
+}
+
+/*
+ * Parses a hex number of arbitrary length into a bit vector, LSB first
+ */
+static void ParseHexBits(const char* hex, vector<unsigned char>& bits, size_t count)
+{
+    bits.assign((count + 7) / 8, 0);
+    size_t len = strlen(hex);
+    if( (len > 2) && (hex[0] == '0') && ( (hex[1] == 'x') || (hex[1] == 'X') ) )
+    {
+        hex += 2;
+        len -= 2;
+    }
+    for(size_t i = 0; i < len; i++)
+    {
+        char c = hex[len - 1 - i];
+        int nibble;
+        if( (c >= '0') && (c <= '9') )
+            nibble = c - '0';
+        else if( (c >= 'a') && (c <= 'f') )
+            nibble = c - 'a' + 10;
+        else if( (c >= 'A') && (c <= 'F') )
+            nibble = c - 'A' + 10;
+        else
+            continue;
+        for(int b = 0; b < 4; b++)
+        {
+            if( (i*4 + b < count) && (nibble & (1 << b)) )
+                PokeBit(&bits[0], i*4 + b, true);
+        }
+    }
+}
+
+/*
+ * Prints a bit vector as a hex number, MSB first
+ */
+static void PrintHexBits(const unsigned char* bits, size_t count)
+{
+    for(size_t i = (count + 3) / 4; i-- > 0; )
+    {
+        int nibble = 0;
+        for(size_t b = 0; b < 4; b++)
+        {
+            if( (i*4 + b < count) && PeekBit(bits, i*4 + b) )
+                nibble |= (1 << b);
+        }
+        printf("%x", nibble);
+    }
+    printf("\n");
+}
+
+/*
+ * Moves a block of DSP memory through the daemon: over shared memory if it's local, otherwise over the socket
+ */
+static void ClientTransfer(JtagClient& client, const string& endpoint, bool write, uint32_t addr,
+    uint32_t* words, size_t count)
+{
+    //Without a sealable memfd the daemon won't take the ring, and the socket does the same job, only slower
+    bool shm = (count != 0) && (endpoint.compare(0, 5, "unix:") == 0);
+    JtagShmChannel channel;
+    if(shm)
+    {
+        try
+        {
+            channel.Attach(client);
+        }
+        catch(const JtagException&)
+        {
+            shm = false;
+        }
+    }
+
+    if(!shm)
+    {
+        if(write)
+            client.WriteMemory(addr, words, count);
+        else
+            client.ReadMemory(addr, words, count);
+    }
+    else if(write)
+        channel.WriteMemory(addr, words, count);
+    else
+        channel.ReadMemory(addr, words, count);
+}
+
+static void ClientUsage()
+{
+    fprintf(stderr,
+        "usage: jtag client [-s endpoint] [-p interactive|normal|bulk] <command> [args]\n"
+        "    ping | info | stats | reinit | reset\n"
+        "    clients                       per-client scheduling statistics\n"
+        "    ir <device> <bits> <hex>      load IR, print captured value\n"
+        "    dr <device> <bits> <hex>      scan DR, print captured value\n"
+        "    irdr <device> <irbits> <irhex> <drbits> <drhex>\n"
+        "                                  load IR then scan DR atomically, print captured DR\n"
+        "    version | status | pc | halt | resume | step\n"
+        "    regs                          print all DSP registers\n"
+        "    read <addr> <words>           hex dump of DSP memory\n"
+        "    write <addr> <word> [word...] write DSP memory\n"
+        "    dump <addr> <words> <file>    save DSP memory to a file\n"
+        "    load <addr> <file>            write a file to DSP memory\n");
+}
+
+/*
+ * client [-s endpoint] [-p priority] <command> [args]
+ * Runs one command through the daemon. Bulk transfers default to the bulk class, everything else to interactive.
+ */
+static int ClientMain(int argc, char* argv[])
+{
+    string endpoint = JtagClient::GetDefaultEndpoint();
+    int priority = -1;
+    while( (argc >= 2) && (argv[0][0] == '-') )
+    {
+        if(!strcmp(argv[0], "-s"))
+            endpoint = argv[1];
+        else if(!strcmp(argv[0], "-p") && !strcmp(argv[1], "interactive"))
+            priority = JTAGD_PRIORITY_INTERACTIVE;
+        else if(!strcmp(argv[0], "-p") && !strcmp(argv[1], "normal"))
+            priority = JTAGD_PRIORITY_NORMAL;
+        else if(!strcmp(argv[0], "-p") && !strcmp(argv[1], "bulk"))
+            priority = JTAGD_PRIORITY_BULK;
+        else
+            break;
+        argc -= 2;
+        argv += 2;
+    }
+    if(argc < 1)
+    {
+        ClientUsage();
+        return 1;
+    }
+
+    string cmd = argv[0];
+    if(priority < 0)
+        priority = ( (cmd == "dump") || (cmd == "load") ) ? JTAGD_PRIORITY_BULK : JTAGD_PRIORITY_INTERACTIVE;
+    try
+    {
+        JtagClient client;
+        client.Connect(endpoint);
+        if(cmd != "ping")
+            client.SetClient(static_cast<JtagdPriority>(priority), "client " + cmd);
+
+        if(cmd == "ping")
+        {
+            uint64_t start = GetTimeNs();
+            client.Ping();
+            printf("round trip %.1f us\n", (GetTimeNs() - start) * 1e-3);
+        }
+        else if(cmd == "info")
+        {
+            JtagdInfo info;
+            vector<uint32_t> idcodes;
+            client.GetInfo(info, idcodes);
+            printf("protocol version %u, up %u s, %u requests served\n", info.version, info.uptime, info.requests);
+            printf("%u device(s), %u IR bits total, TCK %u Hz\n", info.chain_length, info.ir_length, info.frequency);
+            for(size_t i = 0; i < idcodes.size(); i++)
+                printf("device %zu: IDCODE %08x\n", i, idcodes[i]);
+        }
+        else if(cmd == "stats")
+        {
+            JtagdStats stats;
+            client.GetStats(stats);
+            printf("shift ops %" PRIu64 ", data bits %" PRIu64 ", mode bits %" PRIu64 ", dummy clocks %" PRIu64
+                ", shift time %.3f s\n",
+                stats.shift_ops, stats.data_bits, stats.mode_bits, stats.dummy_clocks, stats.shift_time);
+        }
+        else if(cmd == "clients")
+        {
+            static const char* const classes[JTAGD_PRIORITY_COUNT] = {"interactive", "normal", "bulk"};
+            vector<JtagdClientStats> stats;
+            client.GetClientStats(stats);
+            printf("%-20s %7s %-11s %8s %8s %10s %10s %9s %9s %9s %9s\n",
+                "name", "pid", "class", "requests", "slices", "tx bytes", "rx bytes", "busy %", "p50 us", "p99 us",
+                "max us");
+            for(size_t i = 0; i < stats.size(); i++)
+            {
+                const JtagdClientStats& s = stats[i];
+                printf("%-20s %7u %-11s %8" PRIu64 " %8" PRIu64 " %10" PRIu64 " %10" PRIu64 " %9.1f %9.0f %9.0f %9.0f\n",
+                    s.name, s.pid, (s.priority < JTAGD_PRIORITY_COUNT) ? classes[s.priority] : "?",
+                    s.requests, s.slices, s.tx_bytes, s.rx_bytes,
+                    (s.connected_time > 0) ? (100 * s.busy_time / s.connected_time) : 0,
+                    s.latency_p50 * 1e6, s.latency_p99 * 1e6, s.latency_max * 1e6);
+            }
+        }
+        else if(cmd == "reinit")
+            client.Reinitialize();
+        else if(cmd == "reset")
+            client.ResetToIdle();
+        else if( ( (cmd == "ir") || (cmd == "dr") ) && (argc >= 4) )
+        {
+            unsigned int device = strtoul(argv[1], NULL, 0);
+            size_t count = strtoul(argv[2], NULL, 0);
+            vector<unsigned char> send;
+            ParseHexBits(argv[3], send, count);
+            vector<unsigned char> rcv(send.size());
+            if(cmd == "ir")
+                client.SetIR(device, &send[0], &rcv[0], count);
+            else
+                client.ScanDR(device, &send[0], &rcv[0], count);
+            PrintHexBits(&rcv[0], count);
+        }
+        else if( (cmd == "irdr") && (argc >= 6) )
+        {
+            unsigned int device = strtoul(argv[1], NULL, 0);
+            size_t irbits = strtoul(argv[2], NULL, 0);
+            size_t drbits = strtoul(argv[4], NULL, 0);
+            vector<unsigned char> ir;
+            vector<unsigned char> dr;
+            ParseHexBits(argv[3], ir, irbits);
+            ParseHexBits(argv[5], dr, drbits);
+            vector<unsigned char> rcv(dr.size());
+
+            //Nobody else's scans can get between the two
+            client.BeginTransaction();
+            client.SetIR(device, &ir[0], NULL, irbits);
+            client.ScanDR(device, &dr[0], &rcv[0], drbits);
+            client.EndTransaction();
+            PrintHexBits(&rcv[0], drbits);
+        }
+        else if(cmd == "version")
+            printf("Core version : %x\n", client.GetCoreVersion());
+        else if(cmd == "status")
+            printf("%08x\n", client.GetStatus());
+        else if(cmd == "pc")
+            printf("Current PC value : %x\n", client.GetPC());
+        else if(cmd == "halt")
+            client.Halt();
+        else if(cmd == "resume")
+            client.Resume();
+        else if(cmd == "step")
+            client.Step();
+        else if(cmd == "regs")
+        {
+            uint32_t regs[CEVA_REG_COUNT];
+            client.ReadRegisters(0, regs, CEVA_REG_COUNT);
+            for(int i = 0; i < CEVA_REG_COUNT; i++)
+                printf("r%-2d %08x%s", i, regs[i], ( (i % 4) == 3) ? "\n" : "    ");
+            printf("\n");
+        }
+        else if( (cmd == "read") && (argc >= 3) )
+        {
+            uint32_t addr = strtoul(argv[1], NULL, 0);
+            vector<uint32_t> words(strtoul(argv[2], NULL, 0) + 1);
+            ClientTransfer(client, endpoint, false, addr, &words[0], words.size() - 1);
+            for(size_t i = 0; i + 1 < words.size(); i++)
+            {
+                if( (i % 4) == 0)
+                    printf("%08zx:", addr + i*4);
+                printf(" %08x", words[i]);
+                if( ( (i % 4) == 3) || (i + 2 == words.size()) )
+                    printf("\n");
+            }
+        }
+        else if( (cmd == "write") && (argc >= 3) )
+        {
+            uint32_t addr = strtoul(argv[1], NULL, 0);
+            vector<uint32_t> words;
+            for(int i = 2; i < argc; i++)
+                words.push_back(strtoul(argv[i], NULL, 16));
+            client.WriteMemory(addr, &words[0], words.size());
+        }
+        else if( (cmd == "dump") && (argc >= 4) )
+        {
+            uint32_t addr = strtoul(argv[1], NULL, 0);
+            vector<uint32_t> words(strtoul(argv[2], NULL, 0) + 1);
+            ClientTransfer(client, endpoint, false, addr, &words[0], words.size() - 1);
+            FILE* fp = fopen(argv[3], "wb");
+            if( !fp || (fwrite(&words[0], 4, words.size() - 1, fp) != words.size() - 1) )
+            {
+                fprintf(stderr, "failed to write %s\n", argv[3]);
+                if(fp)
+                    fclose(fp);
+                return 1;
+            }
+            fclose(fp);
+        }
+        else if( (cmd == "load") && (argc >= 3) )
+        {
+            uint32_t addr = strtoul(argv[1], NULL, 0);
+            FILE* fp = fopen(argv[2], "rb");
+            if(!fp)
+            {
+                fprintf(stderr, "failed to open %s\n", argv[2]);
+                return 1;
+            }
+            vector<uint32_t> words;
+            uint32_t word;
+            size_t n;
+            while( (n = fread(&word, 1, 4, fp)) > 0)
+            {
+                //Pad a partial last word with zeros
+                if(n < 4)
+                    memset(reinterpret_cast<uint8_t*>(&word) + n, 0, 4 - n);
+                words.push_back(word);
+            }
+            fclose(fp);
+            if(!words.empty())
+                ClientTransfer(client, endpoint, true, addr, &words[0], words.size());
+        }
+        else
+        {
+            ClientUsage();
+            return 1;
+        }
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * planbench [--sim] [iterations]
+ * Reads the PC over and over, once with the hand-written sequence below and once with a compiled JtagScanPlan,
+ * and prints the time per iteration of each.
+ */
+static int PlanBenchMain(int argc, char* argv[])
+{
+    bool sim = false;
+    unsigned long iterations = 10000;
+    for(int i = 0; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--sim"))
+            sim = true;
+        else
+            iterations = strtoul(argv[i], NULL, 0);
+    }
+    if(iterations == 0)
+        iterations = 1;
+
+    JtagInterface* iface = OpenInterface(sim);
+    int ret = 0;
+    try
+    {
+        iface->InitializeChain(true);
+        iface->ResetToIdle();
+
+        uint8_t wdata[4] = {0, 0, 0, 0x34};     // PC value (RO)
+        uint8_t rdata[4] = {0};
+        uint8_t wdatadr[4] = {0};
+        uint8_t rdatadr[4] = {0};
+
+        JtagScanPlan plan(iface);
+        plan.SetIR(0, wdata, 32);
+        plan.ScanDR(0, wdatadr, 32, JTAG_PLAN_NONE, 0);
+        plan.Compile();
+        uint8_t pc[4] = {0};
+        unsigned char* outputs[1] = {pc};
+
+        //Alternate between the two and keep the best round of each, so warmup and noise hit both alike
+        double manual = 1e9;
+        double planned = 1e9;
+        for(int round = 0; round < 5; round++)
+        {
+            uint64_t start = GetTimeNs();
+            for(unsigned long n = 0; n < iterations; n++)
+            {
+                iface->EnterShiftIR();
+                iface->ShiftData(true, wdata, rdata, 32);
+                iface->LeaveExit1IR();
+                iface->EnterShiftDR();
+                iface->ShiftData(true, wdatadr, rdatadr, 32);
+                iface->LeaveExit1DR();
+            }
+            manual = min(manual, (GetTimeNs() - start) * 1e-9 / iterations);
+
+            start = GetTimeNs();
+            for(unsigned long n = 0; n < iterations; n++)
+                plan.Execute(NULL, outputs);
+            planned = min(planned, (GetTimeNs() - start) * 1e-9 / iterations);
+        }
+
+        printf("PC %x (hand-written) / %x (plan), %zu adapter calls per plan run\n",
+            *(uint32_t*)rdatadr, *(uint32_t*)pc, plan.GetStepCount());
+        printf("hand-written: %.3f us/iteration\n", manual * 1e6);
+        printf("plan:         %.3f us/iteration (%.1f%%)\n", planned * 1e6, 100 * planned / manual);
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    CloseInterface(iface);
+    return ret;
+}
+
+/*
+ * svf [--sim] file
+ * Plays an SVF file, or a vector file compiled from one by svfc, and prints how long it took.
+ */
+static int SvfMain(int argc, char* argv[])
+{
+    bool sim = false;
+    const char* path = NULL;
+    for(int i = 0; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--sim"))
+            sim = true;
+        else
+            path = argv[i];
+    }
+    if(!path)
+    {
+        fprintf(stderr, "Usage: jtag svf [--sim] file\n");
+        return 1;
+    }
+
+    JtagInterface* iface = OpenInterface(sim);
+    int ret = 0;
+    try
+    {
+        if(JtagVectorPlayer::IsVectorFile(path))
+        {
+            JtagVectorPlayer player(iface);
+            uint64_t start = GetTimeNs();
+            player.Play(path);
+            double dt = (GetTimeNs() - start) * 1e-9;
+
+            printf("%" PRIu64 " records, %" PRIu64 " scan bits (%" PRIu64 " checked) in %.3f s, %.2f Mbit/s\n",
+                player.GetRecordCount(), player.GetScanBits(), player.GetComparedBits(), dt,
+                (dt > 0) ? (player.GetScanBits() / dt / 1e6) : 0.0);
+            CloseInterface(iface);
+            return 0;
+        }
+
+        SvfPlayer player(iface);
+        uint64_t start = GetTimeNs();
+        player.Play(path);
+        double dt = (GetTimeNs() - start) * 1e-9;
+
+        printf("%zu commands, %" PRIu64 " scan bits (%" PRIu64 " checked) in %.3f s, %.2f Mbit/s\n",
+            player.GetCommandCount(), player.GetScanBits(), player.GetComparedBits(), dt,
+            (dt > 0) ? (player.GetScanBits() / dt / 1e6) : 0.0);
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    CloseInterface(iface);
+    return ret;
+}
+
+/*
+ * svfc file.svf file.jvec
+ * Compiles an SVF file into a binary vector file.
+ */
+static int SvfCompileMain(int argc, char* argv[])
+{
+    if(argc != 2)
+    {
+        fprintf(stderr, "Usage: jtag svfc file.svf file.jvec\n");
+        return 1;
+    }
+
+    try
+    {
+        SvfCompiler compiler;
+        compiler.Compile(argv[0], argv[1]);
+        printf("%" PRIu64 " scan bits, %" PRIu64 " bytes\n", compiler.GetScanBits(), compiler.GetOutputSize());
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Returns the CPU time used by the process so far, in seconds
+ */
+static double GetCpuTime()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+ * svfbench [--sim] file.svf [rounds]
+ * Compiles an SVF file to a temporary vector file, then plays both alternately and prints the best wall and CPU
+ * time of each.
+ */
+static int SvfBenchMain(int argc, char* argv[])
+{
+    bool sim = false;
+    const char* path = NULL;
+    int rounds = 3;
+    for(int i = 0; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--sim"))
+            sim = true;
+        else if(!path)
+            path = argv[i];
+        else
+            rounds = atoi(argv[i]);
+    }
+    if(!path)
+    {
+        fprintf(stderr, "Usage: jtag svfbench [--sim] file.svf [rounds]\n");
+        return 1;
+    }
+    if(rounds < 1)
+        rounds = 1;
+
+    char vecpath[] = "/tmp/jtag-svfbench-XXXXXX";
+    int fd = mkstemp(vecpath);
+    if(fd < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    JtagInterface* iface = OpenInterface(sim);
+    int ret = 0;
+    try
+    {
+        SvfCompiler compiler;
+        uint64_t start = GetTimeNs();
+        compiler.Compile(path, vecpath);
+        printf("compile: %.3f s, %" PRIu64 " bytes\n", (GetTimeNs() - start) * 1e-9, compiler.GetOutputSize());
+
+        SvfPlayer text(iface);
+        JtagVectorPlayer binary(iface);
+        double wall[2] = {1e9, 1e9};
+        double cpu[2] = {1e9, 1e9};
+        for(int round = 0; round < rounds; round++)
+        {
+            for(int which = 0; which < 2; which++)
+            {
+                uint64_t w = GetTimeNs();
+                double c = GetCpuTime();
+                if(which == 0)
+                    text.Play(path);
+                else
+                    binary.Play(vecpath);
+                wall[which] = min(wall[which], (GetTimeNs() - w) * 1e-9);
+                cpu[which] = min(cpu[which], GetCpuTime() - c);
+            }
+        }
+
+        printf("%" PRIu64 " scan bits per run, best of %d\n", text.GetScanBits(), rounds);
+        printf("text:   wall %.3f s, cpu %.3f s\n", wall[0], cpu[0]);
+        printf("binary: wall %.3f s (%.1f%%), cpu %.3f s (%.1f%%)\n",
+            wall[1], 100 * wall[1] / wall[0], cpu[1], 100 * cpu[1] / cpu[0]);
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    CloseInterface(iface);
+    unlink(vecpath);
+    return ret;
+}
+
+/*
+ * estimate [--sim] svf <file> | read <bytes> | write <bytes> | scan <irbits> <drbits> [count]
+ * Calibrates the adapter with idle clocks, then predicts how long a workload would take, without running it.
+ */
+static int EstimateMain(int argc, char* argv[])
+{
+    bool sim = false;
+    if(argc >= 1 && !strcmp(argv[0], "--sim"))
+    {
+        sim = true;
+        argc --;
+        argv ++;
+    }
+    if( (argc < 2) || ( !strcmp(argv[0], "scan") && (argc < 3) ) )
+    {
+        fprintf(stderr, "Usage: jtag estimate [--sim] svf <file> | read <bytes> | write <bytes> | "
+            "scan <irbits> <drbits> [count]\n");
+        return 1;
+    }
+
+    JtagInterface* iface = OpenInterface(sim);
+    int ret = 0;
+    try
+    {
+        JtagCostModel model;
+        model.Calibrate(iface);
+        printf("Adapter costs:\n");
+        model.Print(stdout);
+
+        JtagCostEstimator estimator(model);
+        estimator.CopyScanIntegrity(iface);
+        if(!strcmp(argv[0], "svf"))
+            estimator.AddSvf(argv[1]);
+        else if(!strcmp(argv[0], "read"))
+            estimator.AddMemoryTransfer(strtoull(argv[1], NULL, 0), false);
+        else if(!strcmp(argv[0], "write"))
+            estimator.AddMemoryTransfer(strtoull(argv[1], NULL, 0), true);
+        else if(!strcmp(argv[0], "scan"))
+        {
+            size_t irbits = strtoul(argv[1], NULL, 0);
+            size_t drbits = strtoul(argv[2], NULL, 0);
+            unsigned long count = (argc >= 4) ? strtoul(argv[3], NULL, 0) : 1;
+            vector<unsigned char> ir((irbits + 7) / 8);
+            vector<unsigned char> dr((drbits + 7) / 8);
+            vector<unsigned char> rx((drbits + 7) / 8);
+            for(unsigned long i = 0; i < count; i++)
+            {
+                estimator.SetIR(0, &ir[0], irbits);
+                estimator.ScanDR(0, &dr[0], &rx[0], drbits);
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Unknown workload %s\n", argv[0]);
+            CloseInterface(iface);
+            return 1;
+        }
+
+        JtagCostEstimate estimate;
+        estimator.GetEstimate(estimate);
+        printf("Estimate:\n");
+        estimate.Print(stdout);
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    CloseInterface(iface);
+    return ret;
+}
+
+/*
+ * link [--model] [samples]
+ * Characterizes the MMIO link (register latencies, RTCK echo, effective TCK frequency and jitter). --model measures
+ * the register model instead of the hardware.
+ */
+static int LinkMain(int argc, char* argv[])
+{
+    bool model = false;
+    size_t samples = SPRD_LINK_SAMPLES;
+    for(int i = 0; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--model"))
+            model = true;
+        else
+            samples = strtoul(argv[i], NULL, 0);
+    }
+    if(samples == 0)
+    {
+        fprintf(stderr, "Usage: jtag link [--model] [samples]\n");
+        return 1;
+    }
+
+    SprdJtagRegisterModel regs;
+    SprdMmioDJtagInterface* iface = model ? new SprdMmioDJtagInterface(&regs) : new SprdMmioDJtagInterface;
+    int ret = 0;
+    try
+    {
+        iface->Characterize(samples);
+        iface->GetLinkStats().Print(stdout);
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    delete iface;
+    return ret;
+}
+
+/*
+ * replay [--sim] [--paced] trace
+ * Plays back a trace recorded with JTAG_TRACE set, and reports TDO differences and timing.
+ */
+static int ReplayMain(int argc, char* argv[])
+{
+    bool sim = false;
+    bool paced = false;
+    const char* path = NULL;
+    for(int i = 0; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--sim"))
+            sim = true;
+        else if(!strcmp(argv[i], "--paced"))
+            paced = true;
+        else
+            path = argv[i];
+    }
+    if(!path)
+    {
+        fprintf(stderr, "Usage: jtag replay [--sim] [--paced] trace\n");
+        return 1;
+    }
+
+    JtagInterface* iface = OpenInterface(sim);
+    int ret = 0;
+    try
+    {
+        JtagTraceReplayer replayer(iface);
+        replayer.Replay(path, paced);
+
+        printf("%" PRIu64 " ops recorded on %s, %" PRIu64 " compared, %" PRIu64 " differ\n",
+            replayer.GetOpCount(), replayer.GetRecordedAdapter().c_str(), replayer.GetComparedCount(),
+            replayer.GetMismatchCount());
+        const vector<string>& diffs = replayer.GetDiffs();
+        for(size_t i = 0; i < diffs.size(); i++)
+            printf("    %s\n", diffs[i].c_str());
+        printf("adapter time: recorded %.6f s, replayed %.6f s\n",
+            replayer.GetRecordedTime(), replayer.GetReplayTime());
+        if(replayer.GetMismatchCount())
+            ret = 2;
+    }
+    catch(const JtagException& ex)
+    {
+        fprintf(stderr, "%s", ex.GetDescription().c_str());
+        ret = 1;
+    }
+    CloseInterface(iface);
+    return ret;
+}
+
+int main(int argc, char* argv[]){
+    if(argc >= 2 && !strcmp(argv[1], "symbolize"))
+        return SymbolizeMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "gdbserver"))
+        return GdbServerMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "remote_bitbang"))
+        return RemoteBitbangMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "xvc"))
+        return XvcMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "daemon"))
+        return DaemonMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "client"))
+        return ClientMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "planbench"))
+        return PlanBenchMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "svf"))
+        return SvfMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "svfc"))
+        return SvfCompileMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "svfbench"))
+        return SvfBenchMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "replay"))
+        return ReplayMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "estimate"))
+        return EstimateMain(argc - 2, argv + 2);
+    if(argc >= 2 && !strcmp(argv[1], "link"))
+        return LinkMain(argc - 2, argv + 2);
+
     SprdMmioDJtagInterface jtag;
 
     jtag.InitializeChain();